@@ -0,0 +1,54 @@
+/**
+ * @file SmartBmsCellTable.h
+ * @author TheRealKasumi
+ * @brief Contains a class that collects the data of the individual cells over multiple frames.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SMART_BMS_CELL_TABLE_H
+#define SMART_BMS_CELL_TABLE_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+
+// Maximum number of cells that are tracked
+#ifndef SBMS_MAX_CELLS
+#define SBMS_MAX_CELLS 32
+#endif
+
+class SmartBmsCellTable
+{
+public:
+	SmartBmsCellTable();
+	~SmartBmsCellTable();
+
+	void update(const SmartBmsData &smartBmsData);
+	void clear();
+
+	const uint8_t getCellCount() const;
+	const bool isCellValid(const uint8_t index) const;
+	const float getCellVoltage(const uint8_t index) const;
+	const float getCellTemperature(const uint8_t index) const;
+
+private:
+	uint8_t cellCount_;
+	uint32_t validMask_[(SBMS_MAX_CELLS + 31) / 32];
+	float cellVoltage_[SBMS_MAX_CELLS];
+	float cellTemperature_[SBMS_MAX_CELLS];
+};
+
+#endif
@@ -22,10 +22,11 @@
 #define SMART_BMS_DATA_H
 
 #include <stdint.h>
+#include <stddef.h>
 
-#include "bms/SmartBmsReader.h"
+#include "bms/SmartBmsField.h"
 
-class SmartBmsReader;
+class SmartBmsDecoder;
 
 class SmartBmsData
 {
@@ -63,6 +64,16 @@ public:
 	const bool isMinTemperatureAlarmActive() const;
 	const bool isMaxTemperatureAlarmActive() const;
 
+	const uint8_t getCellNumber() const;
+	const float getCellVoltage() const;
+	const float getCellTemperature() const;
+
+	const float getFieldValue(const SmartBmsField field) const;
+	const uint32_t getChangeMask(const SmartBmsData &other) const;
+	const size_t toJson(char *buffer, const size_t size, const uint32_t fieldMask = SBMS_FIELD_MASK_ALL) const;
+
+	static const char *getFieldName(const SmartBmsField field);
+
 private:
 	uint8_t cellCount_;
 	float cellVoltageMin_;
@@ -94,7 +105,11 @@ private:
 	bool minTemperatureAlarmActive_;
 	bool maxTemperatureAlarmActive_;
 
-	friend class SmartBmsReader;
+	uint8_t cellNumber_;
+	float cellVoltage_;
+	float cellTemperature_;
+
+	friend class SmartBmsDecoder;
 };
 
 #endif
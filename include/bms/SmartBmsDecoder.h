@@ -0,0 +1,54 @@
+/**
+ * @file SmartBmsDecoder.h
+ * @author TheRealKasumi
+ * @brief Contains a class that decodes a single frame of the BMS without any I/O.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SMART_BMS_DECODER_H
+#define SMART_BMS_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bms/SmartBmsData.h"
+#include "bms/SmartBmsError.h"
+
+// Size of a single frame including the checksum
+#define SBMS_FRAME_SIZE 58
+
+/**
+ * Does not depend on the Arduino framework, so it can also be used by host tools.
+ */
+class SmartBmsDecoder
+{
+public:
+	SmartBmsDecoder();
+	~SmartBmsDecoder();
+
+	const SmartBmsError decode(const uint8_t frame[SBMS_FRAME_SIZE], SmartBmsData *smartBmsData) const;
+	static const bool isChecksumValid(const uint8_t frame[SBMS_FRAME_SIZE]);
+
+private:
+	const float decodePackVoltage_(const uint8_t buffer[3]) const;
+	const float decodePackCurrent_(const uint8_t buffer[3]) const;
+	const float decodeCellVoltage_(const uint8_t buffer[2]) const;
+	const float decodeCellTemperature_(const uint8_t buffer[2]) const;
+	const uint16_t decodeTwoByteValue_(const uint8_t buffer[2]) const;
+	const uint32_t decodeThreeByteValue_(const uint8_t buffer[3]) const;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file SmartBmsEnergyMeter.h
+ * @author TheRealKasumi
+ * @brief Contains a class that integrates the charged and discharged energy of the battery pack.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SMART_BMS_ENERGY_METER_H
+#define SMART_BMS_ENERGY_METER_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+
+struct SmartBmsEnergyTotals
+{
+	uint64_t chargedEnergy;		// In nJ
+	uint64_t dischargedEnergy;	// In nJ
+	uint64_t chargedCharge;		// In µC
+	uint64_t dischargedCharge;	// In µC
+};
+
+/**
+ * Current and voltage are converted to mA and mV and integrated with the trapezoidal rule over the frame timestamps.
+ * All sums are 64 bit integers and the remainders of the divisions are carried, so there is no rounding drift.
+ * Two frames further apart than the maximum gap are not integrated, the second frame starts a new segment.
+ */
+class SmartBmsEnergyMeter
+{
+public:
+	SmartBmsEnergyMeter(const uint32_t maxGapMs);
+	~SmartBmsEnergyMeter();
+
+	void update(const SmartBmsData &smartBmsData, const int64_t timeUs);
+	void restore(const SmartBmsEnergyTotals &totals);
+	void reset();
+
+	const SmartBmsEnergyTotals &getTotals() const;
+	const double getChargedKwh() const;
+	const double getDischargedKwh() const;
+	const double getChargedAh() const;
+	const double getDischargedAh() const;
+	const uint32_t getGapCount() const;
+
+private:
+	struct Sample
+	{
+		int64_t timeUs;
+		uint32_t chargeCurrent;		// In mA
+		uint32_t dischargeCurrent;	// In mA
+		uint32_t voltage;			// In mV
+	};
+
+	uint32_t maxGapMs_;
+	bool hasSample_;
+	Sample lastSample_;
+	SmartBmsEnergyTotals totals_;
+	SmartBmsEnergyTotals remainders_;
+	uint32_t gapCount_;
+
+	static const uint32_t toMilli_(const float value);
+	static void accumulate_(uint64_t &total, uint64_t &remainder, const uint64_t value);
+};
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file SmartBmsField.h
+ * @author TheRealKasumi
+ * @brief Contains a enum that identifies the individual fields of the battery pack data.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SMART_BMS_FIELD_H
+#define SMART_BMS_FIELD_H
+
+/**
+ * The order of the fields is part of the public interface.
+ * Each field maps to one bit of a change mask, so new fields must only be appended.
+ */
+enum SmartBmsField
+{
+	SBMS_FIELD_CELL_COUNT,
+	SBMS_FIELD_CELL_VOLTAGE_MIN,
+	SBMS_FIELD_CELL_VOLTAGE_MAX,
+	SBMS_FIELD_CELL_VOLTAGE_BALANCE,
+	SBMS_FIELD_PACK_SOC,
+	SBMS_FIELD_PACK_VOLTAGE,
+	SBMS_FIELD_PACK_CURRENT,
+	SBMS_FIELD_PACK_CHARGE_CURRENT,
+	SBMS_FIELD_PACK_DISCHARGE_CURRENT,
+	SBMS_FIELD_PACK_CAPACITY,
+	SBMS_FIELD_PACK_REMAINING_ENERGY,
+	SBMS_FIELD_LOWEST_CELL_VOLTAGE,
+	SBMS_FIELD_LOWEST_CELL_VOLTAGE_NUMBER,
+	SBMS_FIELD_HIGHEST_CELL_VOLTAGE,
+	SBMS_FIELD_HIGHEST_CELL_VOLTAGE_NUMBER,
+	SBMS_FIELD_LOWEST_CELL_TEMPERATURE,
+	SBMS_FIELD_LOWEST_CELL_TEMPERATURE_NUMBER,
+	SBMS_FIELD_HIGHEST_CELL_TEMPERATURE,
+	SBMS_FIELD_HIGHEST_CELL_TEMPERATURE_NUMBER,
+	SBMS_FIELD_COMMUNICATION_ERROR,
+	SBMS_FIELD_ALLOWED_TO_CHARGE,
+	SBMS_FIELD_ALLOWED_TO_DISCHARGE,
+	SBMS_FIELD_MIN_VOLTAGE_ALARM,
+	SBMS_FIELD_MAX_VOLTAGE_ALARM,
+	SBMS_FIELD_MIN_TEMPERATURE_ALARM,
+	SBMS_FIELD_MAX_TEMPERATURE_ALARM,
+	SBMS_FIELD_CELL_NUMBER,
+	SBMS_FIELD_CELL_VOLTAGE,
+	SBMS_FIELD_CELL_TEMPERATURE,
+	SBMS_FIELD_COUNT
+};
+
+#define SBMS_FIELD_MASK_ALL ((1UL << SBMS_FIELD_COUNT) - 1)
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file SmartBmsLinkMonitor.h
+ * @author TheRealKasumi
+ * @brief Contains a class that tracks the health of the serial link to the BMS.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SMART_BMS_LINK_MONITOR_H
+#define SMART_BMS_LINK_MONITOR_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include "bms/SmartBmsError.h"
+
+enum SmartBmsLinkState
+{
+	SBMS_LINK_OK,
+	SBMS_LINK_DEGRADED,		// Frames are late or too many are corrupt
+	SBMS_LINK_STALE,		// No valid frame for a while, the data must not be trusted anymore
+	SBMS_LINK_LOST			// No valid frame for a long time or never
+};
+
+struct SmartBmsLinkConfig
+{
+	uint32_t degradedTimeoutMs;	// Time without a valid frame until the link is degraded
+	uint32_t staleTimeoutMs;	// Time without a valid frame until the data is stale
+	uint32_t lostTimeoutMs;		// Time without a valid frame until the link is lost
+	uint8_t errorWindow;		// Number of recent frames that are checked for errors, at most 32
+	uint8_t degradedErrors;		// Number of errors within the window that degrade the link
+};
+
+typedef void (*SmartBmsLinkListener)(const SmartBmsLinkState previous, const SmartBmsLinkState state);
+
+/**
+ * The reader reports every frame, the state is only evaluated by check(), which is meant to run on a timer.
+ * So a silent link is detected even if nothing polls for it, and the listener is always called from the same task.
+ */
+class SmartBmsLinkMonitor
+{
+public:
+	SmartBmsLinkMonitor(const SmartBmsLinkConfig &config);
+	~SmartBmsLinkMonitor();
+
+	void setListener(SmartBmsLinkListener listener);
+	void onFrame(const SmartBmsError error, const uint32_t nowMs);
+	void check(const uint32_t nowMs);
+
+	const SmartBmsLinkState getState() const;
+	const uint8_t getRecentErrorCount() const;
+	const uint32_t getTransitionCount() const;
+
+	static const char *getStateName(const SmartBmsLinkState state);
+
+private:
+	SmartBmsLinkConfig config_;
+	SmartBmsLinkListener listener_;
+	std::atomic<bool> received_;
+	std::atomic<uint32_t> lastFrameMs_;
+	std::atomic<uint32_t> errorHistory_;
+	std::atomic<uint8_t> state_;
+	std::atomic<uint32_t> transitionCount_;
+};
+
+#endif
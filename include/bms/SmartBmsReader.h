@@ -22,13 +22,49 @@
 #define SMART_BMS_READER_H
 
 #include <stdint.h>
+#include <atomic>
 #include <Stream.h>
 
 #include "bms/SmartBmsData.h"
+#include "bms/SmartBmsDecoder.h"
 #include "bms/SmartBmsError.h"
+#include "util/SeqLock.h"
 
 class SmartBmsData;
 
+// Longer intervals between valid frames are link outages, they are counted as gaps instead of intervals
+#ifndef SBMS_READER_GAP_MS
+#define SBMS_READER_GAP_MS 5000
+#endif
+
+/**
+ * Cumulative statistics of the reader, intervals are measured between valid frames.
+ * Intervals longer than SBMS_READER_GAP_MS are only counted as gaps.
+ */
+struct SmartBmsReaderStats
+{
+	uint32_t framesOk;
+	uint32_t checksumErrors;
+	uint32_t shortReads;
+	uint32_t resyncs;
+	uint32_t bytesReceived;
+	uint32_t bytesDiscarded;
+	uint32_t overruns;
+	uint32_t intervalMinMs;
+	uint32_t intervalAvgMs;
+	uint32_t intervalMaxMs;
+	uint32_t gaps;
+	float bytesPerSecond;
+};
+
+/**
+ * After a corrupt frame, the reader slides over the stream one byte at a time until the checksum
+ * matches again, instead of dropping whole blocks. The 8 bit checksum also matches by chance,
+ * so after the start and after a corruption a frame is only accepted once the next frame at the
+ * same offset is valid as well, and a state of charge above 100 % is never accepted. Every corruption is reported once as
+ * SBMS_ERR_INVALID_CHECKSUM, the discarded bytes are counted in the statistics.
+ * Statistics are published through a SeqLock, so getStats() may be called from any task.
+ */
 class SmartBmsReader
 {
 public:
@@ -36,17 +72,32 @@ public:
 	~SmartBmsReader();
 
 	const SmartBmsError bmsDataReady() const;
-	const SmartBmsError decodeBmsData(SmartBmsData *smartBmsData) const;
+	const SmartBmsError decodeBmsData(SmartBmsData *smartBmsData);
+	void reportOverrun();
+	const uint8_t *getFrame() const;
+
+	const SmartBmsReaderStats getStats() const;
 
 private:
 	Stream *inputStream_;
+	SmartBmsDecoder decoder_;
+	uint8_t buffer_[SBMS_FRAME_SIZE];
+	size_t bufferLength_;
+	bool synchronizing_;
+	bool aligned_;
+	bool candidate_;
+
+	SmartBmsReaderStats stats_;
+	SeqLock<SmartBmsReaderStats> publishedStats_;
+	std::atomic<uint32_t> overruns_;
+	uint32_t lastFrameMs_;
+	uint64_t intervalSumMs_;
+	uint32_t intervalCount_;
+	uint32_t rateStartMs_;
+	uint32_t rateStartBytes_;
 
-	const float decodePackVoltage_(const uint8_t buffer[3]) const;
-	const float decodePackCurrent_(const uint8_t buffer[3]) const;
-	const float decodeCellVoltage_(const uint8_t buffer[2]) const;
-	const float decodeCellTemperature_(const uint8_t buffer[2]) const;
-	const uint16_t decodeTwoByteValue_(const uint8_t buffer[2]) const;
-	const uint32_t decodeThreeByteValue_(const uint8_t buffer[3]) const;
+	void onFrame_(const uint32_t nowMs);
+	void shiftBuffer_();
 };
 
 #endif
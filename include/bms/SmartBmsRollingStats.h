@@ -0,0 +1,65 @@
+/**
+ * @file SmartBmsRollingStats.h
+ * @author TheRealKasumi
+ * @brief Contains a class that keeps rolling minimum, maximum and mean values of the battery pack data.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SMART_BMS_ROLLING_STATS_H
+#define SMART_BMS_ROLLING_STATS_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+#include "bms/SmartBmsField.h"
+#include "util/RollingWindow.h"
+
+// Maximum number of windows over all fields
+#ifndef SBMS_MAX_ROLLING_WINDOWS
+#define SBMS_MAX_ROLLING_WINDOWS 6
+#endif
+
+struct SmartBmsRollingWindowConfig
+{
+	SmartBmsField field;	// Field that is aggregated
+	uint32_t lengthMs;		// Length of the window
+};
+
+/**
+ * Every window aggregates one field, a field may have several windows of different length.
+ * All windows are updated with every valid frame and the memory is fixed at compile time.
+ */
+class SmartBmsRollingStats
+{
+public:
+	SmartBmsRollingStats(const SmartBmsRollingWindowConfig *config, const uint8_t count);
+	~SmartBmsRollingStats();
+
+	void update(const SmartBmsData &smartBmsData, const uint32_t nowMs);
+	void reset();
+
+	const uint8_t getWindowCount() const;
+	const SmartBmsField getField(const uint8_t window) const;
+	const RollingWindow *getWindow(const uint8_t window) const;
+	const RollingWindow *findWindow(const SmartBmsField field, const uint32_t lengthMs) const;
+
+private:
+	SmartBmsField fields_[SBMS_MAX_ROLLING_WINDOWS];
+	RollingWindow windows_[SBMS_MAX_ROLLING_WINDOWS];
+	uint8_t windowCount_;
+};
+
+#endif
@@ -0,0 +1,75 @@
+/**
+ * @file SmartBmsRuntimeEstimator.h
+ * @author TheRealKasumi
+ * @brief Contains a class that estimates the time until the battery pack is full or empty.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SMART_BMS_RUNTIME_ESTIMATOR_H
+#define SMART_BMS_RUNTIME_ESTIMATOR_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+
+enum SmartBmsRuntimeState
+{
+	SBMS_RUNTIME_UNKNOWN,		// No frame yet
+	SBMS_RUNTIME_IDLE,			// The smoothed power is below the idle threshold
+	SBMS_RUNTIME_CHARGING,
+	SBMS_RUNTIME_DISCHARGING,
+	SBMS_RUNTIME_FULL
+};
+
+struct SmartBmsRuntimeConfig
+{
+	uint32_t timeConstantMs;	// Time constant of the smoothing
+	float idlePower;			// In W, smaller smoothed powers count as idle
+	uint32_t maxGapMs;			// Longer gaps between two frames restart the smoothing
+};
+
+/**
+ * The net power of the pack is smoothed by an exponentially weighted moving average whose weight depends on the time between two frames,
+ * so irregular frames do not bias it. The remaining energy divided by the smoothed power gives the time to full or empty.
+ * The confidence combines how long the average had time to settle with how steady the power was.
+ */
+class SmartBmsRuntimeEstimator
+{
+public:
+	SmartBmsRuntimeEstimator(const SmartBmsRuntimeConfig &config);
+	~SmartBmsRuntimeEstimator();
+
+	void update(const SmartBmsData &smartBmsData, const int64_t timeUs);
+	void reset();
+
+	const SmartBmsRuntimeState getState() const;
+	const float getPower() const;
+	const float getTimeToFull() const;
+	const float getTimeToEmpty() const;
+	const float getConfidence() const;
+
+private:
+	SmartBmsRuntimeConfig config_;
+	SmartBmsRuntimeState state_;
+	int64_t lastTimeUs_;
+	float power_;
+	float variance_;
+	float weight_;
+	float energyToFull_;
+	float energyToEmpty_;
+};
+
+#endif
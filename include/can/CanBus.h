@@ -0,0 +1,41 @@
+/**
+ * @file CanBus.h
+ * @author TheRealKasumi
+ * @brief Contains the interface of a CAN bus driver.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CAN_BUS_H
+#define CAN_BUS_H
+
+#include "can/CanFrame.h"
+
+/**
+ * Implemented by TwaiCanBus on the ESP32 and by SocketCanBus on a Linux host.
+ */
+class CanBus
+{
+public:
+	virtual ~CanBus()
+	{
+	}
+
+	virtual const bool begin() = 0;
+	virtual void end() = 0;
+	virtual const bool send(const CanFrame &frame) = 0;
+};
+
+#endif
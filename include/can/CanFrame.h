@@ -0,0 +1,33 @@
+/**
+ * @file CanFrame.h
+ * @author TheRealKasumi
+ * @brief Contains a struct that holds a single classic CAN frame.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CAN_FRAME_H
+#define CAN_FRAME_H
+
+#include <stdint.h>
+
+struct CanFrame
+{
+	uint32_t id;
+	uint8_t length;
+	uint8_t data[8];
+};
+
+#endif
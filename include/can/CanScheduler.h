@@ -0,0 +1,84 @@
+/**
+ * @file CanScheduler.h
+ * @author TheRealKasumi
+ * @brief Contains a class that transmits CAN frames according to a fixed schedule.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CAN_SCHEDULER_H
+#define CAN_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "can/CanBus.h"
+#include "can/CanFrame.h"
+#include "util/SeqLock.h"
+
+// Maximum number of frames in the transmit table
+#ifndef CAN_SCHEDULER_MAX_FRAMES
+#define CAN_SCHEDULER_MAX_FRAMES 8
+#endif
+
+/**
+ * The frame contents are published by the BMS reader through a sequence lock.
+ * tick() is driven by a periodic timer and sends every frame whose slot in the table is due,
+ * so the timing on the bus does not depend on the display or the network.
+ * Transmission stops when the data was not updated within the timeout, so the inverter
+ * falls back to its own safe state instead of acting on stale values.
+ */
+class CanScheduler
+{
+public:
+	CanScheduler(CanBus *canBus, const uint32_t timeoutMs);
+	~CanScheduler();
+
+	const bool addFrame(const uint8_t slot, const uint32_t periodMs, const uint32_t offsetMs);
+	void update(const CanFrame *frames, const uint8_t count, const uint32_t nowMs);
+	void tick(const uint32_t nowMs);
+
+	const uint32_t getSentCount() const;
+	const uint32_t getErrorCount() const;
+	const uint32_t getMaxLatenessMs() const;
+
+private:
+	struct FrameTable
+	{
+		uint32_t updateMs;
+		uint8_t count;
+		CanFrame frames[CAN_SCHEDULER_MAX_FRAMES];
+	};
+
+	struct Entry
+	{
+		uint8_t slot;
+		uint32_t periodMs;
+		uint32_t offsetMs;
+		uint32_t nextDueMs;
+		bool started;
+	};
+
+	CanBus *canBus_;
+	uint32_t timeoutMs_;
+	uint8_t entryCount_;
+	Entry entries_[CAN_SCHEDULER_MAX_FRAMES];
+	SeqLock<FrameTable> frameTable_;
+	FrameTable tickFrameTable_;
+	uint32_t sentCount_;
+	uint32_t errorCount_;
+	uint32_t maxLatenessMs_;
+};
+
+#endif
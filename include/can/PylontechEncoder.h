@@ -0,0 +1,69 @@
+/**
+ * @file PylontechEncoder.h
+ * @author TheRealKasumi
+ * @brief Contains a class that encodes the battery pack data into Pylontech compatible CAN frames.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef PYLONTECH_ENCODER_H
+#define PYLONTECH_ENCODER_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+#include "can/CanFrame.h"
+
+/**
+ * Frames of the low voltage Pylontech protocol that most hybrid inverters understand.
+ */
+enum PylontechFrame
+{
+	PYLONTECH_FRAME_LIMITS,		// 0x351
+	PYLONTECH_FRAME_SOC,		// 0x355
+	PYLONTECH_FRAME_MEASUREMENT, // 0x356
+	PYLONTECH_FRAME_ALARMS,		// 0x359
+	PYLONTECH_FRAME_REQUEST,	// 0x35C
+	PYLONTECH_FRAME_NAME,		// 0x35E
+	PYLONTECH_FRAME_COUNT
+};
+
+/**
+ * The BMS does not report voltage and current limits, they are configured once and
+ * reduced to 0 A whenever the BMS forbids charging or discharging.
+ */
+struct PylontechLimits
+{
+	float chargeVoltage;		// V
+	float dischargeVoltage;		// V
+	float maxChargeCurrent;		// A
+	float maxDischargeCurrent;	// A
+};
+
+class PylontechEncoder
+{
+public:
+	PylontechEncoder(const PylontechLimits &limits);
+	~PylontechEncoder();
+
+	void encode(const SmartBmsData &smartBmsData, CanFrame frames[PYLONTECH_FRAME_COUNT]) const;
+
+private:
+	PylontechLimits limits_;
+
+	void putInt16_(uint8_t *buffer, const float value, const float scale) const;
+};
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * @file SocketCanBus.h
+ * @author TheRealKasumi
+ * @brief Contains a CAN bus driver for SocketCAN on a Linux host, e.g. on vcan0.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SOCKET_CAN_BUS_H
+#define SOCKET_CAN_BUS_H
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include "can/CanBus.h"
+
+class SocketCanBus : public CanBus
+{
+public:
+	SocketCanBus(const char *interfaceName);
+	~SocketCanBus();
+
+	const bool begin() override;
+	void end() override;
+	const bool send(const CanFrame &frame) override;
+
+private:
+	const char *interfaceName_;
+	int socket_;
+};
+
+#endif
+
+#endif
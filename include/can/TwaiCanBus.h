@@ -0,0 +1,51 @@
+/**
+ * @file TwaiCanBus.h
+ * @author TheRealKasumi
+ * @brief Contains a CAN bus driver for the TWAI controller of the ESP32.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef TWAI_CAN_BUS_H
+#define TWAI_CAN_BUS_H
+
+#ifdef ARDUINO
+
+#include <stdint.h>
+
+#include "can/CanBus.h"
+
+class TwaiCanBus : public CanBus
+{
+public:
+	TwaiCanBus(const int8_t txPin, const int8_t rxPin, const uint32_t bitrate = 500000);
+	~TwaiCanBus();
+
+	const bool begin() override;
+	void end() override;
+	const bool send(const CanFrame &frame) override;
+
+private:
+	int8_t txPin_;
+	int8_t rxPin_;
+	uint32_t bitrate_;
+	bool started_;
+
+	void recover_();
+};
+
+#endif
+
+#endif
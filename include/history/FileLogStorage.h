@@ -0,0 +1,64 @@
+/**
+ * @file FileLogStorage.h
+ * @author TheRealKasumi
+ * @brief Contains a log storage in a file that emulates NOR flash on a Linux host.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef FILE_LOG_STORAGE_H
+#define FILE_LOG_STORAGE_H
+
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include "history/LogStorage.h"
+
+/**
+ * Writes only clear bits like NOR flash does.
+ * A power cut can be simulated with a budget of bytes: the operation that exceeds it is only applied partially,
+ * every following operation fails until the storage is opened again.
+ */
+class FileLogStorage : public LogStorage
+{
+public:
+	FileLogStorage(const char *path, const size_t size, const size_t eraseSize = 4096);
+	~FileLogStorage();
+
+	const bool begin() override;
+	void end();
+	const size_t getSize() const override;
+	const size_t getEraseSize() const override;
+	const bool read(const size_t offset, void *data, const size_t length) override;
+	const bool write(const size_t offset, const void *data, const size_t length) override;
+	const bool erase(const size_t offset, const size_t length) override;
+
+	void setPowerCutAfter(const size_t bytes);
+	const bool isPoweredOff() const;
+
+private:
+	const char *path_;
+	size_t size_;
+	size_t eraseSize_;
+	int file_;
+	bool powerCut_;
+	size_t budget_;
+	bool poweredOff_;
+
+	const size_t consume_(const size_t length);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file FlashLog.h
+ * @author TheRealKasumi
+ * @brief Contains a segment based append-only log that survives power loss.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "history/LogStorage.h"
+
+// Records are collected in RAM and written in pages of this size
+#ifndef LOG_PAGE_SIZE
+#define LOG_PAGE_SIZE 256
+#endif
+
+#define LOG_SEGMENT_MAGIC 0x53424C47
+#define LOG_SEGMENT_HEADER_SIZE 16
+#define LOG_RECORD_HEADER_SIZE 8
+
+/**
+ * Position of a reader in the log.
+ * If its segment is erased in the meantime, it continues with the oldest segment.
+ */
+struct LogCursor
+{
+	bool valid;
+	uint32_t sequence;
+	size_t offset;
+};
+
+/**
+ * The storage is split into segments that are written one after the other and erased as a ring.
+ * Every segment starts with a header that contains a sequence number, the segment with the highest one is written.
+ * A record consists of its length, the inverted length, the CRC32 of the data and the data.
+ * Records are never split between segments, so the largest record is a segment without its header.
+ * Writes are buffered in RAM and only whole pages are written, flush writes the rest of a page.
+ * After a power loss the log continues behind the last valid record.
+ * If there are bytes of a torn record, a new segment is started because the bytes can not be written again.
+ */
+class FlashLog
+{
+public:
+	FlashLog();
+	~FlashLog();
+
+	const bool begin(LogStorage *storage, const size_t segmentSize);
+	void end();
+	const bool append(const void *data, const size_t length);
+	const bool flush();
+	const bool clear();
+
+	const bool rewind(LogCursor &cursor) const;
+	const bool next(LogCursor &cursor, void *data, const size_t size, size_t &length) const;
+
+	const size_t getMaxRecordSize() const;
+	const uint32_t getSegmentCount() const;
+	const uint32_t getUsedSegmentCount() const;
+	const size_t getUsedBytes() const;
+	const size_t getPendingBytes() const;
+	const uint32_t getSequence() const;
+	const uint32_t getRecoveredTornRecords() const;
+	const uint32_t getEraseCount() const;
+	const uint32_t getWriteErrorCount() const;
+
+private:
+	LogStorage *storage_;
+	size_t segmentSize_;
+	uint32_t segmentCount_;
+	uint32_t activeSegment_;
+	uint32_t activeSequence_;
+	uint32_t usedSegments_;
+	size_t writeOffset_;
+	size_t pageOffset_;
+	size_t pageFlushed_;
+	uint32_t tornRecords_;
+	uint32_t eraseCount_;
+	uint32_t writeErrors_;
+	uint8_t page_[LOG_PAGE_SIZE];
+
+	const bool readSegmentHeader_(const uint32_t segment, uint32_t &sequence);
+	const bool openSegment_(const uint32_t segment, const uint32_t sequence);
+	const bool recover_();
+	const bool isErased_(const size_t offset, const size_t length);
+	const bool readRecordHeader_(const size_t segmentEnd, const size_t offset, uint16_t &length, uint32_t &crc) const;
+	const bool checkRecord_(const size_t offset, const uint16_t length, const uint32_t crc) const;
+	const bool read_(const size_t offset, void *data, const size_t length) const;
+	const bool put_(const void *data, const size_t length);
+	const bool writePage_(const size_t end);
+};
+
+#endif
@@ -0,0 +1,153 @@
+/**
+ * @file HistoryArchive.h
+ * @author TheRealKasumi
+ * @brief Contains round robin archives of consolidated history samples.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef HISTORY_ARCHIVE_H
+#define HISTORY_ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "history/HistorySample.h"
+
+// Number of rows of the archives, each row takes 30 bytes
+#ifndef HISTORY_ARCHIVE_MINUTE_ROWS
+#define HISTORY_ARCHIVE_MINUTE_ROWS 720 // 12 h
+#endif
+
+#ifndef HISTORY_ARCHIVE_QUARTER_ROWS
+#define HISTORY_ARCHIVE_QUARTER_ROWS 672 // 7 days
+#endif
+
+#ifndef HISTORY_ARCHIVE_DAY_ROWS
+#define HISTORY_ARCHIVE_DAY_ROWS 366 // 1 year
+#endif
+
+#define HISTORY_ARCHIVE_CHANNEL_COUNT 5
+#define HISTORY_ARCHIVE_UNKNOWN INT16_MIN
+#define HISTORY_ARCHIVE_ENTRY_VERSION 1
+
+enum HistoryArchiveLevel
+{
+	HISTORY_ARCHIVE_MINUTE,
+	HISTORY_ARCHIVE_QUARTER,
+	HISTORY_ARCHIVE_DAY,
+	HISTORY_ARCHIVE_LEVEL_COUNT
+};
+
+/**
+ * Consolidated values of one interval as multiples of the archive scale of the channel, see getValue().
+ * All values are HISTORY_ARCHIVE_UNKNOWN if there were no samples in the interval.
+ */
+struct HistoryArchiveRow
+{
+	int16_t min[HISTORY_ARCHIVE_CHANNEL_COUNT];
+	int16_t avg[HISTORY_ARCHIVE_CHANNEL_COUNT];
+	int16_t max[HISTORY_ARCHIVE_CHANNEL_COUNT];
+};
+
+/**
+ * Closed row with its slot and number of samples, as it is persisted.
+ * The number of samples weights the row when it is consolidated into the next level after a restore.
+ * Entries of another version have a different scale and are not imported.
+ */
+struct HistoryArchiveEntry
+{
+	int64_t slot;
+	uint32_t count;
+	uint8_t level;
+	uint8_t version;
+	HistoryArchiveRow row;
+};
+
+// Called with every row that is closed, e.g. to write it to the flash
+typedef void (*HistoryArchiveListener)(const HistoryArchiveEntry &entry);
+
+/**
+ * Keeps the minimum, average and maximum of the pack voltage, current, SOC and the cell temperatures
+ * per minute, per 15 minutes and per day in rings of fixed size, like a round robin database.
+ * A sample only updates the open minute. When a minute is closed, it is added to the open quarter
+ * and a closed quarter is added to the open day, so every level is consolidated incrementally.
+ * Rows are addressed by their slot, which is the unix time divided by the interval of the level.
+ * Samples that are older than the open minute are dropped.
+ * The pack voltage is stored in coarser steps than it is sampled, values outside of the range of a row are
+ * clamped and counted.
+ * Closed rows are passed to the listener and can be imported again after a reset, the coarser levels first.
+ * Values are only consolidated into slots of the next level that were not closed yet, so samples that are
+ * replayed after an import do not change the imported rows.
+ */
+class HistoryArchive
+{
+public:
+	HistoryArchive();
+	~HistoryArchive();
+
+	const bool begin();
+	void end();
+	void update(const HistorySample &sample);
+	void clear();
+	const bool importEntry(const HistoryArchiveEntry &entry);
+	void setListener(HistoryArchiveListener listener);
+
+	const bool read(const HistoryArchiveLevel level, const int64_t slot, HistoryArchiveRow &row) const;
+	const int64_t getFirstSlot(const HistoryArchiveLevel level) const;
+	const int64_t getLastSlot(const HistoryArchiveLevel level) const;
+	const uint32_t getDroppedSampleCount() const;
+	const uint32_t getClampedValueCount() const;
+	const size_t getSize() const;
+	const bool isInPsram() const;
+
+	static const uint32_t getInterval(const HistoryArchiveLevel level);
+	static const uint32_t getRowCount(const HistoryArchiveLevel level);
+	static const HistoryChannel getChannel(const uint8_t index);
+	static const float getValue(const uint8_t index, const int16_t value);
+
+private:
+	struct Accumulator
+	{
+		int64_t slot;
+		uint32_t count;
+		int32_t min[HISTORY_ARCHIVE_CHANNEL_COUNT];
+		int32_t max[HISTORY_ARCHIVE_CHANNEL_COUNT];
+		int64_t sum[HISTORY_ARCHIVE_CHANNEL_COUNT];
+	};
+
+	HistoryArchiveRow *memory_;
+	bool psram_;
+	HistoryArchiveRow *rows_[HISTORY_ARCHIVE_LEVEL_COUNT];
+	int64_t lastSlot_[HISTORY_ARCHIVE_LEVEL_COUNT];
+	Accumulator open_[HISTORY_ARCHIVE_LEVEL_COUNT];
+	int64_t firstTimeMs_;
+	int64_t lastTimeMs_;
+	uint32_t dropped_;
+	uint32_t clamped_;
+	HistoryArchiveListener listener_;
+
+	void add_(const uint8_t level, const int64_t slot, const Accumulator &values);
+	void close_(const uint8_t level);
+	void consolidate_(const uint8_t level, const Accumulator &values);
+	void store_(const uint8_t level, const int64_t slot, const Accumulator &values);
+
+	static void merge_(Accumulator &target, const Accumulator &values);
+	static const uint8_t toRow_(const Accumulator &values, HistoryArchiveRow &row);
+	static const int64_t divide_(const int64_t value, const int64_t divisor);
+	static const int16_t clamp_(const int64_t value, uint8_t &clamped);
+};
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * @file HistoryBlock.h
+ * @author TheRealKasumi
+ * @brief Contains classes that compress history samples into fixed size blocks.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef HISTORY_BLOCK_H
+#define HISTORY_BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "history/HistorySample.h"
+#include "util/BitStream.h"
+
+// Size of one block including the header
+#ifndef HISTORY_BLOCK_SIZE
+#define HISTORY_BLOCK_SIZE 1024
+#endif
+
+struct HistoryBlockHeader
+{
+	int64_t firstTimeMs;
+	int64_t lastTimeMs;
+	uint32_t bitCount;
+	uint16_t sampleCount;
+	uint16_t reserved;
+};
+
+#define HISTORY_BLOCK_PAYLOAD_SIZE (HISTORY_BLOCK_SIZE - sizeof(HistoryBlockHeader))
+
+/**
+ * Gorilla style compression. The first sample of a block is stored as it is.
+ * The following timestamps are stored as delta of delta with a variable length prefix:
+ * '0' for no change, '10' + 7 bits, '110' + 9 bits, '1110' + 12 bits or '1111' + 32 bits.
+ * A '0' after the timestamp means that no value changed. Otherwise every value is zigzag encoded and XORed with its predecessor:
+ * '0' if it is equal, '10' + the meaningful bits if they fit the window of the previous XOR,
+ * or '11' + 5 bits leading zeros + 5 bits length - 1 + the meaningful bits.
+ */
+class HistoryBlockWriter
+{
+public:
+	HistoryBlockWriter();
+	~HistoryBlockWriter();
+
+	void begin(uint8_t *block);
+	const bool append(const HistorySample &sample);
+
+	const HistoryBlockHeader *getHeader() const;
+	const size_t getUsedBytes() const;
+
+private:
+	HistoryBlockHeader *header_;
+	BitWriter bits_;
+	int64_t lastDelta_;
+	uint32_t lastValues_[HISTORY_CHANNEL_COUNT];
+	uint8_t leading_[HISTORY_CHANNEL_COUNT];
+	uint8_t trailing_[HISTORY_CHANNEL_COUNT];
+
+	void writeTime_(const int64_t deltaOfDelta);
+	void writeValue_(const uint8_t channel, const uint32_t value);
+};
+
+/**
+ * Decodes the samples of a block in order.
+ */
+class HistoryBlockReader
+{
+public:
+	HistoryBlockReader();
+	~HistoryBlockReader();
+
+	void begin(const uint8_t *block);
+	const bool next(HistorySample &sample);
+
+	const uint16_t getRemainingCount() const;
+
+private:
+	const HistoryBlockHeader *header_;
+	BitReader bits_;
+	uint16_t index_;
+	int64_t lastTimeMs_;
+	int64_t lastDelta_;
+	uint32_t lastValues_[HISTORY_CHANNEL_COUNT];
+	uint8_t leading_[HISTORY_CHANNEL_COUNT];
+	uint8_t trailing_[HISTORY_CHANNEL_COUNT];
+
+	const bool readTime_(int64_t &deltaOfDelta);
+	const bool readValue_(const uint8_t channel);
+};
+
+#endif
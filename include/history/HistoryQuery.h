@@ -0,0 +1,103 @@
+/**
+ * @file HistoryQuery.h
+ * @author TheRealKasumi
+ * @brief Contains a downsampled range query over the history.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef HISTORY_QUERY_H
+#define HISTORY_QUERY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "history/HistoryArchive.h"
+#include "history/HistorySample.h"
+#include "history/HistoryStore.h"
+
+// Maximum number of points of a query, the width of a graph in pixels is enough
+#ifndef HISTORY_QUERY_MAX_POINTS
+#define HISTORY_QUERY_MAX_POINTS 400
+#endif
+
+enum HistoryQuerySource
+{
+	HISTORY_QUERY_NONE,
+	HISTORY_QUERY_RAW,
+	HISTORY_QUERY_MINUTES,
+	HISTORY_QUERY_QUARTERS,
+	HISTORY_QUERY_DAYS
+};
+
+struct HistoryPoint
+{
+	int64_t timeMs;
+	float value;
+};
+
+// Receives the points of a query in order of time
+typedef void (*HistoryPointWriter)(const HistoryPoint &point, void *context);
+
+/**
+ * Downsamples a range with Largest-Triangle-Three-Buckets.
+ * The range is split into buckets of equal time and the point of a bucket that forms the largest triangle
+ * with the previously selected point and the average of the next bucket is selected.
+ * The first and the last point are always kept.
+ * The source is read twice, first for the averages of the buckets and then to select the points,
+ * so only the averages need memory and the points are written while the second pass runs.
+ * Short ranges are read from the raw history, longer ranges from the coarsest archive that still has enough rows.
+ * The history must not be modified while a query runs.
+ */
+class HistoryQuery
+{
+public:
+	HistoryQuery(const HistoryStore &historyStore, const HistoryArchive &historyArchive);
+	~HistoryQuery();
+
+	const bool begin(const HistoryChannel channel, const int64_t fromMs, const int64_t toMs, const uint16_t maxPoints);
+	const uint16_t run(HistoryPointWriter writer, void *context);
+	const HistoryQuerySource getSource() const;
+
+	static const char *getSourceName(const HistoryQuerySource source);
+
+private:
+	struct Bucket
+	{
+		float time;
+		float value;
+		uint32_t count;
+	};
+
+	const HistoryStore &historyStore_;
+	const HistoryArchive &historyArchive_;
+	HistoryChannel channel_;
+	uint8_t archiveIndex_;
+	int64_t fromMs_;
+	int64_t toMs_;
+	uint16_t maxPoints_;
+	HistoryQuerySource source_;
+	HistoryCursor cursor_;
+	int64_t slot_;
+	int64_t endSlot_;
+	Bucket buckets_[HISTORY_QUERY_MAX_POINTS];
+
+	void selectSource_();
+	void rewind_();
+	const bool next_(HistoryPoint &point);
+	const uint16_t getBucket_(const int64_t timeMs, const uint16_t bucketCount) const;
+};
+
+#endif
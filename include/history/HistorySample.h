@@ -0,0 +1,85 @@
+/**
+ * @file HistorySample.h
+ * @author TheRealKasumi
+ * @brief Contains a quantized snapshot of the battery pack data for the history.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef HISTORY_SAMPLE_H
+#define HISTORY_SAMPLE_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+
+/**
+ * The order of the channels is part of the stored format, new channels must only be appended.
+ */
+enum HistoryChannel
+{
+	HISTORY_PACK_VOLTAGE,
+	HISTORY_PACK_CURRENT,
+	HISTORY_PACK_SOC,
+	HISTORY_PACK_REMAINING_ENERGY,
+	HISTORY_LOWEST_CELL_VOLTAGE,
+	HISTORY_LOWEST_CELL_VOLTAGE_NUMBER,
+	HISTORY_HIGHEST_CELL_VOLTAGE,
+	HISTORY_HIGHEST_CELL_VOLTAGE_NUMBER,
+	HISTORY_LOWEST_CELL_TEMPERATURE,
+	HISTORY_HIGHEST_CELL_TEMPERATURE,
+	HISTORY_FLAGS,
+	HISTORY_CHANNEL_COUNT
+};
+
+// Bits of the flags channel, they match the status byte of the BMS
+#define HISTORY_FLAG_ALLOWED_TO_CHARGE 0x01
+#define HISTORY_FLAG_ALLOWED_TO_DISCHARGE 0x02
+#define HISTORY_FLAG_COMMUNICATION_ERROR 0x04
+#define HISTORY_FLAG_MIN_VOLTAGE_ALARM 0x08
+#define HISTORY_FLAG_MAX_VOLTAGE_ALARM 0x10
+#define HISTORY_FLAG_MIN_TEMPERATURE_ALARM 0x20
+#define HISTORY_FLAG_MAX_TEMPERATURE_ALARM 0x40
+
+/**
+ * Every channel is stored as an integer multiple of its scale.
+ * The scales match the resolution of the BMS, so voltages and currents are stored without loss.
+ */
+class HistorySample
+{
+public:
+	HistorySample();
+	HistorySample(const SmartBmsData &smartBmsData, const int64_t timeMs);
+	~HistorySample();
+
+	void setTime(const int64_t timeMs);
+	const int64_t getTime() const;
+
+	void setRawValue(const HistoryChannel channel, const int32_t value);
+	const int32_t getRawValue(const HistoryChannel channel) const;
+	const float getValue(const HistoryChannel channel) const;
+
+	static const char *getChannelName(const HistoryChannel channel);
+	static const HistoryChannel findChannel(const char *name);
+	static const float getChannelScale(const HistoryChannel channel);
+
+private:
+	int64_t timeMs_;
+	int32_t values_[HISTORY_CHANNEL_COUNT];
+
+	static const int32_t quantize_(const float value, const HistoryChannel channel);
+};
+
+#endif
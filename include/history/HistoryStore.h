@@ -0,0 +1,92 @@
+/**
+ * @file HistoryStore.h
+ * @author TheRealKasumi
+ * @brief Contains a compressed in-memory history of the battery pack data.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "history/HistoryBlock.h"
+#include "history/HistorySample.h"
+
+/**
+ * Position of a reader in the history, it stays valid while new samples are added.
+ * If its block was dropped in the meantime, it continues with the oldest block.
+ */
+struct HistoryCursor
+{
+	bool valid;
+	uint32_t block;
+	int64_t fromMs;
+	HistoryBlockReader reader;
+};
+
+// Called with every block that is full, e.g. to write it to the flash
+typedef void (*HistoryBlockListener)(const uint8_t *block, const size_t length);
+
+/**
+ * Samples are compressed into a ring of fixed size blocks, the oldest block is dropped when the ring is full.
+ * The memory is allocated once, in PSRAM if available and otherwise in the internal RAM.
+ * The class is not thread safe, add samples and read them from the same task.
+ */
+class HistoryStore
+{
+public:
+	HistoryStore();
+	~HistoryStore();
+
+	const bool begin(const size_t psramSize, const size_t ramSize);
+	void end();
+	const bool append(const HistorySample &sample);
+	void clear();
+	const bool importBlock(const uint8_t *block, const size_t length);
+	void setBlockListener(HistoryBlockListener listener);
+
+	const bool seek(HistoryCursor &cursor, const int64_t fromMs) const;
+	const bool next(HistoryCursor &cursor, HistorySample &sample) const;
+
+	const uint32_t getSampleCount() const;
+	const size_t getUsedBytes() const;
+	const size_t getCapacity() const;
+	const float getBytesPerSample() const;
+	const int64_t getOldestTime() const;
+	const int64_t getNewestTime() const;
+	const bool isInPsram() const;
+
+private:
+	uint8_t *memory_;
+	bool psram_;
+	uint32_t blockCount_;
+	uint32_t head_;
+	uint32_t usedBlocks_;
+	uint32_t firstBlock_;
+	uint32_t sampleCount_;
+	size_t sealedBytes_;
+	bool writerOpen_;
+	HistoryBlockWriter writer_;
+	HistoryBlockListener listener_;
+
+	const uint8_t *getBlock_(const uint32_t block) const;
+	void seal_();
+	void dropOldest_();
+};
+
+#endif
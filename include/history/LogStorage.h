@@ -0,0 +1,46 @@
+/**
+ * @file LogStorage.h
+ * @author TheRealKasumi
+ * @brief Contains the interface of the storage below the flash log.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOG_STORAGE_H
+#define LOG_STORAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Implemented by PartitionLogStorage on the ESP32 and by FileLogStorage on a Linux host.
+ * The storage behaves like NOR flash: erasing sets all bits and writing can only clear bits.
+ */
+class LogStorage
+{
+public:
+	virtual ~LogStorage()
+	{
+	}
+
+	virtual const bool begin() = 0;
+	virtual const size_t getSize() const = 0;
+	virtual const size_t getEraseSize() const = 0;
+	virtual const bool read(const size_t offset, void *data, const size_t length) = 0;
+	virtual const bool write(const size_t offset, const void *data, const size_t length) = 0;
+	virtual const bool erase(const size_t offset, const size_t length) = 0;
+};
+
+#endif
@@ -0,0 +1,50 @@
+/**
+ * @file PartitionLogStorage.h
+ * @author TheRealKasumi
+ * @brief Contains a log storage on a raw flash partition of the ESP32.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef PARTITION_LOG_STORAGE_H
+#define PARTITION_LOG_STORAGE_H
+
+#ifdef ARDUINO
+
+#include <esp_partition.h>
+
+#include "history/LogStorage.h"
+
+class PartitionLogStorage : public LogStorage
+{
+public:
+	PartitionLogStorage(const char *label);
+	~PartitionLogStorage();
+
+	const bool begin() override;
+	const size_t getSize() const override;
+	const size_t getEraseSize() const override;
+	const bool read(const size_t offset, void *data, const size_t length) override;
+	const bool write(const size_t offset, const void *data, const size_t length) override;
+	const bool erase(const size_t offset, const size_t length) override;
+
+private:
+	const char *label_;
+	const esp_partition_t *partition_;
+};
+
+#endif
+
+#endif
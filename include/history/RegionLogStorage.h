@@ -0,0 +1,52 @@
+/**
+ * @file RegionLogStorage.h
+ * @author TheRealKasumi
+ * @brief Contains a storage that exposes a region of another storage.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef REGION_LOG_STORAGE_H
+#define REGION_LOG_STORAGE_H
+
+#include "history/LogStorage.h"
+
+/**
+ * Lets several logs share one partition. Offsets are relative to the start of the region.
+ * The region must start at a multiple of the erase size, a size of 0 extends it to the end of the storage.
+ */
+class RegionLogStorage : public LogStorage
+{
+public:
+	RegionLogStorage(LogStorage *storage, const size_t offset, const size_t size);
+	~RegionLogStorage();
+
+	const bool begin() override;
+	const size_t getSize() const override;
+	const size_t getEraseSize() const override;
+	const bool read(const size_t offset, void *data, const size_t length) override;
+	const bool write(const size_t offset, const void *data, const size_t length) override;
+	const bool erase(const size_t offset, const size_t length) override;
+
+private:
+	LogStorage *storage_;
+	size_t offset_;
+	size_t size_;
+	size_t regionSize_;
+
+	const bool contains_(const size_t offset, const size_t length) const;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * @file AlarmOutputs.h
+ * @author TheRealKasumi
+ * @brief Contains a class that drives relay outputs directly from the flags of the BMS.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef ALARM_OUTPUTS_H
+#define ALARM_OUTPUTS_H
+
+#include <stdint.h>
+#include <mutex>
+
+#include "bms/SmartBmsData.h"
+
+// Use as pin to disable an output
+#define ALARM_OUTPUT_DISABLED -1
+
+struct AlarmOutputConfig
+{
+	int8_t chargePin;		// Active while charging is allowed
+	int8_t dischargePin;	// Active while discharging is allowed
+	int8_t alarmPin;		// Active while any alarm or the communication error is set
+	bool activeHigh;		// Level of an active output
+};
+
+/**
+ * Bits of the output state.
+ */
+enum AlarmOutputBit
+{
+	ALARM_OUTPUT_CHARGE = 0x01,
+	ALARM_OUTPUT_DISCHARGE = 0x02,
+	ALARM_OUTPUT_ALARM = 0x04
+};
+
+/**
+ * Meant to be called by the reader as soon as a frame is valid, before anything else is done with it.
+ * Until the first frame arrives and whenever setSafeState() is called, charging and discharging
+ * are blocked and the alarm is active. Both may be called from different tasks.
+ */
+class AlarmOutputs
+{
+public:
+	AlarmOutputs(const AlarmOutputConfig &config);
+	~AlarmOutputs();
+
+	void begin();
+	void apply(const SmartBmsData &smartBmsData);
+	void setSafeState();
+
+	const uint8_t getState() const;
+	const uint32_t getChangeCount() const;
+
+private:
+	AlarmOutputConfig config_;
+	std::mutex mutex_;
+	volatile uint8_t state_;
+	volatile uint32_t changeCount_;
+
+	void write_(const uint8_t state);
+	void writePin_(const int8_t pin, const bool active) const;
+};
+
+#endif
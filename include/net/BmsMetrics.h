@@ -0,0 +1,113 @@
+/**
+ * @file BmsMetrics.h
+ * @author TheRealKasumi
+ * @brief Contains a class that exposes the battery pack data and internal counters as Prometheus metrics.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef BMS_METRICS_H
+#define BMS_METRICS_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+#include "bms/SmartBmsCellTable.h"
+#include "bms/SmartBmsEnergyMeter.h"
+#include "bms/SmartBmsReader.h"
+#include "bms/SmartBmsRollingStats.h"
+#include "bms/SmartBmsRuntimeEstimator.h"
+#include "history/HistoryStore.h"
+#include "ui/RefreshScheduler.h"
+#include "net/MetricsExporter.h"
+#include "util/LogHistogram.h"
+
+// Buckets of the latency histogram, from 127 µs up to 131 ms
+#define BMS_LATENCY_FIRST_BUCKET 7
+#define BMS_LATENCY_BUCKETS 11
+
+/**
+ * Internal counters and gauges of the firmware.
+ */
+enum BmsCounter
+{
+	BMS_COUNTER_FRAMES_DECODED,
+	BMS_COUNTER_CHECKSUM_ERRORS,
+	BMS_COUNTER_READ_ERRORS,
+	BMS_COUNTER_RESYNCS,
+	BMS_COUNTER_RENDERS,
+	BMS_COUNTER_RENDER_TIME,
+	BMS_COUNTER_SSE_CLIENTS,
+	BMS_COUNTER_MODBUS_REQUESTS,
+	BMS_COUNTER_CAN_FRAMES_SENT,
+	BMS_COUNTER_LINK_STATE,
+	BMS_COUNTER_LINK_TRANSITIONS,
+	BMS_COUNTER_BYTES_DISCARDED,
+	BMS_COUNTER_UART_OVERRUNS,
+	BMS_COUNTER_FRAMES_DROPPED,
+	BMS_COUNTER_FRAME_INTERVAL_MIN,
+	BMS_COUNTER_FRAME_INTERVAL_AVG,
+	BMS_COUNTER_FRAME_INTERVAL_MAX,
+	BMS_COUNTER_BYTES_PER_SECOND,
+	BMS_COUNTER_CHARGED_ENERGY,
+	BMS_COUNTER_DISCHARGED_ENERGY,
+	BMS_COUNTER_CHARGED_CHARGE,
+	BMS_COUNTER_DISCHARGED_CHARGE,
+	BMS_COUNTER_ENERGY_GAPS,
+	BMS_COUNTER_NET_POWER,
+	BMS_COUNTER_TIME_TO_FULL,
+	BMS_COUNTER_TIME_TO_EMPTY,
+	BMS_COUNTER_RUNTIME_CONFIDENCE,
+	BMS_COUNTER_HISTORY_SAMPLES,
+	BMS_COUNTER_HISTORY_BYTES,
+	BMS_COUNTER_HISTORY_BYTES_PER_SAMPLE,
+	BMS_COUNTER_HISTORY_SECONDS,
+	BMS_COUNTER_FULL_REFRESHES,
+	BMS_COUNTER_PARTIAL_REFRESHES,
+	BMS_COUNTER_REFRESHES_PER_HOUR,
+	BMS_COUNTER_GHOSTING_LEVEL,
+	BMS_COUNTER_COUNT
+};
+
+class BmsMetrics
+{
+public:
+	BmsMetrics();
+	~BmsMetrics();
+
+	void update(const SmartBmsData &smartBmsData, const SmartBmsCellTable &cellTable);
+	void setCounter(const BmsCounter counter, const double value);
+	void setAlarmLatency(const LogHistogram &histogram);
+	void setReaderStats(const SmartBmsReaderStats &stats);
+	void setRollingStats(const SmartBmsRollingStats &stats);
+	void setEnergyMeter(const SmartBmsEnergyMeter &energyMeter);
+	void setRuntimeEstimator(const SmartBmsRuntimeEstimator &runtimeEstimator);
+	void setHistoryStore(const HistoryStore &historyStore);
+	void setRefreshScheduler(const RefreshScheduler &refreshScheduler);
+
+	const char *getBuffer() const;
+	const size_t getLength() const;
+
+private:
+	MetricsExporter exporter_;
+	int16_t fieldSeries_[SBMS_FIELD_COUNT];
+	int16_t cellVoltageSeries_[SBMS_MAX_CELLS];
+	int16_t cellTemperatureSeries_[SBMS_MAX_CELLS];
+	int16_t counterSeries_[BMS_COUNTER_COUNT];
+	int16_t alarmLatencySeries_;
+	int16_t rollingSeries_;
+};
+
+#endif
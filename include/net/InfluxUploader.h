@@ -0,0 +1,125 @@
+/**
+ * @file InfluxUploader.h
+ * @author TheRealKasumi
+ * @brief Contains a class that uploads the battery pack data in compressed batches to InfluxDB.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef INFLUX_UPLOADER_H
+#define INFLUX_UPLOADER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+#include "bms/SmartBmsData.h"
+#include "util/GzipEncoder.h"
+
+// Longest line of one point, a point with all fields takes about 690 bytes
+#define INFLUX_LINE_SIZE 768
+
+// Points of one batch period, 300 s at one point every 10 s and one spare point
+#ifndef INFLUX_BATCH_POINTS
+#define INFLUX_BATCH_POINTS 31
+#endif
+
+// Size of the line protocol text of one batch, a full text buffer seals the batch before its period is over
+#ifndef INFLUX_BATCH_SIZE
+#define INFLUX_BATCH_SIZE (INFLUX_BATCH_POINTS * INFLUX_LINE_SIZE)
+#endif
+
+// Number of compressed batches kept while the upload is not possible
+#ifndef INFLUX_MAX_PENDING
+#define INFLUX_MAX_PENDING 6
+#endif
+
+// Maximum size of one compressed batch, a batch that does not fit is split
+#ifndef INFLUX_PENDING_SIZE
+#define INFLUX_PENDING_SIZE 4096
+#endif
+
+struct InfluxConfig
+{
+	const char *host;
+	uint16_t port;
+	const char *path;			// e.g. /api/v2/write?org=home&bucket=bms&precision=ms
+	const char *token;			// API token or nullptr
+	const char *measurement;
+	const char *tags;			// e.g. host=garage or nullptr
+	uint32_t sampleIntervalMs;	// Time between two points
+	uint32_t batchPeriodMs;		// Time covered by one batch
+};
+
+/**
+ * Points are collected as line protocol text. When the batch period is over or the text buffer is full,
+ * the batch is gzip compressed once into a ring of pending batches. If the compressed batch does not fit
+ * into a slot of the ring, it is split at a line and both parts are compressed on their own. upload() posts the pending batches
+ * oldest first and keeps them until the server accepted them, so they survive WiFi reconnects.
+ * When the ring is full, the oldest batch is dropped. Every request carries an X-Batch-Sequence header.
+ * addPoint() and upload() may be called from different tasks.
+ */
+class InfluxUploader
+{
+public:
+	InfluxUploader(const InfluxConfig &config);
+	~InfluxUploader();
+
+	void addPoint(const SmartBmsData &smartBmsData, const uint64_t unixTimeMs, const uint32_t nowMs);
+	const bool upload();
+
+	const uint8_t getPendingCount();
+	const uint32_t getSentCount() const;
+	const uint32_t getDroppedCount() const;
+	const int getLastStatus() const;
+
+private:
+	struct Batch
+	{
+		uint32_t sequence;
+		uint16_t points;
+		size_t rawLength;
+		size_t length;
+		uint8_t data[INFLUX_PENDING_SIZE];
+	};
+
+	InfluxConfig config_;
+	std::mutex mutex_;
+	GzipEncoder encoder_;
+
+	char text_[INFLUX_BATCH_SIZE];
+	size_t textLength_;
+	uint16_t pointCount_;
+	uint32_t batchStartMs_;
+	uint32_t lastSampleMs_;
+	bool sampled_;
+
+	Batch pending_[INFLUX_MAX_PENDING];
+	uint8_t pendingHead_;
+	uint8_t pendingCount_;
+	uint32_t nextSequence_;
+	Batch sendBatch_;
+
+	uint32_t sentCount_;
+	uint32_t droppedCount_;
+	int lastStatus_;
+
+	const size_t formatLine_(const SmartBmsData &smartBmsData, const uint64_t unixTimeMs, char *line, const size_t size) const;
+	void sealBatch_();
+	Batch &reserveBatch_();
+	const int post_(const Batch &batch) const;
+};
+
+#endif
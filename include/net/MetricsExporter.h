@@ -0,0 +1,81 @@
+/**
+ * @file MetricsExporter.h
+ * @author TheRealKasumi
+ * @brief Contains a class that keeps a preformatted Prometheus text exposition in memory.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Size of the exposition buffer in bytes
+#ifndef METRICS_BUFFER_SIZE
+#define METRICS_BUFFER_SIZE 16384
+#endif
+
+// Maximum number of series
+#ifndef METRICS_MAX_SERIES
+#define METRICS_MAX_SERIES 160
+#endif
+
+// Width of the value field of each series
+#define METRICS_VALUE_WIDTH 16
+
+/**
+ * All series are laid out once when they are added. Each value lives in a fixed width,
+ * space padded field at a known offset, so setting a value only rewrites that field
+ * and only if the value changed. A scrape just sends the buffer as it is.
+ * The class is not thread safe, set values and serve scrapes from the same task.
+ */
+class MetricsExporter
+{
+public:
+	enum MetricType
+	{
+		METRIC_GAUGE,
+		METRIC_COUNTER,
+		METRIC_HISTOGRAM
+	};
+
+	MetricsExporter();
+	~MetricsExporter();
+
+	const int16_t addSeries(const char *name, const char *help, const MetricType type, const char *labels = nullptr);
+	const int16_t addHistogram(const char *name, const char *help, const uint32_t *bounds, const uint8_t boundCount);
+	void set(const int16_t series, const double value);
+
+	const char *getBuffer() const;
+	const size_t getLength() const;
+	const uint32_t getFormatCount() const;
+
+private:
+	char buffer_[METRICS_BUFFER_SIZE];
+	size_t length_;
+	uint16_t seriesCount_;
+	uint16_t valueOffset_[METRICS_MAX_SERIES];
+	double value_[METRICS_MAX_SERIES];
+	const char *lastName_;
+	uint32_t formatCount_;
+
+	const int16_t appendSeries_(const char *name, const char *labels);
+	const bool append_(const char *format, ...);
+	void formatValue_(const int16_t series);
+};
+
+#endif
@@ -0,0 +1,96 @@
+/**
+ * @file ModbusRegisterMap.h
+ * @author TheRealKasumi
+ * @brief Contains a class that maps the battery pack data to Modbus registers.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MODBUS_REGISTER_MAP_H
+#define MODBUS_REGISTER_MAP_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+#include "bms/SmartBmsCellTable.h"
+
+/**
+ * Register addresses. The same map is served as input and holding registers.
+ * Signed values are two's complement, 32 bit values are sent high word first.
+ */
+enum ModbusRegister
+{
+	MB_REG_CELL_COUNT = 0,				// 1
+	MB_REG_CELL_VOLTAGE_MIN = 1,		// mV
+	MB_REG_CELL_VOLTAGE_MAX = 2,		// mV
+	MB_REG_CELL_VOLTAGE_BALANCE = 3,	// mV
+	MB_REG_PACK_SOC = 4,				// %
+	MB_REG_PACK_VOLTAGE = 5,			// 10 mV
+	MB_REG_PACK_CURRENT = 6,			// 100 mA, signed
+	MB_REG_PACK_CHARGE_CURRENT = 7,		// 100 mA, signed
+	MB_REG_PACK_DISCHARGE_CURRENT = 8,	// 100 mA, signed
+	MB_REG_PACK_CAPACITY = 9,			// 100 Wh
+	MB_REG_PACK_REMAINING_ENERGY = 10,	// Wh, 32 bit
+	MB_REG_LOWEST_CELL_VOLTAGE = 12,	// mV
+	MB_REG_LOWEST_CELL_VOLTAGE_NUMBER = 13,
+	MB_REG_HIGHEST_CELL_VOLTAGE = 14,	// mV
+	MB_REG_HIGHEST_CELL_VOLTAGE_NUMBER = 15,
+	MB_REG_LOWEST_CELL_TEMPERATURE = 16, // 0.1 °C, signed
+	MB_REG_LOWEST_CELL_TEMPERATURE_NUMBER = 17,
+	MB_REG_HIGHEST_CELL_TEMPERATURE = 18, // 0.1 °C, signed
+	MB_REG_HIGHEST_CELL_TEMPERATURE_NUMBER = 19,
+	MB_REG_STATUS = 20,					// Bits, see ModbusStatusBit
+	MB_REG_CELL_NUMBER = 21,			// Cell of the latest frame
+	MB_REG_CELL_VOLTAGE = 22,			// mV
+	MB_REG_CELL_TEMPERATURE = 23,		// 0.1 °C, signed
+	MB_REG_CELL_VOLTAGE_TABLE = 100,	// mV, one register per cell
+	MB_REG_CELL_TEMPERATURE_TABLE = MB_REG_CELL_VOLTAGE_TABLE + SBMS_MAX_CELLS, // 0.1 °C, signed, one register per cell
+	MB_REG_COUNT = MB_REG_CELL_TEMPERATURE_TABLE + SBMS_MAX_CELLS
+};
+
+/**
+ * Bits of the status register. They are also served as discrete inputs with the bit number as address.
+ */
+enum ModbusStatusBit
+{
+	MB_STATUS_ALLOWED_TO_CHARGE = 0,
+	MB_STATUS_ALLOWED_TO_DISCHARGE = 1,
+	MB_STATUS_COMMUNICATION_ERROR = 2,
+	MB_STATUS_MIN_VOLTAGE_ALARM = 3,
+	MB_STATUS_MAX_VOLTAGE_ALARM = 4,
+	MB_STATUS_MIN_TEMPERATURE_ALARM = 5,
+	MB_STATUS_MAX_TEMPERATURE_ALARM = 6,
+	MB_STATUS_COUNT = 7
+};
+
+class ModbusRegisterMap
+{
+public:
+	ModbusRegisterMap();
+	~ModbusRegisterMap();
+
+	void encode(const SmartBmsData &smartBmsData, const SmartBmsCellTable &cellTable);
+
+	const uint16_t getRegister(const uint16_t address) const;
+	const bool getDiscreteInput(const uint16_t address) const;
+
+private:
+	uint16_t registers_[MB_REG_COUNT];
+
+	const uint16_t toUnsigned_(const float value, const float scale) const;
+	const uint16_t toSigned_(const float value, const float scale) const;
+};
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file ModbusServer.h
+ * @author TheRealKasumi
+ * @brief Contains a Modbus TCP server that exposes the battery pack data to inverters and other masters.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MODBUS_SERVER_H
+#define MODBUS_SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bms/SmartBmsData.h"
+#include "bms/SmartBmsCellTable.h"
+#include "net/ModbusRegisterMap.h"
+#include "util/SeqLock.h"
+
+// Maximum number of concurrently connected masters
+#ifndef MODBUS_MAX_CLIENTS
+#define MODBUS_MAX_CLIENTS 4
+#endif
+
+// MBAP header plus the largest PDU
+#define MODBUS_ADU_SIZE 260
+
+/**
+ * Serves function codes 0x02 (discrete inputs), 0x03 (holding registers) and 0x04 (input registers).
+ * All registers are read only. The register image is published by the BMS reader through a sequence lock,
+ * so handle() can run in its own task without ever blocking the reader.
+ */
+class ModbusServer
+{
+public:
+	ModbusServer(const uint16_t port = 502);
+	~ModbusServer();
+
+	const bool begin();
+	void end();
+	void handle(const uint32_t timeoutMs);
+
+	void update(const SmartBmsData &smartBmsData, const SmartBmsCellTable &cellTable);
+	const uint32_t getRequestCount() const;
+
+private:
+	struct Client
+	{
+		int socket;
+		size_t rxLength;
+		size_t txLength;
+		size_t txOffset;
+		uint8_t rx[MODBUS_ADU_SIZE];
+		uint8_t tx[MODBUS_ADU_SIZE];
+	};
+
+	uint16_t port_;
+	int listenSocket_;
+	uint32_t requestCount_;
+	Client clients_[MODBUS_MAX_CLIENTS];
+	SeqLock<ModbusRegisterMap> registerMap_;
+	ModbusRegisterMap requestRegisterMap_;
+
+	void acceptClients_();
+	void receive_(Client &client);
+	void processRequests_(Client &client);
+	void flush_(Client &client);
+	const size_t processRequest_(const uint8_t *request, const size_t length, uint8_t *response);
+	const size_t exceptionResponse_(const uint8_t *request, const uint8_t exceptionCode, uint8_t *response) const;
+	void closeClient_(Client &client);
+};
+
+#endif
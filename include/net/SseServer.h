@@ -0,0 +1,110 @@
+/**
+ * @file SseServer.h
+ * @author TheRealKasumi
+ * @brief Contains a minimal Server-Sent Events server that pushes BMS updates to browsers.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SSE_SERVER_H
+#define SSE_SERVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Maximum number of connected browsers
+#ifndef SSE_MAX_CLIENTS
+#define SSE_MAX_CLIENTS 4
+#endif
+
+// Number of events kept for slow clients, a client falling further behind is dropped
+#ifndef SSE_EVENT_SLOTS
+#define SSE_EVENT_SLOTS 8
+#endif
+
+// Maximum size of one serialized event including the SSE framing
+#ifndef SSE_EVENT_SIZE
+#define SSE_EVENT_SIZE 1024
+#endif
+
+#define SSE_REQUEST_SIZE 256
+
+/**
+ * Every event is serialized exactly once into a ring of slots that is shared by all clients.
+ * Clients only keep a sequence number and an offset into that ring.
+ * Sockets are non-blocking, so a slow client never stalls the caller.
+ * New clients start streaming at the next keyframe, which must contain the full state.
+ */
+class SseServer
+{
+public:
+	SseServer(const uint16_t port, const char *path = "/events");
+	~SseServer();
+
+	const bool begin();
+	void end();
+	void handle();
+
+	const bool publish(const char *event, const char *data, const size_t length, const bool keyframe);
+	const bool needsKeyframe() const;
+	const uint8_t getClientCount() const;
+	const uint32_t getDroppedClientCount() const;
+
+private:
+	enum ClientState
+	{
+		SSE_CLIENT_FREE,
+		SSE_CLIENT_READING_REQUEST,
+		SSE_CLIENT_SENDING_HEADER,
+		SSE_CLIENT_WAITING_KEYFRAME,
+		SSE_CLIENT_STREAMING
+	};
+
+	struct Client
+	{
+		int socket;
+		ClientState state;
+		uint32_t nextSequence;
+		size_t offset;
+		size_t requestLength;
+		char request[SSE_REQUEST_SIZE];
+	};
+
+	struct Event
+	{
+		uint32_t sequence;
+		bool keyframe;
+		size_t length;
+		char data[SSE_EVENT_SIZE];
+	};
+
+	uint16_t port_;
+	const char *path_;
+	int listenSocket_;
+	uint32_t headSequence_;
+	uint32_t droppedClients_;
+	Client clients_[SSE_MAX_CLIENTS];
+	Event events_[SSE_EVENT_SLOTS];
+
+	void acceptClients_();
+	void readRequest_(Client &client);
+	void sendHeader_(Client &client);
+	void sendEvents_(Client &client);
+	const bool sendPending_(Client &client, const char *data, const size_t length);
+	void dropLaggingClients_();
+	void closeClient_(Client &client);
+};
+
+#endif
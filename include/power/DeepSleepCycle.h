@@ -0,0 +1,122 @@
+/**
+ * @file DeepSleepCycle.h
+ * @author TheRealKasumi
+ * @brief Contains the state of the deep sleep mode that is kept in the RTC memory between two wake ups.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef DEEP_SLEEP_CYCLE_H
+#define DEEP_SLEEP_CYCLE_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+#include "bms/SmartBmsDecoder.h"
+#include "ui/RefreshScheduler.h"
+
+#define DEEP_SLEEP_STATE_MAGIC 0x534C5031
+
+// Fields that are shown on the display, the data of the single cells changes with every frame
+#define DEEP_SLEEP_FIELD_MASK (SBMS_FIELD_MASK_ALL & ~((1UL << SBMS_FIELD_CELL_NUMBER) | (1UL << SBMS_FIELD_CELL_VOLTAGE) | (1UL << SBMS_FIELD_CELL_TEMPERATURE)))
+
+enum DeepSleepWake
+{
+	DEEP_SLEEP_WAKE_RESET,		// Power on or reset, the panel content is unknown
+	DEEP_SLEEP_WAKE_TIMER,
+	DEEP_SLEEP_WAKE_UART		// The BMS started to send
+};
+
+enum DeepSleepPanel
+{
+	DEEP_SLEEP_PANEL_UNKNOWN,	// The controller of the panel lost its image
+	DEEP_SLEEP_PANEL_VALUES,
+	DEEP_SLEEP_PANEL_MESSAGE
+};
+
+struct DeepSleepConfig
+{
+	uint8_t ghostingBudget;		// Partial refreshes until a full refresh, 0 for full refreshes only
+	float awakeCurrent;			// In mA, current of the board while it is awake
+	float refreshCurrent;		// In mA, additional current of the panel while it refreshes
+	float sleepCurrent;			// In mA, current of the board and the panel in deep sleep
+};
+
+/**
+ * Must stay trivially constructible, a constructor would reset it on every wake up.
+ * The last frame is kept as raw bytes and decoded again, so nothing depends on the layout of SmartBmsData.
+ */
+struct DeepSleepState
+{
+	uint32_t magic;
+	uint32_t cycles;
+	uint32_t timerWakes;
+	uint32_t uartWakes;
+	uint32_t frames;
+	uint32_t missedFrames;
+	uint32_t fullRefreshes;
+	uint32_t partialRefreshes;
+	uint8_t partialsSinceFull;
+	uint8_t panel;
+	bool hasFrame;
+	uint8_t frame[SBMS_FRAME_SIZE];
+	int64_t sleepStartUs;
+	uint32_t lastAwakeUs;
+	uint32_t lastRefreshUs;
+	uint32_t lastSleepUs;
+	uint64_t totalAwakeUs;
+	uint64_t totalRefreshUs;
+	uint64_t totalSleepUs;
+};
+
+/**
+ * One cycle wakes up, reads a single frame, updates the display if the values changed and goes back to sleep.
+ * All times are taken from a clock that keeps running in deep sleep, like the system time of the ESP32.
+ * The average current is estimated from the time spent awake, refreshing and sleeping and the configured currents.
+ */
+class DeepSleepCycle
+{
+public:
+	DeepSleepCycle(DeepSleepState &state, const DeepSleepConfig &config);
+	~DeepSleepCycle();
+
+	void begin(const DeepSleepWake wake, const int64_t wakeTimeUs);
+	const DisplayRefresh onFrame(const uint8_t frame[SBMS_FRAME_SIZE], const SmartBmsData &smartBmsData);
+	const DisplayRefresh onMissedFrame();
+	void onRefresh(const DisplayRefresh refresh, const uint32_t durationUs);
+	void sleep(const int64_t timeUs);
+
+	const DeepSleepWake getWake() const;
+	const DeepSleepPanel getPanel() const;
+	const DeepSleepState &getState() const;
+	const bool hasLastCycle() const;
+	const float getLastCycleCurrent() const;
+	const float getAverageCurrent() const;
+
+	static const char *getWakeName(const DeepSleepWake wake);
+
+private:
+	DeepSleepState &state_;
+	DeepSleepConfig config_;
+	DeepSleepWake wake_;
+	int64_t wakeTimeUs_;
+	uint32_t refreshUs_;
+	bool hasLastCycle_;
+
+	const DisplayRefresh getRefresh_() const;
+	const float getCurrent_(const uint64_t awakeUs, const uint64_t refreshUs, const uint64_t sleepUs) const;
+};
+
+#endif
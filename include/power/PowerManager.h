@@ -0,0 +1,109 @@
+/**
+ * @file PowerManager.h
+ * @author TheRealKasumi
+ * @brief Contains the power management that scales the CPU frequency and keeps it high while the firmware is busy.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#ifdef ARDUINO
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <sdkconfig.h>
+
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+// Time is counted for 240, 160, 80 MHz and everything below
+#define POWER_FREQUENCY_COUNT 4
+
+struct PowerConfig
+{
+	uint16_t maxFrequencyMhz;	// Frequency while a lock is held
+	uint16_t minFrequencyMhz;	// Frequency while waiting, at least 80 MHz keeps the APB clock of the UART
+	bool lightSleep;			// Only with CONFIG_PM_ENABLE and tickless idle
+};
+
+/**
+ * With CONFIG_PM_ENABLE, ESP-IDF scales the frequency and a lock of the type ESP_PM_CPU_FREQ_MAX keeps the maximum.
+ * Without it, the frequency is switched by setCpuFrequencyMhz() when the first lock is taken and the last one released.
+ * Locks are counted, so they may be nested and taken by several tasks.
+ * The time at each frequency is accounted whenever a lock changes and by sample(), which should run regularly.
+ */
+class PowerManager
+{
+public:
+	PowerManager();
+	~PowerManager();
+
+	const bool begin(const PowerConfig &config);
+	void acquire();
+	void release();
+	void sample();
+	void resetStats();
+
+	const bool isScaling() const;
+	const size_t format(char *buffer, const size_t size);
+
+	static const uint16_t getFrequency(const uint8_t index);
+
+private:
+	PowerConfig config_;
+	bool scaling_;
+#ifdef CONFIG_PM_ENABLE
+	esp_pm_lock_handle_t lock_;
+#endif
+	std::mutex mutex_;
+	uint8_t holders_;
+	uint32_t lockCount_;
+	int64_t lastSampleUs_;
+	uint8_t lastFrequency_;
+	int64_t lockStartUs_;
+	uint64_t lockedUs_;
+	uint64_t frequencyUs_[POWER_FREQUENCY_COUNT];
+
+	void account_(const int64_t nowUs);
+	static const uint8_t getFrequencyIndex_(const uint32_t frequencyMhz);
+};
+
+/**
+ * Holds the maximum frequency for the lifetime of the scope.
+ */
+class PowerBoost
+{
+public:
+	PowerBoost(PowerManager &powerManager) : powerManager_(powerManager)
+	{
+		this->powerManager_.acquire();
+	}
+
+	~PowerBoost()
+	{
+		this->powerManager_.release();
+	}
+
+private:
+	PowerManager &powerManager_;
+};
+
+#endif
+
+#endif
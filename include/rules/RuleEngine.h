@@ -0,0 +1,141 @@
+/**
+ * @file RuleEngine.h
+ * @author TheRealKasumi
+ * @brief Contains a small rule language that switches outputs based on the battery pack data.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef RULE_ENGINE_H
+#define RULE_ENGINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bms/SmartBmsData.h"
+#include "rules/RuleError.h"
+
+#define RULE_MAX_RULES 8
+#define RULE_MAX_OUTPUTS 8
+#define RULE_MAX_CODE 128
+#define RULE_MAX_CONSTANTS 32
+#define RULE_MAX_DEPTH 32		// Values on the stack and nested not or parentheses, each limited on its own
+#define RULE_MAX_WORD 32
+
+/**
+ * One rule per line (or separated by ;), # starts a comment:
+ *
+ *   <output> = on <condition> [off <condition>] [min_on <s>] [min_off <s>]
+ *
+ * A condition combines comparisons of fields with and, or, not and parentheses, e.g.
+ * packSoc > 30 and not maxTemperatureAlarmActive. Flag fields can be used without comparison.
+ * Field names are the ones of SmartBmsData::getFieldName(). Without an off condition, the
+ * output turns off as soon as the on condition is false. With both, the gap between them
+ * is the hysteresis. min_on and min_off delay a change until the output kept its state that long.
+ * Several rules for the same output are combined with or.
+ *
+ * The rules are compiled once into a stack machine code without jumps,
+ * so evaluation time is bounded by RULE_MAX_CODE instructions.
+ */
+class RuleEngine
+{
+public:
+	RuleEngine(const char *const *outputNames, const uint8_t outputCount);
+	~RuleEngine();
+
+	const RuleError compile(const char *text);
+	const uint8_t evaluate(const SmartBmsData &smartBmsData, const uint32_t nowMs);
+	void reset();
+
+	const uint8_t getOutputMask() const;
+	const uint8_t getRuleCount() const;
+	const uint16_t getCodeSize() const;
+	const uint16_t getErrorLine() const;
+
+	static const char *getErrorMessage(const RuleError error);
+
+private:
+	enum RuleOpcode
+	{
+		RULE_OP_LT,
+		RULE_OP_LE,
+		RULE_OP_GT,
+		RULE_OP_GE,
+		RULE_OP_EQ,
+		RULE_OP_NE,
+		RULE_OP_FLAG,
+		RULE_OP_AND,
+		RULE_OP_OR,
+		RULE_OP_NOT
+	};
+
+	struct Instruction
+	{
+		uint8_t opcode;
+		uint8_t field;
+		uint8_t constant;
+	};
+
+	struct Rule
+	{
+		uint8_t output;
+		uint8_t onStart;
+		uint8_t onLength;
+		uint8_t offStart;
+		uint8_t offLength;
+		uint32_t minOnMs;
+		uint32_t minOffMs;
+		bool active;
+		bool switched;
+		uint32_t changedMs;
+	};
+
+	const char *const *outputNames_;
+	uint8_t outputCount_;
+	Instruction code_[RULE_MAX_CODE];
+	uint16_t codeSize_;
+	float constants_[RULE_MAX_CONSTANTS];
+	uint8_t constantCount_;
+	Rule rules_[RULE_MAX_RULES];
+	uint8_t ruleCount_;
+	uint8_t outputMask_;
+
+	// Only used while compiling
+	const char *text_;
+	size_t position_;
+	uint16_t line_;
+	uint16_t errorLine_;
+	uint8_t depth_;
+	uint8_t nesting_;
+
+	const bool run_(const uint8_t start, const uint8_t length, const SmartBmsData &smartBmsData) const;
+
+	const RuleError parseRule_();
+	const RuleError parseExpression_();
+	const RuleError parseTerm_();
+	const RuleError parseFactor_();
+	const RuleError emit_(const uint8_t opcode, const uint8_t field = 0, const uint8_t constant = 0);
+	const RuleError addConstant_(const float value, uint8_t &index);
+
+	void skipSpace_();
+	const bool readWord_(char word[RULE_MAX_WORD]);
+	const bool acceptWord_(const char *word);
+	const bool acceptChar_(const char c);
+	const bool readNumber_(float &value);
+	const bool readComparison_(uint8_t &opcode);
+	const bool isEndOfRule_();
+};
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ * @file RuleError.h
+ * @author TheRealKasumi
+ * @brief Contains the errors of the rule compiler.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef RULE_ERROR_H
+#define RULE_ERROR_H
+
+enum RuleError
+{
+	RULE_OK,
+	RULE_ERR_SYNTAX,
+	RULE_ERR_UNKNOWN_OUTPUT,
+	RULE_ERR_UNKNOWN_FIELD,
+	RULE_ERR_EXPECTED_NUMBER,
+	RULE_ERR_TOO_MANY_RULES,
+	RULE_ERR_TOO_COMPLEX
+};
+
+#endif
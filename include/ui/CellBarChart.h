@@ -0,0 +1,157 @@
+/**
+ * @file CellBarChart.h
+ * @author TheRealKasumi
+ * @brief Contains a bar chart of the cell voltages for the e-ink display.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CELL_BAR_CHART_H
+#define CELL_BAR_CHART_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsCellTable.h"
+#include "bms/SmartBmsData.h"
+
+// Space for the labels of the limits on the left and the cell numbers at the bottom
+#define CELL_CHART_LABEL_WIDTH 24
+#define CELL_CHART_NUMBER_HEIGHT 10
+
+/**
+ * Every cell is a bar from the bottom of the chart to its voltage.
+ * The minimum and maximum cell voltage of the BMS are dashed lines, the balance voltage is a dotted line.
+ * Cells at or above the balance voltage are drawn as outlined bars.
+ * Bars are written directly into the buffer of a 1 bit canvas, a whole byte at a time.
+ */
+class CellBarChart
+{
+public:
+	CellBarChart();
+	~CellBarChart();
+
+	void begin(const int16_t x, const int16_t y, const uint16_t width, const uint16_t height);
+
+	/**
+	 * @brief Draw the chart.
+	 * @param canvas Adafruit GFXcanvas1 compatible canvas without rotation
+	 * @param cellTable voltages of the cells
+	 * @param smartBmsData limits of the cell voltage
+	 * @param foreground color of the bars and lines
+	 * @param background color of the background
+	 */
+	template <typename Canvas>
+	void draw(Canvas &canvas, const SmartBmsCellTable &cellTable, const SmartBmsData &smartBmsData, const uint16_t foreground, const uint16_t background) const
+	{
+		canvas.fillRect(this->x_, this->y_, this->width_, this->height_, background);
+		const uint8_t cellCount = cellTable.getCellCount();
+		if (cellCount == 0 || this->width_ <= CELL_CHART_LABEL_WIDTH)
+		{
+			return;
+		}
+
+		// Scale that includes all cells and the limits of the BMS
+		float scaleMin = smartBmsData.getCellVoltageMin();
+		float scaleMax = smartBmsData.getCellVoltageMax();
+		for (uint8_t i = 0; i < cellCount; i++)
+		{
+			if (cellTable.isCellValid(i))
+			{
+				scaleMin = cellTable.getCellVoltage(i) < scaleMin ? cellTable.getCellVoltage(i) : scaleMin;
+				scaleMax = cellTable.getCellVoltage(i) > scaleMax ? cellTable.getCellVoltage(i) : scaleMax;
+			}
+		}
+		scaleMin -= 0.05f;
+		scaleMax += 0.05f;
+
+		const int16_t chartX = this->x_ + CELL_CHART_LABEL_WIDTH;
+		const uint16_t chartWidth = this->width_ - CELL_CHART_LABEL_WIDTH;
+		const int16_t chartBottom = this->y_ + this->height_ - CELL_CHART_NUMBER_HEIGHT - 1;
+		const uint16_t slot = this->getSlotWidth_(chartWidth, cellCount);
+		const uint16_t barWidth = slot >= 16 ? slot - 8 : (slot > 2 ? slot - 2 : 1);
+		const bool rotated = canvas.getRotation() != 0;
+		const bool foregroundBits = foreground != 0;
+		for (uint8_t i = 0; i < cellCount; i++)
+		{
+			const int16_t barX = chartX + i * slot;
+			if (cellTable.isCellValid(i))
+			{
+				const int16_t top = this->toPixel_(cellTable.getCellVoltage(i), scaleMin, scaleMax);
+				if (rotated)
+				{
+					canvas.fillRect(barX, top, barWidth, chartBottom - top + 1, foreground);
+				}
+				else
+				{
+					fillBytes_(canvas.getBuffer(), canvas.width(), barX, top, barWidth, chartBottom - top + 1, foregroundBits);
+					if (cellTable.getCellVoltage(i) >= smartBmsData.getCellVoltageBalance() && barWidth > 2 && chartBottom - top > 1)
+					{
+						fillBytes_(canvas.getBuffer(), canvas.width(), barX + 1, top + 1, barWidth - 2, chartBottom - top - 1, !foregroundBits);
+					}
+				}
+			}
+
+			// Number of the cell below its bar, only every fourth one if there is no space
+			if (slot >= 12 || i % 4 == 0)
+			{
+				canvas.setFont(nullptr);
+				canvas.setTextColor(foreground);
+				canvas.setCursor(barX, chartBottom + 2);
+				canvas.print(i + 1);
+			}
+		}
+
+		// Limits of the BMS
+		this->drawMarker_(canvas, chartX, chartWidth, this->toPixel_(smartBmsData.getCellVoltageMax(), scaleMin, scaleMax), "max", 6, foreground);
+		this->drawMarker_(canvas, chartX, chartWidth, this->toPixel_(smartBmsData.getCellVoltageBalance(), scaleMin, scaleMax), "bal", 2, foreground);
+		this->drawMarker_(canvas, chartX, chartWidth, this->toPixel_(smartBmsData.getCellVoltageMin(), scaleMin, scaleMax), "min", 6, foreground);
+	}
+
+private:
+	int16_t x_;
+	int16_t y_;
+	uint16_t width_;
+	uint16_t height_;
+
+	/**
+	 * @brief Draw a horizontal line with a label on the left side.
+	 * @param canvas canvas to draw on
+	 * @param chartX left edge of the bars
+	 * @param chartWidth width of the bars
+	 * @param y row of the line
+	 * @param label label of the line
+	 * @param dash length of the dashes
+	 * @param color color of the line and label
+	 */
+	template <typename Canvas>
+	void drawMarker_(Canvas &canvas, const int16_t chartX, const uint16_t chartWidth, const int16_t y, const char *label, const uint8_t dash, const uint16_t color) const
+	{
+		for (uint16_t i = 0; i < chartWidth; i += 2 * dash)
+		{
+			canvas.drawFastHLine(chartX + i, y, dash, color);
+		}
+		canvas.setFont(nullptr);
+		canvas.setTextColor(color);
+		canvas.setCursor(this->x_, y - 3);
+		canvas.print(label);
+	}
+
+	const uint16_t getSlotWidth_(const uint16_t chartWidth, const uint8_t cellCount) const;
+	const int16_t toPixel_(const float voltage, const float scaleMin, const float scaleMax) const;
+
+	static void fillBytes_(uint8_t *buffer, const uint16_t bufferWidth, const int16_t x, const int16_t y, const uint16_t width, const uint16_t height, const bool set);
+};
+
+#endif
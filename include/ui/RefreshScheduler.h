@@ -0,0 +1,117 @@
+/**
+ * @file RefreshScheduler.h
+ * @author TheRealKasumi
+ * @brief Contains a scheduler that decides when and how the e-ink display is refreshed.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef REFRESH_SCHEDULER_H
+#define REFRESH_SCHEDULER_H
+
+#include <stdint.h>
+
+#include "bms/SmartBmsData.h"
+
+// The refreshes per hour are counted in this many buckets
+#define REFRESH_HOUR_BUCKETS 12
+
+// Fields that are shown immediately when they change
+#define REFRESH_ALARM_MASK ((1UL << SBMS_FIELD_COMMUNICATION_ERROR) | (1UL << SBMS_FIELD_ALLOWED_TO_CHARGE) | (1UL << SBMS_FIELD_ALLOWED_TO_DISCHARGE) | \
+							(1UL << SBMS_FIELD_MIN_VOLTAGE_ALARM) | (1UL << SBMS_FIELD_MAX_VOLTAGE_ALARM) |                                      \
+							(1UL << SBMS_FIELD_MIN_TEMPERATURE_ALARM) | (1UL << SBMS_FIELD_MAX_TEMPERATURE_ALARM))
+
+enum DisplayRefresh
+{
+	DISPLAY_REFRESH_NONE,
+	DISPLAY_REFRESH_PARTIAL,
+	DISPLAY_REFRESH_FULL
+};
+
+enum RefreshReason
+{
+	REFRESH_REASON_NONE,
+	REFRESH_REASON_REDRAW,		// The screen was replaced or does not show the latest values
+	REFRESH_REASON_ALARM,		// An alarm or a permission changed
+	REFRESH_REASON_CHANGE,		// A value changed by more than its step
+	REFRESH_REASON_STABLE		// The values are stable, but the interval elapsed
+};
+
+struct RefreshSchedulerConfig
+{
+	uint32_t minIntervalMs;		// Shortest time between two refreshes for changed values
+	uint32_t maxIntervalMs;		// Longest time between two refreshes while the values are stable
+	uint32_t swingIntervalMs;	// Shortest time between two refreshes while the current swings
+	float voltageStep;			// Change of the pack voltage that counts as a change
+	float currentStep;			// Change of the pack current that counts as a change
+	uint8_t socStep;			// Change of the SOC that counts as a change
+	float cellVoltageStep;		// Change of the lowest or highest cell voltage that counts as a change
+	float temperatureStep;		// Change of the lowest or highest temperature that counts as a change
+	float swingCurrent;			// Change of the current between two frames that counts as a swing
+	uint8_t ghostingBudget;		// Partial refreshes of the whole screen until a full refresh, 0 for full refreshes only
+	uint32_t fullIntervalMs;	// Longest time between two full refreshes
+};
+
+/**
+ * Every frame is compared to the values that are currently shown.
+ * Alarms are shown immediately, changed values after the minimum interval and stable values with a growing interval.
+ * While the current swings, changes are only shown after the longer swing interval.
+ * Partial refreshes cost a ghosting budget in percent of the screen, a full refresh is due once it is used up.
+ * The caller must perform every refresh that update() returns and report all refreshes of the panel with onRefresh().
+ */
+class RefreshScheduler
+{
+public:
+	RefreshScheduler(const RefreshSchedulerConfig &config);
+	~RefreshScheduler();
+
+	const DisplayRefresh update(const SmartBmsData &smartBmsData, const uint32_t nowMs);
+	void onRefresh(const DisplayRefresh refresh, const uint32_t nowMs, const uint8_t area = 100);
+	void invalidate(const bool clean = true);
+
+	const RefreshReason getReason() const;
+	const uint32_t getInterval() const;
+	const uint8_t getGhostingLevel() const;
+	const uint32_t getFullRefreshCount() const;
+	const uint32_t getPartialRefreshCount() const;
+	const uint16_t getRefreshesPerHour() const;
+
+	static const char *getReasonName(const RefreshReason reason);
+
+private:
+	RefreshSchedulerConfig config_;
+	SmartBmsData shown_;
+	bool hasShown_;
+	bool cleanRedraw_;
+	float previousCurrent_;
+	bool hasPrevious_;
+	bool swinging_;
+	uint32_t lastSwingMs_;
+	uint32_t lastRefreshMs_;
+	uint32_t lastFullMs_;
+	uint32_t interval_;
+	uint16_t ghosting_;
+	RefreshReason reason_;
+	uint32_t fullCount_;
+	uint32_t partialCount_;
+	uint16_t hourBuckets_[REFRESH_HOUR_BUCKETS];
+	uint8_t bucketIndex_;
+	uint32_t bucketStartMs_;
+
+	const bool isChanged_(const SmartBmsData &smartBmsData) const;
+	void advanceBuckets_(const uint32_t nowMs);
+};
+
+#endif
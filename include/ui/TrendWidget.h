@@ -0,0 +1,125 @@
+/**
+ * @file TrendWidget.h
+ * @author TheRealKasumi
+ * @brief Contains a sparkline of a history channel for the e-ink display.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef TREND_WIDGET_H
+#define TREND_WIDGET_H
+
+#include <stdint.h>
+
+#include "history/HistoryQuery.h"
+#include "history/HistorySample.h"
+
+// Maximum width of the widget in pixels
+#ifndef TREND_MAX_WIDTH
+#define TREND_MAX_WIDTH 384
+#endif
+
+/**
+ * Every pixel column covers a fixed time span and shows the range of the values in that span as a vertical line.
+ * The columns are appended from the left, once the widget is full it scrolls by one column per time span.
+ * The widget tracks which columns changed, so only that part of the display needs a partial refresh.
+ * Without a fixed scale, the scale follows the visible values and always includes zero.
+ */
+class TrendWidget
+{
+public:
+	TrendWidget();
+	~TrendWidget();
+
+	void begin(const int16_t x, const int16_t y, const uint16_t width, const uint16_t height, const HistoryChannel channel, const uint32_t spanMs,
+			   const float scaleMin = 0.0f, const float scaleMax = 0.0f);
+	void add(const int64_t timeMs, const float value);
+	void add(const HistorySample &sample);
+	void load(HistoryQuery &historyQuery, const int64_t nowMs);
+	void clear();
+
+	const bool isDirty() const;
+	const int16_t getDirtyX() const;
+	const uint16_t getDirtyWidth() const;
+	void clearDirty();
+
+	const int16_t getX() const;
+	const int16_t getY() const;
+	const uint16_t getWidth() const;
+	const uint16_t getHeight() const;
+
+	/**
+	 * @brief Draw the widget.
+	 * @param gfx Adafruit GFX compatible display or canvas
+	 * @param foreground color of the lines
+	 * @param background color of the background
+	 */
+	template <typename Gfx>
+	void draw(Gfx &gfx, const uint16_t foreground, const uint16_t background) const
+	{
+		gfx.fillRect(this->x_, this->y_, this->width_, this->height_, background);
+
+		// Dotted zero line if the scale includes negative values
+		if (this->scaleMin_ < 0.0f && this->scaleMax_ > 0.0f)
+		{
+			const int16_t zero = this->toPixel_(0.0f);
+			for (uint16_t i = 0; i < this->width_; i += 4)
+			{
+				gfx.drawPixel(this->x_ + i, zero, foreground);
+			}
+		}
+
+		for (uint16_t i = 0; i < this->count_; i++)
+		{
+			const Column &column = this->columns_[(this->head_ + TREND_MAX_WIDTH + 1 - this->count_ + i) % TREND_MAX_WIDTH];
+			if (column.min <= column.max)
+			{
+				const int16_t top = this->toPixel_(column.max);
+				gfx.drawFastVLine(this->x_ + i, top, this->toPixel_(column.min) - top + 1, foreground);
+			}
+		}
+	}
+
+private:
+	struct Column
+	{
+		float min;
+		float max;
+	};
+
+	int16_t x_;
+	int16_t y_;
+	uint16_t width_;
+	uint16_t height_;
+	HistoryChannel channel_;
+	uint32_t columnMs_;
+	bool fixedScale_;
+	float scaleMin_;
+	float scaleMax_;
+	Column columns_[TREND_MAX_WIDTH];
+	uint16_t head_;
+	uint16_t count_;
+	int64_t headSlot_;
+	uint16_t dirtyFrom_;
+	uint16_t dirtyTo_;
+
+	void markDirty_(const uint16_t from, const uint16_t to);
+	const bool updateScale_();
+	const int16_t toPixel_(const float value) const;
+
+	static void writePoint_(const HistoryPoint &point, void *context);
+};
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file BitStream.h
+ * @author TheRealKasumi
+ * @brief Contains classes that write and read values with an arbitrary number of bits.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef BIT_STREAM_H
+#define BIT_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Writes values MSB first into a byte buffer, the buffer must be zeroed before it is written.
+ */
+class BitWriter
+{
+public:
+	BitWriter();
+	~BitWriter();
+
+	void begin(uint8_t *buffer, const size_t size, const size_t bitCount = 0);
+	const bool write(const uint32_t value, const uint8_t bits);
+
+	const size_t getBitCount() const;
+	const size_t getFreeBits() const;
+
+private:
+	uint8_t *buffer_;
+	size_t capacity_;
+	size_t bitCount_;
+};
+
+/**
+ * Reads values that were written by the BitWriter.
+ */
+class BitReader
+{
+public:
+	BitReader();
+	~BitReader();
+
+	void begin(const uint8_t *buffer, const size_t bitCount);
+	void setBitCount(const size_t bitCount);
+	const bool read(uint32_t &value, const uint8_t bits);
+
+	const size_t getPosition() const;
+
+private:
+	const uint8_t *buffer_;
+	size_t bitCount_;
+	size_t position_;
+};
+
+#endif
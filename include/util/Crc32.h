@@ -0,0 +1,43 @@
+/**
+ * @file Crc32.h
+ * @author TheRealKasumi
+ * @brief Contains a class to calculate the CRC-32 checksum used by gzip and zlib.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Crc32
+{
+public:
+	Crc32();
+	~Crc32();
+
+	void update(const uint8_t *data, const size_t length);
+	void reset();
+	const uint32_t getValue() const;
+
+	static const uint32_t calculate(const uint8_t *data, const size_t length);
+
+private:
+	uint32_t crc_;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file GzipEncoder.h
+ * @author TheRealKasumi
+ * @brief Contains a small gzip compressor for text payloads.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef GZIP_ENCODER_H
+#define GZIP_ENCODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Size of the match finder hash table as power of 2
+#ifndef GZIP_HASH_BITS
+#define GZIP_HASH_BITS 11
+#endif
+
+// Largest input that can be compressed at once
+#define GZIP_MAX_INPUT 65534
+
+/**
+ * Compresses a complete buffer into a single deflate block with the fixed Huffman codes
+ * and greedy LZ77 matching. This gets most of the gain on repetitive text like line
+ * protocol, but needs only a small hash table instead of the ~300 KB of a full zlib state.
+ */
+class GzipEncoder
+{
+public:
+	GzipEncoder();
+	~GzipEncoder();
+
+	const size_t compress(const uint8_t *input, const size_t length, uint8_t *output, const size_t capacity);
+
+private:
+	uint16_t hashHead_[1 << GZIP_HASH_BITS];
+	uint8_t *output_;
+	size_t capacity_;
+	size_t length_;
+	uint32_t bitBuffer_;
+	uint8_t bitCount_;
+	bool overflow_;
+
+	void putByte_(const uint8_t value);
+	void putBits_(const uint32_t value, const uint8_t count);
+	void putCode_(const uint16_t code, const uint8_t count);
+	void putSymbol_(const uint16_t symbol);
+	void putMatch_(const uint16_t length, const uint16_t distance);
+	void flushBits_();
+	const uint16_t hash_(const uint8_t *data) const;
+};
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * @file LogHistogram.h
+ * @author TheRealKasumi
+ * @brief Contains a histogram with logarithmic buckets for latency measurements.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LOG_HISTOGRAM_H
+#define LOG_HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Bucket i counts the values that need i bits, so bucket 0 only counts 0 and bucket 31 the largest values
+#define LOG_HISTOGRAM_BUCKETS 33
+
+/**
+ * Recording only increments one bucket, so it can be used on the hot path.
+ * There must only be a single writer, but any task may read.
+ */
+class LogHistogram
+{
+public:
+	LogHistogram();
+	~LogHistogram();
+
+	void record(const uint32_t value);
+	void reset();
+
+	const uint32_t getBucketCount(const uint8_t bucket) const;
+	const uint32_t getCount() const;
+	const uint64_t getSum() const;
+	const uint32_t getMax() const;
+	const uint32_t getPercentile(const float percentile) const;
+
+	static const uint32_t getUpperBound(const uint8_t bucket);
+
+private:
+	std::atomic<uint32_t> buckets_[LOG_HISTOGRAM_BUCKETS];
+	std::atomic<uint32_t> count_;
+	std::atomic<uint32_t> sumLow_;
+	std::atomic<uint32_t> sumHigh_;
+	std::atomic<uint32_t> max_;
+};
+
+#endif
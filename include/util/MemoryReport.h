@@ -0,0 +1,62 @@
+/**
+ * @file MemoryReport.h
+ * @author TheRealKasumi
+ * @brief Contains a class that reports heap, stack and static memory use.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MEMORY_REPORT_H
+#define MEMORY_REPORT_H
+
+#ifdef ARDUINO
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MEMORY_REPORT_MAX_TASKS 12
+#define MEMORY_REPORT_MAX_OBJECTS 16
+
+/**
+ * Tasks are looked up by name when the report is formatted, so tasks that are not running are skipped.
+ * Static objects are registered with their size, e.g. the display with its frame buffer.
+ * The flash and RAM use per module at build time is reported by tools/memory_map.py.
+ */
+class MemoryReport
+{
+public:
+	MemoryReport();
+	~MemoryReport();
+
+	void addTask(const char *name);
+	void addObject(const char *name, const size_t size);
+	const size_t format(char *buffer, const size_t size) const;
+
+private:
+	struct Object
+	{
+		const char *name;
+		size_t size;
+	};
+
+	const char *taskNames_[MEMORY_REPORT_MAX_TASKS];
+	uint8_t taskCount_;
+	Object objects_[MEMORY_REPORT_MAX_OBJECTS];
+	uint8_t objectCount_;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * @file Profiler.h
+ * @author TheRealKasumi
+ * @brief Contains a lightweight profiler that keeps a cycle count histogram per stage.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The profiler is only compiled in with -DSBMS_PROFILING in the build_flags of platformio.ini.
+ * Without it, all macros expand to nothing and no memory is used.
+ *
+ * On the ESP32, time is measured in µs with esp_timer. The CCOUNT register would be finer, but
+ * it follows the CPU frequency, which the PowerManager changes between and during the stages.
+ * A measurement costs about 1 µs and one histogram increment, far below 1 % of any stage.
+ * On the host, std::chrono::steady_clock in ns is used instead.
+ */
+enum ProfileStage
+{
+	PROFILE_STAGE_DECODE,
+	PROFILE_STAGE_SERIAL_DUMP,
+	PROFILE_STAGE_PUBLISH,
+	PROFILE_STAGE_RASTERIZE,
+	PROFILE_STAGE_SPI_TRANSFER,
+	PROFILE_STAGE_REFRESH,
+	PROFILE_STAGE_COUNT
+};
+
+#ifdef SBMS_PROFILING
+
+#include "util/LogHistogram.h"
+
+#if defined(__XTENSA__)
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+class Profiler
+{
+public:
+	/**
+	 * @brief Get the current time in ticks.
+	 * @return µs on the ESP32, ns on the host
+	 */
+	static inline uint32_t now()
+	{
+#if defined(__XTENSA__)
+		return static_cast<uint32_t>(esp_timer_get_time());
+#else
+		return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+	}
+
+	static void record(const ProfileStage stage, const uint32_t ticks);
+	static void reset();
+
+	static const LogHistogram &getHistogram(const ProfileStage stage);
+	static const char *getStageName(const ProfileStage stage);
+	static const uint32_t getTicksPerUs();
+	static const size_t format(char *buffer, const size_t size);
+
+private:
+	static LogHistogram histograms_[PROFILE_STAGE_COUNT];
+};
+
+/**
+ * Measures the lifetime of the scope.
+ */
+class ProfileScope
+{
+public:
+	ProfileScope(const ProfileStage stage)
+	{
+		this->stage_ = stage;
+		this->start_ = Profiler::now();
+	}
+
+	~ProfileScope()
+	{
+		Profiler::record(this->stage_, Profiler::now() - this->start_);
+	}
+
+private:
+	ProfileStage stage_;
+	uint32_t start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_NAME_(line) PROFILE_CONCAT_(profileScope, line)
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_NAME_(__LINE__)(stage)
+#define PROFILE_BEGIN(id) const uint32_t profileStart_##id = Profiler::now()
+#define PROFILE_END(id, stage) Profiler::record(stage, Profiler::now() - profileStart_##id)
+#define PROFILE_RECORD(stage, ticks) Profiler::record(stage, ticks)
+
+#else
+
+#define PROFILE_SCOPE(stage)
+#define PROFILE_BEGIN(id)
+#define PROFILE_END(id, stage)
+#define PROFILE_RECORD(stage, ticks)
+
+#endif
+
+#endif
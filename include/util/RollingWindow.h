@@ -0,0 +1,82 @@
+/**
+ * @file RollingWindow.h
+ * @author TheRealKasumi
+ * @brief Contains a sliding window that tracks the minimum, maximum and mean of a value.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef ROLLING_WINDOW_H
+#define ROLLING_WINDOW_H
+
+#include <stdint.h>
+
+// Number of buckets per window, the window slides in steps of one bucket
+#ifndef ROLLING_WINDOW_BUCKETS
+#define ROLLING_WINDOW_BUCKETS 60
+#endif
+
+/**
+ * Samples are merged into buckets of window / ROLLING_WINDOW_BUCKETS, so the memory does not depend on the sample rate.
+ * The completed buckets are kept in a ring, the minimum and maximum are the fronts of two monotonic deques
+ * of that ring and the mean comes from a running sum. Adding a sample is O(1) amortized.
+ * The window covers the completed buckets of the last window length plus the current bucket.
+ */
+class RollingWindow
+{
+public:
+	RollingWindow();
+	~RollingWindow();
+
+	void setLength(const uint32_t lengthMs);
+	void add(const float value, const uint32_t nowMs);
+	void reset();
+
+	const uint32_t getLength() const;
+	const uint32_t getCount() const;
+	const float getMin() const;
+	const float getMax() const;
+	const float getMean() const;
+
+private:
+	struct Bucket
+	{
+		uint32_t index;
+		float min;
+		float max;
+		float sum;
+		uint32_t count;
+	};
+
+	uint32_t lengthMs_;
+	uint32_t bucketMs_;
+	Bucket current_;
+	Bucket buckets_[ROLLING_WINDOW_BUCKETS];
+	uint8_t head_;
+	uint8_t count_;
+	uint8_t minDeque_[ROLLING_WINDOW_BUCKETS];
+	uint8_t minHead_;
+	uint8_t minCount_;
+	uint8_t maxDeque_[ROLLING_WINDOW_BUCKETS];
+	uint8_t maxHead_;
+	uint8_t maxCount_;
+	double sum_;
+	uint32_t samples_;
+
+	void close_();
+	void expire_(const uint32_t index);
+};
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file SeqLock.h
+ * @author TheRealKasumi
+ * @brief Contains a sequence lock to share a value between one writer and many readers.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SEQ_LOCK_H
+#define SEQ_LOCK_H
+
+#include <stdint.h>
+#include <atomic>
+
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+/**
+ * The writer never waits and readers never block the writer.
+ * A reader retries until it got a copy that was not modified while it was copied.
+ * There must only be a single writer.
+ */
+template <typename T>
+class SeqLock
+{
+public:
+	SeqLock()
+	{
+		this->sequence_.store(0, std::memory_order_relaxed);
+	}
+
+	~SeqLock()
+	{
+	}
+
+	/**
+	 * @brief Publish a new value.
+	 * @param value value to publish
+	 */
+	void write(const T &value)
+	{
+		const uint32_t sequence = this->sequence_.load(std::memory_order_relaxed);
+		this->sequence_.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		this->value_ = value;
+		this->sequence_.store(sequence + 2, std::memory_order_release);
+	}
+
+	/**
+	 * @brief Read a consistent copy of the latest value.
+	 * @param value reference that will receive the copy
+	 * @return sequence number of the copy, it increases by 2 with every write
+	 */
+	const uint32_t read(T &value) const
+	{
+		uint8_t retries = 0;
+		while (true)
+		{
+			const uint32_t before = this->sequence_.load(std::memory_order_acquire);
+			if ((before & 1) == 0)
+			{
+				value = this->value_;
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (this->sequence_.load(std::memory_order_relaxed) == before)
+				{
+					return before;
+				}
+			}
+
+			// The writer may have been preempted on the same core, give it time to finish
+			if (++retries >= 8)
+			{
+				retries = 0;
+#ifdef ARDUINO
+				vTaskDelay(1);
+#else
+				std::this_thread::yield();
+#endif
+			}
+		}
+	}
+
+	/**
+	 * @brief Get the sequence number of the latest value without copying it.
+	 * @return sequence number of the latest value
+	 */
+	const uint32_t getSequence() const
+	{
+		return this->sequence_.load(std::memory_order_acquire) & ~1UL;
+	}
+
+private:
+	std::atomic<uint32_t> sequence_;
+	T value_;
+};
+
+#endif
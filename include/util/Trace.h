@@ -0,0 +1,111 @@
+/**
+ * @file Trace.h
+ * @author TheRealKasumi
+ * @brief Contains a per core trace buffer for begin, end and instant events.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Events of the pipeline. New events must be appended, the names are part of the dump.
+ */
+enum TraceEvent
+{
+	TRACE_UART_RECEIVE,
+	TRACE_DECODE,
+	TRACE_OUTPUTS,
+	TRACE_QUEUE_SEND,
+	TRACE_QUEUE_RECEIVE,
+	TRACE_PUBLISH,
+	TRACE_RASTERIZE,
+	TRACE_DISPLAY_UPDATE,
+	TRACE_LINK_STATE,
+	TRACE_INFLUX_UPLOAD,
+	TRACE_EVENT_COUNT
+};
+
+/**
+ * Tracing is only compiled in with -DSBMS_TRACING in the build_flags of platformio.ini.
+ * Without it, all macros expand to nothing and no memory is used.
+ *
+ * Every core writes into its own ring, a slot is claimed with a single atomic increment,
+ * so there is no lock and tasks or interrupts on the same core can not corrupt each other.
+ * The oldest events are overwritten. Timestamps are µs of the system timer, which is shared by both cores.
+ * The dump consists of text lines that tools/trace2json.py converts into Chrome trace_event JSON.
+ */
+#ifdef SBMS_TRACING
+
+#include <atomic>
+
+// Number of events per core
+#ifndef TRACE_EVENTS_PER_CORE
+#define TRACE_EVENTS_PER_CORE 512
+#endif
+
+#define TRACE_CORES 2
+
+class Trace
+{
+public:
+	enum Phase
+	{
+		TRACE_PHASE_BEGIN = 'B',
+		TRACE_PHASE_END = 'E',
+		TRACE_PHASE_INSTANT = 'i'
+	};
+
+	static void record(const TraceEvent event, const Phase phase, const uint32_t argument = 0);
+	static void setEnabled(const bool enabled);
+	static const bool isEnabled();
+	static void clear();
+	static void dump(void (*writeLine)(const char *line));
+
+	static const char *getEventName(const TraceEvent event);
+	static const size_t getBufferSize();
+
+private:
+	struct Record
+	{
+		uint32_t timestampUs;
+		uint16_t event;
+		uint8_t phase;
+		uint8_t core;
+		uint32_t argument;
+	};
+
+	static Record records_[TRACE_CORES][TRACE_EVENTS_PER_CORE];
+	static std::atomic<uint32_t> heads_[TRACE_CORES];
+	static std::atomic<bool> enabled_;
+};
+
+#define TRACE_BEGIN(event) Trace::record(event, Trace::TRACE_PHASE_BEGIN)
+#define TRACE_END(event) Trace::record(event, Trace::TRACE_PHASE_END)
+#define TRACE_INSTANT(event, argument) Trace::record(event, Trace::TRACE_PHASE_INSTANT, argument)
+
+#else
+
+#define TRACE_BEGIN(event)
+#define TRACE_END(event)
+#define TRACE_INSTANT(event, argument)
+
+#endif
+
+#endif
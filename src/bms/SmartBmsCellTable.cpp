@@ -0,0 +1,119 @@
+/**
+ * @file SmartBmsCellTable.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of SmartBmsCellTable.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "bms/SmartBmsCellTable.h"
+
+/**
+ * @brief Create a new instance of SmartBmsCellTable.
+ */
+SmartBmsCellTable::SmartBmsCellTable()
+{
+	this->clear();
+}
+
+/**
+ * @brief Destroy the SmartBmsCellTable instance.
+ */
+SmartBmsCellTable::~SmartBmsCellTable()
+{
+}
+
+/**
+ * @brief Store the cell specific data of a frame. Each frame only contains the data of a single cell.
+ * @param smartBmsData decoded frame
+ */
+void SmartBmsCellTable::update(const SmartBmsData &smartBmsData)
+{
+	// Forget all cells when the pack layout changed
+	const uint8_t cellCount = smartBmsData.getCellCount() < SBMS_MAX_CELLS ? smartBmsData.getCellCount() : SBMS_MAX_CELLS;
+	if (cellCount != this->cellCount_)
+	{
+		this->clear();
+		this->cellCount_ = cellCount;
+	}
+
+	// Cell numbers start at 1, 0 means that the frame carries no cell data
+	const uint8_t cellNumber = smartBmsData.getCellNumber();
+	if (cellNumber == 0 || cellNumber > this->cellCount_)
+	{
+		return;
+	}
+
+	const uint8_t index = cellNumber - 1;
+	this->cellVoltage_[index] = smartBmsData.getCellVoltage();
+	this->cellTemperature_[index] = smartBmsData.getCellTemperature();
+	this->validMask_[index / 32] |= 1UL << (index % 32);
+}
+
+/**
+ * @brief Forget all cell data.
+ */
+void SmartBmsCellTable::clear()
+{
+	this->cellCount_ = 0;
+	for (uint8_t i = 0; i < sizeof(this->validMask_) / sizeof(this->validMask_[0]); i++)
+	{
+		this->validMask_[i] = 0;
+	}
+	for (uint8_t i = 0; i < SBMS_MAX_CELLS; i++)
+	{
+		this->cellVoltage_[i] = 0.0f;
+		this->cellTemperature_[i] = 0.0f;
+	}
+}
+
+/**
+ * @brief Get the number of cells in the table.
+ * @return number of cells, limited to SBMS_MAX_CELLS
+ */
+const uint8_t SmartBmsCellTable::getCellCount() const
+{
+	return this->cellCount_;
+}
+
+/**
+ * @brief Check if data for a cell was received already.
+ * @param index zero based index of the cell
+ * @return true when the cell data is valid
+ */
+const bool SmartBmsCellTable::isCellValid(const uint8_t index) const
+{
+	return index < this->cellCount_ && (this->validMask_[index / 32] & (1UL << (index % 32)));
+}
+
+/**
+ * @brief Get the voltage of a cell.
+ * @param index zero based index of the cell
+ * @return voltage in V or 0.0 when not known
+ */
+const float SmartBmsCellTable::getCellVoltage(const uint8_t index) const
+{
+	return this->isCellValid(index) ? this->cellVoltage_[index] : 0.0f;
+}
+
+/**
+ * @brief Get the temperature of a cell.
+ * @param index zero based index of the cell
+ * @return temperature in °C or 0.0 when not known
+ */
+const float SmartBmsCellTable::getCellTemperature(const uint8_t index) const
+{
+	return this->isCellValid(index) ? this->cellTemperature_[index] : 0.0f;
+}
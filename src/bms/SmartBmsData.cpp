@@ -20,6 +20,8 @@
  */
 #include "bms/SmartBmsData.h"
 
+#include <stdio.h>
+
 /**
  * @brief Create a new instance of SmartBmsData.
  */
@@ -51,6 +53,9 @@ SmartBmsData::SmartBmsData()
 	this->maxVoltageAlarmActive_ = 0;
 	this->minTemperatureAlarmActive_ = 0;
 	this->maxTemperatureAlarmActive_ = 0;
+	this->cellNumber_ = 0;
+	this->cellVoltage_ = 0.0f;
+	this->cellTemperature_ = 0.0f;
 }
 
 /**
@@ -189,3 +194,209 @@ const bool SmartBmsData::isMaxTemperatureAlarmActive() const
 {
 	return this->maxTemperatureAlarmActive_;
 }
+
+/**
+ * @brief Get the number of the cell whose data was appended to this frame.
+ * Only one between module adds its cell data per cycle.
+ * @return cell number starting at 1 or 0 if the frame contains no cell data
+ */
+const uint8_t SmartBmsData::getCellNumber() const
+{
+	return this->cellNumber_;
+}
+
+const float SmartBmsData::getCellVoltage() const
+{
+	return this->cellVoltage_;
+}
+
+const float SmartBmsData::getCellTemperature() const
+{
+	return this->cellTemperature_;
+}
+
+/**
+ * @brief Get the value of a single field as float. Flags are returned as 0.0 or 1.0.
+ * @param field field to read
+ * @return value of the field or 0.0 for an unknown field
+ */
+const float SmartBmsData::getFieldValue(const SmartBmsField field) const
+{
+	switch (field)
+	{
+	case SBMS_FIELD_CELL_COUNT:
+		return this->cellCount_;
+	case SBMS_FIELD_CELL_VOLTAGE_MIN:
+		return this->cellVoltageMin_;
+	case SBMS_FIELD_CELL_VOLTAGE_MAX:
+		return this->cellVoltageMax_;
+	case SBMS_FIELD_CELL_VOLTAGE_BALANCE:
+		return this->cellVoltageBalance_;
+	case SBMS_FIELD_PACK_SOC:
+		return this->packSoc_;
+	case SBMS_FIELD_PACK_VOLTAGE:
+		return this->packVoltage_;
+	case SBMS_FIELD_PACK_CURRENT:
+		return this->packCurrent_;
+	case SBMS_FIELD_PACK_CHARGE_CURRENT:
+		return this->packChargeCurrent_;
+	case SBMS_FIELD_PACK_DISCHARGE_CURRENT:
+		return this->packDischargeCurrent_;
+	case SBMS_FIELD_PACK_CAPACITY:
+		return this->packCapacity_;
+	case SBMS_FIELD_PACK_REMAINING_ENERGY:
+		return this->packRemainingEnergy_;
+	case SBMS_FIELD_LOWEST_CELL_VOLTAGE:
+		return this->lowestCellVoltage_;
+	case SBMS_FIELD_LOWEST_CELL_VOLTAGE_NUMBER:
+		return this->lowestCellVoltageNumber_;
+	case SBMS_FIELD_HIGHEST_CELL_VOLTAGE:
+		return this->highestCellVoltage_;
+	case SBMS_FIELD_HIGHEST_CELL_VOLTAGE_NUMBER:
+		return this->highestCellVoltageNumber_;
+	case SBMS_FIELD_LOWEST_CELL_TEMPERATURE:
+		return this->lowestCellTemperature_;
+	case SBMS_FIELD_LOWEST_CELL_TEMPERATURE_NUMBER:
+		return this->lowestCellTemperatureNumber_;
+	case SBMS_FIELD_HIGHEST_CELL_TEMPERATURE:
+		return this->highestCellTemperature_;
+	case SBMS_FIELD_HIGHEST_CELL_TEMPERATURE_NUMBER:
+		return this->highestCellTemperatureNumber_;
+	case SBMS_FIELD_COMMUNICATION_ERROR:
+		return this->communicationError_;
+	case SBMS_FIELD_ALLOWED_TO_CHARGE:
+		return this->allowedToCharge_;
+	case SBMS_FIELD_ALLOWED_TO_DISCHARGE:
+		return this->allowedToDischarge_;
+	case SBMS_FIELD_MIN_VOLTAGE_ALARM:
+		return this->minVoltageAlarmActive_;
+	case SBMS_FIELD_MAX_VOLTAGE_ALARM:
+		return this->maxVoltageAlarmActive_;
+	case SBMS_FIELD_MIN_TEMPERATURE_ALARM:
+		return this->minTemperatureAlarmActive_;
+	case SBMS_FIELD_MAX_TEMPERATURE_ALARM:
+		return this->maxTemperatureAlarmActive_;
+	case SBMS_FIELD_CELL_NUMBER:
+		return this->cellNumber_;
+	case SBMS_FIELD_CELL_VOLTAGE:
+		return this->cellVoltage_;
+	case SBMS_FIELD_CELL_TEMPERATURE:
+		return this->cellTemperature_;
+	default:
+		return 0.0f;
+	}
+}
+
+/**
+ * @brief Compare this data with another instance.
+ * @param other data to compare with, usually the previous frame
+ * @return bit mask with one bit set per field that differs, see SmartBmsField
+ */
+const uint32_t SmartBmsData::getChangeMask(const SmartBmsData &other) const
+{
+	uint32_t mask = 0;
+	for (uint8_t i = 0; i < SBMS_FIELD_COUNT; i++)
+	{
+		const SmartBmsField field = static_cast<SmartBmsField>(i);
+		if (this->getFieldValue(field) != other.getFieldValue(field))
+		{
+			mask |= 1UL << i;
+		}
+	}
+	return mask;
+}
+
+/**
+ * @brief Serialize the data into a flat JSON object.
+ * @param buffer buffer that will receive the zero terminated JSON
+ * @param size size of the buffer in bytes
+ * @param fieldMask bit mask of the fields to include, see SmartBmsField
+ * @return length of the JSON without the terminator or 0 when the buffer is too small
+ */
+const size_t SmartBmsData::toJson(char *buffer, const size_t size, const uint32_t fieldMask) const
+{
+	if (size < 3)
+	{
+		return 0;
+	}
+
+	// Append one key value pair per selected field
+	size_t length = 0;
+	buffer[length++] = '{';
+	for (uint8_t i = 0; i < SBMS_FIELD_COUNT; i++)
+	{
+		if (!(fieldMask & (1UL << i)))
+		{
+			continue;
+		}
+
+		const SmartBmsField field = static_cast<SmartBmsField>(i);
+		const char *separator = length > 1 ? "," : "";
+		int written;
+		if (field >= SBMS_FIELD_COMMUNICATION_ERROR && field <= SBMS_FIELD_MAX_TEMPERATURE_ALARM)
+		{
+			written = snprintf(&buffer[length], size - length, "%s\"%s\":%s", separator, SmartBmsData::getFieldName(field), this->getFieldValue(field) != 0.0f ? "true" : "false");
+		}
+		else
+		{
+			written = snprintf(&buffer[length], size - length, "%s\"%s\":%g", separator, SmartBmsData::getFieldName(field), this->getFieldValue(field));
+		}
+
+		// Bail out if the buffer was too small
+		if (written < 0 || static_cast<size_t>(written) >= size - length)
+		{
+			buffer[0] = '\0';
+			return 0;
+		}
+		length += written;
+	}
+
+	if (length + 2 > size)
+	{
+		buffer[0] = '\0';
+		return 0;
+	}
+	buffer[length++] = '}';
+	buffer[length] = '\0';
+	return length;
+}
+
+/**
+ * @brief Get the name of a field as used in serialized output.
+ * @param field field to get the name for
+ * @return zero terminated name of the field
+ */
+const char *SmartBmsData::getFieldName(const SmartBmsField field)
+{
+	static const char *const names[SBMS_FIELD_COUNT] = {
+		"cellCount",
+		"cellVoltageMin",
+		"cellVoltageMax",
+		"cellVoltageBalance",
+		"packSoc",
+		"packVoltage",
+		"packCurrent",
+		"packChargeCurrent",
+		"packDischargeCurrent",
+		"packCapacity",
+		"packRemainingEnergy",
+		"lowestCellVoltage",
+		"lowestCellVoltageNumber",
+		"highestCellVoltage",
+		"highestCellVoltageNumber",
+		"lowestCellTemperature",
+		"lowestCellTemperatureNumber",
+		"highestCellTemperature",
+		"highestCellTemperatureNumber",
+		"communicationError",
+		"allowedToCharge",
+		"allowedToDischarge",
+		"minVoltageAlarmActive",
+		"maxVoltageAlarmActive",
+		"minTemperatureAlarmActive",
+		"maxTemperatureAlarmActive",
+		"cellNumber",
+		"cellVoltage",
+		"cellTemperature"};
+	return field < SBMS_FIELD_COUNT ? names[field] : "";
+}
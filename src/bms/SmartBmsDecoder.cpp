@@ -0,0 +1,178 @@
+/**
+ * @file SmartBmsDecoder.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the SmartBmsDecoder class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "bms/SmartBmsDecoder.h"
+
+/**
+ * @brief Create a new instance of SmartBmsDecoder.
+ */
+SmartBmsDecoder::SmartBmsDecoder()
+{
+}
+
+/**
+ * @brief Destroy the SmartBmsDecoder instance.
+ */
+SmartBmsDecoder::~SmartBmsDecoder()
+{
+}
+
+/**
+ * @brief Decode a single frame.
+ * @param frame frame of 58 bytes
+ * @param smartBmsData reference to a SmartBmsData object that will receive the data
+ * @return SmartBmsError::SBMS_OK when the frame was decoded
+ * @return SmartBmsError::SBMS_ERR_INVALID_CHECKSUM when the checksum does not match, the data is not touched
+ */
+const SmartBmsError SmartBmsDecoder::decode(const uint8_t frame[SBMS_FRAME_SIZE], SmartBmsData *smartBmsData) const
+{
+	if (!SmartBmsDecoder::isChecksumValid(frame))
+	{
+		return SmartBmsError::SBMS_ERR_INVALID_CHECKSUM;
+	}
+
+	// Decode the BMS data from the buffer
+	smartBmsData->cellCount_ = frame[25];
+	smartBmsData->cellVoltageMin_ = this->decodeCellVoltage_(&frame[51]);
+	smartBmsData->cellVoltageMax_ = this->decodeCellVoltage_(&frame[53]);
+	smartBmsData->cellVoltageBalance_ = this->decodeCellVoltage_(&frame[55]);
+	smartBmsData->packSoc_ = frame[40];
+	smartBmsData->packVoltage_ = this->decodePackVoltage_(&frame[0]);
+	smartBmsData->packCurrent_ = this->decodePackCurrent_(&frame[9]);
+	smartBmsData->packChargeCurrent_ = this->decodePackCurrent_(&frame[3]);
+	smartBmsData->packDischargeCurrent_ = this->decodePackCurrent_(&frame[6]);
+	smartBmsData->packCapacity_ = this->decodeTwoByteValue_(&frame[49]) * 0.1f;
+	smartBmsData->packRemainingEnergy_ = this->decodeThreeByteValue_(&frame[34]) * 0.001f;
+	smartBmsData->lowestCellVoltage_ = this->decodeCellVoltage_(&frame[12]);
+	smartBmsData->lowestCellVoltageNumber_ = frame[14];
+	smartBmsData->highestCellVoltage_ = this->decodeCellVoltage_(&frame[15]);
+	smartBmsData->highestCellVoltageNumber_ = frame[17];
+	smartBmsData->lowestCellTemperature_ = this->decodeCellTemperature_(&frame[18]);
+	smartBmsData->lowestCellTemperatureNumber_ = frame[20];
+	smartBmsData->highestCellTemperature_ = this->decodeCellTemperature_(&frame[21]);
+	smartBmsData->highestCellTemperatureNumber_ = frame[23];
+	smartBmsData->communicationError_ = frame[30] & 0b00000100;
+	smartBmsData->allowedToCharge_ = frame[30] & 0b00000001;
+	smartBmsData->allowedToDischarge_ = frame[30] & 0b00000010;
+	smartBmsData->minVoltageAlarmActive_ = frame[30] & 0b00001000;
+	smartBmsData->maxVoltageAlarmActive_ = frame[30] & 0b00010000;
+	smartBmsData->minTemperatureAlarmActive_ = frame[30] & 0b00100000;
+	smartBmsData->maxTemperatureAlarmActive_ = frame[30] & 0b01000000;
+
+	// Cell specific data, added by one of the between modules per cycle
+	smartBmsData->cellNumber_ = frame[24];
+	smartBmsData->cellVoltage_ = this->decodeCellVoltage_(&frame[26]);
+	smartBmsData->cellTemperature_ = this->decodeCellTemperature_(&frame[28]);
+	return SmartBmsError::SBMS_OK;
+}
+
+/**
+ * @brief Check the checksum of a frame, it is the sum of all other bytes.
+ * @param frame frame of 58 bytes
+ * @return true when the checksum matches
+ */
+const bool SmartBmsDecoder::isChecksumValid(const uint8_t frame[SBMS_FRAME_SIZE])
+{
+	uint8_t checkSum = 0;
+	for (size_t i = 0; i < SBMS_FRAME_SIZE - 1; i++)
+	{
+		checkSum += frame[i];
+	}
+	return checkSum == frame[SBMS_FRAME_SIZE - 1];
+}
+
+/**
+ * @brief Decode the pack voltage value from 3 bytes.
+ * @param buffer buffer of 3 bytes
+ * @return voltage value in V
+ */
+const float SmartBmsDecoder::decodePackVoltage_(const uint8_t buffer[3]) const
+{
+	// Detmerine the raw value and multiply it with the factor
+	const uint32_t rawValue = this->decodeThreeByteValue_(buffer);
+	return rawValue * 0.005f;
+}
+
+/**
+ * @brief Decode a current value from 3 bytes.
+ * @param buffer buffer of 3 bytes
+ * @return current value in A
+ */
+const float SmartBmsDecoder::decodePackCurrent_(const uint8_t buffer[3]) const
+{
+	// Determine the factor based on the first byte
+	float factor = 1.0f;
+	if (buffer[0] == 'X')
+	{
+		factor = 0.0f;
+	}
+	else if (buffer[0] == '-')
+	{
+		factor = -1.0f;
+	}
+
+	// Detmerine the raw value and multiply it with the factor
+	const uint16_t rawValue = this->decodeTwoByteValue_(&buffer[1]);
+	return factor * rawValue * 0.125f;
+}
+
+/**
+ * @brief Decode a cell voltage value from 2 bytes.
+ * @param buffer buffer of 2 bytes
+ * @return voltage value in V
+ */
+const float SmartBmsDecoder::decodeCellVoltage_(const uint8_t buffer[2]) const
+{
+	// Detmerine the raw value and multiply it with the factor
+	const uint16_t rawValue = this->decodeTwoByteValue_(buffer);
+	return rawValue * 0.005f;
+}
+
+/**
+ * @brief Decode a cell temperature value from 2 bytes.
+ * @param buffer buffer of 2 bytes
+ * @return temperature value in °C
+ */
+const float SmartBmsDecoder::decodeCellTemperature_(const uint8_t buffer[2]) const
+{
+	// Detmerine the raw value and multiply it with the factor
+	const uint16_t rawValue = this->decodeTwoByteValue_(buffer);
+	return rawValue * 0.857f - 232.0f;
+}
+
+/**
+ * @brief Decode a 2 byte value.
+ * @param buffer buffer of 2 bytes
+ * @return decoded 2 byte value
+ */
+const uint16_t SmartBmsDecoder::decodeTwoByteValue_(const uint8_t buffer[2]) const
+{
+	return (static_cast<uint16_t>(buffer[0]) << 8) | buffer[1];
+}
+
+/**
+ * @brief Decode a 3 byte value.
+ * @param buffer buffer of 3 bytes
+ * @return decoded 3 byte value
+ */
+const uint32_t SmartBmsDecoder::decodeThreeByteValue_(const uint8_t buffer[3]) const
+{
+	return (static_cast<uint32_t>(buffer[0]) << 16) | (static_cast<uint16_t>(buffer[1]) << 8) | buffer[2];
+}
@@ -0,0 +1,174 @@
+/**
+ * @file SmartBmsEnergyMeter.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the SmartBmsEnergyMeter class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "bms/SmartBmsEnergyMeter.h"
+
+/**
+ * @brief Create a new instance of SmartBmsEnergyMeter with all totals at 0.
+ * @param maxGapMs maximum time between two frames that is still integrated
+ */
+SmartBmsEnergyMeter::SmartBmsEnergyMeter(const uint32_t maxGapMs)
+{
+	this->maxGapMs_ = maxGapMs;
+	this->reset();
+}
+
+/**
+ * @brief Destroy the SmartBmsEnergyMeter instance.
+ */
+SmartBmsEnergyMeter::~SmartBmsEnergyMeter()
+{
+}
+
+/**
+ * @brief Integrate the time since the previous frame.
+ * @param smartBmsData data of a valid frame
+ * @param timeUs monotonic time of the frame in µs
+ */
+void SmartBmsEnergyMeter::update(const SmartBmsData &smartBmsData, const int64_t timeUs)
+{
+	const Sample sample = {timeUs, SmartBmsEnergyMeter::toMilli_(smartBmsData.getPackChargeCurrent()),
+						   SmartBmsEnergyMeter::toMilli_(smartBmsData.getPackDischargeCurrent()), SmartBmsEnergyMeter::toMilli_(smartBmsData.getPackVoltage())};
+	if (!this->hasSample_)
+	{
+		this->lastSample_ = sample;
+		this->hasSample_ = true;
+		return;
+	}
+
+	const int64_t elapsedUs = timeUs - this->lastSample_.timeUs;
+	if (elapsedUs < 0 || elapsedUs > static_cast<int64_t>(this->maxGapMs_) * 1000)
+	{
+		this->gapCount_++;
+		this->lastSample_ = sample;
+		return;
+	}
+
+	// Twice the trapezoid, mA * mV * µs is 2 pJ and mA * µs is 2 nC
+	const uint64_t elapsed = static_cast<uint64_t>(elapsedUs);
+	const uint64_t chargePower = static_cast<uint64_t>(this->lastSample_.chargeCurrent) * this->lastSample_.voltage + static_cast<uint64_t>(sample.chargeCurrent) * sample.voltage;
+	const uint64_t dischargePower = static_cast<uint64_t>(this->lastSample_.dischargeCurrent) * this->lastSample_.voltage + static_cast<uint64_t>(sample.dischargeCurrent) * sample.voltage;
+	SmartBmsEnergyMeter::accumulate_(this->totals_.chargedEnergy, this->remainders_.chargedEnergy, chargePower * elapsed);
+	SmartBmsEnergyMeter::accumulate_(this->totals_.dischargedEnergy, this->remainders_.dischargedEnergy, dischargePower * elapsed);
+	SmartBmsEnergyMeter::accumulate_(this->totals_.chargedCharge, this->remainders_.chargedCharge,
+									 static_cast<uint64_t>(this->lastSample_.chargeCurrent + sample.chargeCurrent) * elapsed);
+	SmartBmsEnergyMeter::accumulate_(this->totals_.dischargedCharge, this->remainders_.dischargedCharge,
+									 static_cast<uint64_t>(this->lastSample_.dischargeCurrent + sample.dischargeCurrent) * elapsed);
+	this->lastSample_ = sample;
+}
+
+/**
+ * @brief Continue from previously saved totals.
+ * @param totals saved totals
+ */
+void SmartBmsEnergyMeter::restore(const SmartBmsEnergyTotals &totals)
+{
+	this->totals_ = totals;
+	this->remainders_ = {0, 0, 0, 0};
+}
+
+/**
+ * @brief Set all totals to 0 and start a new segment with the next frame.
+ */
+void SmartBmsEnergyMeter::reset()
+{
+	this->hasSample_ = false;
+	this->lastSample_ = {0, 0, 0, 0};
+	this->totals_ = {0, 0, 0, 0};
+	this->remainders_ = {0, 0, 0, 0};
+	this->gapCount_ = 0;
+}
+
+/**
+ * @brief Get the raw totals, e.g. to save them.
+ * @return totals in nJ and µC
+ */
+const SmartBmsEnergyTotals &SmartBmsEnergyMeter::getTotals() const
+{
+	return this->totals_;
+}
+
+/**
+ * @brief Get the energy charged into the pack.
+ * @return energy in kWh
+ */
+const double SmartBmsEnergyMeter::getChargedKwh() const
+{
+	return this->totals_.chargedEnergy / 3.6e15;
+}
+
+/**
+ * @brief Get the energy discharged from the pack.
+ * @return energy in kWh
+ */
+const double SmartBmsEnergyMeter::getDischargedKwh() const
+{
+	return this->totals_.dischargedEnergy / 3.6e15;
+}
+
+/**
+ * @brief Get the charge charged into the pack.
+ * @return charge in Ah
+ */
+const double SmartBmsEnergyMeter::getChargedAh() const
+{
+	return this->totals_.chargedCharge / 3.6e9;
+}
+
+/**
+ * @brief Get the charge discharged from the pack.
+ * @return charge in Ah
+ */
+const double SmartBmsEnergyMeter::getDischargedAh() const
+{
+	return this->totals_.dischargedCharge / 3.6e9;
+}
+
+/**
+ * @brief Get the number of gaps that were not integrated.
+ * @return number of gaps since the start
+ */
+const uint32_t SmartBmsEnergyMeter::getGapCount() const
+{
+	return this->gapCount_;
+}
+
+/**
+ * @brief Convert a value to a thousandth of its unit, negative values count as 0.
+ * @param value value in A or V
+ * @return value in mA or mV
+ */
+const uint32_t SmartBmsEnergyMeter::toMilli_(const float value)
+{
+	return value > 0.0f ? static_cast<uint32_t>(value * 1000.0f + 0.5f) : 0;
+}
+
+/**
+ * @brief Add twice a trapezoid to a total, 2000 units of the trapezoid are one unit of the total.
+ * @param total total in nJ or µC
+ * @param remainder part of the total that is not yet a full unit
+ * @param value twice the trapezoid in pJ or nC
+ */
+void SmartBmsEnergyMeter::accumulate_(uint64_t &total, uint64_t &remainder, const uint64_t value)
+{
+	remainder += value;
+	total += remainder / 2000;
+	remainder %= 2000;
+}
@@ -0,0 +1,168 @@
+/**
+ * @file SmartBmsLinkMonitor.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the SmartBmsLinkMonitor class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "bms/SmartBmsLinkMonitor.h"
+
+/**
+ * @brief Create a new instance of SmartBmsLinkMonitor. The link starts as lost.
+ * @param config timeouts and error limits
+ */
+SmartBmsLinkMonitor::SmartBmsLinkMonitor(const SmartBmsLinkConfig &config)
+{
+	this->config_ = config;
+	if (this->config_.errorWindow > 32)
+	{
+		this->config_.errorWindow = 32;
+	}
+	this->listener_ = nullptr;
+	this->received_.store(false);
+	this->lastFrameMs_.store(0);
+	this->errorHistory_.store(0);
+	this->state_.store(SBMS_LINK_LOST);
+	this->transitionCount_.store(0);
+}
+
+/**
+ * @brief Destroy the SmartBmsLinkMonitor instance.
+ */
+SmartBmsLinkMonitor::~SmartBmsLinkMonitor()
+{
+}
+
+/**
+ * @brief Set the function that is called on every change of the state.
+ * @param listener function or nullptr
+ */
+void SmartBmsLinkMonitor::setListener(SmartBmsLinkListener listener)
+{
+	this->listener_ = listener;
+}
+
+/**
+ * @brief Report the result of a decoded frame.
+ * @param error result of the decoder
+ * @param nowMs monotonic time in ms
+ */
+void SmartBmsLinkMonitor::onFrame(const SmartBmsError error, const uint32_t nowMs)
+{
+	if (error == SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA)
+	{
+		return;
+	}
+
+	const bool failed = error != SmartBmsError::SBMS_OK;
+	this->errorHistory_.store((this->errorHistory_.load(std::memory_order_relaxed) << 1) | (failed ? 1 : 0), std::memory_order_relaxed);
+	if (!failed)
+	{
+		this->lastFrameMs_.store(nowMs, std::memory_order_relaxed);
+		this->received_.store(true, std::memory_order_release);
+	}
+}
+
+/**
+ * @brief Evaluate the state and call the listener when it changed.
+ * @param nowMs monotonic time in ms
+ */
+void SmartBmsLinkMonitor::check(const uint32_t nowMs)
+{
+	SmartBmsLinkState state = SBMS_LINK_LOST;
+	if (this->received_.load(std::memory_order_acquire))
+	{
+		// The reader task may store a frame that is newer than nowMs, which is no age at all
+		const int32_t difference = static_cast<int32_t>(nowMs - this->lastFrameMs_.load(std::memory_order_relaxed));
+		const uint32_t age = difference > 0 ? difference : 0;
+		if (age >= this->config_.lostTimeoutMs)
+		{
+			state = SBMS_LINK_LOST;
+		}
+		else if (age >= this->config_.staleTimeoutMs)
+		{
+			state = SBMS_LINK_STALE;
+		}
+		else if (age >= this->config_.degradedTimeoutMs || this->getRecentErrorCount() >= this->config_.degradedErrors)
+		{
+			state = SBMS_LINK_DEGRADED;
+		}
+		else
+		{
+			state = SBMS_LINK_OK;
+		}
+	}
+
+	const SmartBmsLinkState previous = static_cast<SmartBmsLinkState>(this->state_.load(std::memory_order_relaxed));
+	if (state != previous)
+	{
+		this->state_.store(state, std::memory_order_relaxed);
+		this->transitionCount_.fetch_add(1, std::memory_order_relaxed);
+		if (this->listener_ != nullptr)
+		{
+			this->listener_(previous, state);
+		}
+	}
+}
+
+/**
+ * @brief Get the state after the latest check.
+ * @return state of the link
+ */
+const SmartBmsLinkState SmartBmsLinkMonitor::getState() const
+{
+	return static_cast<SmartBmsLinkState>(this->state_.load(std::memory_order_relaxed));
+}
+
+/**
+ * @brief Get the number of failed frames within the error window.
+ * @return number of errors
+ */
+const uint8_t SmartBmsLinkMonitor::getRecentErrorCount() const
+{
+	const uint32_t mask = this->config_.errorWindow >= 32 ? UINT32_MAX : (1UL << this->config_.errorWindow) - 1;
+	return __builtin_popcount(this->errorHistory_.load(std::memory_order_relaxed) & mask);
+}
+
+/**
+ * @brief Get the number of state changes.
+ * @return number of changes since start
+ */
+const uint32_t SmartBmsLinkMonitor::getTransitionCount() const
+{
+	return this->transitionCount_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the name of a state.
+ * @param state state of the link
+ * @return lower case name
+ */
+const char *SmartBmsLinkMonitor::getStateName(const SmartBmsLinkState state)
+{
+	switch (state)
+	{
+	case SBMS_LINK_OK:
+		return "ok";
+	case SBMS_LINK_DEGRADED:
+		return "degraded";
+	case SBMS_LINK_STALE:
+		return "stale";
+	case SBMS_LINK_LOST:
+		return "lost";
+	}
+	return "unknown";
+}
@@ -23,6 +23,9 @@
  */
 #include "bms/SmartBmsReader.h"
 
+#include <Arduino.h>
+#include <string.h>
+
 /**
  * @brief Create a new instance of SmartBmsReader.
  * @param inputStream input stream from which the BMS data is read
@@ -32,6 +35,19 @@ SmartBmsReader::SmartBmsReader(Stream *inputStream)
 	// Set the stream and clear it
 	this->inputStream_ = inputStream;
 	this->inputStream_->flush();
+	this->bufferLength_ = 0;
+	this->synchronizing_ = false;
+	this->aligned_ = false;
+	this->candidate_ = false;
+
+	memset(&this->stats_, 0, sizeof(this->stats_));
+	this->publishedStats_.write(this->stats_);
+	this->overruns_.store(0);
+	this->lastFrameMs_ = 0;
+	this->intervalSumMs_ = 0;
+	this->intervalCount_ = 0;
+	this->rateStartMs_ = 0;
+	this->rateStartBytes_ = 0;
 }
 
 /**
@@ -42,155 +58,176 @@ SmartBmsReader::~SmartBmsReader()
 }
 
 /**
- * @brief Check if the input stream is ready to be read. Once it contains at least 58 bytes, it is considdered ready.
+ * @brief Check if the input stream is ready to be read. Once a full frame of 58 bytes is available, it is considdered ready.
  * @return SmartBmsError::SBMS_OK when the input stream is ready to be read
  * @return SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA when not enough data is available yet
  */
 const SmartBmsError SmartBmsReader::bmsDataReady() const
 {
-	return this->inputStream_->available() >= 58 ? SmartBmsError::SBMS_OK : SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA;
+	return this->inputStream_->available() + this->bufferLength_ >= SBMS_FRAME_SIZE ? SmartBmsError::SBMS_OK : SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA;
 }
 
 /**
- * @brief Decode a single frame of BMS data from the input stream.
+ * @brief Decode a single frame of BMS data from the input stream. Should be called as long as data is ready.
  * @param smartBmsData reference to a SmartBmsData object that will receive the data
- * @return SmartBmsError with error information
+ * @return SmartBmsError::SBMS_OK when a frame was decoded
+ * @return SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA when the stream ran out of data, e.g. while searching for the next frame
+ * @return SmartBmsError::SBMS_ERR_READ_STREAM when the stream returned less data than available
+ * @return SmartBmsError::SBMS_ERR_INVALID_CHECKSUM when a corrupt frame was found, the search for the next frame starts
  */
-const SmartBmsError SmartBmsReader::decodeBmsData(SmartBmsData *smartBmsData) const
+const SmartBmsError SmartBmsReader::decodeBmsData(SmartBmsData *smartBmsData)
 {
-	// Ensure enough data is available in the input stream
-	if (this->bmsDataReady() != SmartBmsError::SBMS_OK)
+	SmartBmsError error = SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA;
+	while (error == SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA)
 	{
-		return SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA;
-	}
+		// Fill the buffer with what is available
+		const size_t available = this->inputStream_->available();
+		const size_t missing = SBMS_FRAME_SIZE - this->bufferLength_;
+		if (available == 0 && missing > 0)
+		{
+			break;
+		}
 
-	// Create a buffer for the 58 bytes and read it from the input stream
-	uint8_t buffer[58];
-	if (this->inputStream_->readBytes(buffer, sizeof(buffer)) != 58)
-	{
-		return SmartBmsError::SBMS_ERR_READ_STREAM;
-	}
-
-	// Calculate the checksum
-	uint8_t checkSum = 0;
-	for (size_t i = 0; i < sizeof(buffer) - 1; i++)
-	{
-		checkSum += buffer[i];
+		const size_t requested = available < missing ? available : missing;
+		const size_t read = requested > 0 ? this->inputStream_->readBytes(&this->buffer_[this->bufferLength_], requested) : 0;
+		this->bufferLength_ += read;
+		this->stats_.bytesReceived += read;
+		if (read != requested)
+		{
+			this->stats_.shortReads++;
+			error = SmartBmsError::SBMS_ERR_READ_STREAM;
+		}
+		else if (this->bufferLength_ == SBMS_FRAME_SIZE)
+		{
+			// A state of charge above 100 % rejects most misaligned windows before they are decoded
+			const bool valid = SmartBmsDecoder::isChecksumValid(this->buffer_) && this->buffer_[40] <= 100;
+			if (valid && !this->aligned_ && !this->candidate_)
+			{
+				// The additive checksum also matches by chance, so the next frame must confirm the offset
+				this->candidate_ = true;
+				this->bufferLength_ = 0;
+			}
+			else if (valid)
+			{
+				this->decoder_.decode(this->buffer_, smartBmsData);
+				this->bufferLength_ = 0;
+				this->aligned_ = true;
+				this->candidate_ = false;
+				if (this->synchronizing_)
+				{
+					this->synchronizing_ = false;
+					this->stats_.resyncs++;
+				}
+				this->onFrame_(millis());
+				error = SmartBmsError::SBMS_OK;
+			}
+			else
+			{
+				// The bytes of a rejected candidate frame are lost as well
+				if (this->candidate_)
+				{
+					this->candidate_ = false;
+					this->stats_.bytesDiscarded += SBMS_FRAME_SIZE;
+				}
+				this->aligned_ = false;
+				this->shiftBuffer_();
+				if (!this->synchronizing_)
+				{
+					// Report the corruption once, then search silently
+					this->synchronizing_ = true;
+					this->stats_.checksumErrors++;
+					error = SmartBmsError::SBMS_ERR_INVALID_CHECKSUM;
+				}
+			}
+		}
 	}
 
-	// Verify the checksum
-	if (checkSum != buffer[sizeof(buffer) - 1])
-	{
-		// Flush the stream
-		this->inputStream_->flush();
-		return SmartBmsError::SBMS_ERR_INVALID_CHECKSUM;
-	}
-
-	// Decode the BMS data from the buffer
-	smartBmsData->cellCount_ = buffer[25];
-	smartBmsData->cellVoltageMin_ = this->decodeCellVoltage_(&buffer[51]);
-	smartBmsData->cellVoltageMax_ = this->decodeCellVoltage_(&buffer[53]);
-	smartBmsData->cellVoltageBalance_ = this->decodeCellVoltage_(&buffer[55]);
-	smartBmsData->packSoc_ = buffer[40];
-	smartBmsData->packVoltage_ = this->decodePackVoltage_(&buffer[0]);
-	smartBmsData->packCurrent_ = this->decodePackCurrent_(&buffer[9]);
-	smartBmsData->packChargeCurrent_ = this->decodePackCurrent_(&buffer[3]);
-	smartBmsData->packDischargeCurrent_ = this->decodePackCurrent_(&buffer[6]);
-	smartBmsData->packCapacity_ = this->decodeTwoByteValue_(&buffer[49]) * 0.1f;
-	smartBmsData->packRemainingEnergy_ = this->decodeThreeByteValue_(&buffer[34]) * 0.001f;
-	smartBmsData->lowestCellVoltage_ = this->decodeCellVoltage_(&buffer[12]);
-	smartBmsData->lowestCellVoltageNumber_ = buffer[14];
-	smartBmsData->highestCellVoltage_ = this->decodeCellVoltage_(&buffer[15]);
-	smartBmsData->highestCellVoltageNumber_ = buffer[17];
-	smartBmsData->lowestCellTemperature_ = this->decodeCellTemperature_(&buffer[18]);
-	smartBmsData->lowestCellTemperatureNumber_ = buffer[20];
-	smartBmsData->highestCellTemperature_ = this->decodeCellTemperature_(&buffer[21]);
-	smartBmsData->highestCellTemperatureNumber_ = buffer[23];
-	smartBmsData->communicationError_ = buffer[30] & 0b00000100;
-	smartBmsData->allowedToCharge_ = buffer[30] & 0b00000001;
-	smartBmsData->allowedToDischarge_ = buffer[30] & 0b00000010;
-	smartBmsData->minVoltageAlarmActive_ = buffer[30] & 0b00001000;
-	smartBmsData->maxVoltageAlarmActive_ = buffer[30] & 0b00010000;
-	smartBmsData->minTemperatureAlarmActive_ = buffer[30] & 0b00100000;
-	smartBmsData->maxTemperatureAlarmActive_ = buffer[30] & 0b01000000;
-	return SmartBmsError::SBMS_OK;
+	this->stats_.overruns = this->overruns_.load(std::memory_order_relaxed);
+	this->publishedStats_.write(this->stats_);
+	return error;
 }
 
 /**
- * @brief Decode the pack voltage value from 3 bytes.
- * @param buffer buffer of 3 bytes
- * @return voltage value in V
+ * @brief Count an overrun of the UART, may be called from the UART event task.
+ * The lost bytes are found by the checksum and the reader synchronizes again.
  */
-const float SmartBmsReader::decodePackVoltage_(const uint8_t buffer[3]) const
+void SmartBmsReader::reportOverrun()
 {
-	// Detmerine the raw value and multiply it with the factor
-	const uint32_t rawValue = this->decodeThreeByteValue_(buffer);
-	return rawValue * 0.005f;
+	this->overruns_.fetch_add(1, std::memory_order_relaxed);
 }
 
 /**
- * @brief Decode a current value from 3 bytes.
- * @param buffer buffer of 3 bytes
- * @return current value in A
+ * @brief Get the raw bytes of the last decoded frame.
+ * Only valid after decodeBmsData() returned SmartBmsError::SBMS_OK and until it is called again.
+ * @return frame of SBMS_FRAME_SIZE bytes
  */
-const float SmartBmsReader::decodePackCurrent_(const uint8_t buffer[3]) const
+const uint8_t *SmartBmsReader::getFrame() const
 {
-	// Determine the factor based on the first byte
-	float factor = 1.0f;
-	if (buffer[0] == 'X')
-	{
-		factor = 0.0f;
-	}
-	else if (buffer[0] == '-')
-	{
-		factor = -1.0f;
-	}
-
-	// Detmerine the raw value and multiply it with the factor
-	const uint16_t rawValue = this->decodeTwoByteValue_(&buffer[1]);
-	return factor * rawValue * 0.125f;
+	return this->buffer_;
 }
 
 /**
- * @brief Decode a cell voltage value from 2 bytes.
- * @param buffer buffer of 2 bytes
- * @return voltage value in V
+ * @brief Get a consistent copy of the statistics, may be called from any task.
+ * @return statistics since start
  */
-const float SmartBmsReader::decodeCellVoltage_(const uint8_t buffer[2]) const
+const SmartBmsReaderStats SmartBmsReader::getStats() const
 {
-	// Detmerine the raw value and multiply it with the factor
-	const uint16_t rawValue = this->decodeTwoByteValue_(buffer);
-	return rawValue * 0.005f;
+	SmartBmsReaderStats stats;
+	this->publishedStats_.read(stats);
+	stats.overruns = this->overruns_.load(std::memory_order_relaxed);
+	return stats;
 }
 
 /**
- * @brief Decode a cell temperature value from 2 bytes.
- * @param buffer buffer of 2 bytes
- * @return temperature value in °C
+ * @brief Update the interval and rate statistics after a valid frame.
+ * @param nowMs time of the frame in ms
  */
-const float SmartBmsReader::decodeCellTemperature_(const uint8_t buffer[2]) const
+void SmartBmsReader::onFrame_(const uint32_t nowMs)
 {
-	// Detmerine the raw value and multiply it with the factor
-	const uint16_t rawValue = this->decodeTwoByteValue_(buffer);
-	return rawValue * 0.857f - 232.0f;
-}
+	const uint32_t interval = nowMs - this->lastFrameMs_;
+	if (this->stats_.framesOk > 0 && interval <= SBMS_READER_GAP_MS)
+	{
+		if (this->intervalCount_ == 0 || interval < this->stats_.intervalMinMs)
+		{
+			this->stats_.intervalMinMs = interval;
+		}
+		if (interval > this->stats_.intervalMaxMs)
+		{
+			this->stats_.intervalMaxMs = interval;
+		}
+		this->intervalSumMs_ += interval;
+		this->intervalCount_++;
+		this->stats_.intervalAvgMs = static_cast<uint32_t>(this->intervalSumMs_ / this->intervalCount_);
+	}
+	else
+	{
+		// The rate restarts after a gap, so the outage does not lower it
+		if (this->stats_.framesOk > 0)
+		{
+			this->stats_.gaps++;
+		}
+		this->rateStartMs_ = nowMs;
+		this->rateStartBytes_ = this->stats_.bytesReceived;
+	}
 
-/**
- * @brief Decode a 2 byte value.
- * @param buffer buffer of 2 bytes
- * @return decoded 2 byte value
- */
-const uint16_t SmartBmsReader::decodeTwoByteValue_(const uint8_t buffer[2]) const
-{
-	return (static_cast<uint16_t>(buffer[0]) << 8) | buffer[1];
+	// The rate is measured over at least 10 seconds
+	if (nowMs - this->rateStartMs_ >= 10000)
+	{
+		this->stats_.bytesPerSecond = (this->stats_.bytesReceived - this->rateStartBytes_) * 1000.0f / (nowMs - this->rateStartMs_);
+		this->rateStartMs_ = nowMs;
+		this->rateStartBytes_ = this->stats_.bytesReceived;
+	}
+
+	this->lastFrameMs_ = nowMs;
+	this->stats_.framesOk++;
 }
 
 /**
- * @brief Decode a 3 byte value.
- * @param buffer buffer of 3 bytes
- * @return decoded 3 byte value
+ * @brief Drop the first byte of the buffer.
  */
-const uint32_t SmartBmsReader::decodeThreeByteValue_(const uint8_t buffer[3]) const
+void SmartBmsReader::shiftBuffer_()
 {
-	return (static_cast<uint32_t>(buffer[0]) << 16) | (static_cast<uint16_t>(buffer[1]) << 8) | buffer[2];
+	memmove(this->buffer_, &this->buffer_[1], SBMS_FRAME_SIZE - 1);
+	this->bufferLength_ = SBMS_FRAME_SIZE - 1;
+	this->stats_.bytesDiscarded++;
 }
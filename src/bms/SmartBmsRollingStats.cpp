@@ -0,0 +1,114 @@
+/**
+ * @file SmartBmsRollingStats.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the SmartBmsRollingStats class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "bms/SmartBmsRollingStats.h"
+
+/**
+ * @brief Create a new instance of SmartBmsRollingStats.
+ * @param config field and length of each window, windows beyond SBMS_MAX_ROLLING_WINDOWS are ignored
+ * @param count number of windows
+ */
+SmartBmsRollingStats::SmartBmsRollingStats(const SmartBmsRollingWindowConfig *config, const uint8_t count)
+{
+	this->windowCount_ = count < SBMS_MAX_ROLLING_WINDOWS ? count : SBMS_MAX_ROLLING_WINDOWS;
+	for (uint8_t i = 0; i < this->windowCount_; i++)
+	{
+		this->fields_[i] = config[i].field;
+		this->windows_[i].setLength(config[i].lengthMs);
+	}
+}
+
+/**
+ * @brief Destroy the SmartBmsRollingStats instance.
+ */
+SmartBmsRollingStats::~SmartBmsRollingStats()
+{
+}
+
+/**
+ * @brief Add the values of a valid frame to all windows.
+ * @param smartBmsData decoded data
+ * @param nowMs time of the frame in ms
+ */
+void SmartBmsRollingStats::update(const SmartBmsData &smartBmsData, const uint32_t nowMs)
+{
+	for (uint8_t i = 0; i < this->windowCount_; i++)
+	{
+		this->windows_[i].add(smartBmsData.getFieldValue(this->fields_[i]), nowMs);
+	}
+}
+
+/**
+ * @brief Clear all windows.
+ */
+void SmartBmsRollingStats::reset()
+{
+	for (uint8_t i = 0; i < this->windowCount_; i++)
+	{
+		this->windows_[i].reset();
+	}
+}
+
+/**
+ * @brief Get the number of windows.
+ * @return number of windows
+ */
+const uint8_t SmartBmsRollingStats::getWindowCount() const
+{
+	return this->windowCount_;
+}
+
+/**
+ * @brief Get the field of a window.
+ * @param window index of the window
+ * @return aggregated field
+ */
+const SmartBmsField SmartBmsRollingStats::getField(const uint8_t window) const
+{
+	return window < this->windowCount_ ? this->fields_[window] : SBMS_FIELD_COUNT;
+}
+
+/**
+ * @brief Get a window by its index.
+ * @param window index of the window
+ * @return window or nullptr if the index is invalid
+ */
+const RollingWindow *SmartBmsRollingStats::getWindow(const uint8_t window) const
+{
+	return window < this->windowCount_ ? &this->windows_[window] : nullptr;
+}
+
+/**
+ * @brief Find the window of a field with a specific length.
+ * @param field aggregated field
+ * @param lengthMs length of the window in ms
+ * @return window or nullptr if there is no such window
+ */
+const RollingWindow *SmartBmsRollingStats::findWindow(const SmartBmsField field, const uint32_t lengthMs) const
+{
+	for (uint8_t i = 0; i < this->windowCount_; i++)
+	{
+		if (this->fields_[i] == field && this->windows_[i].getLength() == lengthMs)
+		{
+			return &this->windows_[i];
+		}
+	}
+	return nullptr;
+}
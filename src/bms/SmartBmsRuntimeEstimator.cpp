@@ -0,0 +1,170 @@
+/**
+ * @file SmartBmsRuntimeEstimator.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the SmartBmsRuntimeEstimator class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "bms/SmartBmsRuntimeEstimator.h"
+
+#include <math.h>
+
+/**
+ * @brief Create a new instance of SmartBmsRuntimeEstimator.
+ * @param config smoothing and thresholds
+ */
+SmartBmsRuntimeEstimator::SmartBmsRuntimeEstimator(const SmartBmsRuntimeConfig &config)
+{
+	this->config_ = config;
+	if (this->config_.timeConstantMs == 0)
+	{
+		this->config_.timeConstantMs = 1;
+	}
+	this->reset();
+}
+
+/**
+ * @brief Destroy the SmartBmsRuntimeEstimator instance.
+ */
+SmartBmsRuntimeEstimator::~SmartBmsRuntimeEstimator()
+{
+}
+
+/**
+ * @brief Add a valid frame to the average.
+ * @param smartBmsData decoded data
+ * @param timeUs monotonic time of the frame in µs
+ */
+void SmartBmsRuntimeEstimator::update(const SmartBmsData &smartBmsData, const int64_t timeUs)
+{
+	const float power = (smartBmsData.getPackChargeCurrent() - smartBmsData.getPackDischargeCurrent()) * smartBmsData.getPackVoltage();
+	const int64_t elapsedUs = timeUs - this->lastTimeUs_;
+	if (this->state_ == SBMS_RUNTIME_UNKNOWN || elapsedUs < 0 || elapsedUs > static_cast<int64_t>(this->config_.maxGapMs) * 1000)
+	{
+		// Start over, the first frame has no weight yet
+		this->power_ = power;
+		this->variance_ = 0.0f;
+		this->weight_ = 0.0f;
+	}
+	else
+	{
+		// Incremental exponentially weighted mean and variance
+		const float alpha = 1.0f - expf(-static_cast<float>(elapsedUs) / (this->config_.timeConstantMs * 1000.0f));
+		const float difference = power - this->power_;
+		this->power_ += alpha * difference;
+		this->variance_ = (1.0f - alpha) * (this->variance_ + alpha * difference * difference);
+		this->weight_ += alpha * (1.0f - this->weight_);
+	}
+	this->lastTimeUs_ = timeUs;
+
+	// Energy in kWh, the time is in hours
+	this->energyToFull_ = smartBmsData.getPackCapacity() - smartBmsData.getPackRemainingEnergy();
+	this->energyToEmpty_ = smartBmsData.getPackRemainingEnergy();
+	if (smartBmsData.getPackSoc() >= 100 && this->power_ >= -this->config_.idlePower)
+	{
+		this->state_ = SBMS_RUNTIME_FULL;
+	}
+	else if (this->power_ >= this->config_.idlePower)
+	{
+		this->state_ = SBMS_RUNTIME_CHARGING;
+	}
+	else if (this->power_ <= -this->config_.idlePower)
+	{
+		this->state_ = SBMS_RUNTIME_DISCHARGING;
+	}
+	else
+	{
+		this->state_ = SBMS_RUNTIME_IDLE;
+	}
+}
+
+/**
+ * @brief Forget the history.
+ */
+void SmartBmsRuntimeEstimator::reset()
+{
+	this->state_ = SBMS_RUNTIME_UNKNOWN;
+	this->lastTimeUs_ = 0;
+	this->power_ = 0.0f;
+	this->variance_ = 0.0f;
+	this->weight_ = 0.0f;
+	this->energyToFull_ = 0.0f;
+	this->energyToEmpty_ = 0.0f;
+}
+
+/**
+ * @brief Get the state of the pack according to the smoothed power.
+ * @return state
+ */
+const SmartBmsRuntimeState SmartBmsRuntimeEstimator::getState() const
+{
+	return this->state_;
+}
+
+/**
+ * @brief Get the smoothed net power.
+ * @return power in W, positive while charging
+ */
+const float SmartBmsRuntimeEstimator::getPower() const
+{
+	return this->power_;
+}
+
+/**
+ * @brief Get the time until the pack is full.
+ * @return time in hours, 0 if full or -1 if the pack is not charging
+ */
+const float SmartBmsRuntimeEstimator::getTimeToFull() const
+{
+	if (this->state_ == SBMS_RUNTIME_FULL)
+	{
+		return 0.0f;
+	}
+	if (this->state_ != SBMS_RUNTIME_CHARGING)
+	{
+		return -1.0f;
+	}
+	return this->energyToFull_ > 0.0f ? this->energyToFull_ * 1000.0f / this->power_ : 0.0f;
+}
+
+/**
+ * @brief Get the time until the pack is empty.
+ * @return time in hours or -1 if the pack is not discharging
+ */
+const float SmartBmsRuntimeEstimator::getTimeToEmpty() const
+{
+	if (this->state_ != SBMS_RUNTIME_DISCHARGING)
+	{
+		return -1.0f;
+	}
+	return this->energyToEmpty_ > 0.0f ? this->energyToEmpty_ * 1000.0f / -this->power_ : 0.0f;
+}
+
+/**
+ * @brief Get the confidence in the estimate.
+ * It is low right after the start and while the power fluctuates a lot compared to its mean.
+ * @return confidence from 0 to 1
+ */
+const float SmartBmsRuntimeEstimator::getConfidence() const
+{
+	const float mean = fabsf(this->power_);
+	if (mean <= 0.0f)
+	{
+		return 0.0f;
+	}
+	const float deviation = sqrtf(this->variance_) / mean;
+	return this->weight_ * (deviation < 1.0f ? 1.0f - deviation : 0.0f);
+}
@@ -0,0 +1,164 @@
+/**
+ * @file CanScheduler.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the CanScheduler class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "can/CanScheduler.h"
+
+#include <string.h>
+
+/**
+ * @brief Create a new instance of CanScheduler.
+ * @param canBus bus to send the frames on
+ * @param timeoutMs time after the last update until the transmission stops
+ */
+CanScheduler::CanScheduler(CanBus *canBus, const uint32_t timeoutMs)
+{
+	this->canBus_ = canBus;
+	this->timeoutMs_ = timeoutMs;
+	this->entryCount_ = 0;
+	this->sentCount_ = 0;
+	this->errorCount_ = 0;
+	this->maxLatenessMs_ = 0;
+	memset(&this->tickFrameTable_, 0, sizeof(this->tickFrameTable_));
+	this->frameTable_.write(this->tickFrameTable_);
+}
+
+/**
+ * @brief Destroy the CanScheduler instance.
+ */
+CanScheduler::~CanScheduler()
+{
+}
+
+/**
+ * @brief Add a frame to the transmit table. Must be called before the timer is started.
+ * @param slot index of the frame as passed to update()
+ * @param periodMs transmit period in ms
+ * @param offsetMs phase offset in ms, used to spread the frames over the period
+ * @return true when the frame was added
+ * @return false when the table is full
+ */
+const bool CanScheduler::addFrame(const uint8_t slot, const uint32_t periodMs, const uint32_t offsetMs)
+{
+	if (this->entryCount_ >= CAN_SCHEDULER_MAX_FRAMES || slot >= CAN_SCHEDULER_MAX_FRAMES || periodMs == 0)
+	{
+		return false;
+	}
+
+	Entry &entry = this->entries_[this->entryCount_++];
+	entry.slot = slot;
+	entry.periodMs = periodMs;
+	entry.offsetMs = offsetMs;
+	entry.nextDueMs = 0;
+	entry.started = false;
+	return true;
+}
+
+/**
+ * @brief Publish new frame contents. Can be called from another task than tick().
+ * @param frames frames indexed by slot
+ * @param count number of frames
+ * @param nowMs current time in ms
+ */
+void CanScheduler::update(const CanFrame *frames, const uint8_t count, const uint32_t nowMs)
+{
+	FrameTable frameTable;
+	frameTable.updateMs = nowMs;
+	frameTable.count = count < CAN_SCHEDULER_MAX_FRAMES ? count : CAN_SCHEDULER_MAX_FRAMES;
+	memcpy(frameTable.frames, frames, sizeof(CanFrame) * frameTable.count);
+	this->frameTable_.write(frameTable);
+}
+
+/**
+ * @brief Send all frames that are due. Called periodically by a timer.
+ * @param nowMs current time in ms
+ */
+void CanScheduler::tick(const uint32_t nowMs)
+{
+	this->frameTable_.read(this->tickFrameTable_);
+
+	// update() may run on another core and stamp its frames after nowMs was taken
+	const int32_t age = static_cast<int32_t>(nowMs - this->tickFrameTable_.updateMs);
+	const bool stale = this->tickFrameTable_.count == 0 || (age > 0 && static_cast<uint32_t>(age) > this->timeoutMs_);
+
+	for (uint8_t i = 0; i < this->entryCount_; i++)
+	{
+		Entry &entry = this->entries_[i];
+		if (!entry.started)
+		{
+			entry.nextDueMs = nowMs + entry.offsetMs;
+			entry.started = true;
+		}
+
+		const int32_t lateness = static_cast<int32_t>(nowMs - entry.nextDueMs);
+		if (lateness < 0)
+		{
+			continue;
+		}
+
+		// Keep the phase of the schedule, but skip periods that were missed completely
+		entry.nextDueMs += entry.periodMs;
+		if (static_cast<int32_t>(nowMs - entry.nextDueMs) >= 0)
+		{
+			entry.nextDueMs = nowMs + entry.periodMs;
+		}
+		this->maxLatenessMs_ = static_cast<uint32_t>(lateness) > this->maxLatenessMs_ ? lateness : this->maxLatenessMs_;
+
+		if (stale || entry.slot >= this->tickFrameTable_.count)
+		{
+			continue;
+		}
+
+		if (this->canBus_->send(this->tickFrameTable_.frames[entry.slot]))
+		{
+			this->sentCount_++;
+		}
+		else
+		{
+			this->errorCount_++;
+		}
+	}
+}
+
+/**
+ * @brief Get the number of frames that were sent.
+ * @return number of sent frames since start
+ */
+const uint32_t CanScheduler::getSentCount() const
+{
+	return this->sentCount_;
+}
+
+/**
+ * @brief Get the number of frames that could not be queued for transmission.
+ * @return number of failed frames since start
+ */
+const uint32_t CanScheduler::getErrorCount() const
+{
+	return this->errorCount_;
+}
+
+/**
+ * @brief Get the largest delay between the scheduled and the actual transmit time.
+ * @return maximum lateness in ms
+ */
+const uint32_t CanScheduler::getMaxLatenessMs() const
+{
+	return this->maxLatenessMs_;
+}
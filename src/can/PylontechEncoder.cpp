@@ -0,0 +1,113 @@
+/**
+ * @file PylontechEncoder.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the PylontechEncoder class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "can/PylontechEncoder.h"
+
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief Create a new instance of PylontechEncoder.
+ * @param limits configured voltage and current limits of the pack
+ */
+PylontechEncoder::PylontechEncoder(const PylontechLimits &limits)
+{
+	this->limits_ = limits;
+}
+
+/**
+ * @brief Destroy the PylontechEncoder instance.
+ */
+PylontechEncoder::~PylontechEncoder()
+{
+}
+
+/**
+ * @brief Encode all frames of the protocol. All values are little endian.
+ * @param smartBmsData latest BMS data
+ * @param frames array that receives one frame per PylontechFrame
+ */
+void PylontechEncoder::encode(const SmartBmsData &smartBmsData, CanFrame frames[PYLONTECH_FRAME_COUNT]) const
+{
+	memset(frames, 0, sizeof(CanFrame) * PYLONTECH_FRAME_COUNT);
+
+	// Voltage and current limits, the currents are cut when the BMS forbids charging or discharging
+	CanFrame &limits = frames[PYLONTECH_FRAME_LIMITS];
+	limits.id = 0x351;
+	limits.length = 8;
+	this->putInt16_(&limits.data[0], this->limits_.chargeVoltage, 10.0f);
+	this->putInt16_(&limits.data[2], smartBmsData.isAllowedToCharge() ? this->limits_.maxChargeCurrent : 0.0f, 10.0f);
+	this->putInt16_(&limits.data[4], smartBmsData.isAllowedToDischarge() ? this->limits_.maxDischargeCurrent : 0.0f, 10.0f);
+	this->putInt16_(&limits.data[6], this->limits_.dischargeVoltage, 10.0f);
+
+	// State of charge and state of health, the BMS does not report the latter
+	CanFrame &soc = frames[PYLONTECH_FRAME_SOC];
+	soc.id = 0x355;
+	soc.length = 4;
+	this->putInt16_(&soc.data[0], smartBmsData.getPackSoc(), 1.0f);
+	this->putInt16_(&soc.data[2], 100.0f, 1.0f);
+
+	// Pack voltage, current and the highest cell temperature
+	CanFrame &measurement = frames[PYLONTECH_FRAME_MEASUREMENT];
+	measurement.id = 0x356;
+	measurement.length = 6;
+	this->putInt16_(&measurement.data[0], smartBmsData.getPackVoltage(), 100.0f);
+	this->putInt16_(&measurement.data[2], smartBmsData.getPackCurrent(), 10.0f);
+	this->putInt16_(&measurement.data[4], smartBmsData.getHighestCellTemperature(), 10.0f);
+
+	// Protection flags, the BMS only knows active alarms, so warnings stay cleared
+	CanFrame &alarms = frames[PYLONTECH_FRAME_ALARMS];
+	alarms.id = 0x359;
+	alarms.length = 7;
+	alarms.data[0] = (smartBmsData.isMaxVoltageAlarmActive() << 1) |
+					 (smartBmsData.isMinVoltageAlarmActive() << 2) |
+					 (smartBmsData.isMaxTemperatureAlarmActive() << 3) |
+					 (smartBmsData.isMinTemperatureAlarmActive() << 4);
+	alarms.data[1] = smartBmsData.hasCommunicationError() << 3;
+	alarms.data[4] = 1;
+	alarms.data[5] = 'P';
+	alarms.data[6] = 'N';
+
+	// Charge and discharge permissions
+	CanFrame &request = frames[PYLONTECH_FRAME_REQUEST];
+	request.id = 0x35C;
+	request.length = 2;
+	request.data[0] = (smartBmsData.isAllowedToCharge() << 7) | (smartBmsData.isAllowedToDischarge() << 6);
+
+	CanFrame &name = frames[PYLONTECH_FRAME_NAME];
+	name.id = 0x35E;
+	name.length = 8;
+	memcpy(name.data, "PYLON   ", 8);
+}
+
+/**
+ * @brief Scale, round and store a value as signed 16 bit little endian integer.
+ * @param buffer buffer of 2 bytes
+ * @param value value to store
+ * @param scale factor to multiply the value with
+ */
+void PylontechEncoder::putInt16_(uint8_t *buffer, const float value, const float scale) const
+{
+	long scaled = lroundf(value * scale);
+	scaled = scaled < -32768 ? -32768 : (scaled > 32767 ? 32767 : scaled);
+	const uint16_t raw = static_cast<uint16_t>(static_cast<int16_t>(scaled));
+	buffer[0] = raw & 0xFF;
+	buffer[1] = raw >> 8;
+}
@@ -0,0 +1,127 @@
+/**
+ * @file SocketCanBus.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the SocketCanBus class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include "can/SocketCanBus.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+/**
+ * @brief Create a new instance of SocketCanBus.
+ * @param interfaceName name of the CAN interface, e.g. vcan0
+ */
+SocketCanBus::SocketCanBus(const char *interfaceName)
+{
+	this->interfaceName_ = interfaceName;
+	this->socket_ = -1;
+}
+
+/**
+ * @brief Destroy the SocketCanBus instance.
+ */
+SocketCanBus::~SocketCanBus()
+{
+	this->end();
+}
+
+/**
+ * @brief Open a raw CAN socket and bind it to the interface.
+ * @return true when the socket is ready
+ * @return false when the interface does not exist or the socket could not be opened
+ */
+const bool SocketCanBus::begin()
+{
+	if (this->socket_ >= 0)
+	{
+		return true;
+	}
+
+	this->socket_ = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+	if (this->socket_ < 0)
+	{
+		return false;
+	}
+
+	// Resolve the interface index and bind the socket to it
+	struct ifreq request;
+	memset(&request, 0, sizeof(request));
+	strncpy(request.ifr_name, this->interfaceName_, IFNAMSIZ - 1);
+	if (ioctl(this->socket_, SIOCGIFINDEX, &request) != 0)
+	{
+		this->end();
+		return false;
+	}
+
+	struct sockaddr_can address;
+	memset(&address, 0, sizeof(address));
+	address.can_family = AF_CAN;
+	address.can_ifindex = request.ifr_ifindex;
+	if (bind(this->socket_, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+	{
+		this->end();
+		return false;
+	}
+
+	fcntl(this->socket_, F_SETFL, fcntl(this->socket_, F_GETFL, 0) | O_NONBLOCK);
+	return true;
+}
+
+/**
+ * @brief Close the socket.
+ */
+void SocketCanBus::end()
+{
+	if (this->socket_ >= 0)
+	{
+		close(this->socket_);
+		this->socket_ = -1;
+	}
+}
+
+/**
+ * @brief Send a frame without waiting.
+ * @param frame frame to send
+ * @return true when the frame was sent
+ * @return false when the socket buffer is full or the socket is not open
+ */
+const bool SocketCanBus::send(const CanFrame &frame)
+{
+	if (this->socket_ < 0)
+	{
+		return false;
+	}
+
+	struct can_frame canFrame;
+	memset(&canFrame, 0, sizeof(canFrame));
+	canFrame.can_id = frame.id;
+	canFrame.can_dlc = frame.length;
+	memcpy(canFrame.data, frame.data, frame.length);
+	return write(this->socket_, &canFrame, sizeof(canFrame)) == sizeof(canFrame);
+}
+
+#endif
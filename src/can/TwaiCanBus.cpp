@@ -0,0 +1,164 @@
+/**
+ * @file TwaiCanBus.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the TwaiCanBus class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifdef ARDUINO
+
+#include "can/TwaiCanBus.h"
+
+#include <string.h>
+#include <driver/twai.h>
+
+/**
+ * @brief Create a new instance of TwaiCanBus.
+ * @param txPin GPIO connected to the TX input of the transceiver
+ * @param rxPin GPIO connected to the RX output of the transceiver
+ * @param bitrate bitrate in bit/s, 125000, 250000, 500000 or 1000000
+ */
+TwaiCanBus::TwaiCanBus(const int8_t txPin, const int8_t rxPin, const uint32_t bitrate)
+{
+	this->txPin_ = txPin;
+	this->rxPin_ = rxPin;
+	this->bitrate_ = bitrate;
+	this->started_ = false;
+}
+
+/**
+ * @brief Destroy the TwaiCanBus instance.
+ */
+TwaiCanBus::~TwaiCanBus()
+{
+	this->end();
+}
+
+/**
+ * @brief Install and start the TWAI driver.
+ * @return true when the driver was started
+ * @return false when the driver could not be started or the bitrate is not supported
+ */
+const bool TwaiCanBus::begin()
+{
+	if (this->started_)
+	{
+		return true;
+	}
+
+	// Received frames are not used, so only transmit and keep the RX queue tiny
+	twai_general_config_t generalConfig = TWAI_GENERAL_CONFIG_DEFAULT(static_cast<gpio_num_t>(this->txPin_), static_cast<gpio_num_t>(this->rxPin_), TWAI_MODE_NORMAL);
+	generalConfig.tx_queue_len = 16;
+	generalConfig.rx_queue_len = 1;
+	const twai_filter_config_t filterConfig = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+
+	twai_timing_config_t timingConfig;
+	switch (this->bitrate_)
+	{
+	case 125000:
+		timingConfig = TWAI_TIMING_CONFIG_125KBITS();
+		break;
+	case 250000:
+		timingConfig = TWAI_TIMING_CONFIG_250KBITS();
+		break;
+	case 500000:
+		timingConfig = TWAI_TIMING_CONFIG_500KBITS();
+		break;
+	case 1000000:
+		timingConfig = TWAI_TIMING_CONFIG_1MBITS();
+		break;
+	default:
+		return false;
+	}
+
+	if (twai_driver_install(&generalConfig, &timingConfig, &filterConfig) != ESP_OK)
+	{
+		return false;
+	}
+	if (twai_start() != ESP_OK)
+	{
+		twai_driver_uninstall();
+		return false;
+	}
+
+	this->started_ = true;
+	return true;
+}
+
+/**
+ * @brief Stop and uninstall the TWAI driver.
+ */
+void TwaiCanBus::end()
+{
+	if (!this->started_)
+	{
+		return;
+	}
+
+	twai_stop();
+	twai_driver_uninstall();
+	this->started_ = false;
+}
+
+/**
+ * @brief Queue a frame for transmission without waiting.
+ * @param frame frame to send
+ * @return true when the frame was queued
+ * @return false when the queue is full or the controller is not running
+ */
+const bool TwaiCanBus::send(const CanFrame &frame)
+{
+	if (!this->started_)
+	{
+		return false;
+	}
+
+	twai_message_t message;
+	memset(&message, 0, sizeof(message));
+	message.identifier = frame.id;
+	message.data_length_code = frame.length;
+	memcpy(message.data, frame.data, frame.length);
+	if (twai_transmit(&message, 0) == ESP_OK)
+	{
+		return true;
+	}
+
+	this->recover_();
+	return false;
+}
+
+/**
+ * @brief Recover from bus off, e.g. after the inverter was disconnected.
+ */
+void TwaiCanBus::recover_()
+{
+	twai_status_info_t status;
+	if (twai_get_status_info(&status) != ESP_OK)
+	{
+		return;
+	}
+
+	if (status.state == TWAI_STATE_BUS_OFF)
+	{
+		twai_initiate_recovery();
+	}
+	else if (status.state == TWAI_STATE_STOPPED)
+	{
+		twai_start();
+	}
+}
+
+#endif
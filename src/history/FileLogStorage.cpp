@@ -0,0 +1,243 @@
+/**
+ * @file FileLogStorage.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the FileLogStorage class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#if defined(__linux__) && !defined(ARDUINO)
+
+#include "history/FileLogStorage.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Create a new instance of FileLogStorage.
+ * @param path path of the file, it is created and filled with erased bytes if needed
+ * @param size size of the emulated flash in bytes
+ * @param eraseSize size of an emulated sector in bytes
+ */
+FileLogStorage::FileLogStorage(const char *path, const size_t size, const size_t eraseSize)
+{
+	this->path_ = path;
+	this->size_ = size;
+	this->eraseSize_ = eraseSize;
+	this->file_ = -1;
+	this->powerCut_ = false;
+	this->budget_ = 0;
+	this->poweredOff_ = false;
+}
+
+/**
+ * @brief Destroy the FileLogStorage instance and close the file.
+ */
+FileLogStorage::~FileLogStorage()
+{
+	this->end();
+}
+
+/**
+ * @brief Open the file, this also restores the power after a simulated power cut.
+ * @return true on success
+ */
+const bool FileLogStorage::begin()
+{
+	this->end();
+	this->file_ = open(this->path_, O_RDWR | O_CREAT, 0644);
+	if (this->file_ < 0)
+	{
+		return false;
+	}
+
+	// New parts of the file are erased flash
+	struct stat fileStat;
+	if (fstat(this->file_, &fileStat) != 0)
+	{
+		this->end();
+		return false;
+	}
+	uint8_t erased[256];
+	memset(erased, 0xFF, sizeof(erased));
+	for (size_t offset = fileStat.st_size; offset < this->size_; offset += sizeof(erased))
+	{
+		const size_t length = this->size_ - offset < sizeof(erased) ? this->size_ - offset : sizeof(erased);
+		if (pwrite(this->file_, erased, length, offset) != static_cast<ssize_t>(length))
+		{
+			this->end();
+			return false;
+		}
+	}
+
+	this->powerCut_ = false;
+	this->poweredOff_ = false;
+	return true;
+}
+
+/**
+ * @brief Close the file.
+ */
+void FileLogStorage::end()
+{
+	if (this->file_ >= 0)
+	{
+		close(this->file_);
+		this->file_ = -1;
+	}
+}
+
+/**
+ * @brief Get the size of the emulated flash.
+ * @return size in bytes
+ */
+const size_t FileLogStorage::getSize() const
+{
+	return this->size_;
+}
+
+/**
+ * @brief Get the size of an emulated sector.
+ * @return size in bytes
+ */
+const size_t FileLogStorage::getEraseSize() const
+{
+	return this->eraseSize_;
+}
+
+/**
+ * @brief Read from the file.
+ * @param offset offset in the emulated flash
+ * @param data buffer that receives the data
+ * @param length number of bytes
+ * @return true on success
+ */
+const bool FileLogStorage::read(const size_t offset, void *data, const size_t length)
+{
+	if (this->file_ < 0 || this->poweredOff_ || offset + length > this->size_)
+	{
+		return false;
+	}
+	return pread(this->file_, data, length, offset) == static_cast<ssize_t>(length);
+}
+
+/**
+ * @brief Clear the bits that are cleared in the data.
+ * @param offset offset in the emulated flash
+ * @param data data to write
+ * @param length number of bytes
+ * @return true on success, false if the file failed or the power was cut
+ */
+const bool FileLogStorage::write(const size_t offset, const void *data, const size_t length)
+{
+	if (this->file_ < 0 || this->poweredOff_ || offset + length > this->size_)
+	{
+		return false;
+	}
+
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	const size_t allowed = this->consume_(length);
+	uint8_t buffer[256];
+	for (size_t done = 0; done < allowed; done += sizeof(buffer))
+	{
+		const size_t count = allowed - done < sizeof(buffer) ? allowed - done : sizeof(buffer);
+		if (pread(this->file_, buffer, count, offset + done) != static_cast<ssize_t>(count))
+		{
+			return false;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			buffer[i] &= bytes[done + i];
+		}
+		if (pwrite(this->file_, buffer, count, offset + done) != static_cast<ssize_t>(count))
+		{
+			return false;
+		}
+	}
+	return allowed == length;
+}
+
+/**
+ * @brief Set all bits of whole sectors.
+ * @param offset offset in the emulated flash, aligned to the sector size
+ * @param length number of bytes, a multiple of the sector size
+ * @return true on success, false if the file failed or the power was cut
+ */
+const bool FileLogStorage::erase(const size_t offset, const size_t length)
+{
+	if (this->file_ < 0 || this->poweredOff_ || offset % this->eraseSize_ != 0 || length % this->eraseSize_ != 0 || offset + length > this->size_)
+	{
+		return false;
+	}
+
+	const size_t allowed = this->consume_(length);
+	uint8_t erased[256];
+	memset(erased, 0xFF, sizeof(erased));
+	for (size_t done = 0; done < allowed; done += sizeof(erased))
+	{
+		const size_t count = allowed - done < sizeof(erased) ? allowed - done : sizeof(erased);
+		if (pwrite(this->file_, erased, count, offset + done) != static_cast<ssize_t>(count))
+		{
+			return false;
+		}
+	}
+	return allowed == length;
+}
+
+/**
+ * @brief Cut the power once the given number of bytes was written or erased.
+ * @param bytes number of bytes that are still applied
+ */
+void FileLogStorage::setPowerCutAfter(const size_t bytes)
+{
+	this->powerCut_ = true;
+	this->budget_ = bytes;
+}
+
+/**
+ * @brief Check if the simulated power was cut.
+ * @return true if every operation fails until begin is called again
+ */
+const bool FileLogStorage::isPoweredOff() const
+{
+	return this->poweredOff_;
+}
+
+/**
+ * @brief Take bytes from the budget of the simulated power cut.
+ * @param length number of bytes of the operation
+ * @return number of bytes that are applied
+ */
+const size_t FileLogStorage::consume_(const size_t length)
+{
+	if (!this->powerCut_)
+	{
+		return length;
+	}
+	if (length < this->budget_)
+	{
+		this->budget_ -= length;
+		return length;
+	}
+
+	const size_t allowed = this->budget_;
+	this->budget_ = 0;
+	this->poweredOff_ = true;
+	return allowed;
+}
+
+#endif
@@ -0,0 +1,598 @@
+/**
+ * @file FlashLog.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the FlashLog class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "history/FlashLog.h"
+
+#include <string.h>
+
+#include "util/Crc32.h"
+
+/**
+ * @brief Create a new instance of FlashLog without storage.
+ */
+FlashLog::FlashLog()
+{
+	this->storage_ = nullptr;
+	this->end();
+}
+
+/**
+ * @brief Destroy the FlashLog instance.
+ */
+FlashLog::~FlashLog()
+{
+}
+
+/**
+ * @brief Mount the log and continue behind the last valid record.
+ * A storage without any valid segment is formatted.
+ * @param storage storage of the log, it must stay valid until end is called
+ * @param segmentSize size of a segment, a multiple of the erase size
+ * @return true on success, false if the storage failed or is too small for two segments
+ */
+const bool FlashLog::begin(LogStorage *storage, const size_t segmentSize)
+{
+	this->end();
+	if (storage == nullptr || !storage->begin())
+	{
+		return false;
+	}
+
+	const size_t eraseSize = storage->getEraseSize();
+	if (eraseSize == 0 || eraseSize % LOG_PAGE_SIZE != 0 || segmentSize % eraseSize != 0 || segmentSize <= LOG_SEGMENT_HEADER_SIZE + LOG_RECORD_HEADER_SIZE ||
+		storage->getSize() / segmentSize < 2)
+	{
+		return false;
+	}
+
+	this->storage_ = storage;
+	this->segmentSize_ = segmentSize;
+	this->segmentCount_ = storage->getSize() / segmentSize;
+	if (!this->recover_())
+	{
+		this->end();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Release the storage, records that were not flushed are lost.
+ */
+void FlashLog::end()
+{
+	this->storage_ = nullptr;
+	this->segmentSize_ = 0;
+	this->segmentCount_ = 0;
+	this->activeSegment_ = 0;
+	this->activeSequence_ = 0;
+	this->usedSegments_ = 0;
+	this->writeOffset_ = 0;
+	this->pageOffset_ = 0;
+	this->pageFlushed_ = 0;
+	this->tornRecords_ = 0;
+	this->eraseCount_ = 0;
+	this->writeErrors_ = 0;
+	memset(this->page_, 0xFF, sizeof(this->page_));
+}
+
+/**
+ * @brief Add a record, it is written once its page is full or flush is called.
+ * The oldest segment is erased if a new segment is needed and all segments are in use.
+ * @param data data of the record
+ * @param length length of the data, at least 1 byte and at most getMaxRecordSize
+ * @return true if the record was added
+ */
+const bool FlashLog::append(const void *data, const size_t length)
+{
+	if (this->storage_ == nullptr || length == 0 || length > this->getMaxRecordSize())
+	{
+		return false;
+	}
+
+	const size_t segmentEnd = (this->activeSegment_ + 1) * this->segmentSize_;
+	if (this->writeOffset_ + LOG_RECORD_HEADER_SIZE + length > segmentEnd)
+	{
+		this->flush();
+		if (!this->openSegment_((this->activeSegment_ + 1) % this->segmentCount_, this->activeSequence_ + 1))
+		{
+			return false;
+		}
+	}
+
+	uint8_t header[LOG_RECORD_HEADER_SIZE];
+	const uint16_t recordLength = length;
+	const uint16_t invertedLength = ~recordLength;
+	const uint32_t crc = Crc32::calculate(static_cast<const uint8_t *>(data), length);
+	memcpy(&header[0], &recordLength, sizeof(recordLength));
+	memcpy(&header[2], &invertedLength, sizeof(invertedLength));
+	memcpy(&header[4], &crc, sizeof(crc));
+	if (!this->put_(header, sizeof(header)) || !this->put_(data, length))
+	{
+		// The segment may contain a torn record now, continue in a new one
+		this->writeOffset_ = this->pageOffset_ = this->pageFlushed_ = (this->activeSegment_ + 1) * this->segmentSize_;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Write the buffered bytes of the current page.
+ * The page is not padded, the next write continues in the same page.
+ * @return true on success
+ */
+const bool FlashLog::flush()
+{
+	if (this->storage_ == nullptr)
+	{
+		return false;
+	}
+	return this->writePage_(this->writeOffset_);
+}
+
+/**
+ * @brief Remove all records.
+ * Old segments are not erased, the sequence number skips them so they are ignored when the log is mounted.
+ * @return true on success
+ */
+const bool FlashLog::clear()
+{
+	if (this->storage_ == nullptr)
+	{
+		return false;
+	}
+	this->usedSegments_ = 0;
+	return this->openSegment_((this->activeSegment_ + 1) % this->segmentCount_, this->activeSequence_ + this->segmentCount_ + 1);
+}
+
+/**
+ * @brief Position a cursor at the oldest record.
+ * @param cursor cursor to position
+ * @return true on success, false if the log is not mounted
+ */
+const bool FlashLog::rewind(LogCursor &cursor) const
+{
+	cursor.valid = this->storage_ != nullptr && this->usedSegments_ > 0;
+	if (!cursor.valid)
+	{
+		return false;
+	}
+	cursor.sequence = this->activeSequence_ + 1 - this->usedSegments_;
+	cursor.offset = LOG_SEGMENT_HEADER_SIZE;
+	return true;
+}
+
+/**
+ * @brief Read the next record, from the oldest to the newest one.
+ * Records that are larger than the buffer are skipped.
+ * @param cursor cursor positioned by rewind
+ * @param data buffer that receives the record
+ * @param size size of the buffer
+ * @param length length of the record
+ * @return true if a record was read, false if there are no newer records
+ */
+const bool FlashLog::next(LogCursor &cursor, void *data, const size_t size, size_t &length) const
+{
+	if (!cursor.valid || this->storage_ == nullptr || this->usedSegments_ == 0)
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		// The segment of the cursor was erased, continue with the oldest one
+		const uint32_t oldestSequence = this->activeSequence_ + 1 - this->usedSegments_;
+		if (static_cast<int32_t>(cursor.sequence - oldestSequence) < 0)
+		{
+			cursor.sequence = oldestSequence;
+			cursor.offset = LOG_SEGMENT_HEADER_SIZE;
+		}
+		if (static_cast<int32_t>(cursor.sequence - this->activeSequence_) > 0)
+		{
+			return false;
+		}
+
+		const uint32_t segment = (this->activeSegment_ + this->segmentCount_ - (this->activeSequence_ - cursor.sequence)) % this->segmentCount_;
+		const size_t segmentStart = segment * this->segmentSize_;
+		const size_t segmentEnd = segmentStart + this->segmentSize_;
+		uint16_t recordLength = 0;
+		uint32_t crc = 0;
+		if (this->readRecordHeader_(segmentEnd, segmentStart + cursor.offset, recordLength, crc))
+		{
+			const size_t dataOffset = segmentStart + cursor.offset + LOG_RECORD_HEADER_SIZE;
+			if (recordLength > size)
+			{
+				cursor.offset += LOG_RECORD_HEADER_SIZE + recordLength;
+				continue;
+			}
+			if (this->read_(dataOffset, data, recordLength) && Crc32::calculate(static_cast<uint8_t *>(data), recordLength) == crc)
+			{
+				cursor.offset += LOG_RECORD_HEADER_SIZE + recordLength;
+				length = recordLength;
+				return true;
+			}
+		}
+
+		// The end of a segment or a torn record
+		if (cursor.sequence == this->activeSequence_)
+		{
+			return false;
+		}
+		cursor.sequence++;
+		cursor.offset = LOG_SEGMENT_HEADER_SIZE;
+	}
+}
+
+/**
+ * @brief Get the size of the largest record.
+ * @return size in bytes
+ */
+const size_t FlashLog::getMaxRecordSize() const
+{
+	const size_t size = this->segmentSize_ - LOG_SEGMENT_HEADER_SIZE - LOG_RECORD_HEADER_SIZE;
+	return size < 0xFFFF ? size : 0xFFFF;
+}
+
+/**
+ * @brief Get the number of segments.
+ * @return number of segments
+ */
+const uint32_t FlashLog::getSegmentCount() const
+{
+	return this->segmentCount_;
+}
+
+/**
+ * @brief Get the number of segments that contain records.
+ * @return number of segments including the one that is written
+ */
+const uint32_t FlashLog::getUsedSegmentCount() const
+{
+	return this->usedSegments_;
+}
+
+/**
+ * @brief Get the number of used bytes.
+ * @return bytes including headers and buffered bytes
+ */
+const size_t FlashLog::getUsedBytes() const
+{
+	if (this->usedSegments_ == 0)
+	{
+		return 0;
+	}
+	return (this->usedSegments_ - 1) * this->segmentSize_ + this->writeOffset_ - this->activeSegment_ * this->segmentSize_;
+}
+
+/**
+ * @brief Get the number of bytes that are only buffered in RAM.
+ * @return bytes that are lost on a power loss
+ */
+const size_t FlashLog::getPendingBytes() const
+{
+	return this->writeOffset_ - this->pageFlushed_;
+}
+
+/**
+ * @brief Get the sequence number of the segment that is written.
+ * It increases with every segment, divided by the number of segments it is the number of erase cycles of a segment.
+ * @return sequence number
+ */
+const uint32_t FlashLog::getSequence() const
+{
+	return this->activeSequence_;
+}
+
+/**
+ * @brief Get the number of torn records that were found when the log was mounted.
+ * @return number of torn records
+ */
+const uint32_t FlashLog::getRecoveredTornRecords() const
+{
+	return this->tornRecords_;
+}
+
+/**
+ * @brief Get the number of segments that were erased since the log was mounted.
+ * @return number of erased segments
+ */
+const uint32_t FlashLog::getEraseCount() const
+{
+	return this->eraseCount_;
+}
+
+/**
+ * @brief Get the number of failed writes and erases since the log was mounted.
+ * @return number of errors
+ */
+const uint32_t FlashLog::getWriteErrorCount() const
+{
+	return this->writeErrors_;
+}
+
+/**
+ * @brief Read and check the header of a segment.
+ * @param segment number of the segment
+ * @param sequence sequence number of the segment
+ * @return true if the header is valid
+ */
+const bool FlashLog::readSegmentHeader_(const uint32_t segment, uint32_t &sequence)
+{
+	uint32_t header[LOG_SEGMENT_HEADER_SIZE / sizeof(uint32_t)];
+	if (!this->storage_->read(segment * this->segmentSize_, header, sizeof(header)))
+	{
+		return false;
+	}
+	if (header[0] != LOG_SEGMENT_MAGIC || header[3] != Crc32::calculate(reinterpret_cast<uint8_t *>(header), 3 * sizeof(uint32_t)))
+	{
+		return false;
+	}
+	sequence = header[1];
+	return true;
+}
+
+/**
+ * @brief Erase a segment and start writing it.
+ * @param segment number of the segment
+ * @param sequence sequence number of the segment
+ * @return true on success
+ */
+const bool FlashLog::openSegment_(const uint32_t segment, const uint32_t sequence)
+{
+	// The oldest segment is lost as soon as it is erased
+	if (this->usedSegments_ == this->segmentCount_)
+	{
+		this->usedSegments_--;
+	}
+
+	const size_t segmentStart = segment * this->segmentSize_;
+	this->eraseCount_++;
+	if (!this->storage_->erase(segmentStart, this->segmentSize_))
+	{
+		this->writeErrors_++;
+		return false;
+	}
+
+	uint32_t header[LOG_SEGMENT_HEADER_SIZE / sizeof(uint32_t)] = {LOG_SEGMENT_MAGIC, sequence, 0, 0};
+	header[3] = Crc32::calculate(reinterpret_cast<uint8_t *>(header), 3 * sizeof(uint32_t));
+	if (!this->storage_->write(segmentStart, header, sizeof(header)))
+	{
+		this->writeErrors_++;
+		return false;
+	}
+
+	this->activeSegment_ = segment;
+	this->activeSequence_ = sequence;
+	this->usedSegments_++;
+	this->writeOffset_ = segmentStart + LOG_SEGMENT_HEADER_SIZE;
+	this->pageOffset_ = segmentStart;
+	this->pageFlushed_ = this->writeOffset_;
+	memset(this->page_, 0xFF, sizeof(this->page_));
+	memcpy(this->page_, header, sizeof(header));
+	return true;
+}
+
+/**
+ * @brief Find the newest segment and the end of its records.
+ * @return true on success, false if the storage failed
+ */
+const bool FlashLog::recover_()
+{
+	bool found = false;
+	for (uint32_t segment = 0; segment < this->segmentCount_; segment++)
+	{
+		uint32_t sequence = 0;
+		if (this->readSegmentHeader_(segment, sequence) && (!found || static_cast<int32_t>(sequence - this->activeSequence_) > 0))
+		{
+			found = true;
+			this->activeSegment_ = segment;
+			this->activeSequence_ = sequence;
+		}
+	}
+	if (!found)
+	{
+		return this->openSegment_(0, 1);
+	}
+
+	// Older segments are in use as long as their sequence numbers are consecutive
+	this->usedSegments_ = 1;
+	while (this->usedSegments_ < this->segmentCount_)
+	{
+		uint32_t sequence = 0;
+		const uint32_t segment = (this->activeSegment_ + this->segmentCount_ - this->usedSegments_) % this->segmentCount_;
+		if (!this->readSegmentHeader_(segment, sequence) || sequence != this->activeSequence_ - this->usedSegments_)
+		{
+			break;
+		}
+		this->usedSegments_++;
+	}
+
+	const size_t segmentStart = this->activeSegment_ * this->segmentSize_;
+	const size_t segmentEnd = segmentStart + this->segmentSize_;
+	size_t offset = segmentStart + LOG_SEGMENT_HEADER_SIZE;
+	uint16_t length = 0;
+	uint32_t crc = 0;
+	while (this->readRecordHeader_(segmentEnd, offset, length, crc) && this->checkRecord_(offset + LOG_RECORD_HEADER_SIZE, length, crc))
+	{
+		offset += LOG_RECORD_HEADER_SIZE + length;
+	}
+
+	// Bytes of a torn record can not be written again
+	if (!this->isErased_(offset, segmentEnd - offset))
+	{
+		this->tornRecords_++;
+		return this->openSegment_((this->activeSegment_ + 1) % this->segmentCount_, this->activeSequence_ + 1);
+	}
+
+	this->writeOffset_ = offset;
+	this->pageOffset_ = offset - (offset - segmentStart) % LOG_PAGE_SIZE;
+	this->pageFlushed_ = offset;
+	memset(this->page_, 0xFF, sizeof(this->page_));
+	return this->storage_->read(this->pageOffset_, this->page_, offset - this->pageOffset_);
+}
+
+/**
+ * @brief Check if a range of the storage is erased.
+ * @param offset offset in the storage
+ * @param length number of bytes
+ * @return true if all bits are set
+ */
+const bool FlashLog::isErased_(const size_t offset, const size_t length)
+{
+	uint32_t buffer[LOG_PAGE_SIZE / sizeof(uint32_t)];
+	for (size_t done = 0; done < length; done += sizeof(buffer))
+	{
+		const size_t count = length - done < sizeof(buffer) ? length - done : sizeof(buffer);
+		if (!this->storage_->read(offset + done, buffer, count))
+		{
+			return false;
+		}
+		const uint8_t *bytes = reinterpret_cast<uint8_t *>(buffer);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (bytes[i] != 0xFF)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Read and check the header of a record.
+ * @param segmentEnd end of the segment of the record
+ * @param offset offset of the record in the storage
+ * @param length length of the record
+ * @param crc CRC32 of the record
+ * @return true if the header is valid and the record fits the segment
+ */
+const bool FlashLog::readRecordHeader_(const size_t segmentEnd, const size_t offset, uint16_t &length, uint32_t &crc) const
+{
+	uint8_t header[LOG_RECORD_HEADER_SIZE];
+	if (offset + sizeof(header) > segmentEnd || !this->read_(offset, header, sizeof(header)))
+	{
+		return false;
+	}
+
+	uint16_t invertedLength = 0;
+	memcpy(&length, &header[0], sizeof(length));
+	memcpy(&invertedLength, &header[2], sizeof(invertedLength));
+	memcpy(&crc, &header[4], sizeof(crc));
+	return static_cast<uint16_t>(length ^ invertedLength) == 0xFFFF && length > 0 && offset + sizeof(header) + length <= segmentEnd;
+}
+
+/**
+ * @brief Check the CRC32 of a record in the storage.
+ * @param offset offset of the data of the record
+ * @param length length of the record
+ * @param crc expected CRC32
+ * @return true if the record is valid
+ */
+const bool FlashLog::checkRecord_(const size_t offset, const uint16_t length, const uint32_t crc) const
+{
+	Crc32 calculated;
+	uint8_t buffer[LOG_PAGE_SIZE];
+	for (size_t done = 0; done < length; done += sizeof(buffer))
+	{
+		const size_t count = length - done < sizeof(buffer) ? length - done : sizeof(buffer);
+		if (!this->read_(offset + done, buffer, count))
+		{
+			return false;
+		}
+		calculated.update(buffer, count);
+	}
+	return calculated.getValue() == crc;
+}
+
+/**
+ * @brief Read from the storage, buffered bytes of the current page are included.
+ * @param offset offset in the storage
+ * @param data buffer that receives the data
+ * @param length number of bytes
+ * @return true on success
+ */
+const bool FlashLog::read_(const size_t offset, void *data, const size_t length) const
+{
+	if (!this->storage_->read(offset, data, length))
+	{
+		return false;
+	}
+
+	const size_t start = offset > this->pageFlushed_ ? offset : this->pageFlushed_;
+	const size_t end = offset + length < this->writeOffset_ ? offset + length : this->writeOffset_;
+	if (start < end)
+	{
+		memcpy(static_cast<uint8_t *>(data) + start - offset, &this->page_[start - this->pageOffset_], end - start);
+	}
+	return true;
+}
+
+/**
+ * @brief Add bytes to the page buffer and write the page once it is full.
+ * @param data bytes to add
+ * @param length number of bytes
+ * @return true on success
+ */
+const bool FlashLog::put_(const void *data, const size_t length)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	size_t done = 0;
+	while (done < length)
+	{
+		const size_t position = this->writeOffset_ - this->pageOffset_;
+		const size_t count = length - done < LOG_PAGE_SIZE - position ? length - done : LOG_PAGE_SIZE - position;
+		memcpy(&this->page_[position], &bytes[done], count);
+		this->writeOffset_ += count;
+		done += count;
+
+		if (this->writeOffset_ - this->pageOffset_ == LOG_PAGE_SIZE)
+		{
+			if (!this->writePage_(this->writeOffset_))
+			{
+				return false;
+			}
+			this->pageOffset_ = this->writeOffset_;
+			this->pageFlushed_ = this->writeOffset_;
+			memset(this->page_, 0xFF, sizeof(this->page_));
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Write the bytes of the page buffer that were not written yet.
+ * @param end end of the bytes to write
+ * @return true on success
+ */
+const bool FlashLog::writePage_(const size_t end)
+{
+	if (end <= this->pageFlushed_)
+	{
+		return true;
+	}
+	if (!this->storage_->write(this->pageFlushed_, &this->page_[this->pageFlushed_ - this->pageOffset_], end - this->pageFlushed_))
+	{
+		this->writeErrors_++;
+		return false;
+	}
+	this->pageFlushed_ = end;
+	return true;
+}
@@ -0,0 +1,529 @@
+/**
+ * @file HistoryArchive.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the HistoryArchive class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "history/HistoryArchive.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#endif
+
+static const uint32_t ARCHIVE_INTERVALS[HISTORY_ARCHIVE_LEVEL_COUNT] = {60, 15 * 60, 24 * 60 * 60};
+static const uint32_t ARCHIVE_ROWS[HISTORY_ARCHIVE_LEVEL_COUNT] = {HISTORY_ARCHIVE_MINUTE_ROWS, HISTORY_ARCHIVE_QUARTER_ROWS, HISTORY_ARCHIVE_DAY_ROWS};
+static const HistoryChannel ARCHIVE_CHANNELS[HISTORY_ARCHIVE_CHANNEL_COUNT] = {
+	HISTORY_PACK_VOLTAGE, HISTORY_PACK_CURRENT, HISTORY_PACK_SOC, HISTORY_LOWEST_CELL_TEMPERATURE, HISTORY_HIGHEST_CELL_TEMPERATURE};
+
+// Steps of the channel scale per step of a row, the pack voltage is stored in steps of 0.05 V up to 1638 V
+static const int64_t ARCHIVE_DIVISORS[HISTORY_ARCHIVE_CHANNEL_COUNT] = {10, 1, 1, 1, 1};
+
+#define ARCHIVE_TOTAL_ROWS (HISTORY_ARCHIVE_MINUTE_ROWS + HISTORY_ARCHIVE_QUARTER_ROWS + HISTORY_ARCHIVE_DAY_ROWS)
+
+/**
+ * @brief Create a new instance of HistoryArchive without memory.
+ */
+HistoryArchive::HistoryArchive()
+{
+	this->memory_ = nullptr;
+	this->psram_ = false;
+	this->listener_ = nullptr;
+	this->end();
+}
+
+/**
+ * @brief Destroy the HistoryArchive instance and free the memory.
+ */
+HistoryArchive::~HistoryArchive()
+{
+	this->end();
+}
+
+/**
+ * @brief Allocate the memory of the archives, in PSRAM if available.
+ * @return true on success, false if the memory could not be allocated
+ */
+const bool HistoryArchive::begin()
+{
+	this->end();
+
+	const size_t size = ARCHIVE_TOTAL_ROWS * sizeof(HistoryArchiveRow);
+#ifdef ARDUINO
+	if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0)
+	{
+		this->memory_ = static_cast<HistoryArchiveRow *>(heap_caps_malloc(size, MALLOC_CAP_SPIRAM));
+		this->psram_ = this->memory_ != nullptr;
+	}
+	if (this->memory_ == nullptr)
+	{
+		this->memory_ = static_cast<HistoryArchiveRow *>(heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+	}
+#else
+	this->memory_ = static_cast<HistoryArchiveRow *>(malloc(size));
+#endif
+
+	if (this->memory_ == nullptr)
+	{
+		return false;
+	}
+	this->rows_[HISTORY_ARCHIVE_MINUTE] = this->memory_;
+	this->rows_[HISTORY_ARCHIVE_QUARTER] = this->rows_[HISTORY_ARCHIVE_MINUTE] + HISTORY_ARCHIVE_MINUTE_ROWS;
+	this->rows_[HISTORY_ARCHIVE_DAY] = this->rows_[HISTORY_ARCHIVE_QUARTER] + HISTORY_ARCHIVE_QUARTER_ROWS;
+	this->clear();
+	return true;
+}
+
+/**
+ * @brief Free the memory of the archives.
+ */
+void HistoryArchive::end()
+{
+	free(this->memory_);
+	this->memory_ = nullptr;
+	this->psram_ = false;
+	for (uint8_t i = 0; i < HISTORY_ARCHIVE_LEVEL_COUNT; i++)
+	{
+		this->rows_[i] = nullptr;
+	}
+	this->clear();
+}
+
+/**
+ * @brief Add a sample to the open minute.
+ * @param sample sample with the unix time in ms
+ */
+void HistoryArchive::update(const HistorySample &sample)
+{
+	if (this->memory_ == nullptr || sample.getTime() < 0)
+	{
+		return;
+	}
+
+	const int64_t slot = sample.getTime() / 1000 / ARCHIVE_INTERVALS[HISTORY_ARCHIVE_MINUTE];
+	if (this->open_[HISTORY_ARCHIVE_MINUTE].count > 0 && slot < this->open_[HISTORY_ARCHIVE_MINUTE].slot)
+	{
+		this->dropped_++;
+		return;
+	}
+
+	Accumulator values;
+	values.slot = slot;
+	values.count = 1;
+	for (uint8_t i = 0; i < HISTORY_ARCHIVE_CHANNEL_COUNT; i++)
+	{
+		const int32_t value = sample.getRawValue(ARCHIVE_CHANNELS[i]);
+		values.min[i] = value;
+		values.max[i] = value;
+		values.sum[i] = value;
+	}
+	this->add_(HISTORY_ARCHIVE_MINUTE, slot, values);
+
+	if (this->firstTimeMs_ < 0)
+	{
+		this->firstTimeMs_ = sample.getTime();
+	}
+	this->lastTimeMs_ = sample.getTime();
+}
+
+/**
+ * @brief Remove all rows.
+ */
+void HistoryArchive::clear()
+{
+	for (uint8_t i = 0; i < HISTORY_ARCHIVE_LEVEL_COUNT; i++)
+	{
+		this->lastSlot_[i] = -1;
+		this->open_[i].count = 0;
+	}
+	this->firstTimeMs_ = -1;
+	this->lastTimeMs_ = -1;
+	this->dropped_ = 0;
+	this->clamped_ = 0;
+
+	if (this->memory_ != nullptr)
+	{
+		for (uint32_t i = 0; i < ARCHIVE_TOTAL_ROWS; i++)
+		{
+			for (uint8_t j = 0; j < HISTORY_ARCHIVE_CHANNEL_COUNT; j++)
+			{
+				this->memory_[i].min[j] = HISTORY_ARCHIVE_UNKNOWN;
+				this->memory_[i].avg[j] = HISTORY_ARCHIVE_UNKNOWN;
+				this->memory_[i].max[j] = HISTORY_ARCHIVE_UNKNOWN;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Restore a persisted row, it is also consolidated into the open slot of the next level.
+ * Entries of a level must be imported in the order they were closed and before any sample is added.
+ * @param entry closed row
+ * @return true if the row was restored, false if it is invalid or not newer than the rows of its level
+ */
+const bool HistoryArchive::importEntry(const HistoryArchiveEntry &entry)
+{
+	if (this->memory_ == nullptr || entry.version != HISTORY_ARCHIVE_ENTRY_VERSION || entry.level >= HISTORY_ARCHIVE_LEVEL_COUNT ||
+		entry.count == 0 || entry.slot < 0 || entry.slot <= this->lastSlot_[entry.level])
+	{
+		return false;
+	}
+
+	Accumulator values;
+	values.slot = entry.slot;
+	values.count = entry.count;
+	for (uint8_t i = 0; i < HISTORY_ARCHIVE_CHANNEL_COUNT; i++)
+	{
+		values.min[i] = entry.row.min[i] * ARCHIVE_DIVISORS[i];
+		values.max[i] = entry.row.max[i] * ARCHIVE_DIVISORS[i];
+		values.sum[i] = entry.row.avg[i] * ARCHIVE_DIVISORS[i] * entry.count;
+	}
+	this->store_(entry.level, entry.slot, values);
+	this->consolidate_(entry.level, values);
+
+	const int64_t startMs = entry.slot * ARCHIVE_INTERVALS[entry.level] * 1000LL;
+	const int64_t endMs = startMs + ARCHIVE_INTERVALS[entry.level] * 1000LL - 1;
+	if (this->firstTimeMs_ < 0 || startMs < this->firstTimeMs_)
+	{
+		this->firstTimeMs_ = startMs;
+	}
+	if (endMs > this->lastTimeMs_)
+	{
+		this->lastTimeMs_ = endMs;
+	}
+	return true;
+}
+
+/**
+ * @brief Set the function that is called with every closed row.
+ * @param listener function or nullptr
+ */
+void HistoryArchive::setListener(HistoryArchiveListener listener)
+{
+	this->listener_ = listener;
+}
+
+/**
+ * @brief Read the row of a slot, the open slot includes the samples that were not consolidated yet.
+ * @param level level of the archive
+ * @param slot unix time in seconds divided by the interval of the level
+ * @param row row that receives the values
+ * @return true if there were samples in the slot
+ */
+const bool HistoryArchive::read(const HistoryArchiveLevel level, const int64_t slot, HistoryArchiveRow &row) const
+{
+	if (this->memory_ == nullptr || level >= HISTORY_ARCHIVE_LEVEL_COUNT)
+	{
+		return false;
+	}
+
+	// The open slots of the finer levels belong to the open slot of this level
+	Accumulator values;
+	values.count = 0;
+	for (uint8_t i = 0; i <= level; i++)
+	{
+		const Accumulator &open = this->open_[i];
+		if (open.count > 0 && open.slot * ARCHIVE_INTERVALS[i] / ARCHIVE_INTERVALS[level] == slot)
+		{
+			merge_(values, open);
+		}
+	}
+	if (values.count > 0)
+	{
+		toRow_(values, row);
+		return true;
+	}
+
+	const int64_t lastSlot = this->lastSlot_[level];
+	if (lastSlot < 0 || slot > lastSlot || slot <= lastSlot - ARCHIVE_ROWS[level])
+	{
+		return false;
+	}
+	row = this->rows_[level][slot % ARCHIVE_ROWS[level]];
+	return row.min[0] != HISTORY_ARCHIVE_UNKNOWN;
+}
+
+/**
+ * @brief Get the oldest slot that can contain samples.
+ * @param level level of the archive
+ * @return slot or -1 without samples
+ */
+const int64_t HistoryArchive::getFirstSlot(const HistoryArchiveLevel level) const
+{
+	if (this->firstTimeMs_ < 0 || level >= HISTORY_ARCHIVE_LEVEL_COUNT)
+	{
+		return -1;
+	}
+	const int64_t firstSlot = this->firstTimeMs_ / 1000 / ARCHIVE_INTERVALS[level];
+	const int64_t oldestRow = this->lastSlot_[level] + 1 - ARCHIVE_ROWS[level];
+	return firstSlot > oldestRow ? firstSlot : oldestRow;
+}
+
+/**
+ * @brief Get the newest slot that can contain samples, this is the open slot.
+ * @param level level of the archive
+ * @return slot or -1 without samples
+ */
+const int64_t HistoryArchive::getLastSlot(const HistoryArchiveLevel level) const
+{
+	if (this->lastTimeMs_ < 0 || level >= HISTORY_ARCHIVE_LEVEL_COUNT)
+	{
+		return -1;
+	}
+	return this->lastTimeMs_ / 1000 / ARCHIVE_INTERVALS[level];
+}
+
+/**
+ * @brief Get the number of samples that were dropped because they were older than the open minute.
+ * @return number of samples
+ */
+const uint32_t HistoryArchive::getDroppedSampleCount() const
+{
+	return this->dropped_;
+}
+
+/**
+ * @brief Get the number of stored values that were outside of the range of a row.
+ * @return number of values
+ */
+const uint32_t HistoryArchive::getClampedValueCount() const
+{
+	return this->clamped_;
+}
+
+/**
+ * @brief Get the size of the allocated memory.
+ * @return size in bytes
+ */
+const size_t HistoryArchive::getSize() const
+{
+	return this->memory_ != nullptr ? ARCHIVE_TOTAL_ROWS * sizeof(HistoryArchiveRow) : 0;
+}
+
+/**
+ * @brief Check where the archives are stored.
+ * @return true if the archives are in PSRAM
+ */
+const bool HistoryArchive::isInPsram() const
+{
+	return this->psram_;
+}
+
+/**
+ * @brief Get the interval of a level.
+ * @param level level of the archive
+ * @return interval in seconds
+ */
+const uint32_t HistoryArchive::getInterval(const HistoryArchiveLevel level)
+{
+	return level < HISTORY_ARCHIVE_LEVEL_COUNT ? ARCHIVE_INTERVALS[level] : 0;
+}
+
+/**
+ * @brief Get the number of rows of a level.
+ * @param level level of the archive
+ * @return number of rows
+ */
+const uint32_t HistoryArchive::getRowCount(const HistoryArchiveLevel level)
+{
+	return level < HISTORY_ARCHIVE_LEVEL_COUNT ? ARCHIVE_ROWS[level] : 0;
+}
+
+/**
+ * @brief Get the history channel of a column of the rows.
+ * @param index index of the column
+ * @return channel
+ */
+const HistoryChannel HistoryArchive::getChannel(const uint8_t index)
+{
+	return index < HISTORY_ARCHIVE_CHANNEL_COUNT ? ARCHIVE_CHANNELS[index] : HISTORY_CHANNEL_COUNT;
+}
+
+/**
+ * @brief Convert a value of a row to its unit.
+ * @param index index of the column
+ * @param value value of the row
+ * @return value in the unit of the channel
+ */
+const float HistoryArchive::getValue(const uint8_t index, const int16_t value)
+{
+	return index < HISTORY_ARCHIVE_CHANNEL_COUNT ? value * ARCHIVE_DIVISORS[index] * HistorySample::getChannelScale(ARCHIVE_CHANNELS[index]) : 0.0f;
+}
+
+/**
+ * @brief Add values to the open slot of a level, the open slot is closed first if the values belong to a newer one.
+ * @param level level of the archive
+ * @param slot slot of the values
+ * @param values values to add
+ */
+void HistoryArchive::add_(const uint8_t level, const int64_t slot, const Accumulator &values)
+{
+	Accumulator &open = this->open_[level];
+	if (open.count > 0 && open.slot != slot)
+	{
+		this->close_(level);
+	}
+	if (open.count == 0)
+	{
+		open = values;
+		open.slot = slot;
+		return;
+	}
+	merge_(open, values);
+}
+
+/**
+ * @brief Store the open slot of a level and add it to the next level.
+ * @param level level of the archive
+ */
+void HistoryArchive::close_(const uint8_t level)
+{
+	const Accumulator open = this->open_[level];
+	this->open_[level].count = 0;
+	this->store_(level, open.slot, open);
+	if (this->listener_ != nullptr)
+	{
+		HistoryArchiveEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.slot = open.slot;
+		entry.count = open.count;
+		entry.level = level;
+		entry.version = HISTORY_ARCHIVE_ENTRY_VERSION;
+		toRow_(open, entry.row);
+		this->listener_(entry);
+	}
+	this->consolidate_(level, open);
+}
+
+/**
+ * @brief Add closed values to the next level, unless their slot of the next level was already closed.
+ * @param level level of the values
+ * @param values closed values
+ */
+void HistoryArchive::consolidate_(const uint8_t level, const Accumulator &values)
+{
+	if (level + 1 >= HISTORY_ARCHIVE_LEVEL_COUNT)
+	{
+		return;
+	}
+	const int64_t slot = values.slot * ARCHIVE_INTERVALS[level] / ARCHIVE_INTERVALS[level + 1];
+	if (slot > this->lastSlot_[level + 1])
+	{
+		this->add_(level + 1, slot, values);
+	}
+}
+
+/**
+ * @brief Write a row to the ring of a level, skipped slots are marked as unknown.
+ * @param level level of the archive
+ * @param slot slot of the row, it must be newer than the last stored one
+ * @param values values of the row
+ */
+void HistoryArchive::store_(const uint8_t level, const int64_t slot, const Accumulator &values)
+{
+	const uint32_t rowCount = ARCHIVE_ROWS[level];
+	HistoryArchiveRow *rows = this->rows_[level];
+	if (this->lastSlot_[level] >= 0)
+	{
+		const int64_t oldestRow = slot + 1 - rowCount;
+		for (int64_t skipped = this->lastSlot_[level] + 1 > oldestRow ? this->lastSlot_[level] + 1 : oldestRow; skipped < slot; skipped++)
+		{
+			for (uint8_t i = 0; i < HISTORY_ARCHIVE_CHANNEL_COUNT; i++)
+			{
+				rows[skipped % rowCount].min[i] = HISTORY_ARCHIVE_UNKNOWN;
+				rows[skipped % rowCount].avg[i] = HISTORY_ARCHIVE_UNKNOWN;
+				rows[skipped % rowCount].max[i] = HISTORY_ARCHIVE_UNKNOWN;
+			}
+		}
+	}
+	this->clamped_ += toRow_(values, rows[slot % rowCount]);
+	this->lastSlot_[level] = slot;
+}
+
+/**
+ * @brief Combine two sets of values.
+ * @param target values that are extended, an empty target receives a copy
+ * @param values values to add
+ */
+void HistoryArchive::merge_(Accumulator &target, const Accumulator &values)
+{
+	if (target.count == 0)
+	{
+		target = values;
+		return;
+	}
+	target.count += values.count;
+	for (uint8_t i = 0; i < HISTORY_ARCHIVE_CHANNEL_COUNT; i++)
+	{
+		target.min[i] = values.min[i] < target.min[i] ? values.min[i] : target.min[i];
+		target.max[i] = values.max[i] > target.max[i] ? values.max[i] : target.max[i];
+		target.sum[i] += values.sum[i];
+	}
+}
+
+/**
+ * @brief Convert accumulated values into a row.
+ * @param values accumulated values, there must be at least one sample
+ * @param row row that receives the values
+ * @return number of values that were clamped
+ */
+const uint8_t HistoryArchive::toRow_(const Accumulator &values, HistoryArchiveRow &row)
+{
+	uint8_t clamped = 0;
+	for (uint8_t i = 0; i < HISTORY_ARCHIVE_CHANNEL_COUNT; i++)
+	{
+		row.min[i] = clamp_(divide_(values.min[i], ARCHIVE_DIVISORS[i]), clamped);
+		row.max[i] = clamp_(divide_(values.max[i], ARCHIVE_DIVISORS[i]), clamped);
+		row.avg[i] = clamp_(divide_(values.sum[i], ARCHIVE_DIVISORS[i] * values.count), clamped);
+	}
+	return clamped;
+}
+
+/**
+ * @brief Divide and round to the nearest integer, halves are rounded away from 0.
+ * @param value dividend
+ * @param divisor positive divisor
+ * @return rounded quotient
+ */
+const int64_t HistoryArchive::divide_(const int64_t value, const int64_t divisor)
+{
+	const int64_t half = divisor / 2;
+	return (value + (value < 0 ? -half : half)) / divisor;
+}
+
+/**
+ * @brief Limit a value to the range of a row, the smallest value is reserved for unknown values.
+ * @param value value to limit
+ * @param clamped counter that is incremented if the value was out of range
+ * @return limited value
+ */
+const int16_t HistoryArchive::clamp_(const int64_t value, uint8_t &clamped)
+{
+	if (value <= HISTORY_ARCHIVE_UNKNOWN)
+	{
+		clamped++;
+		return HISTORY_ARCHIVE_UNKNOWN + 1;
+	}
+	if (value > INT16_MAX)
+	{
+		clamped++;
+		return INT16_MAX;
+	}
+	return static_cast<int16_t>(value);
+}
@@ -0,0 +1,405 @@
+/**
+ * @file HistoryBlock.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the HistoryBlockWriter and HistoryBlockReader classes.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "history/HistoryBlock.h"
+
+#include <string.h>
+
+// Bits of the largest possible sample, a sample is only appended if they are available
+#define HISTORY_MAX_SAMPLE_BITS (4 + 32 + 1 + HISTORY_CHANNEL_COUNT * (2 + 5 + 5 + 32))
+
+// Marks a channel without a previous XOR window
+#define HISTORY_NO_WINDOW 0xFF
+
+/**
+ * @brief Map signed values to unsigned values, so small negative values have few significant bits.
+ * @param value signed value
+ * @return zigzag encoded value
+ */
+static inline uint32_t zigzagEncode(const int32_t value)
+{
+	return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+/**
+ * @brief Reverse the zigzag encoding.
+ * @param value zigzag encoded value
+ * @return signed value
+ */
+static inline int32_t zigzagDecode(const uint32_t value)
+{
+	return static_cast<int32_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+/**
+ * @brief Extend the sign of a value with less than 32 bits.
+ * @param value value
+ * @param bits number of valid bits
+ * @return signed value
+ */
+static inline int32_t signExtend(const uint32_t value, const uint8_t bits)
+{
+	const uint32_t sign = 1UL << (bits - 1);
+	return static_cast<int32_t>((value ^ sign) - sign);
+}
+
+/**
+ * @brief Create a new instance of HistoryBlockWriter without a block.
+ */
+HistoryBlockWriter::HistoryBlockWriter()
+{
+	this->header_ = nullptr;
+}
+
+/**
+ * @brief Destroy the HistoryBlockWriter instance.
+ */
+HistoryBlockWriter::~HistoryBlockWriter()
+{
+}
+
+/**
+ * @brief Start a new, empty block.
+ * @param block memory of HISTORY_BLOCK_SIZE bytes
+ */
+void HistoryBlockWriter::begin(uint8_t *block)
+{
+	memset(block, 0, HISTORY_BLOCK_SIZE);
+	this->header_ = reinterpret_cast<HistoryBlockHeader *>(block);
+	this->bits_.begin(block + sizeof(HistoryBlockHeader), HISTORY_BLOCK_PAYLOAD_SIZE);
+	this->lastDelta_ = 0;
+}
+
+/**
+ * @brief Append a sample.
+ * @param sample sample, it should not be older than the previous one
+ * @return true if the sample was added, false if the block is full
+ */
+const bool HistoryBlockWriter::append(const HistorySample &sample)
+{
+	if (this->header_ == nullptr || this->header_->sampleCount == UINT16_MAX || this->bits_.getFreeBits() < HISTORY_MAX_SAMPLE_BITS)
+	{
+		return false;
+	}
+
+	if (this->header_->sampleCount == 0)
+	{
+		this->header_->firstTimeMs = sample.getTime();
+		for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT; i++)
+		{
+			this->lastValues_[i] = zigzagEncode(sample.getRawValue(static_cast<HistoryChannel>(i)));
+			this->leading_[i] = HISTORY_NO_WINDOW;
+			this->trailing_[i] = 0;
+			this->bits_.write(this->lastValues_[i], 32);
+		}
+	}
+	else
+	{
+		// Jumps of the clock that do not fit 32 bits start a new block
+		const int64_t delta = sample.getTime() - this->header_->lastTimeMs;
+		const int64_t deltaOfDelta = delta - this->lastDelta_;
+		if (deltaOfDelta < INT32_MIN || deltaOfDelta > INT32_MAX)
+		{
+			return false;
+		}
+		this->writeTime_(deltaOfDelta);
+		this->lastDelta_ = delta;
+
+		bool changed = false;
+		for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT && !changed; i++)
+		{
+			changed = zigzagEncode(sample.getRawValue(static_cast<HistoryChannel>(i))) != this->lastValues_[i];
+		}
+		this->bits_.write(changed ? 1 : 0, 1);
+		for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT && changed; i++)
+		{
+			this->writeValue_(i, zigzagEncode(sample.getRawValue(static_cast<HistoryChannel>(i))));
+		}
+	}
+
+	this->header_->lastTimeMs = sample.getTime();
+	this->header_->sampleCount++;
+	this->header_->bitCount = this->bits_.getBitCount();
+	return true;
+}
+
+/**
+ * @brief Get the header of the current block.
+ * @return header or nullptr without a block
+ */
+const HistoryBlockHeader *HistoryBlockWriter::getHeader() const
+{
+	return this->header_;
+}
+
+/**
+ * @brief Get the number of bytes used by the current block.
+ * @return header and written payload in bytes
+ */
+const size_t HistoryBlockWriter::getUsedBytes() const
+{
+	return this->header_ != nullptr ? sizeof(HistoryBlockHeader) + (this->bits_.getBitCount() + 7) / 8 : 0;
+}
+
+/**
+ * @brief Write the delta of delta of a timestamp.
+ * @param deltaOfDelta difference of the current and the previous delta in ms
+ */
+void HistoryBlockWriter::writeTime_(const int64_t deltaOfDelta)
+{
+	if (deltaOfDelta == 0)
+	{
+		this->bits_.write(0b0, 1);
+	}
+	else if (deltaOfDelta >= -64 && deltaOfDelta < 64)
+	{
+		this->bits_.write(0b10, 2);
+		this->bits_.write(static_cast<uint32_t>(deltaOfDelta) & 0x7F, 7);
+	}
+	else if (deltaOfDelta >= -256 && deltaOfDelta < 256)
+	{
+		this->bits_.write(0b110, 3);
+		this->bits_.write(static_cast<uint32_t>(deltaOfDelta) & 0x1FF, 9);
+	}
+	else if (deltaOfDelta >= -2048 && deltaOfDelta < 2048)
+	{
+		this->bits_.write(0b1110, 4);
+		this->bits_.write(static_cast<uint32_t>(deltaOfDelta) & 0xFFF, 12);
+	}
+	else
+	{
+		this->bits_.write(0b1111, 4);
+		this->bits_.write(static_cast<uint32_t>(deltaOfDelta), 32);
+	}
+}
+
+/**
+ * @brief Write the XOR of a value and its predecessor.
+ * @param channel channel of the value
+ * @param value zigzag encoded value
+ */
+void HistoryBlockWriter::writeValue_(const uint8_t channel, const uint32_t value)
+{
+	const uint32_t difference = value ^ this->lastValues_[channel];
+	this->lastValues_[channel] = value;
+	if (difference == 0)
+	{
+		this->bits_.write(0b0, 1);
+		return;
+	}
+
+	const uint8_t leading = __builtin_clz(difference);
+	const uint8_t trailing = __builtin_ctz(difference);
+	if (this->leading_[channel] != HISTORY_NO_WINDOW && leading >= this->leading_[channel] && trailing >= this->trailing_[channel])
+	{
+		this->bits_.write(0b10, 2);
+		this->bits_.write(difference >> this->trailing_[channel], 32 - this->leading_[channel] - this->trailing_[channel]);
+		return;
+	}
+
+	const uint8_t length = 32 - leading - trailing;
+	this->bits_.write(0b11, 2);
+	this->bits_.write(leading, 5);
+	this->bits_.write(length - 1, 5);
+	this->bits_.write(difference >> trailing, length);
+	this->leading_[channel] = leading;
+	this->trailing_[channel] = trailing;
+}
+
+/**
+ * @brief Create a new instance of HistoryBlockReader without a block.
+ */
+HistoryBlockReader::HistoryBlockReader()
+{
+	this->header_ = nullptr;
+	this->index_ = 0;
+}
+
+/**
+ * @brief Destroy the HistoryBlockReader instance.
+ */
+HistoryBlockReader::~HistoryBlockReader()
+{
+}
+
+/**
+ * @brief Start reading a block from its first sample.
+ * @param block block written by a HistoryBlockWriter
+ */
+void HistoryBlockReader::begin(const uint8_t *block)
+{
+	this->header_ = reinterpret_cast<const HistoryBlockHeader *>(block);
+	this->bits_.begin(block + sizeof(HistoryBlockHeader), this->header_->bitCount);
+	this->index_ = 0;
+	this->lastTimeMs_ = this->header_->firstTimeMs;
+	this->lastDelta_ = 0;
+}
+
+/**
+ * @brief Decode the next sample.
+ * @param sample sample that receives the values
+ * @return true if a sample was decoded, false at the end of the block or if the block is corrupt
+ */
+const bool HistoryBlockReader::next(HistorySample &sample)
+{
+	if (this->header_ == nullptr || this->index_ >= this->header_->sampleCount)
+	{
+		return false;
+	}
+
+	// The block may still be written
+	this->bits_.setBitCount(this->header_->bitCount);
+
+	if (this->index_ == 0)
+	{
+		for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT; i++)
+		{
+			if (!this->bits_.read(this->lastValues_[i], 32))
+			{
+				return false;
+			}
+			this->leading_[i] = HISTORY_NO_WINDOW;
+			this->trailing_[i] = 0;
+		}
+	}
+	else
+	{
+		int64_t deltaOfDelta = 0;
+		uint32_t changed = 0;
+		if (!this->readTime_(deltaOfDelta) || !this->bits_.read(changed, 1))
+		{
+			return false;
+		}
+		this->lastDelta_ += deltaOfDelta;
+		this->lastTimeMs_ += this->lastDelta_;
+		for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT && changed; i++)
+		{
+			if (!this->readValue_(i))
+			{
+				return false;
+			}
+		}
+	}
+
+	sample.setTime(this->lastTimeMs_);
+	for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT; i++)
+	{
+		sample.setRawValue(static_cast<HistoryChannel>(i), zigzagDecode(this->lastValues_[i]));
+	}
+	this->index_++;
+	return true;
+}
+
+/**
+ * @brief Get the number of samples that were not read yet.
+ * @return number of samples
+ */
+const uint16_t HistoryBlockReader::getRemainingCount() const
+{
+	return this->header_ != nullptr ? this->header_->sampleCount - this->index_ : 0;
+}
+
+/**
+ * @brief Read the delta of delta of a timestamp.
+ * @param deltaOfDelta reference that receives the delta of delta in ms
+ * @return true on success, false if the data ended
+ */
+const bool HistoryBlockReader::readTime_(int64_t &deltaOfDelta)
+{
+	static const uint8_t sizes[] = {7, 9, 12};
+	uint32_t bit = 0;
+	uint8_t prefix = 0;
+	while (prefix < 4)
+	{
+		if (!this->bits_.read(bit, 1))
+		{
+			return false;
+		}
+		if (bit == 0)
+		{
+			break;
+		}
+		prefix++;
+	}
+
+	if (prefix == 0)
+	{
+		deltaOfDelta = 0;
+		return true;
+	}
+
+	uint32_t value = 0;
+	const uint8_t size = prefix < 4 ? sizes[prefix - 1] : 32;
+	if (!this->bits_.read(value, size))
+	{
+		return false;
+	}
+	deltaOfDelta = size < 32 ? signExtend(value, size) : static_cast<int32_t>(value);
+	return true;
+}
+
+/**
+ * @brief Read the XOR of a value and its predecessor.
+ * @param channel channel of the value
+ * @return true on success, false if the data ended
+ */
+const bool HistoryBlockReader::readValue_(const uint8_t channel)
+{
+	uint32_t control = 0;
+	if (!this->bits_.read(control, 1))
+	{
+		return false;
+	}
+	if (control == 0)
+	{
+		return true;
+	}
+
+	uint32_t difference = 0;
+	if (!this->bits_.read(control, 1))
+	{
+		return false;
+	}
+	if (control == 0)
+	{
+		if (this->leading_[channel] == HISTORY_NO_WINDOW || !this->bits_.read(difference, 32 - this->leading_[channel] - this->trailing_[channel]))
+		{
+			return false;
+		}
+		this->lastValues_[channel] ^= difference << this->trailing_[channel];
+		return true;
+	}
+
+	uint32_t leading = 0;
+	uint32_t length = 0;
+	if (!this->bits_.read(leading, 5) || !this->bits_.read(length, 5) || !this->bits_.read(difference, length + 1))
+	{
+		return false;
+	}
+	length++;
+	if (leading + length > 32)
+	{
+		return false;
+	}
+	this->leading_[channel] = leading;
+	this->trailing_[channel] = 32 - leading - length;
+	this->lastValues_[channel] ^= difference << this->trailing_[channel];
+	return true;
+}
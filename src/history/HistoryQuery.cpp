@@ -0,0 +1,326 @@
+/**
+ * @file HistoryQuery.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the HistoryQuery class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "history/HistoryQuery.h"
+
+/**
+ * @brief Create a new instance of HistoryQuery.
+ * @param historyStore raw history
+ * @param historyArchive consolidated history
+ */
+HistoryQuery::HistoryQuery(const HistoryStore &historyStore, const HistoryArchive &historyArchive) : historyStore_(historyStore), historyArchive_(historyArchive)
+{
+	this->channel_ = HISTORY_CHANNEL_COUNT;
+	this->archiveIndex_ = HISTORY_ARCHIVE_CHANNEL_COUNT;
+	this->fromMs_ = 0;
+	this->toMs_ = 0;
+	this->maxPoints_ = 0;
+	this->source_ = HISTORY_QUERY_NONE;
+	this->slot_ = 0;
+	this->endSlot_ = -1;
+}
+
+/**
+ * @brief Destroy the HistoryQuery instance.
+ */
+HistoryQuery::~HistoryQuery()
+{
+}
+
+/**
+ * @brief Prepare a query and select its source.
+ * @param channel channel to read
+ * @param fromMs start of the range as unix time in ms
+ * @param toMs end of the range as unix time in ms
+ * @param maxPoints maximum number of points, it is limited to 3 to HISTORY_QUERY_MAX_POINTS
+ * @return true if the query is valid
+ */
+const bool HistoryQuery::begin(const HistoryChannel channel, const int64_t fromMs, const int64_t toMs, const uint16_t maxPoints)
+{
+	this->source_ = HISTORY_QUERY_NONE;
+	if (channel >= HISTORY_CHANNEL_COUNT || toMs < fromMs)
+	{
+		return false;
+	}
+
+	this->channel_ = channel;
+	this->fromMs_ = fromMs;
+	this->toMs_ = toMs;
+	this->maxPoints_ = maxPoints < 3 ? 3 : (maxPoints > HISTORY_QUERY_MAX_POINTS ? HISTORY_QUERY_MAX_POINTS : maxPoints);
+	this->archiveIndex_ = 0;
+	while (this->archiveIndex_ < HISTORY_ARCHIVE_CHANNEL_COUNT && HistoryArchive::getChannel(this->archiveIndex_) != channel)
+	{
+		this->archiveIndex_++;
+	}
+	this->selectSource_();
+	return true;
+}
+
+/**
+ * @brief Run the query.
+ * @param writer function that receives the points
+ * @param context passed to the writer
+ * @return number of points
+ */
+const uint16_t HistoryQuery::run(HistoryPointWriter writer, void *context)
+{
+	if (this->source_ == HISTORY_QUERY_NONE)
+	{
+		return 0;
+	}
+
+	// First pass, average of every bucket
+	const uint16_t bucketCount = this->maxPoints_ - 2;
+	for (uint16_t i = 0; i < bucketCount; i++)
+	{
+		this->buckets_[i].time = 0.0f;
+		this->buckets_[i].value = 0.0f;
+		this->buckets_[i].count = 0;
+	}
+
+	HistoryPoint point;
+	HistoryPoint first;
+	HistoryPoint last;
+	uint32_t count = 0;
+	this->rewind_();
+	while (this->next_(point))
+	{
+		if (count == 0)
+		{
+			first = point;
+		}
+		last = point;
+		count++;
+
+		Bucket &bucket = this->buckets_[this->getBucket_(point.timeMs, bucketCount)];
+		bucket.count++;
+		bucket.time += ((point.timeMs - this->fromMs_) / 1000.0f - bucket.time) / bucket.count;
+		bucket.value += (point.value - bucket.value) / bucket.count;
+	}
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	// Nothing to downsample
+	this->rewind_();
+	if (count <= this->maxPoints_)
+	{
+		uint16_t written = 0;
+		while (written < count && this->next_(point))
+		{
+			writer(point, context);
+			written++;
+		}
+		return written;
+	}
+
+	// Second pass, select the point with the largest triangle in every bucket
+	writer(first, context);
+	uint16_t written = 1;
+	float previousTime = (first.timeMs - this->fromMs_) / 1000.0f;
+	float previousValue = first.value;
+
+	int32_t currentBucket = -1;
+	float nextTime = 0.0f;
+	float nextValue = 0.0f;
+	float bestArea = -1.0f;
+	HistoryPoint best;
+	uint32_t index = 0;
+	while (this->next_(point) && ++index < count)
+	{
+		// The first point was already written, the last one is written at the end
+		if (index == 1)
+		{
+			continue;
+		}
+
+		const uint16_t bucket = this->getBucket_(point.timeMs, bucketCount);
+		if (bucket != currentBucket)
+		{
+			if (bestArea >= 0.0f)
+			{
+				writer(best, context);
+				written++;
+				previousTime = (best.timeMs - this->fromMs_) / 1000.0f;
+				previousValue = best.value;
+			}
+
+			// The average of the next bucket with points or the last point
+			currentBucket = bucket;
+			nextTime = (last.timeMs - this->fromMs_) / 1000.0f;
+			nextValue = last.value;
+			for (uint16_t i = bucket + 1; i < bucketCount; i++)
+			{
+				if (this->buckets_[i].count > 0)
+				{
+					nextTime = this->buckets_[i].time;
+					nextValue = this->buckets_[i].value;
+					break;
+				}
+			}
+			bestArea = -1.0f;
+		}
+
+		const float time = (point.timeMs - this->fromMs_) / 1000.0f;
+		float area = (previousTime - nextTime) * (point.value - previousValue) - (previousTime - time) * (nextValue - previousValue);
+		area = area < 0.0f ? -area : area;
+		if (area > bestArea)
+		{
+			bestArea = area;
+			best = point;
+		}
+	}
+	if (bestArea >= 0.0f)
+	{
+		writer(best, context);
+		written++;
+	}
+	writer(last, context);
+	return written + 1;
+}
+
+/**
+ * @brief Get the source that was selected by begin.
+ * @return source of the points
+ */
+const HistoryQuerySource HistoryQuery::getSource() const
+{
+	return this->source_;
+}
+
+/**
+ * @brief Get the name of a source.
+ * @param source source of the points
+ * @return name of the source
+ */
+const char *HistoryQuery::getSourceName(const HistoryQuerySource source)
+{
+	switch (source)
+	{
+	case HISTORY_QUERY_RAW:
+		return "raw";
+	case HISTORY_QUERY_MINUTES:
+		return "1m";
+	case HISTORY_QUERY_QUARTERS:
+		return "15m";
+	case HISTORY_QUERY_DAYS:
+		return "1d";
+	default:
+		return "none";
+	}
+}
+
+/**
+ * @brief Select the raw history for short ranges and the coarsest archive with enough rows otherwise.
+ * The next coarser archive is used if an archive does not reach back to the start of the range.
+ */
+void HistoryQuery::selectSource_()
+{
+	const int64_t pointInterval = (this->toMs_ - this->fromMs_) / this->maxPoints_;
+	const bool rawAvailable = this->historyStore_.getSampleCount() > 0;
+	const bool rawComplete = rawAvailable && this->historyStore_.getOldestTime() <= this->fromMs_;
+	if (this->archiveIndex_ >= HISTORY_ARCHIVE_CHANNEL_COUNT || this->historyArchive_.getLastSlot(HISTORY_ARCHIVE_MINUTE) < 0 ||
+		(rawComplete && pointInterval < HistoryArchive::getInterval(HISTORY_ARCHIVE_MINUTE) * 1000LL))
+	{
+		this->source_ = rawAvailable ? HISTORY_QUERY_RAW : HISTORY_QUERY_NONE;
+		return;
+	}
+
+	uint8_t level = HISTORY_ARCHIVE_MINUTE;
+	while (level + 1 < HISTORY_ARCHIVE_LEVEL_COUNT && HistoryArchive::getInterval(static_cast<HistoryArchiveLevel>(level + 1)) * 1000LL <= pointInterval)
+	{
+		level++;
+	}
+	while (level + 1 < HISTORY_ARCHIVE_LEVEL_COUNT &&
+		   this->historyArchive_.getFirstSlot(static_cast<HistoryArchiveLevel>(level)) * HistoryArchive::getInterval(static_cast<HistoryArchiveLevel>(level)) * 1000LL > this->fromMs_)
+	{
+		level++;
+	}
+	this->source_ = static_cast<HistoryQuerySource>(HISTORY_QUERY_MINUTES + level);
+}
+
+/**
+ * @brief Start reading the source at the beginning of the range.
+ */
+void HistoryQuery::rewind_()
+{
+	if (this->source_ == HISTORY_QUERY_RAW)
+	{
+		this->historyStore_.seek(this->cursor_, this->fromMs_);
+		return;
+	}
+
+	const HistoryArchiveLevel level = static_cast<HistoryArchiveLevel>(this->source_ - HISTORY_QUERY_MINUTES);
+	const int64_t interval = HistoryArchive::getInterval(level) * 1000LL;
+	const int64_t firstSlot = this->historyArchive_.getFirstSlot(level);
+	const int64_t lastSlot = this->historyArchive_.getLastSlot(level);
+	this->slot_ = this->fromMs_ / interval > firstSlot ? this->fromMs_ / interval : firstSlot;
+	this->endSlot_ = this->toMs_ / interval < lastSlot ? this->toMs_ / interval : lastSlot;
+}
+
+/**
+ * @brief Read the next point of the range from the source.
+ * @param point point that receives the time and value, archive rows are placed in the middle of their interval
+ * @return true if a point was read
+ */
+const bool HistoryQuery::next_(HistoryPoint &point)
+{
+	if (this->source_ == HISTORY_QUERY_RAW)
+	{
+		HistorySample sample;
+		if (!this->historyStore_.next(this->cursor_, sample) || sample.getTime() > this->toMs_)
+		{
+			return false;
+		}
+		point.timeMs = sample.getTime();
+		point.value = sample.getValue(this->channel_);
+		return true;
+	}
+
+	const HistoryArchiveLevel level = static_cast<HistoryArchiveLevel>(this->source_ - HISTORY_QUERY_MINUTES);
+	const int64_t interval = HistoryArchive::getInterval(level) * 1000LL;
+	HistoryArchiveRow row;
+	while (this->slot_ <= this->endSlot_)
+	{
+		const int64_t slot = this->slot_++;
+		if (this->historyArchive_.read(level, slot, row))
+		{
+			point.timeMs = slot * interval + interval / 2;
+			point.timeMs = point.timeMs < this->toMs_ ? point.timeMs : this->toMs_;
+			point.value = HistoryArchive::getValue(this->archiveIndex_, row.avg[this->archiveIndex_]);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Get the bucket of a time.
+ * @param timeMs unix time in ms within the range
+ * @param bucketCount number of buckets
+ * @return index of the bucket
+ */
+const uint16_t HistoryQuery::getBucket_(const int64_t timeMs, const uint16_t bucketCount) const
+{
+	const int64_t range = this->toMs_ - this->fromMs_ + 1;
+	const int64_t bucket = (timeMs - this->fromMs_) * bucketCount / range;
+	return bucket < 0 ? 0 : (bucket >= bucketCount ? bucketCount - 1 : static_cast<uint16_t>(bucket));
+}
@@ -0,0 +1,188 @@
+/**
+ * @file HistorySample.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the HistorySample class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "history/HistorySample.h"
+
+#include <string.h>
+
+struct HistoryChannelInfo
+{
+	const char *name;
+	float scale;
+};
+
+static const HistoryChannelInfo CHANNELS[HISTORY_CHANNEL_COUNT] = {
+	{"packVoltage", 0.005f},
+	{"packCurrent", 0.125f},
+	{"packSoc", 1.0f},
+	{"packRemainingEnergy", 0.001f},
+	{"lowestCellVoltage", 0.005f},
+	{"lowestCellVoltageNumber", 1.0f},
+	{"highestCellVoltage", 0.005f},
+	{"highestCellVoltageNumber", 1.0f},
+	{"lowestCellTemperature", 0.1f},
+	{"highestCellTemperature", 0.1f},
+	{"flags", 1.0f}};
+
+/**
+ * @brief Create a new instance of HistorySample with all values at 0.
+ */
+HistorySample::HistorySample()
+{
+	this->timeMs_ = 0;
+	for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT; i++)
+	{
+		this->values_[i] = 0;
+	}
+}
+
+/**
+ * @brief Create a new instance of HistorySample from decoded data.
+ * @param smartBmsData decoded data
+ * @param timeMs time of the data in ms
+ */
+HistorySample::HistorySample(const SmartBmsData &smartBmsData, const int64_t timeMs)
+{
+	this->timeMs_ = timeMs;
+	this->values_[HISTORY_PACK_VOLTAGE] = HistorySample::quantize_(smartBmsData.getPackVoltage(), HISTORY_PACK_VOLTAGE);
+	this->values_[HISTORY_PACK_CURRENT] = HistorySample::quantize_(smartBmsData.getPackCurrent(), HISTORY_PACK_CURRENT);
+	this->values_[HISTORY_PACK_SOC] = smartBmsData.getPackSoc();
+	this->values_[HISTORY_PACK_REMAINING_ENERGY] = HistorySample::quantize_(smartBmsData.getPackRemainingEnergy(), HISTORY_PACK_REMAINING_ENERGY);
+	this->values_[HISTORY_LOWEST_CELL_VOLTAGE] = HistorySample::quantize_(smartBmsData.getLowestCellVoltage(), HISTORY_LOWEST_CELL_VOLTAGE);
+	this->values_[HISTORY_LOWEST_CELL_VOLTAGE_NUMBER] = smartBmsData.getLowestCellVoltageNumber();
+	this->values_[HISTORY_HIGHEST_CELL_VOLTAGE] = HistorySample::quantize_(smartBmsData.getHighestCellVoltage(), HISTORY_HIGHEST_CELL_VOLTAGE);
+	this->values_[HISTORY_HIGHEST_CELL_VOLTAGE_NUMBER] = smartBmsData.getHighestCellVoltageNumber();
+	this->values_[HISTORY_LOWEST_CELL_TEMPERATURE] = HistorySample::quantize_(smartBmsData.getLowestCellTemperature(), HISTORY_LOWEST_CELL_TEMPERATURE);
+	this->values_[HISTORY_HIGHEST_CELL_TEMPERATURE] = HistorySample::quantize_(smartBmsData.getHighestCellTemperature(), HISTORY_HIGHEST_CELL_TEMPERATURE);
+	this->values_[HISTORY_FLAGS] = (smartBmsData.isAllowedToCharge() ? HISTORY_FLAG_ALLOWED_TO_CHARGE : 0) |
+								   (smartBmsData.isAllowedToDischarge() ? HISTORY_FLAG_ALLOWED_TO_DISCHARGE : 0) |
+								   (smartBmsData.hasCommunicationError() ? HISTORY_FLAG_COMMUNICATION_ERROR : 0) |
+								   (smartBmsData.isMinVoltageAlarmActive() ? HISTORY_FLAG_MIN_VOLTAGE_ALARM : 0) |
+								   (smartBmsData.isMaxVoltageAlarmActive() ? HISTORY_FLAG_MAX_VOLTAGE_ALARM : 0) |
+								   (smartBmsData.isMinTemperatureAlarmActive() ? HISTORY_FLAG_MIN_TEMPERATURE_ALARM : 0) |
+								   (smartBmsData.isMaxTemperatureAlarmActive() ? HISTORY_FLAG_MAX_TEMPERATURE_ALARM : 0);
+}
+
+/**
+ * @brief Destroy the HistorySample instance.
+ */
+HistorySample::~HistorySample()
+{
+}
+
+/**
+ * @brief Set the time of the sample.
+ * @param timeMs time in ms
+ */
+void HistorySample::setTime(const int64_t timeMs)
+{
+	this->timeMs_ = timeMs;
+}
+
+/**
+ * @brief Get the time of the sample.
+ * @return time in ms
+ */
+const int64_t HistorySample::getTime() const
+{
+	return this->timeMs_;
+}
+
+/**
+ * @brief Set the quantized value of a channel.
+ * @param channel channel
+ * @param value value as a multiple of the scale of the channel
+ */
+void HistorySample::setRawValue(const HistoryChannel channel, const int32_t value)
+{
+	if (channel < HISTORY_CHANNEL_COUNT)
+	{
+		this->values_[channel] = value;
+	}
+}
+
+/**
+ * @brief Get the quantized value of a channel.
+ * @param channel channel
+ * @return value as a multiple of the scale of the channel
+ */
+const int32_t HistorySample::getRawValue(const HistoryChannel channel) const
+{
+	return channel < HISTORY_CHANNEL_COUNT ? this->values_[channel] : 0;
+}
+
+/**
+ * @brief Get the value of a channel in its unit.
+ * @param channel channel
+ * @return value in V, A, %, kWh, °C or the plain number
+ */
+const float HistorySample::getValue(const HistoryChannel channel) const
+{
+	return channel < HISTORY_CHANNEL_COUNT ? this->values_[channel] * CHANNELS[channel].scale : 0.0f;
+}
+
+/**
+ * @brief Get the name of a channel, it matches the name of the field of the BMS data.
+ * @param channel channel
+ * @return name of the channel
+ */
+const char *HistorySample::getChannelName(const HistoryChannel channel)
+{
+	return channel < HISTORY_CHANNEL_COUNT ? CHANNELS[channel].name : "unknown";
+}
+
+/**
+ * @brief Find a channel by its name.
+ * @param name name of the channel
+ * @return channel or HISTORY_CHANNEL_COUNT if there is no channel with the name
+ */
+const HistoryChannel HistorySample::findChannel(const char *name)
+{
+	for (uint8_t i = 0; i < HISTORY_CHANNEL_COUNT; i++)
+	{
+		if (strcmp(CHANNELS[i].name, name) == 0)
+		{
+			return static_cast<HistoryChannel>(i);
+		}
+	}
+	return HISTORY_CHANNEL_COUNT;
+}
+
+/**
+ * @brief Get the resolution of a channel.
+ * @param channel channel
+ * @return value of one step
+ */
+const float HistorySample::getChannelScale(const HistoryChannel channel)
+{
+	return channel < HISTORY_CHANNEL_COUNT ? CHANNELS[channel].scale : 1.0f;
+}
+
+/**
+ * @brief Round a value to the nearest multiple of the scale of a channel.
+ * @param value value in its unit
+ * @param channel channel
+ * @return multiple of the scale
+ */
+const int32_t HistorySample::quantize_(const float value, const HistoryChannel channel)
+{
+	const float steps = value / CHANNELS[channel].scale;
+	return static_cast<int32_t>(steps < 0.0f ? steps - 0.5f : steps + 0.5f);
+}
@@ -0,0 +1,361 @@
+/**
+ * @file HistoryStore.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the HistoryStore class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "history/HistoryStore.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#endif
+
+/**
+ * @brief Create a new instance of HistoryStore without memory.
+ */
+HistoryStore::HistoryStore()
+{
+	this->memory_ = nullptr;
+	this->psram_ = false;
+	this->blockCount_ = 0;
+	this->listener_ = nullptr;
+	this->clear();
+}
+
+/**
+ * @brief Destroy the HistoryStore instance and free the memory.
+ */
+HistoryStore::~HistoryStore()
+{
+	this->end();
+}
+
+/**
+ * @brief Allocate the memory of the history.
+ * @param psramSize size in bytes if PSRAM is available
+ * @param ramSize size in bytes in the internal RAM otherwise
+ * @return true on success, false if the memory could not be allocated
+ */
+const bool HistoryStore::begin(const size_t psramSize, const size_t ramSize)
+{
+	this->end();
+
+#ifdef ARDUINO
+	if (psramSize >= 2 * HISTORY_BLOCK_SIZE && heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0)
+	{
+		this->memory_ = static_cast<uint8_t *>(heap_caps_malloc(psramSize, MALLOC_CAP_SPIRAM));
+		this->psram_ = this->memory_ != nullptr;
+		this->blockCount_ = psramSize / HISTORY_BLOCK_SIZE;
+	}
+	if (this->memory_ == nullptr && ramSize >= 2 * HISTORY_BLOCK_SIZE)
+	{
+		this->memory_ = static_cast<uint8_t *>(heap_caps_malloc(ramSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+		this->blockCount_ = ramSize / HISTORY_BLOCK_SIZE;
+	}
+#else
+	const size_t size = psramSize > 0 ? psramSize : ramSize;
+	if (size >= 2 * HISTORY_BLOCK_SIZE)
+	{
+		this->memory_ = static_cast<uint8_t *>(malloc(size));
+		this->blockCount_ = size / HISTORY_BLOCK_SIZE;
+	}
+#endif
+
+	if (this->memory_ == nullptr)
+	{
+		this->blockCount_ = 0;
+		return false;
+	}
+	this->clear();
+	return true;
+}
+
+/**
+ * @brief Free the memory of the history.
+ */
+void HistoryStore::end()
+{
+	free(this->memory_);
+	this->memory_ = nullptr;
+	this->psram_ = false;
+	this->blockCount_ = 0;
+	this->clear();
+}
+
+/**
+ * @brief Add a sample, the oldest block is dropped if the history is full.
+ * @param sample sample, it should not be older than the previous one
+ * @return true if the sample was added, false without memory
+ */
+const bool HistoryStore::append(const HistorySample &sample)
+{
+	if (this->memory_ == nullptr)
+	{
+		return false;
+	}
+
+	if (!this->writerOpen_ || !this->writer_.append(sample))
+	{
+		this->seal_();
+		if (this->usedBlocks_ == this->blockCount_)
+		{
+			this->dropOldest_();
+		}
+
+		const uint32_t index = (this->head_ + this->usedBlocks_) % this->blockCount_;
+		this->writer_.begin(&this->memory_[index * HISTORY_BLOCK_SIZE]);
+		this->usedBlocks_++;
+		this->writerOpen_ = true;
+		if (!this->writer_.append(sample))
+		{
+			return false;
+		}
+	}
+	this->sampleCount_++;
+	return true;
+}
+
+/**
+ * @brief Remove all samples.
+ */
+void HistoryStore::clear()
+{
+	this->head_ = 0;
+	this->usedBlocks_ = 0;
+	this->firstBlock_ = 0;
+	this->sampleCount_ = 0;
+	this->sealedBytes_ = 0;
+	this->writerOpen_ = false;
+}
+
+/**
+ * @brief Add a full block, e.g. one that was restored from the flash.
+ * The block that is written is closed, the next sample starts a new block.
+ * @param block data of the block as it was passed to the listener
+ * @param length length of the data
+ * @return true if the block was added, false without memory or if the block is invalid
+ */
+const bool HistoryStore::importBlock(const uint8_t *block, const size_t length)
+{
+	HistoryBlockHeader header;
+	if (this->memory_ == nullptr || length < sizeof(header) || length > HISTORY_BLOCK_SIZE)
+	{
+		return false;
+	}
+	memcpy(&header, block, sizeof(header));
+	if (header.sampleCount == 0 || header.bitCount > HISTORY_BLOCK_PAYLOAD_SIZE * 8 || sizeof(header) + (header.bitCount + 7) / 8 != length)
+	{
+		return false;
+	}
+
+	// Imported blocks are not passed to the listener again
+	if (this->writerOpen_)
+	{
+		this->sealedBytes_ += this->writer_.getUsedBytes();
+		this->writerOpen_ = false;
+	}
+	if (this->usedBlocks_ == this->blockCount_)
+	{
+		this->dropOldest_();
+	}
+
+	const uint32_t index = (this->head_ + this->usedBlocks_) % this->blockCount_;
+	memcpy(&this->memory_[index * HISTORY_BLOCK_SIZE], block, length);
+	this->usedBlocks_++;
+	this->sampleCount_ += header.sampleCount;
+	this->sealedBytes_ += length;
+	return true;
+}
+
+/**
+ * @brief Set the function that is called with every block that is full.
+ * @param listener function or nullptr
+ */
+void HistoryStore::setBlockListener(HistoryBlockListener listener)
+{
+	this->listener_ = listener;
+}
+
+/**
+ * @brief Position a cursor at the first sample that is not older than a time.
+ * @param cursor cursor to position
+ * @param fromMs time in ms
+ * @return true if there are samples at or after the time
+ */
+const bool HistoryStore::seek(HistoryCursor &cursor, const int64_t fromMs) const
+{
+	cursor.valid = false;
+	cursor.fromMs = fromMs;
+	for (uint32_t i = 0; i < this->usedBlocks_; i++)
+	{
+		const uint8_t *block = this->getBlock_(this->firstBlock_ + i);
+		if (reinterpret_cast<const HistoryBlockHeader *>(block)->lastTimeMs >= fromMs)
+		{
+			cursor.valid = true;
+			cursor.block = this->firstBlock_ + i;
+			cursor.reader.begin(block);
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Read the next sample.
+ * @param cursor cursor positioned by seek
+ * @param sample sample that receives the values
+ * @return true if a sample was read, false if there are no newer samples
+ */
+const bool HistoryStore::next(HistoryCursor &cursor, HistorySample &sample) const
+{
+	if (!cursor.valid || this->usedBlocks_ == 0)
+	{
+		return false;
+	}
+
+	while (true)
+	{
+		// The block of the cursor was dropped, continue with the oldest one
+		if (cursor.block - this->firstBlock_ >= this->usedBlocks_)
+		{
+			cursor.block = this->firstBlock_;
+			cursor.reader.begin(this->getBlock_(cursor.block));
+		}
+
+		if (cursor.reader.next(sample))
+		{
+			if (sample.getTime() >= cursor.fromMs)
+			{
+				return true;
+			}
+			continue;
+		}
+
+		if (cursor.block + 1 - this->firstBlock_ >= this->usedBlocks_)
+		{
+			return false;
+		}
+		cursor.block++;
+		cursor.reader.begin(this->getBlock_(cursor.block));
+	}
+}
+
+/**
+ * @brief Get the number of stored samples.
+ * @return number of samples
+ */
+const uint32_t HistoryStore::getSampleCount() const
+{
+	return this->sampleCount_;
+}
+
+/**
+ * @brief Get the number of bytes used by the compressed samples.
+ * @return bytes including the block headers
+ */
+const size_t HistoryStore::getUsedBytes() const
+{
+	return this->sealedBytes_ + (this->writerOpen_ ? this->writer_.getUsedBytes() : 0);
+}
+
+/**
+ * @brief Get the size of the allocated memory.
+ * @return size in bytes
+ */
+const size_t HistoryStore::getCapacity() const
+{
+	return this->blockCount_ * HISTORY_BLOCK_SIZE;
+}
+
+/**
+ * @brief Get the average size of a compressed sample.
+ * @return bytes per sample or 0 without samples
+ */
+const float HistoryStore::getBytesPerSample() const
+{
+	return this->sampleCount_ > 0 ? static_cast<float>(this->getUsedBytes()) / this->sampleCount_ : 0.0f;
+}
+
+/**
+ * @brief Get the time of the oldest sample.
+ * @return time in ms or 0 without samples
+ */
+const int64_t HistoryStore::getOldestTime() const
+{
+	return this->usedBlocks_ > 0 ? reinterpret_cast<const HistoryBlockHeader *>(this->getBlock_(this->firstBlock_))->firstTimeMs : 0;
+}
+
+/**
+ * @brief Get the time of the newest sample.
+ * @return time in ms or 0 without samples
+ */
+const int64_t HistoryStore::getNewestTime() const
+{
+	return this->usedBlocks_ > 0 ? reinterpret_cast<const HistoryBlockHeader *>(this->getBlock_(this->firstBlock_ + this->usedBlocks_ - 1))->lastTimeMs : 0;
+}
+
+/**
+ * @brief Check where the history is stored.
+ * @return true if the history is in PSRAM
+ */
+const bool HistoryStore::isInPsram() const
+{
+	return this->psram_;
+}
+
+/**
+ * @brief Get the memory of a block.
+ * @param block absolute number of the block, it must be in use
+ * @return memory of the block
+ */
+const uint8_t *HistoryStore::getBlock_(const uint32_t block) const
+{
+	return &this->memory_[((this->head_ + block - this->firstBlock_) % this->blockCount_) * HISTORY_BLOCK_SIZE];
+}
+
+/**
+ * @brief Close the block that is written and pass it to the listener.
+ */
+void HistoryStore::seal_()
+{
+	if (!this->writerOpen_)
+	{
+		return;
+	}
+	this->writerOpen_ = false;
+	this->sealedBytes_ += this->writer_.getUsedBytes();
+	if (this->listener_ != nullptr)
+	{
+		this->listener_(reinterpret_cast<const uint8_t *>(this->writer_.getHeader()), this->writer_.getUsedBytes());
+	}
+}
+
+/**
+ * @brief Drop the oldest block.
+ */
+void HistoryStore::dropOldest_()
+{
+	const HistoryBlockHeader *header = reinterpret_cast<const HistoryBlockHeader *>(this->getBlock_(this->firstBlock_));
+	this->sampleCount_ -= header->sampleCount;
+	this->sealedBytes_ -= sizeof(HistoryBlockHeader) + (header->bitCount + 7) / 8;
+	this->head_ = (this->head_ + 1) % this->blockCount_;
+	this->firstBlock_++;
+	this->usedBlocks_--;
+}
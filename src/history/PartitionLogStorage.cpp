@@ -0,0 +1,105 @@
+/**
+ * @file PartitionLogStorage.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the PartitionLogStorage class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifdef ARDUINO
+
+#include "history/PartitionLogStorage.h"
+
+/**
+ * @brief Create a new instance of PartitionLogStorage.
+ * @param label label of a data partition in the partition table
+ */
+PartitionLogStorage::PartitionLogStorage(const char *label)
+{
+	this->label_ = label;
+	this->partition_ = nullptr;
+}
+
+/**
+ * @brief Destroy the PartitionLogStorage instance.
+ */
+PartitionLogStorage::~PartitionLogStorage()
+{
+}
+
+/**
+ * @brief Find the partition.
+ * @return true if the partition exists
+ */
+const bool PartitionLogStorage::begin()
+{
+	this->partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, this->label_);
+	return this->partition_ != nullptr;
+}
+
+/**
+ * @brief Get the size of the partition.
+ * @return size in bytes
+ */
+const size_t PartitionLogStorage::getSize() const
+{
+	return this->partition_ != nullptr ? this->partition_->size : 0;
+}
+
+/**
+ * @brief Get the size of a flash sector.
+ * @return size in bytes
+ */
+const size_t PartitionLogStorage::getEraseSize() const
+{
+	return SPI_FLASH_SEC_SIZE;
+}
+
+/**
+ * @brief Read from the partition.
+ * @param offset offset in the partition
+ * @param data buffer that receives the data
+ * @param length number of bytes
+ * @return true on success
+ */
+const bool PartitionLogStorage::read(const size_t offset, void *data, const size_t length)
+{
+	return this->partition_ != nullptr && esp_partition_read(this->partition_, offset, data, length) == ESP_OK;
+}
+
+/**
+ * @brief Write to erased flash.
+ * @param offset offset in the partition
+ * @param data data to write
+ * @param length number of bytes
+ * @return true on success
+ */
+const bool PartitionLogStorage::write(const size_t offset, const void *data, const size_t length)
+{
+	return this->partition_ != nullptr && esp_partition_write(this->partition_, offset, data, length) == ESP_OK;
+}
+
+/**
+ * @brief Erase whole sectors.
+ * @param offset offset in the partition, aligned to the sector size
+ * @param length number of bytes, a multiple of the sector size
+ * @return true on success
+ */
+const bool PartitionLogStorage::erase(const size_t offset, const size_t length)
+{
+	return this->partition_ != nullptr && esp_partition_erase_range(this->partition_, offset, length) == ESP_OK;
+}
+
+#endif
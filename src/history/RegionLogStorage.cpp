@@ -0,0 +1,133 @@
+/**
+ * @file RegionLogStorage.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the RegionLogStorage class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "history/RegionLogStorage.h"
+
+/**
+ * @brief Create a new instance of RegionLogStorage.
+ * @param storage storage that contains the region, it must stay valid
+ * @param offset start of the region in the storage
+ * @param size size of the region, 0 for the rest of the storage
+ */
+RegionLogStorage::RegionLogStorage(LogStorage *storage, const size_t offset, const size_t size)
+{
+	this->storage_ = storage;
+	this->offset_ = offset;
+	this->size_ = size;
+	this->regionSize_ = 0;
+}
+
+/**
+ * @brief Destroy the RegionLogStorage instance.
+ */
+RegionLogStorage::~RegionLogStorage()
+{
+}
+
+/**
+ * @brief Open the storage and check that the region fits into it.
+ * @return true if the region is usable
+ */
+const bool RegionLogStorage::begin()
+{
+	this->regionSize_ = 0;
+	if (this->storage_ == nullptr || !this->storage_->begin())
+	{
+		return false;
+	}
+
+	const size_t storageSize = this->storage_->getSize();
+	const size_t eraseSize = this->storage_->getEraseSize();
+	if (eraseSize == 0 || this->offset_ % eraseSize != 0 || this->offset_ >= storageSize)
+	{
+		return false;
+	}
+	const size_t size = this->size_ > 0 ? this->size_ : storageSize - this->offset_;
+	if (size > storageSize - this->offset_)
+	{
+		return false;
+	}
+	this->regionSize_ = size;
+	return true;
+}
+
+/**
+ * @brief Get the size of the region.
+ * @return size in bytes, 0 before begin succeeded
+ */
+const size_t RegionLogStorage::getSize() const
+{
+	return this->regionSize_;
+}
+
+/**
+ * @brief Get the erase size of the storage.
+ * @return size in bytes
+ */
+const size_t RegionLogStorage::getEraseSize() const
+{
+	return this->storage_ != nullptr ? this->storage_->getEraseSize() : 0;
+}
+
+/**
+ * @brief Read from the region.
+ * @param offset offset in the region
+ * @param data buffer that receives the data
+ * @param length number of bytes
+ * @return true on success
+ */
+const bool RegionLogStorage::read(const size_t offset, void *data, const size_t length)
+{
+	return this->contains_(offset, length) && this->storage_->read(this->offset_ + offset, data, length);
+}
+
+/**
+ * @brief Write to erased bytes of the region.
+ * @param offset offset in the region
+ * @param data data to write
+ * @param length number of bytes
+ * @return true on success
+ */
+const bool RegionLogStorage::write(const size_t offset, const void *data, const size_t length)
+{
+	return this->contains_(offset, length) && this->storage_->write(this->offset_ + offset, data, length);
+}
+
+/**
+ * @brief Erase whole sectors of the region.
+ * @param offset offset in the region, aligned to the erase size
+ * @param length number of bytes, a multiple of the erase size
+ * @return true on success
+ */
+const bool RegionLogStorage::erase(const size_t offset, const size_t length)
+{
+	return this->contains_(offset, length) && this->storage_->erase(this->offset_ + offset, length);
+}
+
+/**
+ * @brief Check if a range lies within the region.
+ * @param offset offset in the region
+ * @param length number of bytes
+ * @return true if the range is inside
+ */
+const bool RegionLogStorage::contains_(const size_t offset, const size_t length) const
+{
+	return offset <= this->regionSize_ && length <= this->regionSize_ - offset;
+}
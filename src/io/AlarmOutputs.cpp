@@ -0,0 +1,152 @@
+/**
+ * @file AlarmOutputs.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the AlarmOutputs class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "io/AlarmOutputs.h"
+
+#include <Arduino.h>
+
+/**
+ * @brief Create a new instance of AlarmOutputs.
+ * @param config pins and polarity of the outputs
+ */
+AlarmOutputs::AlarmOutputs(const AlarmOutputConfig &config)
+{
+	this->config_ = config;
+	this->state_ = ALARM_OUTPUT_ALARM;
+	this->changeCount_ = 0;
+}
+
+/**
+ * @brief Destroy the AlarmOutputs instance.
+ */
+AlarmOutputs::~AlarmOutputs()
+{
+}
+
+/**
+ * @brief Configure the pins and enter the safe state.
+ */
+void AlarmOutputs::begin()
+{
+	const int8_t pins[] = {this->config_.chargePin, this->config_.dischargePin, this->config_.alarmPin};
+	for (const int8_t pin : pins)
+	{
+		if (pin != ALARM_OUTPUT_DISABLED)
+		{
+			pinMode(pin, OUTPUT);
+		}
+	}
+
+	this->state_ = ALARM_OUTPUT_ALARM;
+	this->writePin_(this->config_.chargePin, false);
+	this->writePin_(this->config_.dischargePin, false);
+	this->writePin_(this->config_.alarmPin, true);
+}
+
+/**
+ * @brief Drive the outputs from the flags of a valid frame. Pins are only written when their state changes.
+ * @param smartBmsData validated BMS data
+ */
+void AlarmOutputs::apply(const SmartBmsData &smartBmsData)
+{
+	uint8_t state = 0;
+	if (smartBmsData.isAllowedToCharge())
+	{
+		state |= ALARM_OUTPUT_CHARGE;
+	}
+	if (smartBmsData.isAllowedToDischarge())
+	{
+		state |= ALARM_OUTPUT_DISCHARGE;
+	}
+	if (smartBmsData.hasCommunicationError() || smartBmsData.isMinVoltageAlarmActive() || smartBmsData.isMaxVoltageAlarmActive() ||
+		smartBmsData.isMinTemperatureAlarmActive() || smartBmsData.isMaxTemperatureAlarmActive())
+	{
+		state |= ALARM_OUTPUT_ALARM;
+	}
+	this->write_(state);
+}
+
+/**
+ * @brief Block charging and discharging and activate the alarm, e.g. when the BMS is not reachable anymore.
+ */
+void AlarmOutputs::setSafeState()
+{
+	this->write_(ALARM_OUTPUT_ALARM);
+}
+
+/**
+ * @brief Get the current state of the outputs.
+ * @return combination of AlarmOutputBit
+ */
+const uint8_t AlarmOutputs::getState() const
+{
+	return this->state_;
+}
+
+/**
+ * @brief Get the number of state changes.
+ * @return number of changes since start
+ */
+const uint32_t AlarmOutputs::getChangeCount() const
+{
+	return this->changeCount_;
+}
+
+/**
+ * @brief Write a new state to the pins that changed.
+ * @param state combination of AlarmOutputBit
+ */
+void AlarmOutputs::write_(const uint8_t state)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	const uint8_t changed = state ^ this->state_;
+	if (changed == 0)
+	{
+		return;
+	}
+
+	if (changed & ALARM_OUTPUT_CHARGE)
+	{
+		this->writePin_(this->config_.chargePin, state & ALARM_OUTPUT_CHARGE);
+	}
+	if (changed & ALARM_OUTPUT_DISCHARGE)
+	{
+		this->writePin_(this->config_.dischargePin, state & ALARM_OUTPUT_DISCHARGE);
+	}
+	if (changed & ALARM_OUTPUT_ALARM)
+	{
+		this->writePin_(this->config_.alarmPin, state & ALARM_OUTPUT_ALARM);
+	}
+	this->state_ = state;
+	this->changeCount_ = this->changeCount_ + 1;
+}
+
+/**
+ * @brief Write the level of a single output.
+ * @param pin pin of the output or ALARM_OUTPUT_DISABLED
+ * @param active true to activate the output
+ */
+void AlarmOutputs::writePin_(const int8_t pin, const bool active) const
+{
+	if (pin != ALARM_OUTPUT_DISABLED)
+	{
+		digitalWrite(pin, active == this->config_.activeHigh ? HIGH : LOW);
+	}
+}
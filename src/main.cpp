@@ -19,10 +19,54 @@
  *
  */
 #include <HardwareSerial.h>
+#include <WiFi.h>
+#include <WebServer.h>
+#include <Preferences.h>
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <driver/gpio.h>
+#include <driver/uart.h>
+#include <freertos/queue.h>
+#include <atomic>
+#include <mutex>
+#include <sys/time.h>
 
+#include "bms/SmartBmsCellTable.h"
 #include "bms/SmartBmsData.h"
+#include "bms/SmartBmsEnergyMeter.h"
 #include "bms/SmartBmsError.h"
+#include "bms/SmartBmsLinkMonitor.h"
 #include "bms/SmartBmsReader.h"
+#include "bms/SmartBmsRollingStats.h"
+#include "bms/SmartBmsRuntimeEstimator.h"
+#include "can/CanScheduler.h"
+#include "can/PylontechEncoder.h"
+#include "can/TwaiCanBus.h"
+#include "history/FlashLog.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryQuery.h"
+#include "history/HistorySample.h"
+#include "history/HistoryStore.h"
+#include "history/PartitionLogStorage.h"
+#include "history/RegionLogStorage.h"
+#include "io/AlarmOutputs.h"
+#include "net/BmsMetrics.h"
+#include "net/InfluxUploader.h"
+#include "net/ModbusServer.h"
+#include "net/SseServer.h"
+#include "power/DeepSleepCycle.h"
+#include "power/PowerManager.h"
+#include "rules/RuleEngine.h"
+#include "ui/CellBarChart.h"
+#include "ui/RefreshScheduler.h"
+#include "ui/TrendWidget.h"
+#include "util/Crc32.h"
+#include "util/LogHistogram.h"
+#include "util/MemoryReport.h"
+#include "util/Profiler.h"
+#include "util/Trace.h"
 
 #include <GxEPD2_BW.h>
 
@@ -35,13 +79,143 @@
 
 // Serial configuration, adjust as needed
 #define PC_SERIAL_BAUD 115200
+#define PC_SERIAL_DUMP_TIME 10			// In seconds between two dumps of the BMS data, a dump takes longer than a frame
 #define BMS_SERIAL_MODE SERIAL_8N1
 #define BMS_SERIAL_PERIPHERAL 1
 #define BMS_SERIAL_BAUD_RATE 9600
 #define BMS_SERIAL_RX_PIN 15
 #define BMS_SERIAL_INVERT false
+#define BMS_SERIAL_FIFO_FULL 8			// In bytes, the reader is woken up after this many bytes, frames follow each other without a pause
+#define BMS_SERIAL_CHAR_US (10000000UL / BMS_SERIAL_BAUD_RATE)	// In microseconds, one character of BMS_SERIAL_MODE takes 10 bits on the wire
 
-#define DISPLAY_UPDATE_TIME 10		// In seconds
+// Refreshes of the display, alarms and permission changes are always shown immediately
+#define DISPLAY_MIN_INTERVAL 10			// In seconds, shortest time between two refreshes for changed values
+#define DISPLAY_MAX_INTERVAL 300		// In seconds, the interval doubles up to this while the values are stable
+#define DISPLAY_SWING_INTERVAL 30		// In seconds, shortest time between two refreshes while the current swings
+#define DISPLAY_SWING_CURRENT 10.0		// Change of the current between two frames that counts as a swing
+#define DISPLAY_VOLTAGE_STEP 0.1		// Smallest change of the pack voltage that counts as a change
+#define DISPLAY_CURRENT_STEP 1.0		// Smallest change of the pack current that counts as a change
+#define DISPLAY_SOC_STEP 1				// Smallest change of the SOC that counts as a change
+#define DISPLAY_CELL_VOLTAGE_STEP 0.01	// Smallest change of the lowest or highest cell that counts as a change
+#define DISPLAY_TEMPERATURE_STEP 1.0	// Smallest change of the lowest or highest temperature that counts as a change
+#define DISPLAY_GHOSTING_BUDGET 5		// Partial refreshes of the whole screen until a full refresh, 0 for full refreshes only
+#define DISPLAY_FULL_INTERVAL 1800		// In seconds, longest time between two full refreshes
+
+// CPU frequency, the maximum is only kept while rendering and during network bursts
+#define POWER_MAX_FREQUENCY 240			// In MHz
+#define POWER_MIN_FREQUENCY 80			// In MHz, at least 80 keeps the clock of the UART
+#define POWER_LIGHT_SLEEP false			// Needs CONFIG_PM_ENABLE and tickless idle, the UART loses the bytes that wake it up
+#define POWER_LOOP_WAIT 10				// In milliseconds, the loop waits this long for a frame, so the CPU can idle
+
+// Deep sleep mode for battery powered remote displays, the ESP32 only wakes up to read one frame and update the display
+// Relays, network, history and the pages are not served in this mode
+#define SLEEP_MODE false
+#define SLEEP_TIME 300					// In seconds between two wake ups
+#define SLEEP_FRAME_TIMEOUT 2000		// In milliseconds, maximum time to wait for a valid frame
+#define SLEEP_WAKE_ON_UART false		// Also wake up when the BMS starts to send, only useful if it is silent in between
+#define SLEEP_GHOSTING_BUDGET 10		// Partial refreshes until a full refresh, 0 for full refreshes only
+#define SLEEP_AWAKE_CURRENT 45.0		// In mA, current of the board while awake, used to estimate the average current
+#define SLEEP_REFRESH_CURRENT 5.0		// In mA, additional current of the panel while it refreshes
+#define SLEEP_CURRENT 0.2				// In mA, current of the board and the panel in deep sleep
+
+// Trend of the SOC or the pack current in the bottom right corner, it is updated with partial refreshes in between
+#define TREND_CHANNEL HISTORY_PACK_SOC	// HISTORY_PACK_SOC or HISTORY_PACK_CURRENT
+#define TREND_HOURS 6					// Time span of the whole trend
+#define TREND_X 312
+#define TREND_Y 144						// A multiple of 8, the panel refreshes whole bytes
+#define TREND_WIDTH 64
+#define TREND_HEIGHT 24
+#define TREND_SCALE_MIN 0.0				// Fixed scale, the scale follows the values if both are equal
+#define TREND_SCALE_MAX 100.0
+#define TREND_REFRESH_TIME 60			// In seconds, minimum time between two partial refreshes of the trend
+
+// Pages of the display, the button or the timer switches to the next page
+#define PAGE_BUTTON_DISABLED -1
+#define PAGE_BUTTON_PIN 0				// Active low, PAGE_BUTTON_DISABLED to disable the button
+#define PAGE_BUTTON_DEBOUNCE 50			// In milliseconds
+#define PAGE_SWITCH_TIME 0				// In seconds, 0 to disable the timer
+
+// Rolling windows for the display and the metrics, each window is {field, length in ms}
+#define ROLLING_PEAK_WINDOW 5		// In minutes, peak discharge current on the display
+#define ROLLING_CELL_WINDOW 60		// In minutes, lowest cell voltage on the display
+#define ROLLING_WINDOWS {{SBMS_FIELD_PACK_DISCHARGE_CURRENT, ROLLING_PEAK_WINDOW * 60000}, {SBMS_FIELD_PACK_CHARGE_CURRENT, ROLLING_PEAK_WINDOW * 60000}, \
+						 {SBMS_FIELD_LOWEST_CELL_VOLTAGE, ROLLING_CELL_WINDOW * 60000}, {SBMS_FIELD_HIGHEST_CELL_TEMPERATURE, ROLLING_CELL_WINDOW * 60000}}
+
+// Charged and discharged energy, the totals survive a restart
+#define ENERGY_MAX_GAP 5000				// In milliseconds, longer gaps between two frames are not integrated
+#define ENERGY_CHECKPOINT_TIME 900		// In seconds, minimum time between two writes to the flash
+
+// Time to full and time to empty, based on the smoothed power of the pack
+#define RUNTIME_TIME_CONSTANT 120		// In seconds
+#define RUNTIME_IDLE_POWER 20.0			// In W, the pack is idle below this power
+#define RUNTIME_MIN_CONFIDENCE 0.3		// From 0 to 1, less confident estimates are marked on the display
+
+// Relay outputs driven directly by the flags of the BMS, use ALARM_OUTPUT_DISABLED for unused outputs
+#define RELAY_CHARGE_PIN 25
+#define RELAY_DISCHARGE_PIN 33
+#define RELAY_ALARM_PIN 32
+#define RELAY_ACTIVE_HIGH true
+#define BMS_FRAME_QUEUE_LENGTH 16	// Frames buffered while the display is refreshing
+
+// Health of the BMS link, the relays go to the safe state once the data is stale
+#define LINK_CHECK_TIME 100				// In milliseconds
+#define LINK_DEGRADED_TIMEOUT 2500		// In milliseconds
+#define LINK_STALE_TIMEOUT 5000			// In milliseconds
+#define LINK_LOST_TIMEOUT 30000			// In milliseconds
+#define LINK_ERROR_WINDOW 16			// In frames
+#define LINK_DEGRADED_ERRORS 2			// Corrupt frames within the window
+
+// Outputs switched by user rules, the rules are edited at http://<ip>/rules and stored in the flash
+#define RULE_OUTPUT_NAMES {"relay1", "relay2"}
+#define RULE_OUTPUT_PINS {13, 14}
+#define RULE_OUTPUT_ACTIVE_HIGH true
+#define RULE_DEFAULT_TEXT "relay1 = on packSoc > 30 off packSoc < 20 min_off 300"
+
+// WiFi configuration, adjust as needed
+#define WIFI_SSID "your-ssid"
+#define WIFI_PASSWORD "your-password"
+#define SSE_SERVER_PORT 8080		// Live stream at http://<ip>:8080/events
+#define HTTP_SERVER_PORT 80			// Prometheus metrics at http://<ip>/metrics
+#define MODBUS_SERVER_PORT 502		// Modbus TCP, see ModbusRegisterMap.h for the register map
+
+// CAN configuration for the inverter (Pylontech protocol), adjust as needed
+#define CAN_TX_PIN 26
+#define CAN_RX_PIN 27
+#define CAN_BITRATE 500000
+#define CAN_TICK_TIME 10				// In milliseconds
+#define CAN_FRAME_PERIOD 1000			// In milliseconds
+#define CAN_DATA_TIMEOUT 5000			// In milliseconds, stop sending when no valid frame arrives
+#define CAN_CHARGE_VOLTAGE_LIMIT 56.8	// In V
+#define CAN_DISCHARGE_VOLTAGE_LIMIT 48.0 // In V
+#define CAN_MAX_CHARGE_CURRENT 100.0	// In A
+#define CAN_MAX_DISCHARGE_CURRENT 100.0 // In A
+
+// InfluxDB history upload, adjust as needed
+#define INFLUX_HOST "influxdb.local"
+#define INFLUX_PORT 8086
+#define INFLUX_PATH "/api/v2/write?org=home&bucket=bms&precision=ms"
+#define INFLUX_TOKEN "your-token"
+#define INFLUX_MEASUREMENT "bms"
+#define INFLUX_TAGS "device=smartbms"
+#define INFLUX_SAMPLE_INTERVAL 10		// In seconds
+#define INFLUX_BATCH_PERIOD 300			// In seconds
+#define NTP_SERVER "pool.ntp.org"
+
+// Compressed history of all frames, kept in PSRAM if the board has it
+#define HISTORY_PSRAM_SIZE (3584 * 1024)	// In bytes, about 24 h at 16 frames per second
+#define HISTORY_RAM_SIZE (32 * 1024)		// In bytes, used without PSRAM
+
+// Full history blocks are kept in a log on the flash and restored after a reset
+#define LOG_PARTITION_LABEL "spiffs"		// Data partition of the default partition table that is not used otherwise
+#define LOG_SEGMENT_SIZE (16 * 1024)		// In bytes, a multiple of 4 KB
+#define LOG_FLUSH_TIME 60					// In seconds, maximum time a full block is only kept in RAM
+#define ARCHIVE_QUARTER_LOG_SIZE (48 * 1024)	// In bytes at the start of the partition, 7 days of closed quarter rows
+#define ARCHIVE_DAY_LOG_SIZE (32 * 1024)		// In bytes behind the quarter rows, 1 year of closed day rows
+#define ARCHIVE_SEGMENT_SIZE (4 * 1024)			// In bytes, a multiple of 4 KB
+
+// Defaults of the history API, /api/history?channel=packVoltage&from=<unix ms>&to=<unix ms>&points=<n>
+#define HISTORY_API_RANGE 24				// In hours, used without from
+#define HISTORY_API_POINTS 300				// Used without points, at most HISTORY_QUERY_MAX_POINTS
 
 // Serial connections
 HardwareSerial smartBmsSerial(BMS_SERIAL_PERIPHERAL);
@@ -50,326 +224,1622 @@ SmartBmsReader smartBmsReader(&smartBmsSerial);
 // Define the display
 GxEPD2_BW<GxEPD2_290_GDEY029T71H, GxEPD2_290_GDEY029T71H::HEIGHT> display(GxEPD2_290_GDEY029T71H(/*CS=5*/ SS, /*DC=*/17, /*RST=*/16, /*BUSY=*/4)); // ESPink-Shelf-2.9 GDEY029T94  128x296, SSD1680, (FPC-A005 20.06.15)
 
+// Frequency scaling, the reader waits for the UART at the minimum frequency
+PowerManager powerManager;
+
 // Pin definitions for the display
 #define DISPLAY_POWER_PIN 2
+#define DISPLAY_POWER_DELAY 100		// In milliseconds, time the display needs after it was powered on
+
+// Checksum of the page on the panel, the display stays powered over a software reset and keeps its image
+#define DISPLAY_IMAGE_MAGIC 0x494D4731
+RTC_DATA_ATTR uint32_t displayImageMagic;
+RTC_DATA_ATTR uint32_t displayImageCrc;
+
+// Frames are read by their own task, so the relays never wait for the display
+struct BmsFrameEvent
+{
+	SmartBmsError error;
+	SmartBmsData data;
+	int64_t timeUs;
+};
 
-// Update interval
-const unsigned long updateInterval = DISPLAY_UPDATE_TIME*1000;
-unsigned long lastUpdateTime = 0;
+AlarmOutputs alarmOutputs({RELAY_CHARGE_PIN, RELAY_DISCHARGE_PIN, RELAY_ALARM_PIN, RELAY_ACTIVE_HIGH});
+LogHistogram alarmLatency;
+QueueHandle_t bmsFrameQueue;
+TaskHandle_t bmsReaderTaskHandle;
+std::atomic<uint32_t> rxEventTimeUs(0);
+std::atomic<uint32_t> droppedFrameEvents(0);
 
-// Remaining charge time
-float remainingChargeTime = 0.0;
+// Rules are compiled in the loop and evaluated by the reader task
+const char *const ruleOutputNames[] = RULE_OUTPUT_NAMES;
+const int8_t ruleOutputPins[] = RULE_OUTPUT_PINS;
+const uint8_t ruleOutputCount = sizeof(ruleOutputPins) / sizeof(ruleOutputPins[0]);
+RuleEngine ruleEngine(ruleOutputNames, ruleOutputCount);
+RuleEngine ruleCompiler(ruleOutputNames, ruleOutputCount);
+std::mutex ruleMutex;
+uint8_t ruleOutputMask = 0;
+Preferences rulePreferences;
 
 /**
- * @brief Setup.
+ * @brief Evaluate the rules and switch the outputs that changed.
+ * @param smartBmsData validated BMS data
  */
-void setup()
+void applyRules(const SmartBmsData &smartBmsData)
 {
-	// Initialize the serial connections
-	Serial.begin(PC_SERIAL_BAUD);																				// Begin pc serial monitor
-	smartBmsSerial.begin(BMS_SERIAL_BAUD_RATE, BMS_SERIAL_MODE, BMS_SERIAL_RX_PIN, -1, BMS_SERIAL_INVERT);		// Begin BMS serial
+	std::lock_guard<std::mutex> lock(ruleMutex);
+	const uint8_t outputMask = ruleEngine.evaluate(smartBmsData, millis());
+	for (uint8_t i = 0; i < ruleOutputCount; i++)
+	{
+		if ((outputMask ^ ruleOutputMask) & (1 << i))
+		{
+			digitalWrite(ruleOutputPins[i], ((outputMask >> i) & 1) == RULE_OUTPUT_ACTIVE_HIGH ? HIGH : LOW);
+		}
+	}
+	ruleOutputMask = outputMask;
+}
 
-	// Activate the display
-	pinMode(DISPLAY_POWER_PIN, OUTPUT);																			// Set display pin mode
-	digitalWrite(DISPLAY_POWER_PIN, HIGH); 																		// Activate the display
-	delay(100);							   																		// Wait for the display to initialize
-	display.init(115200);				  																		// Initialize the display with the specified baud rate
-	display.setRotation(1);				 																		// Rotate the display 90 degrees clockwise
+/**
+ * @brief Turn all rule outputs off, they are switched again by the next valid frame.
+ */
+void resetRuleOutputs()
+{
+	std::lock_guard<std::mutex> lock(ruleMutex);
+	ruleEngine.reset();
+	for (uint8_t i = 0; i < ruleOutputCount; i++)
+	{
+		digitalWrite(ruleOutputPins[i], RULE_OUTPUT_ACTIVE_HIGH ? LOW : HIGH);
+	}
+	ruleOutputMask = 0;
 }
 
 /**
- * @brief Endless loop.
+ * @brief Compile a rule set and activate it when it is valid.
+ * @param text rule set
+ * @return RuleError
  */
-void loop()
+const RuleError loadRules(const char *text)
 {
-	// Check if enough data was received
-	if (smartBmsReader.bmsDataReady() == SmartBmsError::SBMS_OK)
+	const RuleError error = ruleCompiler.compile(text);
+	if (error == RuleError::RULE_OK)
 	{
-		// Read the BMS data and check for errors
-		SmartBmsData smartBmsData;
-		const SmartBmsError err = smartBmsReader.decodeBmsData(&smartBmsData);
-		if (err == SmartBmsError::SBMS_OK)
+		std::lock_guard<std::mutex> lock(ruleMutex);
+		ruleEngine = ruleCompiler;
+	}
+	return error;
+}
+
+// Link state, evaluated by a timer so a silent wire is detected without any frame
+SmartBmsLinkMonitor linkMonitor({LINK_DEGRADED_TIMEOUT, LINK_STALE_TIMEOUT, LINK_LOST_TIMEOUT, LINK_ERROR_WINDOW, LINK_DEGRADED_ERRORS});
+esp_timer_handle_t linkTimer;
+std::atomic<bool> linkSafeStatePending(false);
+
+/**
+ * @brief Called by the link monitor on every change. The display and the telemetry follow in the loop.
+ * The outputs are switched by the reader task, the timer task also runs the CAN schedule.
+ * @param previous previous state
+ * @param state new state
+ */
+void onLinkStateChange(const SmartBmsLinkState previous, const SmartBmsLinkState state)
+{
+	TRACE_INSTANT(TRACE_LINK_STATE, state);
+	if (state >= SBMS_LINK_STALE)
+	{
+		linkSafeStatePending.store(true, std::memory_order_relaxed);
+		xTaskNotifyGive(bmsReaderTaskHandle);
+	}
+}
+
+/**
+ * @brief Timer callback that evaluates the link state.
+ * @param parameter unused
+ */
+void linkTimerCallback(void *parameter)
+{
+	linkMonitor.check(millis());
+}
+
+/**
+ * @brief Called by the UART event task when the FIFO reached BMS_SERIAL_FIFO_FULL bytes or after a pause of one character,
+ * so the event time is at most one character after the newest received byte.
+ */
+void onBmsSerialReceive()
+{
+	rxEventTimeUs.store(static_cast<uint32_t>(esp_timer_get_time()), std::memory_order_relaxed);
+	TRACE_INSTANT(TRACE_UART_RECEIVE, smartBmsSerial.available());
+	xTaskNotifyGive(bmsReaderTaskHandle);
+}
+
+/**
+ * @brief Called by the UART driver on receive errors.
+ * @param error type of the error
+ */
+void onBmsSerialError(hardwareSerial_error_t error)
+{
+	if (error == UART_FIFO_OVF_ERROR || error == UART_BUFFER_FULL_ERROR)
+	{
+		smartBmsReader.reportOverrun();
+	}
+}
+
+/**
+ * @brief Task that decodes the frames and drives the relays before anything else sees the data.
+ * @param parameter unused
+ */
+void bmsReaderTask(void *parameter)
+{
+	while (true)
+	{
+		// Woken up by the UART, the timeout only covers a missed notification
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
 
+		// A frame that arrived since then already restored the link, its outputs stay
+		if (linkSafeStatePending.exchange(false, std::memory_order_relaxed) && linkMonitor.getState() >= SBMS_LINK_STALE)
 		{
-			// Data is ok, lets print it
-			Serial.println();
-			Serial.println("===========================");
-			Serial.println((String) "Cell-Count: " + smartBmsData.getCellCount());
-			Serial.println((String) "Min-Cell-Voltage: " + smartBmsData.getCellVoltageMin() + "V");
-			Serial.println((String) "Max-Cell-Voltage: " + smartBmsData.getCellVoltageMax() + "V");
-			Serial.println((String) "Balance-Voltage: " + smartBmsData.getCellVoltageBalance() + "V");
-			Serial.println((String) "Pack-SOC: " + smartBmsData.getPackSoc() + "%");
-			Serial.println((String) "Pack-Voltage: " + smartBmsData.getPackVoltage() + "V");
-			Serial.println((String) "Pack-Current: " + smartBmsData.getPackCurrent() + "A");
-			Serial.println((String) "Pack-Charge-Current: " + smartBmsData.getPackChargeCurrent() + "A");
-			Serial.println((String) "Pack-Discharge-Current: " + smartBmsData.getPackDischargeCurrent() + "A");
-			Serial.println((String) "Pack-Capacity: " + smartBmsData.getPackCapacity() + "kWh");
-			Serial.println((String) "Pack-Energy: " + smartBmsData.getPackRemainingEnergy() + "kWh");
-			Serial.println((String) "Lowest-Cell-Voltage: " + smartBmsData.getLowestCellVoltage() + "V");
-			Serial.println((String) "Lowest-Cell-Voltage-Numer: " + smartBmsData.getLowestCellVoltageNumber());
-			Serial.println((String) "Highest-Cell-Voltage: " + smartBmsData.getHighestCellVoltage() + "V");
-			Serial.println((String) "Highest-Cell-Voltage-Number: " + smartBmsData.getHighestCellVoltageNumber());
-			Serial.println((String) "Lowest-Cell-Temp: " + smartBmsData.getLowestCellTemperature() + "°C");
-			Serial.println((String) "Lowest-Cell-Temp-Number: " + smartBmsData.getLowestCellTemperatureNumber());
-			Serial.println((String) "Highest-Cell-Temp: " + smartBmsData.getHighestCellTemperature() + "°C");
-			Serial.println((String) "Highest-Cell-Temp-Number: " + smartBmsData.getHighestCellTemperatureNumber());
-			Serial.println((String) "Allowed-Charge: " + (smartBmsData.isAllowedToCharge() ? "Yes" : "No"));
-			Serial.println((String) "Allowed-Discharge: " + (smartBmsData.isAllowedToDischarge() ? "Yes" : "No"));
-			Serial.println((String) "Alarm-Communication-Error: " + (smartBmsData.hasCommunicationError() ? "Active" : "Inactive"));
-			Serial.println((String) "Alarm-Min-Voltage: " + (smartBmsData.isMinVoltageAlarmActive() ? "Active" : "Inactive"));
-			Serial.println((String) "Alarm-Max-Voltage: " + (smartBmsData.isMaxVoltageAlarmActive() ? "Active" : "Inactive"));
-			Serial.println((String) "Alarm-Min-Temp: " + (smartBmsData.isMinTemperatureAlarmActive() ? "Active" : "Inactive"));
-			Serial.println((String) "Alarm-Max-Temp: " + (smartBmsData.isMaxTemperatureAlarmActive() ? "Active" : "Inactive"));
-			Serial.println("===========================");
-			Serial.println();
-
-			// Calculate remaining charge time if charging
-			if (smartBmsData.getPackChargeCurrent() > 5 && smartBmsData.getPackSoc() < 100)
+			alarmOutputs.setSafeState();
+			resetRuleOutputs();
+		}
+		while (smartBmsReader.bmsDataReady() == SmartBmsError::SBMS_OK)
+		{
+			BmsFrameEvent frameEvent;
+			TRACE_BEGIN(TRACE_DECODE);
+			PROFILE_BEGIN(decode);
+			frameEvent.error = smartBmsReader.decodeBmsData(&frameEvent.data);
+			frameEvent.timeUs = esp_timer_get_time();
+			PROFILE_END(decode, PROFILE_STAGE_DECODE);
+			TRACE_END(TRACE_DECODE);
+			if (frameEvent.error == SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA)
 			{
-				remainingChargeTime = (smartBmsData.getPackCapacity() - smartBmsData.getPackRemainingEnergy()) * 1000 /
-									  (smartBmsData.getPackChargeCurrent() * smartBmsData.getPackVoltage());
+				break;
 			}
-			else if (smartBmsData.getPackSoc() >= 100)
+			linkMonitor.onFrame(frameEvent.error, millis());
+
+			// The last UART event delivered everything still buffered behind this frame, these bytes followed
+			// its last byte back to back, so it was received one character time per buffered byte before the event
+			uint32_t eventUs;
+			int buffered;
+			do
 			{
-				remainingChargeTime = 0; // Battery already at 100%
-			}
-			else
+				eventUs = rxEventTimeUs.load(std::memory_order_relaxed);
+				buffered = smartBmsSerial.available();
+			} while (eventUs != rxEventTimeUs.load(std::memory_order_relaxed));
+			const uint32_t lastByteUs = eventUs - static_cast<uint32_t>(buffered) * BMS_SERIAL_CHAR_US;
+			if (frameEvent.error == SmartBmsError::SBMS_OK)
 			{
-				remainingChargeTime = -1; // Error or invalid value
+				TRACE_BEGIN(TRACE_OUTPUTS);
+				alarmOutputs.apply(frameEvent.data);
+				applyRules(frameEvent.data);
+				TRACE_END(TRACE_OUTPUTS);
+
+				alarmLatency.record(static_cast<uint32_t>(esp_timer_get_time()) - lastByteUs);
 			}
 
-			// Update display if enough time has passed
-			unsigned long currentMillis = millis();
-			if (currentMillis - lastUpdateTime >= updateInterval)
+			TRACE_INSTANT(TRACE_QUEUE_SEND, frameEvent.error);
+			if (xQueueSend(bmsFrameQueue, &frameEvent, 0) != pdTRUE)
 			{
-				lastUpdateTime = currentMillis;
-
-				// Clear the display
-				display.fillScreen(GxEPD_WHITE);
-				display.setTextColor(GxEPD_BLACK);
-
-				// Display battery information
-				display.drawBitmap(15, 15, icon_charge, 24, 24, GxEPD_BLACK);
-				display.drawBitmap(15, 50, icon_up, 24, 24, GxEPD_BLACK);
-				display.drawBitmap(15, 85, icon_hot, 24, 24, GxEPD_BLACK);
-				display.drawBitmap(160, 15, icon_discharge, 24, 24, GxEPD_BLACK);
-				display.drawBitmap(160, 50, icon_down, 24, 24, GxEPD_BLACK);
-				display.drawBitmap(160, 85, icon_cold, 24, 24, GxEPD_BLACK);
-
-				// Battery icon dependenat on SoC and charging current
-				if (smartBmsData.getPackSoc() < 10)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_0_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_0, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 20)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_10_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_10, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 30)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_20_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_20, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 40)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_30_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_30, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 50)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_40_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_40, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 60)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_50_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_50, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 70)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_60_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_60, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 80)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_70_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_70, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 90)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 0)
-					{
-						display.drawBitmap(320, 15, icon_battery_80_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_80, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else if (smartBmsData.getPackSoc() < 100)
-				{
-					if (smartBmsData.getPackChargeCurrent() > 5)
-					{
-						display.drawBitmap(320, 15, icon_battery_90_charging, 45, 75, GxEPD_BLACK);
-					}
-					else
-					{
-						display.drawBitmap(320, 15, icon_battery_90, 45, 75, GxEPD_BLACK);
-					}
-				}
-				else
-				{ // If SOC is already at 100%
-					display.drawBitmap(320, 15, icon_battery_100, 45, 75, GxEPD_BLACK);
-				}
+				droppedFrameEvents.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+}
 
-				display.setFont(&SourceSans3_Bold9pt7b);
+// Decides when the display is refreshed and if a partial refresh is enough
+RefreshScheduler refreshScheduler({DISPLAY_MIN_INTERVAL * 1000, DISPLAY_MAX_INTERVAL * 1000, DISPLAY_SWING_INTERVAL * 1000, DISPLAY_VOLTAGE_STEP, DISPLAY_CURRENT_STEP,
+								   DISPLAY_SOC_STEP, DISPLAY_CELL_VOLTAGE_STEP, DISPLAY_TEMPERATURE_STEP, DISPLAY_SWING_CURRENT, DISPLAY_GHOSTING_BUDGET, DISPLAY_FULL_INTERVAL * 1000});
 
-				display.setCursor(49, 33); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getPackChargeCurrent() + "A");
+// Trend widget, it is only refreshed on its own while the values are shown
+TrendWidget trendWidget;
+bool trendVisible = false;
+bool trendLoaded = false;
+unsigned long lastTrendRefresh = 0;
 
-				display.setCursor(49, 67); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getHighestCellVoltage() + "V @ " + smartBmsData.getHighestCellVoltageNumber());
+// Pages of the display, each page is drawn into its own canvas
+enum DisplayPage
+{
+	DISPLAY_PAGE_OVERVIEW,
+	DISPLAY_PAGE_CELLS,
+	DISPLAY_PAGE_COUNT
+};
+GFXcanvas1 overviewCanvas(GxEPD2_290_GDEY029T71H::HEIGHT, GxEPD2_290_GDEY029T71H::WIDTH);
+GFXcanvas1 cellsCanvas(GxEPD2_290_GDEY029T71H::HEIGHT, GxEPD2_290_GDEY029T71H::WIDTH);
+GFXcanvas1 *const pageCanvases[DISPLAY_PAGE_COUNT] = {&overviewCanvas, &cellsCanvas};
+bool pageValid[DISPLAY_PAGE_COUNT] = {false, false};
+uint8_t currentPage = DISPLAY_PAGE_OVERVIEW;
+bool messageShown = false;
+CellBarChart cellBarChart;
 
-				display.setCursor(49, 102); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getHighestCellTemperature() + "C @ " + smartBmsData.getHighestCellTemperatureNumber());
+// Data of the last frame, it is needed to draw a page when switching to it
+SmartBmsData displayedBmsData;
+bool hasDisplayedBmsData = false;
 
-				display.setCursor(194, 33); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getPackDischargeCurrent() + "A");
+// Time to full and time to empty
+SmartBmsRuntimeEstimator runtimeEstimator({RUNTIME_TIME_CONSTANT * 1000, RUNTIME_IDLE_POWER, ENERGY_MAX_GAP});
 
-				display.setCursor(194, 67); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getLowestCellVoltage() + "V @ " + smartBmsData.getLowestCellVoltageNumber());
+// Collected data of the individual cells
+SmartBmsCellTable smartBmsCellTable;
 
-				display.setCursor(194, 102); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getLowestCellTemperature() + "C @ " + smartBmsData.getLowestCellTemperatureNumber());
+// Minimum, maximum and mean of selected fields over the last minutes
+const SmartBmsRollingWindowConfig rollingWindowConfig[] = ROLLING_WINDOWS;
+SmartBmsRollingStats rollingStats(rollingWindowConfig, sizeof(rollingWindowConfig) / sizeof(rollingWindowConfig[0]));
 
-				display.setCursor(317, 140); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getPackVoltage() + "V");
+// Energy counters, saved to the NVS at most every ENERGY_CHECKPOINT_TIME seconds
+SmartBmsEnergyMeter energyMeter(ENERGY_MAX_GAP);
+SmartBmsEnergyTotals savedEnergyTotals = {0, 0, 0, 0};
+uint32_t lastEnergyCheckpoint = 0;
+Preferences energyPreferences;
 
-				display.setFont(&SourceSans3_Bold12pt7b);
+/**
+ * @brief Continue with the totals of the last checkpoint.
+ */
+void restoreEnergyMeter()
+{
+	energyPreferences.begin("energy", false);
+	if (energyPreferences.getBytesLength("totals") == sizeof(savedEnergyTotals) &&
+		energyPreferences.getBytes("totals", &savedEnergyTotals, sizeof(savedEnergyTotals)) == sizeof(savedEnergyTotals))
+	{
+		energyMeter.restore(savedEnergyTotals);
+	}
+	lastEnergyCheckpoint = millis();
+}
 
-				display.setCursor(320, 115); // Adjust cursor position as needed
-				display.println((String)smartBmsData.getPackSoc() + "%");
+/**
+ * @brief Save the totals if they changed and the last checkpoint is old enough.
+ * Energy integrated since the last checkpoint is lost on a power failure, which bounds the wear of the flash.
+ */
+void checkpointEnergyMeter()
+{
+	if (millis() - lastEnergyCheckpoint < ENERGY_CHECKPOINT_TIME * 1000UL)
+	{
+		return;
+	}
+	lastEnergyCheckpoint = millis();
 
-				display.setFont(&SourceSans3_Bold9pt7b);
+	const SmartBmsEnergyTotals &totals = energyMeter.getTotals();
+	if (totals.chargedEnergy == savedEnergyTotals.chargedEnergy && totals.dischargedEnergy == savedEnergyTotals.dischargedEnergy &&
+		totals.chargedCharge == savedEnergyTotals.chargedCharge && totals.dischargedCharge == savedEnergyTotals.dischargedCharge)
+	{
+		return;
+	}
+	if (energyPreferences.putBytes("totals", &totals, sizeof(totals)) == sizeof(totals))
+	{
+		savedEnergyTotals = totals;
+	}
+}
 
-				display.setCursor(15, 135); // Adjust cursor position as needed
+// Modbus TCP server for inverters, served by its own task
+ModbusServer modbusServer(MODBUS_SERVER_PORT);
 
-				// If communication error print it else show relevant data
-				if (smartBmsData.hasCommunicationError())
-				{
-					display.println("CHYBA KOMUNIKACE");
-				}
-				else if (!smartBmsData.isAllowedToCharge() && (!smartBmsData.isAllowedToDischarge()))
-				{
-					display.println("Vybijeni ZAKAZANO - chyba");
-					display.setCursor(15, 155); // Adjust cursor position as needed
-					display.println("Nabijeni ZAKAZANO - chyba");
-				}
-				else if (!smartBmsData.isAllowedToCharge())
-				{
-					display.println("Nabijeni ZAKAZANO - chyba");
-				}
-				else if (!smartBmsData.isAllowedToDischarge())
-				{
-					display.println("Vybijeni ZAKAZANO - chyba");
-				}
-				else if (remainingChargeTime > 0)
-				{
-					int hours = (int)remainingChargeTime;
-					int minutes = (int)((remainingChargeTime - hours) * 60);
-					display.setCursor(15, 155); // Adjust cursor position as needed
-					display.println((String) "Cas do nabiti: ~" + hours + "h " + minutes + "min");
-				}
+/**
+ * @brief Task that serves the Modbus masters independent of the display updates.
+ * @param parameter unused
+ */
+void modbusTask(void *parameter)
+{
+	while (true)
+	{
+		modbusServer.handle(1000);
+	}
+}
 
-				// Display the content
-				display.display();
-			}
-		}
-		else if (err == SmartBmsError::SBMS_ERR_READ_STREAM)
-		{
-			// Failed to read the input stream
-			Serial.println("Error: Failed to read BMS data. The input stream could not be read.");
+// CAN output to the inverter, the transmit table is driven by a timer
+TwaiCanBus canBus(CAN_TX_PIN, CAN_RX_PIN, CAN_BITRATE);
+CanScheduler canScheduler(&canBus, CAN_DATA_TIMEOUT);
+PylontechEncoder pylontechEncoder({CAN_CHARGE_VOLTAGE_LIMIT, CAN_DISCHARGE_VOLTAGE_LIMIT, CAN_MAX_CHARGE_CURRENT, CAN_MAX_DISCHARGE_CURRENT});
+esp_timer_handle_t canTimer;
 
-			// Clear the display
-			display.fillScreen(GxEPD_WHITE);
-			display.setCursor(82, 93); // Adjust cursor position as needed
-			display.setTextColor(GxEPD_BLACK);
-			display.setFont(&SourceSans3_Bold18pt7b);
+/**
+ * @brief Timer callback that sends the CAN frames which are due.
+ * @param parameter unused
+ */
+void canTimerCallback(void *parameter)
+{
+	canScheduler.tick(esp_timer_get_time() / 1000);
+}
+
+/**
+ * @brief Start the CAN controller and the timer of the transmit table.
+ * The frames are spread over the period, so they never queue up behind each other.
+ */
+void beginCanOutput()
+{
+	if (!canBus.begin())
+	{
+		Serial.println("Error: Failed to start the CAN controller.");
+		return;
+	}
 
-			display.print("ZADNA DATA");
-			display.display();
+	for (uint8_t i = 0; i < PYLONTECH_FRAME_COUNT; i++)
+	{
+		canScheduler.addFrame(i, CAN_FRAME_PERIOD, i * CAN_FRAME_PERIOD / PYLONTECH_FRAME_COUNT);
+	}
 
-			return;
+	esp_timer_create_args_t timerArgs = {};
+	timerArgs.callback = canTimerCallback;
+	timerArgs.dispatch_method = ESP_TIMER_TASK;
+	timerArgs.name = "can";
+	if (esp_timer_create(&timerArgs, &canTimer) == ESP_OK)
+	{
+		esp_timer_start_periodic(canTimer, CAN_TICK_TIME * 1000);
+	}
+}
+
+// Live stream for dashboards
+SseServer sseServer(SSE_SERVER_PORT);
+SmartBmsData lastPublishedBmsData;
+char sseEventBuffer[SSE_EVENT_SIZE];
+
+/**
+ * @brief Push the fields that changed since the last event to all connected browsers.
+ * A full frame is sent when a new browser is waiting for its first event.
+ * @param smartBmsData latest BMS data
+ */
+void publishBmsData(const SmartBmsData &smartBmsData)
+{
+	const bool keyframe = sseServer.needsKeyframe();
+	const uint32_t changeMask = keyframe ? SBMS_FIELD_MASK_ALL : smartBmsData.getChangeMask(lastPublishedBmsData);
+	lastPublishedBmsData = smartBmsData;
+	if (changeMask == 0 || sseServer.getClientCount() == 0)
+	{
+		return;
+	}
+
+	// Serialize once, the server shares the buffer with all clients
+	const size_t length = smartBmsData.toJson(sseEventBuffer, sizeof(sseEventBuffer), changeMask);
+	if (length > 0)
+	{
+		sseServer.publish(keyframe ? "frame" : "delta", sseEventBuffer, length, keyframe);
+	}
+}
+
+// History upload to InfluxDB, the radio sleeps between two batches
+InfluxUploader influxUploader({INFLUX_HOST, INFLUX_PORT, INFLUX_PATH, INFLUX_TOKEN, INFLUX_MEASUREMENT, INFLUX_TAGS, INFLUX_SAMPLE_INTERVAL * 1000, INFLUX_BATCH_PERIOD * 1000});
+
+/**
+ * @brief Get the wall clock time.
+ * @return time in ms since the epoch or 0 if the clock was not synchronized yet
+ */
+uint64_t getUnixTimeMs()
+{
+	struct timeval now;
+	gettimeofday(&now, nullptr);
+	if (now.tv_sec < 1700000000)
+	{
+		return 0;
+	}
+	return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+/**
+ * @brief Get the system time, it keeps running in deep sleep.
+ * @return time in microseconds
+ */
+int64_t getSystemTimeUs()
+{
+	struct timeval now;
+	gettimeofday(&now, nullptr);
+	return static_cast<int64_t>(now.tv_sec) * 1000000 + now.tv_usec;
+}
+
+// Compressed history for graphs and the analysis of incidents
+HistoryStore historyStore;
+
+// Consolidated minute, quarter and day values for long ranges
+HistoryArchive historyArchive;
+
+// Downsampled range queries for the graph and the history API
+HistoryQuery historyQuery(historyStore, historyArchive);
+
+// Log of the full history blocks on the flash, it only covers the last hours
+// The closed quarter and day rows of the archives are kept in their own logs at the start of the partition
+PartitionLogStorage logStorage(LOG_PARTITION_LABEL);
+RegionLogStorage quarterLogStorage(&logStorage, 0, ARCHIVE_QUARTER_LOG_SIZE);
+RegionLogStorage dayLogStorage(&logStorage, ARCHIVE_QUARTER_LOG_SIZE, ARCHIVE_DAY_LOG_SIZE);
+RegionLogStorage blockLogStorage(&logStorage, ARCHIVE_QUARTER_LOG_SIZE + ARCHIVE_DAY_LOG_SIZE, 0);
+FlashLog flashLog;
+FlashLog quarterLog;
+FlashLog dayLog;
+unsigned long lastLogFlush = 0;
+
+/**
+ * @brief Append a full history block to the flash log.
+ * @param block data of the block
+ * @param length length of the block
+ */
+void onHistoryBlock(const uint8_t *block, const size_t length)
+{
+	if (!flashLog.append(block, length))
+	{
+		Serial.println("Error: Failed to write a history block to the flash.");
+	}
+}
+
+/**
+ * @brief Write a closed quarter or day row of the archives to its log, the rows are written right away.
+ * @param entry closed row
+ */
+void onArchiveEntry(const HistoryArchiveEntry &entry)
+{
+	if (entry.level == HISTORY_ARCHIVE_MINUTE)
+	{
+		return;
+	}
+	FlashLog &log = entry.level == HISTORY_ARCHIVE_DAY ? dayLog : quarterLog;
+	if (!log.append(&entry, sizeof(entry)) || !log.flush())
+	{
+		Serial.println("Error: Failed to write an archive row to the flash.");
+	}
+}
+
+/**
+ * @brief Import the persisted rows of an archive log.
+ * @param log mounted log
+ * @param level level of the rows in the log
+ * @return number of imported rows
+ */
+const uint32_t importArchiveLog(const FlashLog &log, const HistoryArchiveLevel level)
+{
+	HistoryArchiveEntry entry;
+	LogCursor cursor;
+	size_t length = 0;
+	uint32_t rows = 0;
+	log.rewind(cursor);
+	while (log.next(cursor, &entry, sizeof(entry), length))
+	{
+		if (length == sizeof(entry) && entry.level == level && historyArchive.importEntry(entry))
+		{
+			rows++;
 		}
-		else if (err == SmartBmsError::SBMS_ERR_INVALID_CHECKSUM)
+	}
+	return rows;
+}
+
+/**
+ * @brief Mount the flash logs and restore the history and the archives from them.
+ */
+void restoreHistory()
+{
+	// The days are imported first, so the quarters only extend the open day
+	uint32_t archiveRows = 0;
+	if (dayLog.begin(&dayLogStorage, ARCHIVE_SEGMENT_SIZE) && quarterLog.begin(&quarterLogStorage, ARCHIVE_SEGMENT_SIZE))
+	{
+		archiveRows += importArchiveLog(dayLog, HISTORY_ARCHIVE_DAY);
+		archiveRows += importArchiveLog(quarterLog, HISTORY_ARCHIVE_QUARTER);
+		historyArchive.setListener(onArchiveEntry);
+	}
+	else
+	{
+		Serial.println("Error: Failed to mount the archive logs, the archives only cover the history log.");
+	}
+
+	if (!flashLog.begin(&blockLogStorage, LOG_SEGMENT_SIZE))
+	{
+		Serial.println("Error: Failed to mount the history log, is there a data partition named " LOG_PARTITION_LABEL "?");
+		return;
+	}
+
+	static uint8_t block[HISTORY_BLOCK_SIZE];
+	LogCursor cursor;
+	size_t length = 0;
+	uint32_t blocks = 0;
+	flashLog.rewind(cursor);
+	while (flashLog.next(cursor, block, sizeof(block), length))
+	{
+		if (historyStore.importBlock(block, length))
 		{
-			// Checksum is invalid, something went very wrong
-			Serial.println("Error: Failed to read BMS data. The checksum is invalid.");
+			blocks++;
+		}
+	}
+	historyStore.setBlockListener(onHistoryBlock);
 
-			// Clear the display
-			display.fillScreen(GxEPD_WHITE);
-			display.setCursor(52, 93); // Adjust cursor position as needed
-			display.setTextColor(GxEPD_BLACK);
-			display.setFont(&SourceSans3_Bold18pt7b);
+	// Rebuild the minutes and the open slots from the restored samples, closed rows are not changed
+	HistoryCursor historyCursor;
+	HistorySample sample;
+	historyStore.seek(historyCursor, historyStore.getOldestTime());
+	while (historyStore.next(historyCursor, sample))
+	{
+		historyArchive.update(sample);
+	}
+	Serial.printf("Restored %lu history blocks and %lu archive rows, %lu torn records were skipped.\n", static_cast<unsigned long>(blocks),
+				  static_cast<unsigned long>(archiveRows), static_cast<unsigned long>(flashLog.getRecoveredTornRecords()));
+}
 
-			display.print("POSKOZENA DATA");
-			display.display();
+/**
+ * @brief Write the rest of the buffered page of the flash log from time to time.
+ */
+void flushHistory()
+{
+	if (millis() - lastLogFlush < LOG_FLUSH_TIME * 1000UL)
+	{
+		return;
+	}
+	lastLogFlush = millis();
+	flashLog.flush();
+}
 
-			return;
+/**
+ * @brief Task that uploads the pending batches. Unsent batches stay in RAM and are retried after a reconnect.
+ * @param parameter unused
+ */
+void influxTask(void *parameter)
+{
+	while (true)
+	{
+		if (WiFi.status() == WL_CONNECTED && influxUploader.getPendingCount() > 0)
+		{
+			esp_wifi_set_ps(WIFI_PS_NONE);
+			powerManager.acquire();
+			TRACE_BEGIN(TRACE_INFLUX_UPLOAD);
+			influxUploader.upload();
+			TRACE_END(TRACE_INFLUX_UPLOAD);
+			powerManager.release();
+			esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
 		}
+		vTaskDelay(pdMS_TO_TICKS(5000));
 	}
+}
+
+// Prometheus metrics, formatted incrementally and served from a cached buffer
+WebServer webServer(HTTP_SERVER_PORT);
+BmsMetrics bmsMetrics;
+uint32_t renderCount = 0;
+
+/**
+ * @brief Serve the metrics, a scrape only copies the cached buffer.
+ */
+void handleMetricsRequest()
+{
+	PowerBoost boost(powerManager);
+	bmsMetrics.setCounter(BMS_COUNTER_SSE_CLIENTS, sseServer.getClientCount());
+	bmsMetrics.setCounter(BMS_COUNTER_MODBUS_REQUESTS, modbusServer.getRequestCount());
+	bmsMetrics.setCounter(BMS_COUNTER_CAN_FRAMES_SENT, canScheduler.getSentCount());
+	bmsMetrics.setAlarmLatency(alarmLatency);
+	bmsMetrics.setReaderStats(smartBmsReader.getStats());
+	bmsMetrics.setCounter(BMS_COUNTER_FRAMES_DROPPED, droppedFrameEvents.load(std::memory_order_relaxed));
+	bmsMetrics.setHistoryStore(historyStore);
+	bmsMetrics.setRefreshScheduler(refreshScheduler);
+	webServer.send_P(200, "text/plain; version=0.0.4", bmsMetrics.getBuffer(), bmsMetrics.getLength());
+}
+
+#ifdef SBMS_PROFILING
+// Time the panel signaled busy during the latest update
+uint32_t displayBusyTicks = 0;
+uint32_t lastBusyTicks = 0;
+
+/**
+ * @brief Called by GxEPD2 roughly every ms while it waits for the busy pin.
+ * Consecutive calls belong to the same refresh, longer gaps are SPI transfers between two waits.
+ * @param parameter unused
+ */
+void onDisplayBusy(const void *parameter)
+{
+	const uint32_t now = Profiler::now();
+	if (now - lastBusyTicks < 5000 * Profiler::getTicksPerUs())
+	{
+		displayBusyTicks += now - lastBusyTicks;
+	}
+	lastBusyTicks = now;
+	delay(1);
+}
+#endif
+
+/**
+ * @brief Transfer the buffer to the display and refresh it.
+ * With profiling, the time is split into the SPI transfer and the refresh of the panel.
+ * @param partial true for a partial refresh
+ */
+void updateDisplay(const bool partial)
+{
+	TRACE_BEGIN(TRACE_DISPLAY_UPDATE);
+#ifdef SBMS_PROFILING
+	displayBusyTicks = 0;
+	lastBusyTicks = Profiler::now();
+	const uint32_t start = lastBusyTicks;
+	display.display(partial);
+	const uint32_t total = Profiler::now() - start;
+	Profiler::record(PROFILE_STAGE_SPI_TRANSFER, total - displayBusyTicks);
+	Profiler::record(PROFILE_STAGE_REFRESH, displayBusyTicks);
+#else
+	display.display(partial);
+#endif
+	TRACE_END(TRACE_DISPLAY_UPDATE);
+	refreshScheduler.onRefresh(partial ? DISPLAY_REFRESH_PARTIAL : DISPLAY_REFRESH_FULL, millis());
+}
+
+/**
+ * @brief Replace the whole screen with a single message.
+ * @param x horizontal position of the text
+ * @param text message
+ */
+void showMessage(const int16_t x, const char *text)
+{
+	trendVisible = false;
+	messageShown = true;
+	displayImageCrc = 0;
+	refreshScheduler.invalidate();
+	display.setFullWindow();
+	display.fillScreen(GxEPD_WHITE);
+	display.setCursor(x, 93); // Adjust cursor position as needed
+	display.setTextColor(GxEPD_BLACK);
+	display.setFont(&SourceSans3_Bold18pt7b);
+
+	display.print(text);
+	updateDisplay(false);
+}
+
+/**
+ * @brief Calculate the checksum of the image of a page.
+ * @param canvas canvas of the page
+ * @return checksum of the image
+ */
+const uint32_t getImageCrc(const GFXcanvas1 &canvas)
+{
+	return Crc32::calculate(canvas.getBuffer(), (canvas.width() + 7) / 8 * canvas.height());
+}
+
+/**
+ * @brief Draw the changed columns of the trend with a partial refresh.
+ * The partial window reuses the buffer, so the next full update draws the whole screen again.
+ * The trend is also drawn into the cache of the overview page.
+ */
+void refreshTrend()
+{
+	if (!trendVisible || !trendWidget.isDirty() || millis() - lastTrendRefresh < TREND_REFRESH_TIME * 1000UL)
+	{
+		return;
+	}
+	lastTrendRefresh = millis();
+
+	TRACE_BEGIN(TRACE_DISPLAY_UPDATE);
+	display.setPartialWindow(trendWidget.getDirtyX(), trendWidget.getY(), trendWidget.getDirtyWidth(), trendWidget.getHeight());
+	display.firstPage();
+	do
+	{
+		trendWidget.draw(display, GxEPD_BLACK, GxEPD_WHITE);
+	} while (display.nextPage());
+	TRACE_END(TRACE_DISPLAY_UPDATE);
+
+	// The trend only uses a small part of the ghosting budget, rounded up to whole percent of the screen
+	const uint32_t screenArea = display.width() * display.height();
+	refreshScheduler.onRefresh(DISPLAY_REFRESH_PARTIAL, millis(), (trendWidget.getDirtyWidth() * trendWidget.getHeight() * 100 + screenArea - 1) / screenArea);
+	trendWidget.draw(overviewCanvas, GxEPD_BLACK, GxEPD_WHITE);
+	trendWidget.clearDirty();
+	displayImageCrc = getImageCrc(overviewCanvas);
+}
+
+/**
+ * @brief Draw the overview with the pack values, the status and the trend.
+ * @param gfx display or canvas
+ * @param smartBmsData latest data of the BMS
+ */
+void drawOverviewPage(Adafruit_GFX &gfx, const SmartBmsData &smartBmsData)
+{
+	// Display battery information
+	gfx.drawBitmap(15, 15, icon_charge, 24, 24, GxEPD_BLACK);
+	gfx.drawBitmap(15, 50, icon_up, 24, 24, GxEPD_BLACK);
+	gfx.drawBitmap(15, 85, icon_hot, 24, 24, GxEPD_BLACK);
+	gfx.drawBitmap(160, 15, icon_discharge, 24, 24, GxEPD_BLACK);
+	gfx.drawBitmap(160, 50, icon_down, 24, 24, GxEPD_BLACK);
+	gfx.drawBitmap(160, 85, icon_cold, 24, 24, GxEPD_BLACK);
+
+	// Battery icon dependenat on SoC and charging current
+	if (smartBmsData.getPackSoc() < 10)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_0_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_0, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 20)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_10_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_10, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 30)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_20_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_20, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 40)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_30_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_30, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 50)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_40_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_40, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 60)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_50_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_50, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 70)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_60_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_60, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 80)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_70_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_70, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 90)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 0)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_80_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_80, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else if (smartBmsData.getPackSoc() < 100)
+	{
+		if (smartBmsData.getPackChargeCurrent() > 5)
+		{
+			gfx.drawBitmap(320, 15, icon_battery_90_charging, 45, 75, GxEPD_BLACK);
+		}
+		else
+		{
+			gfx.drawBitmap(320, 15, icon_battery_90, 45, 75, GxEPD_BLACK);
+		}
+	}
+	else
+	{ // If SOC is already at 100%
+		gfx.drawBitmap(320, 15, icon_battery_100, 45, 75, GxEPD_BLACK);
+	}
+
+	gfx.setFont(&SourceSans3_Bold9pt7b);
+
+	gfx.setCursor(49, 33); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getPackChargeCurrent() + "A");
+
+	gfx.setCursor(49, 67); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getHighestCellVoltage() + "V @ " + smartBmsData.getHighestCellVoltageNumber());
+
+	gfx.setCursor(49, 102); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getHighestCellTemperature() + "C @ " + smartBmsData.getHighestCellTemperatureNumber());
+
+	gfx.setCursor(194, 33); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getPackDischargeCurrent() + "A");
+
+	gfx.setCursor(194, 67); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getLowestCellVoltage() + "V @ " + smartBmsData.getLowestCellVoltageNumber());
+
+	gfx.setCursor(194, 102); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getLowestCellTemperature() + "C @ " + smartBmsData.getLowestCellTemperatureNumber());
+
+	gfx.setCursor(317, 140); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getPackVoltage() + "V");
+
+	gfx.setFont(&SourceSans3_Bold12pt7b);
+
+	gfx.setCursor(320, 115); // Adjust cursor position as needed
+	gfx.println((String)smartBmsData.getPackSoc() + "%");
+
+	gfx.setFont(&SourceSans3_Bold9pt7b);
+
+	gfx.setCursor(15, 135); // Adjust cursor position as needed
+
+	// If communication error print it else show relevant data
+	if (smartBmsData.hasCommunicationError())
+	{
+		gfx.println("CHYBA KOMUNIKACE");
+	}
+	else if (!smartBmsData.isAllowedToCharge() && (!smartBmsData.isAllowedToDischarge()))
+	{
+		gfx.println("Vybijeni ZAKAZANO - chyba");
+		gfx.setCursor(15, 155); // Adjust cursor position as needed
+		gfx.println("Nabijeni ZAKAZANO - chyba");
+	}
+	else if (!smartBmsData.isAllowedToCharge())
+	{
+		gfx.println("Nabijeni ZAKAZANO - chyba");
+	}
+	else if (!smartBmsData.isAllowedToDischarge())
+	{
+		gfx.println("Vybijeni ZAKAZANO - chyba");
+	}
+	else if (linkMonitor.getState() == SBMS_LINK_DEGRADED)
+	{
+		gfx.println("NESTABILNI SPOJENI S BMS");
+	}
+	else
+	{
+		// Peak discharge current and lowest cell voltage of the rolling windows
+		const RollingWindow *peakWindow = rollingStats.findWindow(SBMS_FIELD_PACK_DISCHARGE_CURRENT, ROLLING_PEAK_WINDOW * 60000);
+		const RollingWindow *cellWindow = rollingStats.findWindow(SBMS_FIELD_LOWEST_CELL_VOLTAGE, ROLLING_CELL_WINDOW * 60000);
+		if (peakWindow != nullptr && cellWindow != nullptr)
+		{
+			gfx.setFont(&SourceSans3_Regular9pt7b);
+			gfx.println((String) "Max " + ROLLING_PEAK_WINDOW + "min: " + peakWindow->getMax() + "A | Min " + ROLLING_CELL_WINDOW + "min: " + cellWindow->getMin() + "V");
+			gfx.setFont(&SourceSans3_Bold9pt7b);
+		}
+
+		// Estimated time to full or empty, uncertain estimates are marked
+		const float remainingTime = runtimeEstimator.getState() == SBMS_RUNTIME_CHARGING ? runtimeEstimator.getTimeToFull() : runtimeEstimator.getTimeToEmpty();
+		if (remainingTime > 0)
+		{
+			int hours = (int)remainingTime;
+			int minutes = (int)((remainingTime - hours) * 60);
+			gfx.setCursor(15, 155); // Adjust cursor position as needed
+			gfx.println((String)(runtimeEstimator.getState() == SBMS_RUNTIME_CHARGING ? "Cas do nabiti: ~" : "Cas do vybiti: ~") + hours + "h " + minutes + "min" +
+							(runtimeEstimator.getConfidence() < RUNTIME_MIN_CONFIDENCE ? " (?)" : ""));
+		}
+	}
+
+	// Trend of the last hours
+	trendWidget.draw(gfx, GxEPD_BLACK, GxEPD_WHITE);
+}
+
+/**
+ * @brief Draw the voltages of all cells as a bar chart.
+ * @param gfx canvas of the page
+ * @param smartBmsData latest data of the BMS
+ */
+void drawCellsPage(GFXcanvas1 &gfx, const SmartBmsData &smartBmsData)
+{
+	gfx.setFont(&SourceSans3_Bold9pt7b);
+	gfx.setCursor(8, 18);
+	gfx.print((String) "Min " + smartBmsData.getLowestCellVoltage() + "V #" + smartBmsData.getLowestCellVoltageNumber() +
+			  "  Max " + smartBmsData.getHighestCellVoltage() + "V #" + smartBmsData.getHighestCellVoltageNumber() +
+			  "  Rozdil " + (int)((smartBmsData.getHighestCellVoltage() - smartBmsData.getLowestCellVoltage()) * 1000 + 0.5f) + "mV");
+	cellBarChart.draw(gfx, smartBmsCellTable, smartBmsData, GxEPD_BLACK, GxEPD_WHITE);
+}
+
+/**
+ * @brief Draw a page into its cache.
+ * @param page page to draw
+ * @param smartBmsData latest data of the BMS
+ */
+void renderPage(const uint8_t page, const SmartBmsData &smartBmsData)
+{
+	PowerBoost boost(powerManager);
+	GFXcanvas1 &canvas = *pageCanvases[page];
+	canvas.fillScreen(GxEPD_WHITE);
+	canvas.setTextColor(GxEPD_BLACK);
+	if (page == DISPLAY_PAGE_CELLS)
+	{
+		drawCellsPage(canvas, smartBmsData);
+	}
+	else
+	{
+		drawOverviewPage(canvas, smartBmsData);
+	}
+	pageValid[page] = true;
+}
+
+/**
+ * @brief Copy the cache of a page to the display and refresh it.
+ * A partial refresh is skipped if the panel already shows the same image.
+ * @param page page to show, it must have been drawn before
+ * @param partial true for a partial refresh
+ */
+void showPage(const uint8_t page, const bool partial)
+{
+	const GFXcanvas1 &canvas = *pageCanvases[page];
+	const uint32_t crc = getImageCrc(canvas);
+	if (!partial || crc != displayImageCrc)
+	{
+		display.setFullWindow();
+		display.drawBitmap(0, 0, canvas.getBuffer(), canvas.width(), canvas.height(), GxEPD_WHITE, GxEPD_BLACK);
+		updateDisplay(partial);
+		displayImageCrc = crc;
+	}
+	messageShown = false;
+	trendVisible = page == DISPLAY_PAGE_OVERVIEW;
+	trendWidget.clearDirty();
+	lastTrendRefresh = millis();
+}
+
+/**
+ * @brief Switch to the next page with the button or the timer.
+ * A page is taken from its cache if no new data arrived since it was drawn.
+ * The panel still shows a complete image, so a partial refresh is enough.
+ */
+void handlePageSwitch()
+{
+	static unsigned long lastPageSwitch = 0;
+	bool next = false;
+#if PAGE_BUTTON_PIN != PAGE_BUTTON_DISABLED
+	static bool buttonPressed = false;
+	static unsigned long lastButtonChange = 0;
+	const bool pressed = digitalRead(PAGE_BUTTON_PIN) == LOW;
+	if (pressed != buttonPressed && millis() - lastButtonChange >= PAGE_BUTTON_DEBOUNCE)
+	{
+		buttonPressed = pressed;
+		lastButtonChange = millis();
+		next = pressed;
+	}
+#endif
+#if PAGE_SWITCH_TIME > 0
+	next = next || millis() - lastPageSwitch >= PAGE_SWITCH_TIME * 1000UL;
+#endif
+	if (!next || messageShown || !hasDisplayedBmsData)
+	{
+		return;
+	}
+
+	lastPageSwitch = millis();
+	currentPage = (currentPage + 1) % DISPLAY_PAGE_COUNT;
+	if (!pageValid[currentPage])
+	{
+		renderPage(currentPage, displayedBmsData);
+	}
+	showPage(currentPage, true);
+}
+
+/**
+ * @brief Show a change of the link state on the display and push it to the browsers.
+ * Called by the loop, the relays were already switched by the link monitor.
+ */
+void publishLinkState()
+{
+	static SmartBmsLinkState publishedState = SBMS_LINK_LOST;
+	const SmartBmsLinkState state = linkMonitor.getState();
+	if (state == publishedState)
+	{
+		return;
+	}
+	publishedState = state;
+
+	char event[32];
+	const int length = snprintf(event, sizeof(event), "{\"state\":\"%s\"}", SmartBmsLinkMonitor::getStateName(state));
+	sseServer.publish("link", event, length, false);
+	bmsMetrics.setCounter(BMS_COUNTER_LINK_STATE, state);
+	bmsMetrics.setCounter(BMS_COUNTER_LINK_TRANSITIONS, linkMonitor.getTransitionCount());
+
+	if (state >= SBMS_LINK_STALE)
+	{
+		showMessage(82, "ZADNA DATA");
+	}
+	else
+	{
+		// Redraw the values with the next frame
+		refreshScheduler.invalidate();
+	}
+}
+
+/**
+ * @brief Serve the active rule set.
+ */
+void handleGetRules()
+{
+	webServer.send(200, "text/plain", rulePreferences.getString("text", RULE_DEFAULT_TEXT));
+}
+
+/**
+ * @brief Replace the rule set with the request body. It is only stored when it compiles.
+ */
+void handlePostRules()
+{
+	PowerBoost boost(powerManager);
+	const String text = webServer.arg("plain");
+	const RuleError error = loadRules(text.c_str());
+	if (error != RuleError::RULE_OK)
+	{
+		webServer.send(400, "text/plain", (String) "line " + ruleCompiler.getErrorLine() + ": " + RuleEngine::getErrorMessage(error) + "\n");
+		return;
+	}
+
+	rulePreferences.putString("text", text);
+	webServer.send(200, "text/plain", (String) ruleEngine.getRuleCount() + " rules active\n");
+}
+
+// Points of a history response are collected and sent in chunks
+struct HistoryResponse
+{
+	char buffer[1024];
+	size_t length;
+	uint16_t count;
+};
+
+/**
+ * @brief Add a point to the history response and send the buffer when it is full.
+ * @param point point of the query
+ * @param context history response
+ */
+void writeHistoryPoint(const HistoryPoint &point, void *context)
+{
+	HistoryResponse *response = static_cast<HistoryResponse *>(context);
+	if (response->length + 48 > sizeof(response->buffer))
+	{
+		webServer.sendContent(response->buffer, response->length);
+		response->length = 0;
+	}
+	response->length += snprintf(&response->buffer[response->length], sizeof(response->buffer) - response->length, "%s[%lld,%.4g]",
+								 response->count > 0 ? "," : "", static_cast<long long>(point.timeMs), point.value);
+	response->count++;
+}
+
+/**
+ * @brief Serve a downsampled range of a history channel as JSON.
+ */
+void handleHistoryRequest()
+{
+	PowerBoost boost(powerManager);
+	const HistoryChannel channel = HistorySample::findChannel(webServer.arg("channel").c_str());
+	const int64_t now = getUnixTimeMs();
+	const int64_t to = webServer.hasArg("to") ? atoll(webServer.arg("to").c_str()) : now;
+	const int64_t from = webServer.hasArg("from") ? atoll(webServer.arg("from").c_str()) : to - HISTORY_API_RANGE * 3600000LL;
+	const uint16_t points = webServer.hasArg("points") ? webServer.arg("points").toInt() : HISTORY_API_POINTS;
+	if (!historyQuery.begin(channel, from, to, points))
+	{
+		webServer.send(400, "text/plain", "unknown channel or invalid range\n");
+		return;
+	}
+
+	static HistoryResponse response;
+	response.length = snprintf(response.buffer, sizeof(response.buffer), "{\"channel\":\"%s\",\"source\":\"%s\",\"points\":[",
+							   HistorySample::getChannelName(channel), HistoryQuery::getSourceName(historyQuery.getSource()));
+	response.count = 0;
+	webServer.setContentLength(CONTENT_LENGTH_UNKNOWN);
+	webServer.send(200, "application/json", "");
+	historyQuery.run(writeHistoryPoint, &response);
+	response.length += snprintf(&response.buffer[response.length], sizeof(response.buffer) - response.length, "]}\n");
+	webServer.sendContent(response.buffer, response.length);
+	webServer.sendContent("");
+}
+
+// Commands from the serial monitor
+char serialCommand[32];
+size_t serialCommandLength = 0;
+MemoryReport memoryReport;
+
+/**
+ * @brief Register the tasks and the large static objects for the memory report.
+ */
+void beginMemoryReport()
+{
+	memoryReport.addTask("loopTask");
+	memoryReport.addTask("bmsReader");
+	memoryReport.addTask("modbus");
+	memoryReport.addTask("influx");
+	memoryReport.addTask("esp_timer");
+	memoryReport.addTask("tiT");
+	memoryReport.addObject("display", sizeof(display));
+	memoryReport.addObject("reader", sizeof(smartBmsReader));
+	memoryReport.addObject("cellTable", sizeof(smartBmsCellTable));
+	memoryReport.addObject("rolling", sizeof(rollingStats));
+	memoryReport.addObject("rules", sizeof(ruleEngine) + sizeof(ruleCompiler));
+	memoryReport.addObject("modbus", sizeof(modbusServer));
+	memoryReport.addObject("sse", sizeof(sseServer) + sizeof(sseEventBuffer));
+	memoryReport.addObject("influx", sizeof(influxUploader));
+	memoryReport.addObject("metrics", sizeof(bmsMetrics));
+	memoryReport.addObject("query", sizeof(historyQuery));
+	memoryReport.addObject("trend", sizeof(trendWidget));
+	memoryReport.addObject("refresh", sizeof(refreshScheduler));
+	memoryReport.addObject("pages", sizeof(cellBarChart) + DISPLAY_PAGE_COUNT * (sizeof(GFXcanvas1) + GxEPD2_290_GDEY029T71H::HEIGHT * GxEPD2_290_GDEY029T71H::WIDTH / 8));
+#ifdef SBMS_TRACING
+	memoryReport.addObject("trace", Trace::getBufferSize());
+#endif
+}
+
+/**
+ * @brief Execute a single command from the serial monitor.
+ * @param command zero terminated command
+ */
+void runSerialCommand(const char *command)
+{
+	if (strcmp(command, "prof") == 0 || strcmp(command, "prof reset") == 0)
+	{
+#ifdef SBMS_PROFILING
+		static char table[1024];
+		Profiler::format(table, sizeof(table));
+		Serial.print(table);
+		if (strcmp(command, "prof reset") == 0)
+		{
+			Profiler::reset();
+		}
+#else
+		Serial.println("Profiling is disabled, build with -DSBMS_PROFILING.");
+#endif
+	}
+	else if (strcmp(command, "mem") == 0)
+	{
+		static char report[1024];
+		memoryReport.format(report, sizeof(report));
+		Serial.print(report);
+	}
+	else if (strcmp(command, "energy") == 0)
+	{
+		Serial.printf("Energy: charged=%.3fkWh/%.2fAh discharged=%.3fkWh/%.2fAh gaps=%lu\n", energyMeter.getChargedKwh(), energyMeter.getChargedAh(),
+					  energyMeter.getDischargedKwh(), energyMeter.getDischargedAh(), static_cast<unsigned long>(energyMeter.getGapCount()));
+	}
+	else if (strcmp(command, "hist") == 0)
+	{
+		Serial.printf("History: %lu samples, %u of %u bytes in %s, %.2f bytes per sample, %.1f h\n", static_cast<unsigned long>(historyStore.getSampleCount()),
+					  historyStore.getUsedBytes(), historyStore.getCapacity(), historyStore.isInPsram() ? "PSRAM" : "RAM", historyStore.getBytesPerSample(),
+					  (historyStore.getNewestTime() - historyStore.getOldestTime()) / 3600000.0);
+		for (uint8_t i = 0; i < HISTORY_ARCHIVE_LEVEL_COUNT; i++)
+		{
+			const HistoryArchiveLevel level = static_cast<HistoryArchiveLevel>(i);
+			const int64_t firstSlot = historyArchive.getFirstSlot(level);
+			Serial.printf("Archive %lus: %ld of %lu rows\n", static_cast<unsigned long>(HistoryArchive::getInterval(level)),
+						  firstSlot >= 0 ? static_cast<long>(historyArchive.getLastSlot(level) - firstSlot + 1) : 0L,
+						  static_cast<unsigned long>(HistoryArchive::getRowCount(level)));
+		}
+		Serial.printf("Archive: %lu dropped samples, %lu clamped values\n", static_cast<unsigned long>(historyArchive.getDroppedSampleCount()),
+					  static_cast<unsigned long>(historyArchive.getClampedValueCount()));
+		Serial.printf("Flash log: %u bytes in %lu of %lu segments, %u pending, sequence %lu, %lu erases, %lu torn records, %lu write errors\n", flashLog.getUsedBytes(),
+					  static_cast<unsigned long>(flashLog.getUsedSegmentCount()), static_cast<unsigned long>(flashLog.getSegmentCount()), flashLog.getPendingBytes(),
+					  static_cast<unsigned long>(flashLog.getSequence()), static_cast<unsigned long>(flashLog.getEraseCount()),
+					  static_cast<unsigned long>(flashLog.getRecoveredTornRecords()), static_cast<unsigned long>(flashLog.getWriteErrorCount()));
+		Serial.printf("Archive logs: %u bytes of quarters, %u bytes of days, %lu write errors\n", quarterLog.getUsedBytes(), dayLog.getUsedBytes(),
+					  static_cast<unsigned long>(quarterLog.getWriteErrorCount() + dayLog.getWriteErrorCount()));
+	}
+	else if (strcmp(command, "power") == 0 || strcmp(command, "power reset") == 0)
+	{
+		static char report[512];
+		powerManager.format(report, sizeof(report));
+		Serial.print(report);
+		if (strcmp(command, "power reset") == 0)
+		{
+			powerManager.resetStats();
+		}
+	}
+	else if (strcmp(command, "reader") == 0)
+	{
+		const SmartBmsReaderStats readerStats = smartBmsReader.getStats();
+		Serial.printf("Reader: ok=%lu checksum=%lu short=%lu resyncs=%lu discarded=%lu overruns=%lu interval=%lu/%lu/%lums gaps=%lu %.1fB/s\n",
+					  static_cast<unsigned long>(readerStats.framesOk), static_cast<unsigned long>(readerStats.checksumErrors),
+					  static_cast<unsigned long>(readerStats.shortReads), static_cast<unsigned long>(readerStats.resyncs),
+					  static_cast<unsigned long>(readerStats.bytesDiscarded), static_cast<unsigned long>(readerStats.overruns),
+					  static_cast<unsigned long>(readerStats.intervalMinMs), static_cast<unsigned long>(readerStats.intervalAvgMs),
+					  static_cast<unsigned long>(readerStats.intervalMaxMs), static_cast<unsigned long>(readerStats.gaps), readerStats.bytesPerSecond);
+	}
+	else if (strcmp(command, "trace") == 0 || strcmp(command, "trace clear") == 0)
+	{
+#ifdef SBMS_TRACING
+		if (strcmp(command, "trace clear") == 0)
+		{
+			Trace::clear();
+			return;
+		}
+		Trace::dump([](const char *line)
+					{ Serial.println(line); });
+#else
+		Serial.println("Tracing is disabled, build with -DSBMS_TRACING.");
+#endif
+	}
+	else
+	{
+		Serial.println("Commands: energy, hist, mem, power, power reset, prof, prof reset, reader, trace, trace clear");
+	}
+}
+
+/**
+ * @brief Collect the characters from the serial monitor and run complete lines.
+ */
+void handleSerialCommands()
+{
+	while (Serial.available() > 0)
+	{
+		const char c = Serial.read();
+		if (c == '\r' || c == '\n')
+		{
+			if (serialCommandLength > 0)
+			{
+				serialCommand[serialCommandLength] = '\0';
+				runSerialCommand(serialCommand);
+			}
+			serialCommandLength = 0;
+		}
+		else if (serialCommandLength < sizeof(serialCommand) - 1)
+		{
+			serialCommand[serialCommandLength++] = c;
+		}
+	}
+}
+
+// Counters, times and the last frame of the deep sleep mode
+RTC_DATA_ATTR DeepSleepState deepSleepState;
+
+/**
+ * @brief Run one cycle of the deep sleep mode, it never returns.
+ * A single frame is read and the display is only updated if the values changed, then the ESP32 sleeps again.
+ * The display stays powered and keeps its image in deep sleep, so a partial refresh is enough.
+ */
+void runSleepCycle()
+{
+	// The time since the start of the firmware is added to cover the boot
+	const esp_sleep_wakeup_cause_t cause = esp_sleep_get_wakeup_cause();
+	const DeepSleepWake wake = cause == ESP_SLEEP_WAKEUP_TIMER ? DEEP_SLEEP_WAKE_TIMER : cause == ESP_SLEEP_WAKEUP_EXT0 ? DEEP_SLEEP_WAKE_UART : DEEP_SLEEP_WAKE_RESET;
+	DeepSleepCycle sleepCycle(deepSleepState, {SLEEP_GHOSTING_BUDGET, SLEEP_AWAKE_CURRENT, SLEEP_REFRESH_CURRENT, SLEEP_CURRENT});
+	sleepCycle.begin(wake, getSystemTimeUs() - esp_timer_get_time());
+	if (sleepCycle.hasLastCycle())
+	{
+		const DeepSleepState &state = sleepCycle.getState();
+		Serial.println((String) "Last cycle: awake " + state.lastAwakeUs / 1000 + " ms, refresh " + state.lastRefreshUs / 1000 + " ms, sleep " + state.lastSleepUs / 1000 +
+					   " ms, " + String(sleepCycle.getLastCycleCurrent(), 3) + " mA, average " + String(sleepCycle.getAverageCurrent(), 3) + " mA");
+	}
+	Serial.println((String) "Cycle " + deepSleepState.cycles + ", wake up by " + DeepSleepCycle::getWakeName(wake) + ", " + deepSleepState.missedFrames + " missed frames");
+
+	// Wait for one valid frame, the first bytes after the wake up are usually a partial frame
+	SmartBmsData smartBmsData;
+	SmartBmsError error = SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA;
+	const unsigned long readStart = millis();
+	while (error != SmartBmsError::SBMS_OK && millis() - readStart < SLEEP_FRAME_TIMEOUT)
+	{
+		error = smartBmsReader.decodeBmsData(&smartBmsData);
+		if (error == SmartBmsError::SBMS_ERR_NOT_ENOUGH_DATA)
+		{
+			delay(1);
+		}
+	}
+	const DisplayRefresh refresh = error == SmartBmsError::SBMS_OK ? sleepCycle.onFrame(smartBmsReader.getFrame(), smartBmsData) : sleepCycle.onMissedFrame();
+
+	if (refresh != DISPLAY_REFRESH_NONE)
+	{
+		// The power pin is configured before the hold is released, so the display never loses its power
+		pinMode(DISPLAY_POWER_PIN, OUTPUT);
+		digitalWrite(DISPLAY_POWER_PIN, HIGH);
+		gpio_hold_dis(static_cast<gpio_num_t>(DISPLAY_POWER_PIN));
+		if (wake == DEEP_SLEEP_WAKE_RESET)
+		{
+			delay(100);
+		}
+
+		// Without an initial refresh the controller keeps the old image as the base of the partial refresh
+		display.init(115200, refresh == DISPLAY_REFRESH_FULL);
+		display.setRotation(1);
+		const unsigned long refreshStart = micros();
+		if (error == SmartBmsError::SBMS_OK)
+		{
+			linkMonitor.onFrame(error, millis());
+			linkMonitor.check(millis());
+			rollingStats.update(smartBmsData, millis());
+			display.setFullWindow();
+			display.fillScreen(GxEPD_WHITE);
+			display.setTextColor(GxEPD_BLACK);
+			drawOverviewPage(display, smartBmsData);
+			updateDisplay(refresh == DISPLAY_REFRESH_PARTIAL);
+		}
+		else
+		{
+			showMessage(82, "ZADNA DATA");
+		}
+		sleepCycle.onRefresh(error == SmartBmsError::SBMS_OK ? refresh : DISPLAY_REFRESH_FULL, micros() - refreshStart);
+		display.hibernate();
+	}
+
+	// Keep the display powered in deep sleep
+	gpio_hold_en(static_cast<gpio_num_t>(DISPLAY_POWER_PIN));
+	gpio_deep_sleep_hold_en();
+	esp_sleep_enable_timer_wakeup(SLEEP_TIME * 1000000ULL);
+#if SLEEP_WAKE_ON_UART
+	esp_sleep_enable_ext0_wakeup(static_cast<gpio_num_t>(BMS_SERIAL_RX_PIN), BMS_SERIAL_INVERT ? 1 : 0);
+#endif
+	Serial.flush();
+	sleepCycle.sleep(getSystemTimeUs());
+	esp_deep_sleep_start();
+}
+
+/**
+ * @brief Setup.
+ */
+void setup()
+{
+	// Initialize the serial connections
+	Serial.begin(PC_SERIAL_BAUD);																				// Begin pc serial monitor
+	smartBmsSerial.begin(BMS_SERIAL_BAUD_RATE, BMS_SERIAL_MODE, BMS_SERIAL_RX_PIN, -1, BMS_SERIAL_INVERT);		// Begin BMS serial
+#if SLEEP_MODE
+	runSleepCycle();
+#endif
+
+	// Wait for the frames at the minimum frequency
+	if (!powerManager.begin({POWER_MAX_FREQUENCY, POWER_MIN_FREQUENCY, POWER_LIGHT_SLEEP}))
+	{
+		Serial.println("Power management is not available, the frequency is switched directly.");
+	}
+#if POWER_LIGHT_SLEEP
+	uart_set_wakeup_threshold(static_cast<uart_port_t>(BMS_SERIAL_PERIPHERAL), 3);
+	esp_sleep_enable_uart_wakeup(BMS_SERIAL_PERIPHERAL);
+#endif
+
+	// Power the display first, it starts up while everything else is started
+	// The pin is held, so the display keeps its image over a software reset
+	pinMode(DISPLAY_POWER_PIN, OUTPUT);
+	digitalWrite(DISPLAY_POWER_PIN, HIGH);
+	gpio_hold_en(static_cast<gpio_num_t>(DISPLAY_POWER_PIN));
+	const unsigned long displayPowerOn = millis();
+
+	// Start the reader task with the relays in the safe state and the stored rules
+	alarmOutputs.begin();
+	for (uint8_t i = 0; i < ruleOutputCount; i++)
+	{
+		pinMode(ruleOutputPins[i], OUTPUT);
+		digitalWrite(ruleOutputPins[i], RULE_OUTPUT_ACTIVE_HIGH ? LOW : HIGH);
+	}
+	rulePreferences.begin("rules", false);
+	if (loadRules(rulePreferences.getString("text", RULE_DEFAULT_TEXT).c_str()) != RuleError::RULE_OK)
+	{
+		Serial.println("Error: The stored rules are invalid.");
+	}
+	restoreEnergyMeter();
+	bmsFrameQueue = xQueueCreate(BMS_FRAME_QUEUE_LENGTH, sizeof(BmsFrameEvent));
+	xTaskCreatePinnedToCore(bmsReaderTask, "bmsReader", 4096, nullptr, configMAX_PRIORITIES - 2, &bmsReaderTaskHandle, 1);
+	smartBmsSerial.setRxTimeout(1);
+	smartBmsSerial.setRxFIFOFull(BMS_SERIAL_FIFO_FULL);
+	smartBmsSerial.onReceive(onBmsSerialReceive, false);
+	smartBmsSerial.onReceiveError(onBmsSerialError);
+
+	// Watch the link
+	linkMonitor.setListener(onLinkStateChange);
+	esp_timer_create_args_t linkTimerArgs = {};
+	linkTimerArgs.callback = linkTimerCallback;
+	linkTimerArgs.dispatch_method = ESP_TIMER_TASK;
+	linkTimerArgs.name = "link";
+	if (esp_timer_create(&linkTimerArgs, &linkTimer) == ESP_OK)
+	{
+		esp_timer_start_periodic(linkTimer, LINK_CHECK_TIME * 1000);
+	}
+
+	// Connect to the WiFi in the background and start the live stream
+	WiFi.mode(WIFI_STA);
+	WiFi.setAutoReconnect(true);
+	WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+	webServer.on("/metrics", HTTP_GET, handleMetricsRequest);
+	webServer.on("/rules", HTTP_GET, handleGetRules);
+	webServer.on("/rules", HTTP_POST, handlePostRules);
+	webServer.on("/api/history", HTTP_GET, handleHistoryRequest);
+	webServer.begin();
+	sseServer.begin();
+	if (modbusServer.begin())
+	{
+		xTaskCreatePinnedToCore(modbusTask, "modbus", 4096, nullptr, 1, nullptr, 0);
+	}
+
+	// Synchronize the clock for the history and let the modem sleep between the uploads
+	configTime(0, 0, NTP_SERVER);
+	if (!historyArchive.begin())
+	{
+		Serial.println("Error: Failed to allocate the memory of the history archives.");
+	}
+	if (!historyStore.begin(HISTORY_PSRAM_SIZE, HISTORY_RAM_SIZE))
+	{
+		Serial.println("Error: Failed to allocate the memory of the history.");
+	}
+	else
+	{
+		restoreHistory();
+	}
+	esp_wifi_set_ps(WIFI_PS_MAX_MODEM);
+	xTaskCreatePinnedToCore(influxTask, "influx", 6144, nullptr, 1, nullptr, 0);
+
+	// Start feeding the inverter
+	beginCanOutput();
+	beginMemoryReport();
+
+	// After a software reset the controller of the display still holds the last page, so the panel is not cleared
+	const esp_reset_reason_t resetReason = esp_reset_reason();
+	const bool panelValid = displayImageMagic == DISPLAY_IMAGE_MAGIC && displayImageCrc != 0 && resetReason != ESP_RST_POWERON && resetReason != ESP_RST_BROWNOUT;
+	displayImageMagic = DISPLAY_IMAGE_MAGIC;
+	if (!panelValid)
+	{
+		displayImageCrc = 0;
+		while (millis() - displayPowerOn < DISPLAY_POWER_DELAY)
+		{
+			delay(1);
+		}
+	}
+
+	// Activate the display
+	display.init(115200, !panelValid);																			// Initialize the display with the specified baud rate
+	display.setRotation(1);				 																		// Rotate the display 90 degrees clockwise
+	refreshScheduler.invalidate(!panelValid);
+	cellBarChart.begin(8, 28, 368, 136);
+#if PAGE_BUTTON_PIN != PAGE_BUTTON_DISABLED
+	pinMode(PAGE_BUTTON_PIN, INPUT_PULLUP);
+#endif
+	trendWidget.begin(TREND_X, TREND_Y, TREND_WIDTH, TREND_HEIGHT, TREND_CHANNEL, TREND_HOURS * 3600000UL, TREND_SCALE_MIN, TREND_SCALE_MAX);
+#ifdef SBMS_PROFILING
+	display.epd2.setBusyCallback(onDisplayBusy);																// Split the update time into transfer and refresh
+#endif
+}
+
+// Time of the latest dump of the BMS data to the serial monitor
+unsigned long lastSerialDump = 0;
+
+/**
+ * @brief Endless loop.
+ */
+void loop()
+{
+	// React to changes of the link state detected by the timer
+	publishLinkState();
+	handlePageSwitch();
+
+	// Wait shortly for a frame of the reader task, so the CPU can idle in between
+	BmsFrameEvent frameEvent;
+	powerManager.sample();
+	if (xQueueReceive(bmsFrameQueue, &frameEvent, pdMS_TO_TICKS(POWER_LOOP_WAIT)) == pdTRUE)
+	{
+		// The relays were already updated by the reader task
+		TRACE_INSTANT(TRACE_QUEUE_RECEIVE, uxQueueMessagesWaiting(bmsFrameQueue));
+		const SmartBmsData &smartBmsData = frameEvent.data;
+		const SmartBmsError err = frameEvent.error;
+		if (err == SmartBmsError::SBMS_OK)
+		{
+			// Data is ok, lets print it from time to time, the loop would fall behind the frames otherwise
+			if (millis() - lastSerialDump >= PC_SERIAL_DUMP_TIME * 1000UL)
+			{
+				lastSerialDump = millis();
+				PROFILE_BEGIN(serialDump);
+				Serial.println();
+				Serial.println("===========================");
+				Serial.println((String) "Cell-Count: " + smartBmsData.getCellCount());
+				Serial.println((String) "Min-Cell-Voltage: " + smartBmsData.getCellVoltageMin() + "V");
+				Serial.println((String) "Max-Cell-Voltage: " + smartBmsData.getCellVoltageMax() + "V");
+				Serial.println((String) "Balance-Voltage: " + smartBmsData.getCellVoltageBalance() + "V");
+				Serial.println((String) "Pack-SOC: " + smartBmsData.getPackSoc() + "%");
+				Serial.println((String) "Pack-Voltage: " + smartBmsData.getPackVoltage() + "V");
+				Serial.println((String) "Pack-Current: " + smartBmsData.getPackCurrent() + "A");
+				Serial.println((String) "Pack-Charge-Current: " + smartBmsData.getPackChargeCurrent() + "A");
+				Serial.println((String) "Pack-Discharge-Current: " + smartBmsData.getPackDischargeCurrent() + "A");
+				Serial.println((String) "Pack-Capacity: " + smartBmsData.getPackCapacity() + "kWh");
+				Serial.println((String) "Pack-Energy: " + smartBmsData.getPackRemainingEnergy() + "kWh");
+				Serial.println((String) "Lowest-Cell-Voltage: " + smartBmsData.getLowestCellVoltage() + "V");
+				Serial.println((String) "Lowest-Cell-Voltage-Numer: " + smartBmsData.getLowestCellVoltageNumber());
+				Serial.println((String) "Highest-Cell-Voltage: " + smartBmsData.getHighestCellVoltage() + "V");
+				Serial.println((String) "Highest-Cell-Voltage-Number: " + smartBmsData.getHighestCellVoltageNumber());
+				Serial.println((String) "Lowest-Cell-Temp: " + smartBmsData.getLowestCellTemperature() + "°C");
+				Serial.println((String) "Lowest-Cell-Temp-Number: " + smartBmsData.getLowestCellTemperatureNumber());
+				Serial.println((String) "Highest-Cell-Temp: " + smartBmsData.getHighestCellTemperature() + "°C");
+				Serial.println((String) "Highest-Cell-Temp-Number: " + smartBmsData.getHighestCellTemperatureNumber());
+				Serial.println((String) "Allowed-Charge: " + (smartBmsData.isAllowedToCharge() ? "Yes" : "No"));
+				Serial.println((String) "Allowed-Discharge: " + (smartBmsData.isAllowedToDischarge() ? "Yes" : "No"));
+				Serial.println((String) "Alarm-Communication-Error: " + (smartBmsData.hasCommunicationError() ? "Active" : "Inactive"));
+				Serial.println((String) "Alarm-Min-Voltage: " + (smartBmsData.isMinVoltageAlarmActive() ? "Active" : "Inactive"));
+				Serial.println((String) "Alarm-Max-Voltage: " + (smartBmsData.isMaxVoltageAlarmActive() ? "Active" : "Inactive"));
+				Serial.println((String) "Alarm-Min-Temp: " + (smartBmsData.isMinTemperatureAlarmActive() ? "Active" : "Inactive"));
+				Serial.println((String) "Alarm-Max-Temp: " + (smartBmsData.isMaxTemperatureAlarmActive() ? "Active" : "Inactive"));
+				Serial.println("===========================");
+				Serial.println();
+				PROFILE_END(serialDump, PROFILE_STAGE_SERIAL_DUMP);
+			}
+
+			// Collect the cell specific data
+			PROFILE_BEGIN(publish);
+			TRACE_BEGIN(TRACE_PUBLISH);
+			smartBmsCellTable.update(smartBmsData);
+			displayedBmsData = smartBmsData;
+			hasDisplayedBmsData = true;
+			rollingStats.update(smartBmsData, millis());
+			energyMeter.update(smartBmsData, frameEvent.timeUs);
+			runtimeEstimator.update(smartBmsData, frameEvent.timeUs);
+			checkpointEnergyMeter();
+
+			// Update the metrics, only changed series are formatted
+			bmsMetrics.update(smartBmsData, smartBmsCellTable);
+			bmsMetrics.setRollingStats(rollingStats);
+			bmsMetrics.setEnergyMeter(energyMeter);
+			bmsMetrics.setRuntimeEstimator(runtimeEstimator);
+
+			// Publish the new register values to the Modbus masters
+			modbusServer.update(smartBmsData, smartBmsCellTable);
+
+			// Publish the new CAN frames, they are sent by the timer
+			CanFrame canFrames[PYLONTECH_FRAME_COUNT];
+			pylontechEncoder.encode(smartBmsData, canFrames);
+			canScheduler.update(canFrames, PYLONTECH_FRAME_COUNT, millis());
+
+			// Push the changes to the connected browsers
+			publishBmsData(smartBmsData);
+
+			// Record the history, points are only taken once the clock is valid
+			const uint64_t unixTimeMs = getUnixTimeMs();
+			if (unixTimeMs != 0)
+			{
+				influxUploader.addPoint(smartBmsData, unixTimeMs, millis());
+				const HistorySample sample(smartBmsData, unixTimeMs);
+				historyStore.append(sample);
+				historyArchive.update(sample);
+
+				// Fill the trend from the history once the clock is valid
+				if (!trendLoaded)
+				{
+					trendWidget.load(historyQuery, unixTimeMs);
+					trendLoaded = true;
+				}
+				trendWidget.add(sample);
+			}
+			flushHistory();
+			TRACE_END(TRACE_PUBLISH);
+			PROFILE_END(publish, PROFILE_STAGE_PUBLISH);
+
+			// Update the display if the scheduler asks for it
+			const DisplayRefresh refresh = refreshScheduler.update(smartBmsData, millis());
+			if (refresh != DISPLAY_REFRESH_NONE)
+			{
+				const unsigned long renderStart = micros();
+				PROFILE_BEGIN(rasterize);
+				TRACE_BEGIN(TRACE_RASTERIZE);
+
+				// Draw the page into its cache and show it, the caches of the other pages are outdated now
+				for (uint8_t i = 0; i < DISPLAY_PAGE_COUNT; i++)
+				{
+					pageValid[i] = false;
+				}
+				renderPage(currentPage, smartBmsData);
+				TRACE_END(TRACE_RASTERIZE);
+				PROFILE_END(rasterize, PROFILE_STAGE_RASTERIZE);
+				showPage(currentPage, refresh == DISPLAY_REFRESH_PARTIAL);
+				renderCount++;
+				bmsMetrics.setCounter(BMS_COUNTER_RENDERS, renderCount);
+				bmsMetrics.setCounter(BMS_COUNTER_RENDER_TIME, (micros() - renderStart) / 1000000.0);
+			}
+			else
+			{
+				refreshTrend();
+			}
+		}
+		else if (err == SmartBmsError::SBMS_ERR_READ_STREAM)
+		{
+			// Failed to read the input stream, the link monitor shows repeated errors on the display
+			Serial.println("Error: Failed to read BMS data. The input stream could not be read.");
+		}
+		else if (err == SmartBmsError::SBMS_ERR_INVALID_CHECKSUM)
+		{
+			// Checksum is invalid, the reader synchronizes again and the link monitor shows repeated errors on the display
+			Serial.println("Error: Failed to read BMS data. The checksum is invalid.");
+		}
+	}
+
+	// Serve the live stream, the metrics and the serial monitor
+	sseServer.handle();
+	webServer.handleClient();
+	handleSerialCommands();
 
 	/*
-	 * Do something else in the meantime, but make sure your serial buffer will not overflow.
+	 * Do something else in the meantime, the reader task buffers up to BMS_FRAME_QUEUE_LENGTH frames.
 	 */
 }
@@ -0,0 +1,337 @@
+/**
+ * @file BmsMetrics.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the BmsMetrics class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "net/BmsMetrics.h"
+
+#include <stdio.h>
+
+struct MetricInfo
+{
+	const char *name;
+	const char *help;
+};
+
+static const MetricInfo FIELD_METRICS[SBMS_FIELD_COUNT] = {
+	{"sbms_cell_count", "Number of cells in the pack."},
+	{"sbms_cell_voltage_min_volts", "Configured minimum cell voltage."},
+	{"sbms_cell_voltage_max_volts", "Configured maximum cell voltage."},
+	{"sbms_cell_voltage_balance_volts", "Configured balancing voltage."},
+	{"sbms_pack_soc_percent", "State of charge of the pack."},
+	{"sbms_pack_voltage_volts", "Voltage of the pack."},
+	{"sbms_pack_current_amperes", "Current of the pack, positive while charging."},
+	{"sbms_pack_charge_current_amperes", "Charge current of the pack."},
+	{"sbms_pack_discharge_current_amperes", "Discharge current of the pack."},
+	{"sbms_pack_capacity_kwh", "Capacity of the pack."},
+	{"sbms_pack_remaining_energy_kwh", "Remaining energy of the pack."},
+	{"sbms_lowest_cell_voltage_volts", "Voltage of the lowest cell."},
+	{"sbms_lowest_cell_voltage_number", "Number of the cell with the lowest voltage."},
+	{"sbms_highest_cell_voltage_volts", "Voltage of the highest cell."},
+	{"sbms_highest_cell_voltage_number", "Number of the cell with the highest voltage."},
+	{"sbms_lowest_cell_temperature_celsius", "Temperature of the coldest cell."},
+	{"sbms_lowest_cell_temperature_number", "Number of the coldest cell."},
+	{"sbms_highest_cell_temperature_celsius", "Temperature of the hottest cell."},
+	{"sbms_highest_cell_temperature_number", "Number of the hottest cell."},
+	{"sbms_communication_error", "1 if the BMS reports a communication error."},
+	{"sbms_allowed_to_charge", "1 if charging is allowed."},
+	{"sbms_allowed_to_discharge", "1 if discharging is allowed."},
+	{"sbms_min_voltage_alarm", "1 if the minimum voltage alarm is active."},
+	{"sbms_max_voltage_alarm", "1 if the maximum voltage alarm is active."},
+	{"sbms_min_temperature_alarm", "1 if the minimum temperature alarm is active."},
+	{"sbms_max_temperature_alarm", "1 if the maximum temperature alarm is active."},
+	{"sbms_frame_cell_number", "Number of the cell that sent the latest cell data."},
+	{"sbms_frame_cell_voltage_volts", "Voltage of the cell that sent the latest cell data."},
+	{"sbms_frame_cell_temperature_celsius", "Temperature of the cell that sent the latest cell data."}};
+
+static const MetricInfo COUNTER_METRICS[BMS_COUNTER_COUNT] = {
+	{"sbms_frames_decoded_total", "Number of valid frames."},
+	{"sbms_checksum_errors_total", "Number of frames with an invalid checksum."},
+	{"sbms_read_errors_total", "Number of failed reads from the BMS serial port."},
+	{"sbms_resyncs_total", "Number of times the reader had to find the start of a frame again."},
+	{"sbms_renders_total", "Number of display updates."},
+	{"sbms_render_seconds", "Duration of the latest display update."},
+	{"sbms_sse_clients", "Number of connected live stream clients."},
+	{"sbms_modbus_requests_total", "Number of served Modbus requests."},
+	{"sbms_can_frames_sent_total", "Number of CAN frames sent to the inverter."},
+	{"sbms_link_state", "State of the BMS link, 0 ok, 1 degraded, 2 stale, 3 lost."},
+	{"sbms_link_transitions_total", "Number of changes of the BMS link state."},
+	{"sbms_bytes_discarded_total", "Number of bytes skipped while searching for the start of a frame."},
+	{"sbms_uart_overruns_total", "Number of receive overruns of the UART."},
+	{"sbms_frames_dropped_total", "Number of decoded frames dropped because the main loop was busy."},
+	{"sbms_frame_interval_min_seconds", "Shortest time between two valid frames."},
+	{"sbms_frame_interval_avg_seconds", "Average time between two valid frames."},
+	{"sbms_frame_interval_max_seconds", "Longest time between two valid frames."},
+	{"sbms_bytes_per_second", "Received bytes per second."},
+	{"sbms_charged_energy_kwh_total", "Energy charged into the pack, integrated from current and voltage."},
+	{"sbms_discharged_energy_kwh_total", "Energy discharged from the pack, integrated from current and voltage."},
+	{"sbms_charged_ampere_hours_total", "Charge charged into the pack, integrated from the current."},
+	{"sbms_discharged_ampere_hours_total", "Charge discharged from the pack, integrated from the current."},
+	{"sbms_energy_gaps_total", "Number of gaps between two frames that were too long to be integrated."},
+	{"sbms_net_power_watts", "Smoothed power of the pack, positive while charging."},
+	{"sbms_time_to_full_seconds", "Estimated time until the pack is full, -1 if it is not charging."},
+	{"sbms_time_to_empty_seconds", "Estimated time until the pack is empty, -1 if it is not discharging."},
+	{"sbms_runtime_confidence", "Confidence in the estimated times from 0 to 1."},
+	{"sbms_history_samples", "Number of samples in the compressed history."},
+	{"sbms_history_bytes", "Bytes used by the compressed history."},
+	{"sbms_history_bytes_per_sample", "Average size of a compressed sample."},
+	{"sbms_history_seconds", "Time covered by the compressed history."},
+	{"sbms_display_full_refreshes_total", "Number of full refreshes of the display."},
+	{"sbms_display_partial_refreshes_total", "Number of partial refreshes of the display."},
+	{"sbms_display_refreshes_per_hour", "Number of refreshes of the display within the last hour."},
+	{"sbms_display_ghosting_percent", "Used ghosting budget of the partial refreshes."}};
+
+/**
+ * @brief Create a new instance of BmsMetrics and lay out all series.
+ */
+BmsMetrics::BmsMetrics()
+{
+	for (uint8_t i = 0; i < SBMS_FIELD_COUNT; i++)
+	{
+		this->fieldSeries_[i] = this->exporter_.addSeries(FIELD_METRICS[i].name, FIELD_METRICS[i].help, MetricsExporter::METRIC_GAUGE);
+	}
+
+	// One series per cell, labeled with the cell number
+	char labels[16];
+	for (uint8_t i = 0; i < SBMS_MAX_CELLS; i++)
+	{
+		snprintf(labels, sizeof(labels), "cell=\"%u\"", i + 1);
+		this->cellVoltageSeries_[i] = this->exporter_.addSeries("sbms_cell_voltage_volts", "Voltage of a single cell.", MetricsExporter::METRIC_GAUGE, labels);
+	}
+	for (uint8_t i = 0; i < SBMS_MAX_CELLS; i++)
+	{
+		snprintf(labels, sizeof(labels), "cell=\"%u\"", i + 1);
+		this->cellTemperatureSeries_[i] = this->exporter_.addSeries("sbms_cell_temperature_celsius", "Temperature of a single cell.", MetricsExporter::METRIC_GAUGE, labels);
+	}
+
+	for (uint8_t i = 0; i < BMS_COUNTER_COUNT; i++)
+	{
+		const bool counter = i != BMS_COUNTER_RENDER_TIME && i != BMS_COUNTER_SSE_CLIENTS && i != BMS_COUNTER_LINK_STATE && (i < BMS_COUNTER_FRAME_INTERVAL_MIN || (i >= BMS_COUNTER_CHARGED_ENERGY && i <= BMS_COUNTER_ENERGY_GAPS) || i == BMS_COUNTER_FULL_REFRESHES || i == BMS_COUNTER_PARTIAL_REFRESHES);
+		this->counterSeries_[i] = this->exporter_.addSeries(COUNTER_METRICS[i].name, COUNTER_METRICS[i].help, counter ? MetricsExporter::METRIC_COUNTER : MetricsExporter::METRIC_GAUGE);
+	}
+
+	uint32_t bounds[BMS_LATENCY_BUCKETS];
+	for (uint8_t i = 0; i < BMS_LATENCY_BUCKETS; i++)
+	{
+		bounds[i] = LogHistogram::getUpperBound(BMS_LATENCY_FIRST_BUCKET + i);
+	}
+	this->alarmLatencySeries_ = this->exporter_.addHistogram("sbms_alarm_latency_microseconds", "Estimated time from the last received byte of a frame to the update of the alarm outputs.", bounds, BMS_LATENCY_BUCKETS);
+	this->rollingSeries_ = -1;
+}
+
+/**
+ * @brief Destroy the BmsMetrics instance.
+ */
+BmsMetrics::~BmsMetrics()
+{
+}
+
+/**
+ * @brief Update the pack and cell series. Only changed values are formatted.
+ * @param smartBmsData latest BMS data
+ * @param cellTable collected cell data
+ */
+void BmsMetrics::update(const SmartBmsData &smartBmsData, const SmartBmsCellTable &cellTable)
+{
+	for (uint8_t i = 0; i < SBMS_FIELD_COUNT; i++)
+	{
+		this->exporter_.set(this->fieldSeries_[i], smartBmsData.getFieldValue(static_cast<SmartBmsField>(i)));
+	}
+
+	for (uint8_t i = 0; i < SBMS_MAX_CELLS; i++)
+	{
+		this->exporter_.set(this->cellVoltageSeries_[i], cellTable.getCellVoltage(i));
+		this->exporter_.set(this->cellTemperatureSeries_[i], cellTable.getCellTemperature(i));
+	}
+}
+
+/**
+ * @brief Set the value of an internal counter or gauge.
+ * @param counter counter to set
+ * @param value new value
+ */
+void BmsMetrics::setCounter(const BmsCounter counter, const double value)
+{
+	if (counter < BMS_COUNTER_COUNT)
+	{
+		this->exporter_.set(this->counterSeries_[counter], value);
+	}
+}
+
+/**
+ * @brief Update the alarm latency histogram.
+ * @param histogram latencies in µs
+ */
+void BmsMetrics::setAlarmLatency(const LogHistogram &histogram)
+{
+	if (this->alarmLatencySeries_ < 0)
+	{
+		return;
+	}
+
+	// Prometheus buckets are cumulative, the lower buckets are folded into the first one
+	uint32_t count = 0;
+	for (uint8_t i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+	{
+		count += histogram.getBucketCount(i);
+		if (i >= BMS_LATENCY_FIRST_BUCKET && i < BMS_LATENCY_FIRST_BUCKET + BMS_LATENCY_BUCKETS)
+		{
+			this->exporter_.set(this->alarmLatencySeries_ + i - BMS_LATENCY_FIRST_BUCKET, count);
+		}
+	}
+	this->exporter_.set(this->alarmLatencySeries_ + BMS_LATENCY_BUCKETS, count);
+	this->exporter_.set(this->alarmLatencySeries_ + BMS_LATENCY_BUCKETS + 1, histogram.getSum());
+	this->exporter_.set(this->alarmLatencySeries_ + BMS_LATENCY_BUCKETS + 2, count);
+}
+
+/**
+ * @brief Update the series of the reader statistics.
+ * @param stats statistics of the reader
+ */
+void BmsMetrics::setReaderStats(const SmartBmsReaderStats &stats)
+{
+	this->setCounter(BMS_COUNTER_FRAMES_DECODED, stats.framesOk);
+	this->setCounter(BMS_COUNTER_CHECKSUM_ERRORS, stats.checksumErrors);
+	this->setCounter(BMS_COUNTER_READ_ERRORS, stats.shortReads);
+	this->setCounter(BMS_COUNTER_RESYNCS, stats.resyncs);
+	this->setCounter(BMS_COUNTER_BYTES_DISCARDED, stats.bytesDiscarded);
+	this->setCounter(BMS_COUNTER_UART_OVERRUNS, stats.overruns);
+	this->setCounter(BMS_COUNTER_FRAME_INTERVAL_MIN, stats.intervalMinMs / 1000.0);
+	this->setCounter(BMS_COUNTER_FRAME_INTERVAL_AVG, stats.intervalAvgMs / 1000.0);
+	this->setCounter(BMS_COUNTER_FRAME_INTERVAL_MAX, stats.intervalMaxMs / 1000.0);
+	this->setCounter(BMS_COUNTER_BYTES_PER_SECOND, stats.bytesPerSecond);
+}
+
+/**
+ * @brief Set the values of the rolling windows. The series are added with the first call.
+ * Empty windows keep their previous values.
+ * @param stats rolling windows
+ */
+void BmsMetrics::setRollingStats(const SmartBmsRollingStats &stats)
+{
+	const uint8_t count = stats.getWindowCount();
+	if (this->rollingSeries_ == -1)
+	{
+		// The series are grouped by name, so every name gets a single header
+		static const MetricInfo ROLLING_METRICS[3] = {
+			{"sbms_window_min", "Smallest value of a field within the window."},
+			{"sbms_window_max", "Largest value of a field within the window."},
+			{"sbms_window_mean", "Mean value of a field within the window."}};
+		char labels[64];
+		int16_t first = -1;
+		bool failed = false;
+		for (uint8_t metric = 0; metric < 3; metric++)
+		{
+			for (uint8_t i = 0; i < count; i++)
+			{
+				snprintf(labels, sizeof(labels), "field=\"%s\",window_seconds=\"%lu\"", SmartBmsData::getFieldName(stats.getField(i)),
+						 static_cast<unsigned long>(stats.getWindow(i)->getLength() / 1000));
+				const int16_t series = this->exporter_.addSeries(ROLLING_METRICS[metric].name, ROLLING_METRICS[metric].help, MetricsExporter::METRIC_GAUGE, labels);
+				first = first < 0 ? series : first;
+				failed = failed || series < 0;
+			}
+		}
+
+		// Values are addressed relative to the first series, so it is all or nothing
+		this->rollingSeries_ = failed ? -2 : first;
+	}
+	if (this->rollingSeries_ < 0)
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		const RollingWindow *window = stats.getWindow(i);
+		if (window->getCount() > 0)
+		{
+			this->exporter_.set(this->rollingSeries_ + i, window->getMin());
+			this->exporter_.set(this->rollingSeries_ + count + i, window->getMax());
+			this->exporter_.set(this->rollingSeries_ + 2 * count + i, window->getMean());
+		}
+	}
+}
+
+/**
+ * @brief Set the totals of the energy meter.
+ * @param energyMeter energy meter
+ */
+void BmsMetrics::setEnergyMeter(const SmartBmsEnergyMeter &energyMeter)
+{
+	this->setCounter(BMS_COUNTER_CHARGED_ENERGY, energyMeter.getChargedKwh());
+	this->setCounter(BMS_COUNTER_DISCHARGED_ENERGY, energyMeter.getDischargedKwh());
+	this->setCounter(BMS_COUNTER_CHARGED_CHARGE, energyMeter.getChargedAh());
+	this->setCounter(BMS_COUNTER_DISCHARGED_CHARGE, energyMeter.getDischargedAh());
+	this->setCounter(BMS_COUNTER_ENERGY_GAPS, energyMeter.getGapCount());
+}
+
+/**
+ * @brief Set the estimated times to full and empty.
+ * @param runtimeEstimator runtime estimator
+ */
+void BmsMetrics::setRuntimeEstimator(const SmartBmsRuntimeEstimator &runtimeEstimator)
+{
+	const float timeToFull = runtimeEstimator.getTimeToFull();
+	const float timeToEmpty = runtimeEstimator.getTimeToEmpty();
+	this->setCounter(BMS_COUNTER_NET_POWER, runtimeEstimator.getPower());
+	this->setCounter(BMS_COUNTER_TIME_TO_FULL, timeToFull >= 0.0f ? timeToFull * 3600.0f : -1.0f);
+	this->setCounter(BMS_COUNTER_TIME_TO_EMPTY, timeToEmpty >= 0.0f ? timeToEmpty * 3600.0f : -1.0f);
+	this->setCounter(BMS_COUNTER_RUNTIME_CONFIDENCE, runtimeEstimator.getConfidence());
+}
+
+/**
+ * @brief Set the size of the compressed history.
+ * @param historyStore history
+ */
+void BmsMetrics::setHistoryStore(const HistoryStore &historyStore)
+{
+	this->setCounter(BMS_COUNTER_HISTORY_SAMPLES, historyStore.getSampleCount());
+	this->setCounter(BMS_COUNTER_HISTORY_BYTES, historyStore.getUsedBytes());
+	this->setCounter(BMS_COUNTER_HISTORY_BYTES_PER_SAMPLE, historyStore.getBytesPerSample());
+	this->setCounter(BMS_COUNTER_HISTORY_SECONDS, (historyStore.getNewestTime() - historyStore.getOldestTime()) / 1000.0);
+}
+
+/**
+ * @brief Set the refresh statistics of the display.
+ * @param refreshScheduler scheduler of the display refreshes
+ */
+void BmsMetrics::setRefreshScheduler(const RefreshScheduler &refreshScheduler)
+{
+	this->setCounter(BMS_COUNTER_FULL_REFRESHES, refreshScheduler.getFullRefreshCount());
+	this->setCounter(BMS_COUNTER_PARTIAL_REFRESHES, refreshScheduler.getPartialRefreshCount());
+	this->setCounter(BMS_COUNTER_REFRESHES_PER_HOUR, refreshScheduler.getRefreshesPerHour());
+	this->setCounter(BMS_COUNTER_GHOSTING_LEVEL, refreshScheduler.getGhostingLevel());
+}
+
+/**
+ * @brief Get the text exposition.
+ * @return zero terminated exposition
+ */
+const char *BmsMetrics::getBuffer() const
+{
+	return this->exporter_.getBuffer();
+}
+
+/**
+ * @brief Get the length of the text exposition.
+ * @return length in bytes
+ */
+const size_t BmsMetrics::getLength() const
+{
+	return this->exporter_.getLength();
+}
@@ -0,0 +1,362 @@
+/**
+ * @file InfluxUploader.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the InfluxUploader class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "net/InfluxUploader.h"
+#include "net/SocketApi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define INFLUX_TIMEOUT_MS 5000
+
+/**
+ * @brief Create a new instance of InfluxUploader.
+ * @param config server and batching configuration, the strings must stay valid
+ */
+InfluxUploader::InfluxUploader(const InfluxConfig &config)
+{
+	this->config_ = config;
+	this->textLength_ = 0;
+	this->pointCount_ = 0;
+	this->batchStartMs_ = 0;
+	this->lastSampleMs_ = 0;
+	this->sampled_ = false;
+	this->pendingHead_ = 0;
+	this->pendingCount_ = 0;
+	this->nextSequence_ = 0;
+	this->sentCount_ = 0;
+	this->droppedCount_ = 0;
+	this->lastStatus_ = 0;
+}
+
+/**
+ * @brief Destroy the InfluxUploader instance.
+ */
+InfluxUploader::~InfluxUploader()
+{
+}
+
+/**
+ * @brief Add a point to the current batch, if the sample interval has passed.
+ * @param smartBmsData latest BMS data
+ * @param unixTimeMs wall clock time of the data in ms since the epoch
+ * @param nowMs monotonic time in ms
+ */
+void InfluxUploader::addPoint(const SmartBmsData &smartBmsData, const uint64_t unixTimeMs, const uint32_t nowMs)
+{
+	if (this->sampled_ && nowMs - this->lastSampleMs_ < this->config_.sampleIntervalMs)
+	{
+		return;
+	}
+	this->sampled_ = true;
+	this->lastSampleMs_ = nowMs;
+
+	// Format outside of the lock, the upload task only needs it for the pending ring
+	char line[INFLUX_LINE_SIZE];
+	const size_t length = this->formatLine_(smartBmsData, unixTimeMs, line, sizeof(line));
+	if (length == 0)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if (this->textLength_ + length > sizeof(this->text_))
+	{
+		this->sealBatch_();
+	}
+	if (this->pointCount_ == 0)
+	{
+		this->batchStartMs_ = nowMs;
+	}
+
+	memcpy(&this->text_[this->textLength_], line, length);
+	this->textLength_ += length;
+	this->pointCount_++;
+
+	if (nowMs - this->batchStartMs_ >= this->config_.batchPeriodMs)
+	{
+		this->sealBatch_();
+	}
+}
+
+/**
+ * @brief Post all pending batches, oldest first. Blocks while the requests are running.
+ * @return true when no batch is pending anymore
+ * @return false when a batch could not be delivered and will be retried
+ */
+const bool InfluxUploader::upload()
+{
+	while (true)
+	{
+		// Copy the oldest batch, so the lock is not held during the request
+		{
+			std::lock_guard<std::mutex> lock(this->mutex_);
+			if (this->pendingCount_ == 0)
+			{
+				return true;
+			}
+			this->sendBatch_ = this->pending_[this->pendingHead_];
+		}
+
+		const int status = this->post_(this->sendBatch_);
+		this->lastStatus_ = status;
+
+		// Retry later on network errors, rate limiting and server errors
+		const bool delivered = status >= 200 && status < 300;
+		const bool rejected = status >= 400 && status < 500 && status != 429;
+		if (!delivered && !rejected)
+		{
+			return false;
+		}
+
+		// Remove the batch unless it was already dropped to make room for newer ones
+		std::lock_guard<std::mutex> lock(this->mutex_);
+		if (this->pendingCount_ > 0 && this->pending_[this->pendingHead_].sequence == this->sendBatch_.sequence)
+		{
+			this->pendingHead_ = (this->pendingHead_ + 1) % INFLUX_MAX_PENDING;
+			this->pendingCount_--;
+		}
+		if (delivered)
+		{
+			this->sentCount_++;
+		}
+		else
+		{
+			this->droppedCount_++;
+		}
+	}
+}
+
+/**
+ * @brief Get the number of batches waiting for the upload.
+ * @return number of pending batches
+ */
+const uint8_t InfluxUploader::getPendingCount()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	return this->pendingCount_;
+}
+
+/**
+ * @brief Get the number of batches accepted by the server.
+ * @return number of sent batches since start
+ */
+const uint32_t InfluxUploader::getSentCount() const
+{
+	return this->sentCount_;
+}
+
+/**
+ * @brief Get the number of batches that were lost, because the ring was full or the server rejected them.
+ * @return number of dropped batches since start
+ */
+const uint32_t InfluxUploader::getDroppedCount() const
+{
+	return this->droppedCount_;
+}
+
+/**
+ * @brief Get the HTTP status of the latest request.
+ * @return HTTP status or -1 on network errors
+ */
+const int InfluxUploader::getLastStatus() const
+{
+	return this->lastStatus_;
+}
+
+/**
+ * @brief Format a single point as line protocol.
+ * @param smartBmsData data of the point
+ * @param unixTimeMs timestamp of the point in ms
+ * @param line buffer that receives the line including the line feed
+ * @param size size of the buffer
+ * @return length of the line or 0 if the buffer is too small
+ */
+const size_t InfluxUploader::formatLine_(const SmartBmsData &smartBmsData, const uint64_t unixTimeMs, char *line, const size_t size) const
+{
+	int length = this->config_.tags != nullptr ? snprintf(line, size, "%s,%s ", this->config_.measurement, this->config_.tags) : snprintf(line, size, "%s ", this->config_.measurement);
+	for (uint8_t i = 0; i < SBMS_FIELD_COUNT && length > 0 && static_cast<size_t>(length) < size; i++)
+	{
+		const SmartBmsField field = static_cast<SmartBmsField>(i);
+		const char *separator = i > 0 ? "," : "";
+		if (field >= SBMS_FIELD_COMMUNICATION_ERROR && field <= SBMS_FIELD_MAX_TEMPERATURE_ALARM)
+		{
+			length += snprintf(&line[length], size - length, "%s%s=%s", separator, SmartBmsData::getFieldName(field), smartBmsData.getFieldValue(field) != 0.0f ? "t" : "f");
+		}
+		else
+		{
+			length += snprintf(&line[length], size - length, "%s%s=%.6g", separator, SmartBmsData::getFieldName(field), smartBmsData.getFieldValue(field));
+		}
+	}
+
+	if (length > 0 && static_cast<size_t>(length) < size)
+	{
+		length += snprintf(&line[length], size - length, " %llu\n", static_cast<unsigned long long>(unixTimeMs));
+	}
+	return length > 0 && static_cast<size_t>(length) < size ? length : 0;
+}
+
+/**
+ * @brief Compress the current text into the pending ring and start a new batch. The lock must be held.
+ * Text that does not fit into one slot after the compression is split at a line, the rest is sealed on its own.
+ */
+void InfluxUploader::sealBatch_()
+{
+	while (this->pointCount_ > 0)
+	{
+		Batch &batch = this->reserveBatch_();
+		const uint8_t *text = reinterpret_cast<const uint8_t *>(this->text_);
+		uint16_t points = this->pointCount_;
+		size_t length = this->textLength_;
+		batch.length = this->encoder_.compress(text, length, batch.data, sizeof(batch.data));
+
+		// Halve the number of points until they fit
+		while (batch.length == 0 && points > 1)
+		{
+			points /= 2;
+			length = 0;
+			for (uint16_t i = 0; i < points; i++)
+			{
+				length = static_cast<const char *>(memchr(&this->text_[length], '\n', this->textLength_ - length)) - this->text_ + 1;
+			}
+			batch.length = this->encoder_.compress(text, length, batch.data, sizeof(batch.data));
+		}
+
+		if (batch.length > 0)
+		{
+			batch.sequence = this->nextSequence_++;
+			batch.points = points;
+			batch.rawLength = length;
+			this->pendingCount_++;
+		}
+		else
+		{
+			// A single point that does not fit is lost
+			this->droppedCount_++;
+		}
+
+		memmove(this->text_, &this->text_[length], this->textLength_ - length);
+		this->textLength_ -= length;
+		this->pointCount_ -= points;
+	}
+}
+
+/**
+ * @brief Get the next free slot of the pending ring, the oldest batch is dropped if the ring is full. The lock must be held.
+ * @return free slot, it only becomes pending once the count is increased
+ */
+InfluxUploader::Batch &InfluxUploader::reserveBatch_()
+{
+	if (this->pendingCount_ == INFLUX_MAX_PENDING)
+	{
+		this->pendingHead_ = (this->pendingHead_ + 1) % INFLUX_MAX_PENDING;
+		this->pendingCount_--;
+		this->droppedCount_++;
+	}
+	return this->pending_[(this->pendingHead_ + this->pendingCount_) % INFLUX_MAX_PENDING];
+}
+
+/**
+ * @brief Post a single batch.
+ * @param batch batch to send
+ * @return HTTP status or -1 on network errors
+ */
+const int InfluxUploader::post_(const Batch &batch) const
+{
+	// Resolve the server
+	char port[8];
+	snprintf(port, sizeof(port), "%u", this->config_.port);
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *address = nullptr;
+	if (getaddrinfo(this->config_.host, port, &hints, &address) != 0 || address == nullptr)
+	{
+		return -1;
+	}
+
+	const int requestSocket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+	if (requestSocket < 0)
+	{
+		freeaddrinfo(address);
+		return -1;
+	}
+
+	struct timeval timeout;
+	timeout.tv_sec = INFLUX_TIMEOUT_MS / 1000;
+	timeout.tv_usec = (INFLUX_TIMEOUT_MS % 1000) * 1000;
+	setsockopt(requestSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(requestSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	const bool connected = connect(requestSocket, address->ai_addr, address->ai_addrlen) == 0;
+	freeaddrinfo(address);
+	if (!connected)
+	{
+		close(requestSocket);
+		return -1;
+	}
+
+	// Send header and body
+	char header[512];
+	const int headerLength = snprintf(header, sizeof(header),
+									  "POST %s HTTP/1.1\r\n"
+									  "Host: %s:%u\r\n"
+									  "%s%s%s"
+									  "Content-Type: text/plain; charset=utf-8\r\n"
+									  "Content-Encoding: gzip\r\n"
+									  "Content-Length: %u\r\n"
+									  "X-Batch-Sequence: %lu\r\n"
+									  "Connection: close\r\n"
+									  "\r\n",
+									  this->config_.path, this->config_.host, this->config_.port,
+									  this->config_.token != nullptr ? "Authorization: Token " : "",
+									  this->config_.token != nullptr ? this->config_.token : "",
+									  this->config_.token != nullptr ? "\r\n" : "",
+									  static_cast<unsigned int>(batch.length), static_cast<unsigned long>(batch.sequence));
+	if (headerLength < 0 || static_cast<size_t>(headerLength) >= sizeof(header) ||
+		send(requestSocket, header, headerLength, MSG_NOSIGNAL) != headerLength ||
+		send(requestSocket, batch.data, batch.length, MSG_NOSIGNAL) != static_cast<ssize_t>(batch.length))
+	{
+		close(requestSocket);
+		return -1;
+	}
+
+	// Only the status line is of interest
+	char response[32];
+	size_t responseLength = 0;
+	while (responseLength < sizeof(response) - 1)
+	{
+		const ssize_t received = recv(requestSocket, &response[responseLength], sizeof(response) - 1 - responseLength, 0);
+		if (received <= 0)
+		{
+			break;
+		}
+		responseLength += received;
+	}
+	close(requestSocket);
+	response[responseLength] = '\0';
+
+	int status = -1;
+	if (sscanf(response, "HTTP/%*d.%*d %d", &status) != 1)
+	{
+		return -1;
+	}
+	return status;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file MetricsExporter.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the MetricsExporter class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "net/MetricsExporter.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Create a new instance of MetricsExporter without any series.
+ */
+MetricsExporter::MetricsExporter()
+{
+	this->buffer_[0] = '\0';
+	this->length_ = 0;
+	this->seriesCount_ = 0;
+	this->lastName_ = nullptr;
+	this->formatCount_ = 0;
+}
+
+/**
+ * @brief Destroy the MetricsExporter instance.
+ */
+MetricsExporter::~MetricsExporter()
+{
+}
+
+/**
+ * @brief Add a series to the exposition. Series of the same metric must be added one after another.
+ * @param name metric name
+ * @param help help text of the metric
+ * @param type type of the metric, use addHistogram() for histograms
+ * @param labels label set without braces, e.g. cell="1", or nullptr
+ * @return id of the series or -1 when the buffer is full
+ */
+const int16_t MetricsExporter::addSeries(const char *name, const char *help, const MetricType type, const char *labels)
+{
+	if (this->seriesCount_ >= METRICS_MAX_SERIES)
+	{
+		return -1;
+	}
+
+	// Help and type are only written for the first series of a metric
+	const size_t length = this->length_;
+	if (this->lastName_ == nullptr || strcmp(this->lastName_, name) != 0)
+	{
+		if (!this->append_("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type == METRIC_COUNTER ? "counter" : "gauge"))
+		{
+			return -1;
+		}
+	}
+
+	const int16_t series = this->appendSeries_(name, labels);
+	if (series < 0)
+	{
+		this->length_ = length;
+		this->buffer_[length] = '\0';
+		return -1;
+	}
+	this->lastName_ = name;
+	return series;
+}
+
+/**
+ * @brief Add a histogram with cumulative buckets. The ids of the series follow each other:
+ * one per bound, +Inf, sum and count.
+ * @param name metric name without suffix
+ * @param help help text of the metric
+ * @param bounds inclusive upper bounds of the buckets in ascending order
+ * @param boundCount number of bounds
+ * @return id of the first bucket or -1 when the buffer is full
+ */
+const int16_t MetricsExporter::addHistogram(const char *name, const char *help, const uint32_t *bounds, const uint8_t boundCount)
+{
+	if (this->seriesCount_ + boundCount + 3 > METRICS_MAX_SERIES)
+	{
+		return -1;
+	}
+
+	const size_t length = this->length_;
+	const uint16_t seriesCount = this->seriesCount_;
+	if (!this->append_("# HELP %s %s\n# TYPE %s histogram\n", name, help, name))
+	{
+		return -1;
+	}
+
+	char seriesName[64];
+	char labels[24];
+	snprintf(seriesName, sizeof(seriesName), "%s_bucket", name);
+	bool added = true;
+	for (uint8_t i = 0; i <= boundCount && added; i++)
+	{
+		if (i < boundCount)
+		{
+			snprintf(labels, sizeof(labels), "le=\"%lu\"", static_cast<unsigned long>(bounds[i]));
+		}
+		else
+		{
+			snprintf(labels, sizeof(labels), "le=\"+Inf\"");
+		}
+		added = this->appendSeries_(seriesName, labels) >= 0;
+	}
+
+	snprintf(seriesName, sizeof(seriesName), "%s_sum", name);
+	added = added && this->appendSeries_(seriesName, nullptr) >= 0;
+	snprintf(seriesName, sizeof(seriesName), "%s_count", name);
+	added = added && this->appendSeries_(seriesName, nullptr) >= 0;
+
+	if (!added)
+	{
+		this->length_ = length;
+		this->buffer_[length] = '\0';
+		this->seriesCount_ = seriesCount;
+		return -1;
+	}
+	this->lastName_ = nullptr;
+	return seriesCount;
+}
+
+/**
+ * @brief Set the value of a series. The value is only formatted when it changed.
+ * @param series id of the series
+ * @param value new value
+ */
+void MetricsExporter::set(const int16_t series, const double value)
+{
+	if (series < 0 || series >= this->seriesCount_ || this->value_[series] == value)
+	{
+		return;
+	}
+
+	this->value_[series] = value;
+	this->formatValue_(series);
+}
+
+/**
+ * @brief Get the text exposition.
+ * @return zero terminated exposition
+ */
+const char *MetricsExporter::getBuffer() const
+{
+	return this->buffer_;
+}
+
+/**
+ * @brief Get the length of the text exposition.
+ * @return length in bytes
+ */
+const size_t MetricsExporter::getLength() const
+{
+	return this->length_;
+}
+
+/**
+ * @brief Get the number of values that were formatted, useful to verify that unchanged values are skipped.
+ * @return number of formatted values since start
+ */
+const uint32_t MetricsExporter::getFormatCount() const
+{
+	return this->formatCount_;
+}
+
+/**
+ * @brief Append a single series and reserve its value field.
+ * @param name name of the series
+ * @param labels label set without braces or nullptr
+ * @return id of the series or -1 when the buffer is full, the buffer is not rolled back
+ */
+const int16_t MetricsExporter::appendSeries_(const char *name, const char *labels)
+{
+	const bool added = labels == nullptr ? this->append_("%s", name) : this->append_("%s{%s}", name, labels);
+	if (!added || this->length_ + METRICS_VALUE_WIDTH + 2 > sizeof(this->buffer_))
+	{
+		return -1;
+	}
+
+	// Reserve the value field, the extra space separates it from the name in any case
+	const int16_t series = this->seriesCount_++;
+	this->buffer_[this->length_++] = ' ';
+	this->valueOffset_[series] = this->length_;
+	this->length_ += METRICS_VALUE_WIDTH;
+	this->buffer_[this->length_++] = '\n';
+	this->buffer_[this->length_] = '\0';
+	this->value_[series] = 0.0;
+	this->formatValue_(series);
+	return series;
+}
+
+/**
+ * @brief Append formatted text to the buffer.
+ * @param format printf style format
+ * @return true when the text was appended
+ * @return false when the buffer is full
+ */
+const bool MetricsExporter::append_(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	const int written = vsnprintf(&this->buffer_[this->length_], sizeof(this->buffer_) - this->length_, format, args);
+	va_end(args);
+
+	if (written < 0 || static_cast<size_t>(written) >= sizeof(this->buffer_) - this->length_)
+	{
+		this->buffer_[this->length_] = '\0';
+		return false;
+	}
+	this->length_ += written;
+	return true;
+}
+
+/**
+ * @brief Write the value of a series right aligned into its field.
+ * @param series id of the series
+ */
+void MetricsExporter::formatValue_(const int16_t series)
+{
+	char value[32];
+	if (snprintf(value, sizeof(value), "%*.10g", METRICS_VALUE_WIDTH, this->value_[series]) > METRICS_VALUE_WIDTH)
+	{
+		snprintf(value, sizeof(value), "%*.6e", METRICS_VALUE_WIDTH, this->value_[series]);
+	}
+
+	memcpy(&this->buffer_[this->valueOffset_[series]], value, METRICS_VALUE_WIDTH);
+	this->formatCount_++;
+}
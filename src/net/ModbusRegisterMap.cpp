@@ -0,0 +1,137 @@
+/**
+ * @file ModbusRegisterMap.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of ModbusRegisterMap.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "net/ModbusRegisterMap.h"
+
+#include <math.h>
+
+/**
+ * @brief Create a new instance of ModbusRegisterMap with all registers set to 0.
+ */
+ModbusRegisterMap::ModbusRegisterMap()
+{
+	for (uint16_t i = 0; i < MB_REG_COUNT; i++)
+	{
+		this->registers_[i] = 0;
+	}
+}
+
+/**
+ * @brief Destroy the ModbusRegisterMap instance.
+ */
+ModbusRegisterMap::~ModbusRegisterMap()
+{
+}
+
+/**
+ * @brief Convert the BMS data into the fixed point register representation.
+ * @param smartBmsData latest BMS data
+ * @param cellTable collected cell data
+ */
+void ModbusRegisterMap::encode(const SmartBmsData &smartBmsData, const SmartBmsCellTable &cellTable)
+{
+	this->registers_[MB_REG_CELL_COUNT] = smartBmsData.getCellCount();
+	this->registers_[MB_REG_CELL_VOLTAGE_MIN] = this->toUnsigned_(smartBmsData.getCellVoltageMin(), 1000.0f);
+	this->registers_[MB_REG_CELL_VOLTAGE_MAX] = this->toUnsigned_(smartBmsData.getCellVoltageMax(), 1000.0f);
+	this->registers_[MB_REG_CELL_VOLTAGE_BALANCE] = this->toUnsigned_(smartBmsData.getCellVoltageBalance(), 1000.0f);
+	this->registers_[MB_REG_PACK_SOC] = smartBmsData.getPackSoc();
+	this->registers_[MB_REG_PACK_VOLTAGE] = this->toUnsigned_(smartBmsData.getPackVoltage(), 100.0f);
+	this->registers_[MB_REG_PACK_CURRENT] = this->toSigned_(smartBmsData.getPackCurrent(), 10.0f);
+	this->registers_[MB_REG_PACK_CHARGE_CURRENT] = this->toSigned_(smartBmsData.getPackChargeCurrent(), 10.0f);
+	this->registers_[MB_REG_PACK_DISCHARGE_CURRENT] = this->toSigned_(smartBmsData.getPackDischargeCurrent(), 10.0f);
+	this->registers_[MB_REG_PACK_CAPACITY] = this->toUnsigned_(smartBmsData.getPackCapacity(), 10.0f);
+
+	const float remainingEnergy = smartBmsData.getPackRemainingEnergy() * 1000.0f;
+	const uint32_t remainingEnergyWh = remainingEnergy > 0.0f ? static_cast<uint32_t>(lroundf(remainingEnergy)) : 0;
+	this->registers_[MB_REG_PACK_REMAINING_ENERGY] = remainingEnergyWh >> 16;
+	this->registers_[MB_REG_PACK_REMAINING_ENERGY + 1] = remainingEnergyWh & 0xFFFF;
+
+	this->registers_[MB_REG_LOWEST_CELL_VOLTAGE] = this->toUnsigned_(smartBmsData.getLowestCellVoltage(), 1000.0f);
+	this->registers_[MB_REG_LOWEST_CELL_VOLTAGE_NUMBER] = smartBmsData.getLowestCellVoltageNumber();
+	this->registers_[MB_REG_HIGHEST_CELL_VOLTAGE] = this->toUnsigned_(smartBmsData.getHighestCellVoltage(), 1000.0f);
+	this->registers_[MB_REG_HIGHEST_CELL_VOLTAGE_NUMBER] = smartBmsData.getHighestCellVoltageNumber();
+	this->registers_[MB_REG_LOWEST_CELL_TEMPERATURE] = this->toSigned_(smartBmsData.getLowestCellTemperature(), 10.0f);
+	this->registers_[MB_REG_LOWEST_CELL_TEMPERATURE_NUMBER] = smartBmsData.getLowestCellTemperatureNumber();
+	this->registers_[MB_REG_HIGHEST_CELL_TEMPERATURE] = this->toSigned_(smartBmsData.getHighestCellTemperature(), 10.0f);
+	this->registers_[MB_REG_HIGHEST_CELL_TEMPERATURE_NUMBER] = smartBmsData.getHighestCellTemperatureNumber();
+
+	this->registers_[MB_REG_STATUS] = (smartBmsData.isAllowedToCharge() << MB_STATUS_ALLOWED_TO_CHARGE) |
+									  (smartBmsData.isAllowedToDischarge() << MB_STATUS_ALLOWED_TO_DISCHARGE) |
+									  (smartBmsData.hasCommunicationError() << MB_STATUS_COMMUNICATION_ERROR) |
+									  (smartBmsData.isMinVoltageAlarmActive() << MB_STATUS_MIN_VOLTAGE_ALARM) |
+									  (smartBmsData.isMaxVoltageAlarmActive() << MB_STATUS_MAX_VOLTAGE_ALARM) |
+									  (smartBmsData.isMinTemperatureAlarmActive() << MB_STATUS_MIN_TEMPERATURE_ALARM) |
+									  (smartBmsData.isMaxTemperatureAlarmActive() << MB_STATUS_MAX_TEMPERATURE_ALARM);
+
+	this->registers_[MB_REG_CELL_NUMBER] = smartBmsData.getCellNumber();
+	this->registers_[MB_REG_CELL_VOLTAGE] = this->toUnsigned_(smartBmsData.getCellVoltage(), 1000.0f);
+	this->registers_[MB_REG_CELL_TEMPERATURE] = this->toSigned_(smartBmsData.getCellTemperature(), 10.0f);
+
+	// Cells without data read as 0
+	for (uint8_t i = 0; i < SBMS_MAX_CELLS; i++)
+	{
+		this->registers_[MB_REG_CELL_VOLTAGE_TABLE + i] = this->toUnsigned_(cellTable.getCellVoltage(i), 1000.0f);
+		this->registers_[MB_REG_CELL_TEMPERATURE_TABLE + i] = this->toSigned_(cellTable.getCellTemperature(i), 10.0f);
+	}
+}
+
+/**
+ * @brief Get the value of a register.
+ * @param address register address, see ModbusRegister
+ * @return register value or 0 for unmapped addresses
+ */
+const uint16_t ModbusRegisterMap::getRegister(const uint16_t address) const
+{
+	return address < MB_REG_COUNT ? this->registers_[address] : 0;
+}
+
+/**
+ * @brief Get the value of a discrete input.
+ * @param address bit number, see ModbusStatusBit
+ * @return state of the input or false for unmapped addresses
+ */
+const bool ModbusRegisterMap::getDiscreteInput(const uint16_t address) const
+{
+	return address < MB_STATUS_COUNT && (this->registers_[MB_REG_STATUS] & (1 << address));
+}
+
+/**
+ * @brief Scale and round a value into an unsigned register, clamping it to the register range.
+ * @param value value to convert
+ * @param scale factor to multiply the value with
+ * @return register value
+ */
+const uint16_t ModbusRegisterMap::toUnsigned_(const float value, const float scale) const
+{
+	const long scaled = lroundf(value * scale);
+	return scaled < 0 ? 0 : (scaled > 0xFFFF ? 0xFFFF : scaled);
+}
+
+/**
+ * @brief Scale and round a value into a signed register, clamping it to the register range.
+ * @param value value to convert
+ * @param scale factor to multiply the value with
+ * @return register value as two's complement
+ */
+const uint16_t ModbusRegisterMap::toSigned_(const float value, const float scale) const
+{
+	const long scaled = lroundf(value * scale);
+	return static_cast<uint16_t>(static_cast<int16_t>(scaled < -32768 ? -32768 : (scaled > 32767 ? 32767 : scaled)));
+}
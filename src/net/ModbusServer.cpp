@@ -0,0 +1,423 @@
+/**
+ * @file ModbusServer.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the ModbusServer class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "net/ModbusServer.h"
+#include "net/SocketApi.h"
+
+#include <string.h>
+#include <sys/select.h>
+
+#define MODBUS_MBAP_SIZE 7
+
+#define MODBUS_FC_READ_DISCRETE_INPUTS 0x02
+#define MODBUS_FC_READ_HOLDING_REGISTERS 0x03
+#define MODBUS_FC_READ_INPUT_REGISTERS 0x04
+
+#define MODBUS_EX_ILLEGAL_FUNCTION 0x01
+#define MODBUS_EX_ILLEGAL_DATA_ADDRESS 0x02
+#define MODBUS_EX_ILLEGAL_DATA_VALUE 0x03
+
+/**
+ * @brief Create a new instance of ModbusServer.
+ * @param port TCP port to listen on
+ */
+ModbusServer::ModbusServer(const uint16_t port)
+{
+	this->port_ = port;
+	this->listenSocket_ = -1;
+	this->requestCount_ = 0;
+	for (size_t i = 0; i < MODBUS_MAX_CLIENTS; i++)
+	{
+		this->clients_[i].socket = -1;
+		this->clients_[i].rxLength = 0;
+		this->clients_[i].txLength = 0;
+		this->clients_[i].txOffset = 0;
+	}
+}
+
+/**
+ * @brief Destroy the ModbusServer instance.
+ */
+ModbusServer::~ModbusServer()
+{
+	this->end();
+}
+
+/**
+ * @brief Open the listening socket.
+ * @return true when the server is listening
+ * @return false when the socket could not be created
+ */
+const bool ModbusServer::begin()
+{
+	if (this->listenSocket_ >= 0)
+	{
+		return true;
+	}
+
+	// Create a non-blocking listening socket
+	this->listenSocket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (this->listenSocket_ < 0)
+	{
+		return false;
+	}
+
+	const int reuse = 1;
+	setsockopt(this->listenSocket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(this->port_);
+	if (bind(this->listenSocket_, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+		listen(this->listenSocket_, MODBUS_MAX_CLIENTS) != 0)
+	{
+		close(this->listenSocket_);
+		this->listenSocket_ = -1;
+		return false;
+	}
+
+	fcntl(this->listenSocket_, F_SETFL, fcntl(this->listenSocket_, F_GETFL, 0) | O_NONBLOCK);
+	return true;
+}
+
+/**
+ * @brief Disconnect all masters and close the listening socket.
+ */
+void ModbusServer::end()
+{
+	for (size_t i = 0; i < MODBUS_MAX_CLIENTS; i++)
+	{
+		this->closeClient_(this->clients_[i]);
+	}
+
+	if (this->listenSocket_ >= 0)
+	{
+		close(this->listenSocket_);
+		this->listenSocket_ = -1;
+	}
+}
+
+/**
+ * @brief Wait for network activity and serve all pending requests.
+ * @param timeoutMs maximum time to wait for activity in ms
+ */
+void ModbusServer::handle(const uint32_t timeoutMs)
+{
+	if (this->listenSocket_ < 0)
+	{
+		return;
+	}
+
+	// Sleep until a master connects, sends a request or can receive more of a response
+	fd_set readSet;
+	fd_set writeSet;
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+	FD_SET(this->listenSocket_, &readSet);
+	int maxSocket = this->listenSocket_;
+	for (size_t i = 0; i < MODBUS_MAX_CLIENTS; i++)
+	{
+		const Client &client = this->clients_[i];
+		if (client.socket < 0)
+		{
+			continue;
+		}
+
+		FD_SET(client.socket, client.txOffset < client.txLength ? &writeSet : &readSet);
+		maxSocket = client.socket > maxSocket ? client.socket : maxSocket;
+	}
+
+	struct timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+	if (select(maxSocket + 1, &readSet, &writeSet, nullptr, &timeout) <= 0)
+	{
+		return;
+	}
+
+	if (FD_ISSET(this->listenSocket_, &readSet))
+	{
+		this->acceptClients_();
+	}
+
+	for (size_t i = 0; i < MODBUS_MAX_CLIENTS; i++)
+	{
+		Client &client = this->clients_[i];
+		if (client.socket >= 0 && FD_ISSET(client.socket, &writeSet))
+		{
+			this->flush_(client);
+			this->processRequests_(client);
+		}
+		if (client.socket >= 0 && FD_ISSET(client.socket, &readSet))
+		{
+			this->receive_(client);
+		}
+	}
+}
+
+/**
+ * @brief Publish new BMS data. Can be called from another task than handle().
+ * @param smartBmsData latest BMS data
+ * @param cellTable collected cell data
+ */
+void ModbusServer::update(const SmartBmsData &smartBmsData, const SmartBmsCellTable &cellTable)
+{
+	ModbusRegisterMap registerMap;
+	registerMap.encode(smartBmsData, cellTable);
+	this->registerMap_.write(registerMap);
+}
+
+/**
+ * @brief Get the number of served requests.
+ * @return number of requests since start
+ */
+const uint32_t ModbusServer::getRequestCount() const
+{
+	return this->requestCount_;
+}
+
+/**
+ * @brief Accept all pending connections. Connections beyond MODBUS_MAX_CLIENTS are closed immediately.
+ */
+void ModbusServer::acceptClients_()
+{
+	while (true)
+	{
+		const int clientSocket = accept(this->listenSocket_, nullptr, nullptr);
+		if (clientSocket < 0)
+		{
+			return;
+		}
+
+		// Find a free slot for the master
+		Client *client = nullptr;
+		for (size_t i = 0; i < MODBUS_MAX_CLIENTS && client == nullptr; i++)
+		{
+			if (this->clients_[i].socket < 0)
+			{
+				client = &this->clients_[i];
+			}
+		}
+
+		if (client == nullptr)
+		{
+			close(clientSocket);
+			continue;
+		}
+
+		const int noDelay = 1;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+		fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL, 0) | O_NONBLOCK);
+
+		client->socket = clientSocket;
+		client->rxLength = 0;
+		client->txLength = 0;
+		client->txOffset = 0;
+	}
+}
+
+/**
+ * @brief Receive data from a master.
+ * @param client client to receive from
+ */
+void ModbusServer::receive_(Client &client)
+{
+	const ssize_t received = recv(client.socket, &client.rx[client.rxLength], sizeof(client.rx) - client.rxLength, 0);
+	if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+	{
+		this->closeClient_(client);
+		return;
+	}
+	else if (received < 0)
+	{
+		return;
+	}
+	client.rxLength += received;
+	this->processRequests_(client);
+}
+
+/**
+ * @brief Answer all complete requests in the receive buffer.
+ * @param client client whose requests are processed
+ */
+void ModbusServer::processRequests_(Client &client)
+{
+	// Requests may be pipelined, answer them in order as long as the previous response was sent
+	while (client.socket >= 0 && client.rxLength >= MODBUS_MBAP_SIZE && client.txOffset == client.txLength)
+	{
+		// The length field counts the unit id and the PDU
+		const size_t length = (static_cast<size_t>(client.rx[4]) << 8) | client.rx[5];
+		if (client.rx[2] != 0 || client.rx[3] != 0 || length < 2 || length > MODBUS_ADU_SIZE - 6)
+		{
+			this->closeClient_(client);
+			return;
+		}
+
+		const size_t frameLength = 6 + length;
+		if (client.rxLength < frameLength)
+		{
+			return;
+		}
+
+		client.txLength = this->processRequest_(client.rx, frameLength, client.tx);
+		client.txOffset = 0;
+		client.rxLength -= frameLength;
+		memmove(client.rx, &client.rx[frameLength], client.rxLength);
+		this->flush_(client);
+	}
+}
+
+/**
+ * @brief Send the remaining part of the pending response.
+ * @param client client to send to
+ */
+void ModbusServer::flush_(Client &client)
+{
+	while (client.txOffset < client.txLength)
+	{
+		const ssize_t sent = send(client.socket, &client.tx[client.txOffset], client.txLength - client.txOffset, MSG_NOSIGNAL);
+		if (sent > 0)
+		{
+			client.txOffset += sent;
+		}
+		else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return;
+		}
+		else
+		{
+			this->closeClient_(client);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Build the response for a single request.
+ * @param request complete request including the MBAP header
+ * @param length length of the request
+ * @param response buffer of MODBUS_ADU_SIZE bytes that receives the response
+ * @return length of the response
+ */
+const size_t ModbusServer::processRequest_(const uint8_t *request, const size_t length, uint8_t *response)
+{
+	this->requestCount_++;
+	if (length < MODBUS_MBAP_SIZE + 5)
+	{
+		return this->exceptionResponse_(request, MODBUS_EX_ILLEGAL_DATA_VALUE, response);
+	}
+
+	const uint8_t functionCode = request[7];
+	const uint16_t address = (static_cast<uint16_t>(request[8]) << 8) | request[9];
+	const uint16_t quantity = (static_cast<uint16_t>(request[10]) << 8) | request[11];
+
+	// Take a consistent copy of all registers, so a response never mixes two frames
+	if (functionCode == MODBUS_FC_READ_HOLDING_REGISTERS || functionCode == MODBUS_FC_READ_INPUT_REGISTERS)
+	{
+		if (quantity < 1 || quantity > 125)
+		{
+			return this->exceptionResponse_(request, MODBUS_EX_ILLEGAL_DATA_VALUE, response);
+		}
+		else if (static_cast<uint32_t>(address) + quantity > MB_REG_COUNT)
+		{
+			return this->exceptionResponse_(request, MODBUS_EX_ILLEGAL_DATA_ADDRESS, response);
+		}
+
+		this->registerMap_.read(this->requestRegisterMap_);
+		response[8] = quantity * 2;
+		for (uint16_t i = 0; i < quantity; i++)
+		{
+			const uint16_t value = this->requestRegisterMap_.getRegister(address + i);
+			response[9 + i * 2] = value >> 8;
+			response[10 + i * 2] = value & 0xFF;
+		}
+	}
+	else if (functionCode == MODBUS_FC_READ_DISCRETE_INPUTS)
+	{
+		if (quantity < 1 || quantity > 2000)
+		{
+			return this->exceptionResponse_(request, MODBUS_EX_ILLEGAL_DATA_VALUE, response);
+		}
+		else if (static_cast<uint32_t>(address) + quantity > MB_STATUS_COUNT)
+		{
+			return this->exceptionResponse_(request, MODBUS_EX_ILLEGAL_DATA_ADDRESS, response);
+		}
+
+		this->registerMap_.read(this->requestRegisterMap_);
+		response[8] = (quantity + 7) / 8;
+		memset(&response[9], 0, response[8]);
+		for (uint16_t i = 0; i < quantity; i++)
+		{
+			if (this->requestRegisterMap_.getDiscreteInput(address + i))
+			{
+				response[9 + i / 8] |= 1 << (i % 8);
+			}
+		}
+	}
+	else
+	{
+		return this->exceptionResponse_(request, MODBUS_EX_ILLEGAL_FUNCTION, response);
+	}
+
+	// Copy transaction id, protocol id and unit id, then set the length
+	const size_t responseLength = 9 + response[8];
+	memcpy(response, request, 4);
+	response[4] = (responseLength - 6) >> 8;
+	response[5] = (responseLength - 6) & 0xFF;
+	response[6] = request[6];
+	response[7] = functionCode;
+	return responseLength;
+}
+
+/**
+ * @brief Build an exception response.
+ * @param request request that failed
+ * @param exceptionCode Modbus exception code
+ * @param response buffer that receives the response
+ * @return length of the response
+ */
+const size_t ModbusServer::exceptionResponse_(const uint8_t *request, const uint8_t exceptionCode, uint8_t *response) const
+{
+	memcpy(response, request, 4);
+	response[4] = 0;
+	response[5] = 3;
+	response[6] = request[6];
+	response[7] = request[7] | 0x80;
+	response[8] = exceptionCode;
+	return 9;
+}
+
+/**
+ * @brief Close the connection of a master and free its slot.
+ * @param client client to close
+ */
+void ModbusServer::closeClient_(Client &client)
+{
+	if (client.socket >= 0)
+	{
+		close(client.socket);
+	}
+	client.socket = -1;
+	client.rxLength = 0;
+	client.txLength = 0;
+	client.txOffset = 0;
+}
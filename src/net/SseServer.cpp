@@ -0,0 +1,426 @@
+/**
+ * @file SseServer.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the SseServer class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "net/SseServer.h"
+#include "net/SocketApi.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char SSE_RESPONSE_HEADER[] =
+	"HTTP/1.1 200 OK\r\n"
+	"Content-Type: text/event-stream\r\n"
+	"Cache-Control: no-cache\r\n"
+	"Connection: keep-alive\r\n"
+	"Access-Control-Allow-Origin: *\r\n"
+	"\r\n";
+
+static const char SSE_RESPONSE_NOT_FOUND[] =
+	"HTTP/1.1 404 Not Found\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+
+/**
+ * @brief Create a new instance of SseServer.
+ * @param port TCP port to listen on
+ * @param path request path of the event stream
+ */
+SseServer::SseServer(const uint16_t port, const char *path)
+{
+	this->port_ = port;
+	this->path_ = path;
+	this->listenSocket_ = -1;
+	this->headSequence_ = 0;
+	this->droppedClients_ = 0;
+	for (size_t i = 0; i < SSE_MAX_CLIENTS; i++)
+	{
+		this->clients_[i].socket = -1;
+		this->clients_[i].state = SSE_CLIENT_FREE;
+	}
+	for (size_t i = 0; i < SSE_EVENT_SLOTS; i++)
+	{
+		this->events_[i].sequence = 0;
+		this->events_[i].keyframe = false;
+		this->events_[i].length = 0;
+	}
+}
+
+/**
+ * @brief Destroy the SseServer instance.
+ */
+SseServer::~SseServer()
+{
+	this->end();
+}
+
+/**
+ * @brief Open the listening socket.
+ * @return true when the server is listening
+ * @return false when the socket could not be created
+ */
+const bool SseServer::begin()
+{
+	if (this->listenSocket_ >= 0)
+	{
+		return true;
+	}
+
+	// Create a non-blocking listening socket
+	this->listenSocket_ = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (this->listenSocket_ < 0)
+	{
+		return false;
+	}
+
+	const int reuse = 1;
+	setsockopt(this->listenSocket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(this->port_);
+	if (bind(this->listenSocket_, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+		listen(this->listenSocket_, SSE_MAX_CLIENTS) != 0)
+	{
+		close(this->listenSocket_);
+		this->listenSocket_ = -1;
+		return false;
+	}
+
+	fcntl(this->listenSocket_, F_SETFL, fcntl(this->listenSocket_, F_GETFL, 0) | O_NONBLOCK);
+	return true;
+}
+
+/**
+ * @brief Disconnect all clients and close the listening socket.
+ */
+void SseServer::end()
+{
+	for (size_t i = 0; i < SSE_MAX_CLIENTS; i++)
+	{
+		this->closeClient_(this->clients_[i]);
+	}
+
+	if (this->listenSocket_ >= 0)
+	{
+		close(this->listenSocket_);
+		this->listenSocket_ = -1;
+	}
+}
+
+/**
+ * @brief Accept new clients and push pending events to all clients. Never blocks.
+ */
+void SseServer::handle()
+{
+	if (this->listenSocket_ < 0)
+	{
+		return;
+	}
+
+	this->acceptClients_();
+	for (size_t i = 0; i < SSE_MAX_CLIENTS; i++)
+	{
+		Client &client = this->clients_[i];
+		switch (client.state)
+		{
+		case SSE_CLIENT_READING_REQUEST:
+			this->readRequest_(client);
+			break;
+		case SSE_CLIENT_SENDING_HEADER:
+			this->sendHeader_(client);
+			break;
+		case SSE_CLIENT_STREAMING:
+			this->sendEvents_(client);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Serialize an event once into the shared ring. It is sent to the clients by the next calls to handle().
+ * @param event name of the event
+ * @param data single line payload of the event
+ * @param length length of the payload
+ * @param keyframe true when the payload contains the full state, so new clients can start with it
+ * @return true when the event was queued
+ * @return false when the event does not fit into a slot
+ */
+const bool SseServer::publish(const char *event, const char *data, const size_t length, const bool keyframe)
+{
+	// Format the SSE framing first, the slot may still be in use by a client
+	const uint32_t sequence = this->headSequence_;
+	char header[64];
+	const int headerLength = snprintf(header, sizeof(header), "event: %s\nid: %lu\ndata: ", event, static_cast<unsigned long>(sequence));
+	if (headerLength < 0 || static_cast<size_t>(headerLength) >= sizeof(header) || headerLength + length + 2 > SSE_EVENT_SIZE)
+	{
+		return false;
+	}
+
+	// Clients that still need the overwritten event have fallen too far behind
+	this->headSequence_++;
+	this->dropLaggingClients_();
+
+	Event &slot = this->events_[sequence % SSE_EVENT_SLOTS];
+	memcpy(slot.data, header, headerLength);
+	memcpy(&slot.data[headerLength], data, length);
+	slot.data[headerLength + length] = '\n';
+	slot.data[headerLength + length + 1] = '\n';
+	slot.length = headerLength + length + 2;
+	slot.keyframe = keyframe;
+	slot.sequence = sequence;
+
+	// Waiting clients either start with this keyframe or skip the event
+	for (size_t i = 0; i < SSE_MAX_CLIENTS; i++)
+	{
+		Client &client = this->clients_[i];
+		if (client.state == SSE_CLIENT_WAITING_KEYFRAME)
+		{
+			client.nextSequence = keyframe ? sequence : sequence + 1;
+			client.state = keyframe ? SSE_CLIENT_STREAMING : SSE_CLIENT_WAITING_KEYFRAME;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Check if a client is waiting for a keyframe.
+ * @return true when the next published event should contain the full state
+ */
+const bool SseServer::needsKeyframe() const
+{
+	for (size_t i = 0; i < SSE_MAX_CLIENTS; i++)
+	{
+		if (this->clients_[i].state == SSE_CLIENT_WAITING_KEYFRAME)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Get the number of connected clients.
+ * @return number of connected clients
+ */
+const uint8_t SseServer::getClientCount() const
+{
+	uint8_t count = 0;
+	for (size_t i = 0; i < SSE_MAX_CLIENTS; i++)
+	{
+		if (this->clients_[i].state != SSE_CLIENT_FREE)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief Get the number of clients that were dropped because they fell too far behind.
+ * @return number of dropped clients since start
+ */
+const uint32_t SseServer::getDroppedClientCount() const
+{
+	return this->droppedClients_;
+}
+
+/**
+ * @brief Accept all pending connections. Connections beyond SSE_MAX_CLIENTS are closed immediately.
+ */
+void SseServer::acceptClients_()
+{
+	while (true)
+	{
+		const int clientSocket = accept(this->listenSocket_, nullptr, nullptr);
+		if (clientSocket < 0)
+		{
+			return;
+		}
+
+		// Find a free slot for the client
+		Client *client = nullptr;
+		for (size_t i = 0; i < SSE_MAX_CLIENTS && client == nullptr; i++)
+		{
+			if (this->clients_[i].state == SSE_CLIENT_FREE)
+			{
+				client = &this->clients_[i];
+			}
+		}
+
+		if (client == nullptr)
+		{
+			close(clientSocket);
+			continue;
+		}
+
+		const int noDelay = 1;
+		setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+		fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL, 0) | O_NONBLOCK);
+
+		client->socket = clientSocket;
+		client->state = SSE_CLIENT_READING_REQUEST;
+		client->nextSequence = 0;
+		client->offset = 0;
+		client->requestLength = 0;
+	}
+}
+
+/**
+ * @brief Read the HTTP request of a client until the end of the header is reached.
+ * @param client client to read from
+ */
+void SseServer::readRequest_(Client &client)
+{
+	const ssize_t received = recv(client.socket, &client.request[client.requestLength], sizeof(client.request) - client.requestLength - 1, 0);
+	if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+	{
+		this->closeClient_(client);
+		return;
+	}
+	else if (received < 0)
+	{
+		return;
+	}
+
+	client.requestLength += received;
+	client.request[client.requestLength] = '\0';
+	if (strstr(client.request, "\r\n\r\n") == nullptr)
+	{
+		// Reject requests with oversized headers
+		if (client.requestLength >= sizeof(client.request) - 1)
+		{
+			this->closeClient_(client);
+		}
+		return;
+	}
+
+	// Only GET requests to the configured path are accepted, query parameters are ignored
+	const size_t pathLength = strlen(this->path_);
+	const char *path = &client.request[4];
+	if (strncmp(client.request, "GET ", 4) != 0 || strncmp(path, this->path_, pathLength) != 0 ||
+		(path[pathLength] != ' ' && path[pathLength] != '?'))
+	{
+		send(client.socket, SSE_RESPONSE_NOT_FOUND, sizeof(SSE_RESPONSE_NOT_FOUND) - 1, MSG_NOSIGNAL);
+		this->closeClient_(client);
+		return;
+	}
+
+	client.state = SSE_CLIENT_SENDING_HEADER;
+	client.offset = 0;
+	this->sendHeader_(client);
+}
+
+/**
+ * @brief Send the response header. Once it is sent, the client waits for the next keyframe.
+ * @param client client to send to
+ */
+void SseServer::sendHeader_(Client &client)
+{
+	if (this->sendPending_(client, SSE_RESPONSE_HEADER, sizeof(SSE_RESPONSE_HEADER) - 1))
+	{
+		client.state = SSE_CLIENT_WAITING_KEYFRAME;
+	}
+}
+
+/**
+ * @brief Send all events the client has not received yet, until the socket would block.
+ * @param client client to send to
+ */
+void SseServer::sendEvents_(Client &client)
+{
+	while (client.state == SSE_CLIENT_STREAMING && client.nextSequence != this->headSequence_)
+	{
+		const Event &event = this->events_[client.nextSequence % SSE_EVENT_SLOTS];
+		if (!this->sendPending_(client, event.data, event.length))
+		{
+			return;
+		}
+		client.nextSequence++;
+	}
+}
+
+/**
+ * @brief Send the remaining part of a buffer, starting at the offset of the client.
+ * @param client client to send to
+ * @param data buffer to send
+ * @param length length of the buffer
+ * @return true when the buffer was sent completely
+ * @return false when the socket would block or the client was closed
+ */
+const bool SseServer::sendPending_(Client &client, const char *data, const size_t length)
+{
+	while (client.offset < length)
+	{
+		const ssize_t sent = send(client.socket, &data[client.offset], length - client.offset, MSG_NOSIGNAL);
+		if (sent > 0)
+		{
+			client.offset += sent;
+		}
+		else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return false;
+		}
+		else
+		{
+			this->closeClient_(client);
+			return false;
+		}
+	}
+
+	client.offset = 0;
+	return true;
+}
+
+/**
+ * @brief Drop all streaming clients whose next event is no longer in the ring.
+ */
+void SseServer::dropLaggingClients_()
+{
+	for (size_t i = 0; i < SSE_MAX_CLIENTS; i++)
+	{
+		Client &client = this->clients_[i];
+		if (client.state == SSE_CLIENT_STREAMING && this->headSequence_ - client.nextSequence > SSE_EVENT_SLOTS)
+		{
+			this->closeClient_(client);
+			this->droppedClients_++;
+		}
+	}
+}
+
+/**
+ * @brief Close the connection of a client and free its slot.
+ * @param client client to close
+ */
+void SseServer::closeClient_(Client &client)
+{
+	if (client.socket >= 0)
+	{
+		close(client.socket);
+	}
+	client.socket = -1;
+	client.state = SSE_CLIENT_FREE;
+	client.offset = 0;
+	client.requestLength = 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * @file DeepSleepCycle.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the DeepSleepCycle.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "power/DeepSleepCycle.h"
+
+#include <string.h>
+
+/**
+ * @brief Create a new instance of DeepSleepCycle.
+ * @param state state in the RTC memory, it is validated by begin()
+ * @param config ghosting budget and currents of the board
+ */
+DeepSleepCycle::DeepSleepCycle(DeepSleepState &state, const DeepSleepConfig &config) : state_(state)
+{
+	this->config_ = config;
+	this->wake_ = DEEP_SLEEP_WAKE_RESET;
+	this->wakeTimeUs_ = 0;
+	this->refreshUs_ = 0;
+	this->hasLastCycle_ = false;
+}
+
+/**
+ * @brief Destroy the DeepSleepCycle instance.
+ */
+DeepSleepCycle::~DeepSleepCycle()
+{
+}
+
+/**
+ * @brief Start a new cycle and account the time of the last sleep.
+ * @param wake cause of the wake up
+ * @param wakeTimeUs time of the wake up in microseconds
+ */
+void DeepSleepCycle::begin(const DeepSleepWake wake, const int64_t wakeTimeUs)
+{
+	// The RTC memory is random or from an older firmware after a power on
+	if (this->state_.magic != DEEP_SLEEP_STATE_MAGIC)
+	{
+		memset(&this->state_, 0, sizeof(DeepSleepState));
+		this->state_.magic = DEEP_SLEEP_STATE_MAGIC;
+		this->state_.panel = DEEP_SLEEP_PANEL_UNKNOWN;
+	}
+
+	this->wake_ = wake;
+	this->wakeTimeUs_ = wakeTimeUs;
+	this->refreshUs_ = 0;
+	this->hasLastCycle_ = false;
+	if (wake == DEEP_SLEEP_WAKE_RESET)
+	{
+		// The cycle before a reset did not finish and the controller of the panel was reset
+		this->state_.panel = DEEP_SLEEP_PANEL_UNKNOWN;
+	}
+	else if (this->state_.sleepStartUs != 0 && wakeTimeUs > this->state_.sleepStartUs)
+	{
+		this->state_.lastSleepUs = wakeTimeUs - this->state_.sleepStartUs;
+		this->state_.totalSleepUs += this->state_.lastSleepUs;
+		this->hasLastCycle_ = true;
+	}
+	this->state_.sleepStartUs = 0;
+
+	this->state_.cycles++;
+	if (wake == DEEP_SLEEP_WAKE_TIMER)
+	{
+		this->state_.timerWakes++;
+	}
+	else if (wake == DEEP_SLEEP_WAKE_UART)
+	{
+		this->state_.uartWakes++;
+	}
+}
+
+/**
+ * @brief Keep a valid frame and decide how the display is updated.
+ * The caller must perform the returned refresh.
+ * @param frame raw bytes of the frame
+ * @param smartBmsData decoded frame
+ * @return kind of refresh, DISPLAY_REFRESH_NONE if the display already shows the same values
+ */
+const DisplayRefresh DeepSleepCycle::onFrame(const uint8_t frame[SBMS_FRAME_SIZE], const SmartBmsData &smartBmsData)
+{
+	this->state_.frames++;
+	bool changed = true;
+	if (this->state_.hasFrame && this->state_.panel == DEEP_SLEEP_PANEL_VALUES)
+	{
+		const SmartBmsDecoder decoder;
+		SmartBmsData shown;
+		if (decoder.decode(this->state_.frame, &shown) == SmartBmsError::SBMS_OK)
+		{
+			changed = (smartBmsData.getChangeMask(shown) & DEEP_SLEEP_FIELD_MASK) != 0;
+		}
+	}
+	memcpy(this->state_.frame, frame, SBMS_FRAME_SIZE);
+	this->state_.hasFrame = true;
+	if (!changed)
+	{
+		return DISPLAY_REFRESH_NONE;
+	}
+
+	const DisplayRefresh refresh = this->getRefresh_();
+	this->state_.panel = DEEP_SLEEP_PANEL_VALUES;
+	return refresh;
+}
+
+/**
+ * @brief Count a cycle without a valid frame and decide if the display must show a message.
+ * The caller must perform the returned refresh.
+ * @return kind of refresh, DISPLAY_REFRESH_NONE if the message is already shown
+ */
+const DisplayRefresh DeepSleepCycle::onMissedFrame()
+{
+	this->state_.missedFrames++;
+	if (this->state_.panel == DEEP_SLEEP_PANEL_MESSAGE)
+	{
+		return DISPLAY_REFRESH_NONE;
+	}
+
+	const DisplayRefresh refresh = this->getRefresh_();
+	this->state_.panel = DEEP_SLEEP_PANEL_MESSAGE;
+	return refresh;
+}
+
+/**
+ * @brief Report a refresh of the panel.
+ * @param refresh kind of refresh
+ * @param durationUs duration of the refresh in microseconds
+ */
+void DeepSleepCycle::onRefresh(const DisplayRefresh refresh, const uint32_t durationUs)
+{
+	if (refresh == DISPLAY_REFRESH_FULL)
+	{
+		this->state_.fullRefreshes++;
+		this->state_.partialsSinceFull = 0;
+	}
+	else if (refresh == DISPLAY_REFRESH_PARTIAL)
+	{
+		this->state_.partialRefreshes++;
+		if (this->state_.partialsSinceFull < UINT8_MAX)
+		{
+			this->state_.partialsSinceFull++;
+		}
+	}
+	this->refreshUs_ += durationUs;
+}
+
+/**
+ * @brief Finish the cycle right before the deep sleep starts.
+ * @param timeUs current time in microseconds
+ */
+void DeepSleepCycle::sleep(const int64_t timeUs)
+{
+	this->state_.lastAwakeUs = timeUs > this->wakeTimeUs_ ? timeUs - this->wakeTimeUs_ : 0;
+	this->state_.lastRefreshUs = this->refreshUs_;
+	this->state_.totalAwakeUs += this->state_.lastAwakeUs;
+	this->state_.totalRefreshUs += this->state_.lastRefreshUs;
+	this->state_.sleepStartUs = timeUs;
+}
+
+/**
+ * @brief Get the cause of the current wake up.
+ * @return cause of the wake up
+ */
+const DeepSleepWake DeepSleepCycle::getWake() const
+{
+	return this->wake_;
+}
+
+/**
+ * @brief Get what the panel shows.
+ * @return content of the panel
+ */
+const DeepSleepPanel DeepSleepCycle::getPanel() const
+{
+	return static_cast<DeepSleepPanel>(this->state_.panel);
+}
+
+/**
+ * @brief Get the counters and times kept in the RTC memory.
+ * @return state of the deep sleep mode
+ */
+const DeepSleepState &DeepSleepCycle::getState() const
+{
+	return this->state_;
+}
+
+/**
+ * @brief Check if the last cycle was completed by a sleep, only then its times are known.
+ * @return true if the times of the last cycle are known
+ */
+const bool DeepSleepCycle::hasLastCycle() const
+{
+	return this->hasLastCycle_;
+}
+
+/**
+ * @brief Get the estimated average current of the last cycle, from the wake up to the end of the sleep.
+ * @return current in mA
+ */
+const float DeepSleepCycle::getLastCycleCurrent() const
+{
+	return this->getCurrent_(this->state_.lastAwakeUs, this->state_.lastRefreshUs, this->state_.lastSleepUs);
+}
+
+/**
+ * @brief Get the estimated average current of all cycles since the power on.
+ * @return current in mA
+ */
+const float DeepSleepCycle::getAverageCurrent() const
+{
+	return this->getCurrent_(this->state_.totalAwakeUs, this->state_.totalRefreshUs, this->state_.totalSleepUs);
+}
+
+/**
+ * @brief Get a short name of a wake up cause.
+ * @param wake cause of a wake up
+ * @return name of the cause
+ */
+const char *DeepSleepCycle::getWakeName(const DeepSleepWake wake)
+{
+	switch (wake)
+	{
+	case DEEP_SLEEP_WAKE_RESET:
+		return "reset";
+	case DEEP_SLEEP_WAKE_TIMER:
+		return "timer";
+	case DEEP_SLEEP_WAKE_UART:
+		return "uart";
+	}
+	return "unknown";
+}
+
+/**
+ * @brief Choose between a partial and a full refresh.
+ * @return full refresh if the panel content is unknown or the ghosting budget is used up
+ */
+const DisplayRefresh DeepSleepCycle::getRefresh_() const
+{
+	if (this->state_.panel == DEEP_SLEEP_PANEL_UNKNOWN || this->config_.ghostingBudget == 0 || this->state_.partialsSinceFull >= this->config_.ghostingBudget)
+	{
+		return DISPLAY_REFRESH_FULL;
+	}
+	return DISPLAY_REFRESH_PARTIAL;
+}
+
+/**
+ * @brief Estimate the average current from the time spent in each state.
+ * @param awakeUs time awake in microseconds, including the refreshes
+ * @param refreshUs time of the refreshes in microseconds
+ * @param sleepUs time in deep sleep in microseconds
+ * @return current in mA
+ */
+const float DeepSleepCycle::getCurrent_(const uint64_t awakeUs, const uint64_t refreshUs, const uint64_t sleepUs) const
+{
+	const uint64_t totalUs = awakeUs + sleepUs;
+	if (totalUs == 0)
+	{
+		return 0.0f;
+	}
+	const double charge = static_cast<double>(awakeUs) * this->config_.awakeCurrent + static_cast<double>(refreshUs) * this->config_.refreshCurrent +
+						  static_cast<double>(sleepUs) * this->config_.sleepCurrent;
+	return charge / totalUs;
+}
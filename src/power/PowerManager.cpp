@@ -0,0 +1,269 @@
+/**
+ * @file PowerManager.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the PowerManager.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifdef ARDUINO
+
+#include "power/PowerManager.h"
+
+#include <stdio.h>
+#include <esp_timer.h>
+#include <esp32-hal-cpu.h>
+
+/**
+ * @brief Create a new instance of PowerManager, the frequency is not changed before begin().
+ */
+PowerManager::PowerManager()
+{
+	this->config_ = {240, 240, false};
+	this->scaling_ = false;
+#ifdef CONFIG_PM_ENABLE
+	this->lock_ = nullptr;
+#endif
+	this->holders_ = 0;
+	this->lockCount_ = 0;
+	this->lastSampleUs_ = 0;
+	this->lastFrequency_ = 0;
+	this->lockStartUs_ = 0;
+	this->lockedUs_ = 0;
+	for (uint8_t i = 0; i < POWER_FREQUENCY_COUNT; i++)
+	{
+		this->frequencyUs_[i] = 0;
+	}
+}
+
+/**
+ * @brief Destroy the PowerManager instance.
+ */
+PowerManager::~PowerManager()
+{
+#ifdef CONFIG_PM_ENABLE
+	if (this->lock_ != nullptr)
+	{
+		esp_pm_lock_delete(this->lock_);
+	}
+#endif
+}
+
+/**
+ * @brief Configure the frequency scaling and drop to the minimum frequency.
+ * @param config frequencies and light sleep
+ * @return true if ESP-IDF scales the frequency, false if it is switched by setCpuFrequencyMhz()
+ */
+const bool PowerManager::begin(const PowerConfig &config)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->config_ = config;
+	this->scaling_ = false;
+#ifdef CONFIG_PM_ENABLE
+	esp_pm_config_esp32_t pmConfig = {};
+	pmConfig.max_freq_mhz = config.maxFrequencyMhz;
+	pmConfig.min_freq_mhz = config.minFrequencyMhz;
+	pmConfig.light_sleep_enable = config.lightSleep;
+	if (esp_pm_configure(&pmConfig) == ESP_OK && esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "busy", &this->lock_) == ESP_OK)
+	{
+		this->scaling_ = true;
+	}
+#endif
+	if (!this->scaling_)
+	{
+		setCpuFrequencyMhz(this->holders_ > 0 ? config.maxFrequencyMhz : config.minFrequencyMhz);
+	}
+	this->lastSampleUs_ = esp_timer_get_time();
+	this->lastFrequency_ = getFrequencyIndex_(getCpuFrequencyMhz());
+	return this->scaling_;
+}
+
+/**
+ * @brief Keep the maximum frequency until release() is called.
+ */
+void PowerManager::acquire()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	const int64_t now = esp_timer_get_time();
+	this->account_(now);
+	if (this->holders_++ == 0)
+	{
+		this->lockStartUs_ = now;
+		this->lockCount_++;
+#ifdef CONFIG_PM_ENABLE
+		if (this->scaling_)
+		{
+			esp_pm_lock_acquire(this->lock_);
+		}
+#endif
+		if (!this->scaling_)
+		{
+			setCpuFrequencyMhz(this->config_.maxFrequencyMhz);
+		}
+	}
+	this->lastFrequency_ = getFrequencyIndex_(getCpuFrequencyMhz());
+}
+
+/**
+ * @brief Release a lock taken by acquire(), the frequency drops when the last lock is released.
+ */
+void PowerManager::release()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	if (this->holders_ == 0)
+	{
+		return;
+	}
+
+	const int64_t now = esp_timer_get_time();
+	this->account_(now);
+	if (--this->holders_ == 0)
+	{
+		this->lockedUs_ += now - this->lockStartUs_;
+#ifdef CONFIG_PM_ENABLE
+		if (this->scaling_)
+		{
+			esp_pm_lock_release(this->lock_);
+		}
+#endif
+		if (!this->scaling_)
+		{
+			setCpuFrequencyMhz(this->config_.minFrequencyMhz);
+		}
+	}
+	this->lastFrequency_ = getFrequencyIndex_(getCpuFrequencyMhz());
+}
+
+/**
+ * @brief Account the time since the last sample and read the current frequency.
+ * Other locks, e.g. of the WiFi driver, may raise the frequency without a call of acquire().
+ */
+void PowerManager::sample()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	this->account_(esp_timer_get_time());
+	this->lastFrequency_ = getFrequencyIndex_(getCpuFrequencyMhz());
+}
+
+/**
+ * @brief Reset the accounted times and the lock counter.
+ */
+void PowerManager::resetStats()
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	const int64_t now = esp_timer_get_time();
+	this->lastSampleUs_ = now;
+	this->lockStartUs_ = now;
+	this->lockCount_ = 0;
+	this->lockedUs_ = 0;
+	for (uint8_t i = 0; i < POWER_FREQUENCY_COUNT; i++)
+	{
+		this->frequencyUs_[i] = 0;
+	}
+}
+
+/**
+ * @brief Check if ESP-IDF scales the frequency.
+ * @return true with CONFIG_PM_ENABLE and a valid configuration
+ */
+const bool PowerManager::isScaling() const
+{
+	return this->scaling_;
+}
+
+/**
+ * @brief Format the time at each frequency and the time with a lock held.
+ * @param buffer buffer that receives the zero terminated report
+ * @param size size of the buffer
+ * @return length of the report
+ */
+const size_t PowerManager::format(char *buffer, const size_t size)
+{
+	std::lock_guard<std::mutex> lock(this->mutex_);
+	const int64_t now = esp_timer_get_time();
+	this->account_(now);
+	const uint64_t lockedUs = this->lockedUs_ + (this->holders_ > 0 ? now - this->lockStartUs_ : 0);
+	uint64_t totalUs = 0;
+	for (uint8_t i = 0; i < POWER_FREQUENCY_COUNT; i++)
+	{
+		totalUs += this->frequencyUs_[i];
+	}
+	totalUs = totalUs > 0 ? totalUs : 1;
+
+	size_t length = 0;
+	auto append = [&](const char *format, auto... args)
+	{
+		if (length < size)
+		{
+			const int written = snprintf(&buffer[length], size - length, format, args...);
+			length = written > 0 ? (length + written < size ? length + written : size - 1) : length;
+		}
+	};
+
+	append("CPU: %s, %u to %u MHz, now %u MHz\n", this->scaling_ ? "esp_pm" : "setCpuFrequencyMhz", this->config_.minFrequencyMhz, this->config_.maxFrequencyMhz,
+		   static_cast<unsigned int>(getCpuFrequencyMhz()));
+	for (uint8_t i = 0; i < POWER_FREQUENCY_COUNT; i++)
+	{
+		append("  %s%3u MHz %10.1f s %5.1f %%\n", i == POWER_FREQUENCY_COUNT - 1 ? "<" : " ", getFrequency(i), this->frequencyUs_[i] / 1000000.0,
+			   this->frequencyUs_[i] * 100.0 / totalUs);
+	}
+	append("  locked     %10.1f s %5.1f %%, %lu locks\n", lockedUs / 1000000.0, lockedUs * 100.0 / totalUs, static_cast<unsigned long>(this->lockCount_));
+	return length;
+}
+
+/**
+ * @brief Get the frequency of a counter.
+ * @param index index of the counter
+ * @return frequency in MHz, the last counter covers everything below it
+ */
+const uint16_t PowerManager::getFrequency(const uint8_t index)
+{
+	static const uint16_t frequencies[POWER_FREQUENCY_COUNT] = {240, 160, 80, 80};
+	return index < POWER_FREQUENCY_COUNT ? frequencies[index] : 0;
+}
+
+/**
+ * @brief Add the time since the last sample to the last frequency, the mutex must be held.
+ * @param nowUs current time in microseconds
+ */
+void PowerManager::account_(const int64_t nowUs)
+{
+	this->frequencyUs_[this->lastFrequency_] += nowUs - this->lastSampleUs_;
+	this->lastSampleUs_ = nowUs;
+}
+
+/**
+ * @brief Find the counter of a frequency.
+ * @param frequencyMhz frequency in MHz
+ * @return index of the counter
+ */
+const uint8_t PowerManager::getFrequencyIndex_(const uint32_t frequencyMhz)
+{
+	if (frequencyMhz >= 240)
+	{
+		return 0;
+	}
+	else if (frequencyMhz >= 160)
+	{
+		return 1;
+	}
+	else if (frequencyMhz >= 80)
+	{
+		return 2;
+	}
+	return 3;
+}
+
+#endif
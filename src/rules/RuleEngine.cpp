@@ -0,0 +1,687 @@
+/**
+ * @file RuleEngine.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the RuleEngine class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "rules/RuleEngine.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Create a new instance of RuleEngine without any rules.
+ * @param outputNames names of the outputs that can be used in rules, the strings must stay valid
+ * @param outputCount number of outputs, at most RULE_MAX_OUTPUTS
+ */
+RuleEngine::RuleEngine(const char *const *outputNames, const uint8_t outputCount)
+{
+	this->outputNames_ = outputNames;
+	this->outputCount_ = outputCount < RULE_MAX_OUTPUTS ? outputCount : RULE_MAX_OUTPUTS;
+	this->codeSize_ = 0;
+	this->constantCount_ = 0;
+	this->ruleCount_ = 0;
+	this->outputMask_ = 0;
+	this->text_ = nullptr;
+	this->position_ = 0;
+	this->line_ = 0;
+	this->errorLine_ = 0;
+	this->depth_ = 0;
+	this->nesting_ = 0;
+}
+
+/**
+ * @brief Destroy the RuleEngine instance.
+ */
+RuleEngine::~RuleEngine()
+{
+}
+
+/**
+ * @brief Compile a rule set. Replaces the previous rules and resets all outputs.
+ * @param text rule set, see RuleEngine.h for the syntax
+ * @return RULE_OK when the rules were compiled
+ * @return any other RuleError when the text is invalid, the engine is left without rules then
+ */
+const RuleError RuleEngine::compile(const char *text)
+{
+	this->codeSize_ = 0;
+	this->constantCount_ = 0;
+	this->ruleCount_ = 0;
+	this->outputMask_ = 0;
+	this->text_ = text;
+	this->position_ = 0;
+	this->line_ = 1;
+	this->errorLine_ = 0;
+
+	while (true)
+	{
+		this->skipSpace_();
+		const char c = this->text_[this->position_];
+		if (c == '\0')
+		{
+			break;
+		}
+		else if (c == '\n' || c == ';')
+		{
+			this->line_ += c == '\n' ? 1 : 0;
+			this->position_++;
+			continue;
+		}
+
+		const RuleError error = this->parseRule_();
+		if (error != RuleError::RULE_OK)
+		{
+			this->errorLine_ = this->line_;
+			this->codeSize_ = 0;
+			this->constantCount_ = 0;
+			this->ruleCount_ = 0;
+			this->text_ = nullptr;
+			return error;
+		}
+	}
+
+	this->text_ = nullptr;
+	return RuleError::RULE_OK;
+}
+
+/**
+ * @brief Evaluate all rules, should be called for every valid frame.
+ * @param smartBmsData latest BMS data
+ * @param nowMs monotonic time in ms, used for the minimum on and off times
+ * @return bit mask of the active outputs, bit i belongs to output i
+ */
+const uint8_t RuleEngine::evaluate(const SmartBmsData &smartBmsData, const uint32_t nowMs)
+{
+	uint8_t outputMask = 0;
+	for (uint8_t i = 0; i < this->ruleCount_; i++)
+	{
+		Rule &rule = this->rules_[i];
+		const bool on = this->run_(rule.onStart, rule.onLength, smartBmsData);
+		const bool off = rule.offLength > 0 ? this->run_(rule.offStart, rule.offLength, smartBmsData) : !on;
+		const uint32_t elapsed = nowMs - rule.changedMs;
+
+		// Conflicting conditions keep the current state
+		if (!rule.active && on && !off && (!rule.switched || elapsed >= rule.minOffMs))
+		{
+			rule.active = true;
+			rule.switched = true;
+			rule.changedMs = nowMs;
+		}
+		else if (rule.active && off && !on && elapsed >= rule.minOnMs)
+		{
+			rule.active = false;
+			rule.changedMs = nowMs;
+		}
+
+		if (rule.active)
+		{
+			outputMask |= 1 << rule.output;
+		}
+	}
+
+	this->outputMask_ = outputMask;
+	return outputMask;
+}
+
+/**
+ * @brief Turn all outputs off and forget the switching times, the rules are kept.
+ */
+void RuleEngine::reset()
+{
+	for (uint8_t i = 0; i < this->ruleCount_; i++)
+	{
+		this->rules_[i].active = false;
+		this->rules_[i].switched = false;
+		this->rules_[i].changedMs = 0;
+	}
+	this->outputMask_ = 0;
+}
+
+/**
+ * @brief Get the outputs after the latest evaluation.
+ * @return bit mask of the active outputs
+ */
+const uint8_t RuleEngine::getOutputMask() const
+{
+	return this->outputMask_;
+}
+
+/**
+ * @brief Get the number of compiled rules.
+ * @return number of rules
+ */
+const uint8_t RuleEngine::getRuleCount() const
+{
+	return this->ruleCount_;
+}
+
+/**
+ * @brief Get the number of instructions of all rules.
+ * @return number of instructions
+ */
+const uint16_t RuleEngine::getCodeSize() const
+{
+	return this->codeSize_;
+}
+
+/**
+ * @brief Get the line of the last compile error.
+ * @return line number starting at 1 or 0 if there was no error
+ */
+const uint16_t RuleEngine::getErrorLine() const
+{
+	return this->errorLine_;
+}
+
+/**
+ * @brief Get a readable description of an error.
+ * @param error error of the compiler
+ * @return description
+ */
+const char *RuleEngine::getErrorMessage(const RuleError error)
+{
+	switch (error)
+	{
+	case RuleError::RULE_OK:
+		return "ok";
+	case RuleError::RULE_ERR_SYNTAX:
+		return "syntax error";
+	case RuleError::RULE_ERR_UNKNOWN_OUTPUT:
+		return "unknown output";
+	case RuleError::RULE_ERR_UNKNOWN_FIELD:
+		return "unknown field";
+	case RuleError::RULE_ERR_EXPECTED_NUMBER:
+		return "number expected";
+	case RuleError::RULE_ERR_TOO_MANY_RULES:
+		return "too many rules";
+	case RuleError::RULE_ERR_TOO_COMPLEX:
+		return "rules too complex";
+	}
+	return "unknown error";
+}
+
+/**
+ * @brief Run the code of a single condition.
+ * @param start index of the first instruction
+ * @param length number of instructions
+ * @param smartBmsData data to test
+ * @return result of the condition
+ */
+const bool RuleEngine::run_(const uint8_t start, const uint8_t length, const SmartBmsData &smartBmsData) const
+{
+	// The stack of booleans is a shift register, bit 0 is the top
+	uint32_t stack = 0;
+	for (uint8_t i = start; i < start + length; i++)
+	{
+		const Instruction &instruction = this->code_[i];
+		if (instruction.opcode <= RULE_OP_FLAG)
+		{
+			const float value = smartBmsData.getFieldValue(static_cast<SmartBmsField>(instruction.field));
+			const float constant = this->constants_[instruction.constant];
+			bool result = false;
+			switch (instruction.opcode)
+			{
+			case RULE_OP_LT:
+				result = value < constant;
+				break;
+			case RULE_OP_LE:
+				result = value <= constant;
+				break;
+			case RULE_OP_GT:
+				result = value > constant;
+				break;
+			case RULE_OP_GE:
+				result = value >= constant;
+				break;
+			case RULE_OP_EQ:
+				result = value == constant;
+				break;
+			case RULE_OP_NE:
+				result = value != constant;
+				break;
+			default:
+				result = value != 0.0f;
+				break;
+			}
+			stack = (stack << 1) | (result ? 1 : 0);
+		}
+		else if (instruction.opcode == RULE_OP_AND)
+		{
+			stack = ((stack >> 2) << 1) | (stack & (stack >> 1) & 1);
+		}
+		else if (instruction.opcode == RULE_OP_OR)
+		{
+			stack = ((stack >> 2) << 1) | ((stack | (stack >> 1)) & 1);
+		}
+		else
+		{
+			stack ^= 1;
+		}
+	}
+	return stack & 1;
+}
+
+/**
+ * @brief Parse a single rule.
+ * @return RuleError
+ */
+const RuleError RuleEngine::parseRule_()
+{
+	char word[RULE_MAX_WORD];
+	if (!this->readWord_(word))
+	{
+		return RuleError::RULE_ERR_SYNTAX;
+	}
+
+	int8_t output = -1;
+	for (uint8_t i = 0; i < this->outputCount_ && output < 0; i++)
+	{
+		if (strcmp(word, this->outputNames_[i]) == 0)
+		{
+			output = i;
+		}
+	}
+	if (output < 0)
+	{
+		return RuleError::RULE_ERR_UNKNOWN_OUTPUT;
+	}
+	if (this->ruleCount_ >= RULE_MAX_RULES)
+	{
+		return RuleError::RULE_ERR_TOO_MANY_RULES;
+	}
+	if (!this->acceptChar_('=') || !this->acceptWord_("on"))
+	{
+		return RuleError::RULE_ERR_SYNTAX;
+	}
+
+	Rule &rule = this->rules_[this->ruleCount_];
+	memset(&rule, 0, sizeof(rule));
+	rule.output = output;
+
+	rule.onStart = this->codeSize_;
+	this->depth_ = 0;
+	this->nesting_ = 0;
+	RuleError error = this->parseExpression_();
+	if (error != RuleError::RULE_OK)
+	{
+		return error;
+	}
+	rule.onLength = this->codeSize_ - rule.onStart;
+
+	if (this->acceptWord_("off"))
+	{
+		rule.offStart = this->codeSize_;
+		this->depth_ = 0;
+		this->nesting_ = 0;
+		error = this->parseExpression_();
+		if (error != RuleError::RULE_OK)
+		{
+			return error;
+		}
+		rule.offLength = this->codeSize_ - rule.offStart;
+	}
+
+	// Optional minimum times in seconds
+	while (!this->isEndOfRule_())
+	{
+		uint32_t *time = nullptr;
+		if (this->acceptWord_("min_on"))
+		{
+			time = &rule.minOnMs;
+		}
+		else if (this->acceptWord_("min_off"))
+		{
+			time = &rule.minOffMs;
+		}
+		else
+		{
+			return RuleError::RULE_ERR_SYNTAX;
+		}
+
+		float seconds = 0.0f;
+		if (!this->readNumber_(seconds) || seconds < 0.0f)
+		{
+			return RuleError::RULE_ERR_EXPECTED_NUMBER;
+		}
+		*time = static_cast<uint32_t>(seconds * 1000.0f);
+	}
+
+	this->ruleCount_++;
+	return RuleError::RULE_OK;
+}
+
+/**
+ * @brief Parse terms combined with or.
+ * @return RuleError
+ */
+const RuleError RuleEngine::parseExpression_()
+{
+	RuleError error = this->parseTerm_();
+	while (error == RuleError::RULE_OK && this->acceptWord_("or"))
+	{
+		error = this->parseTerm_();
+		if (error == RuleError::RULE_OK)
+		{
+			error = this->emit_(RULE_OP_OR);
+		}
+	}
+	return error;
+}
+
+/**
+ * @brief Parse factors combined with and.
+ * @return RuleError
+ */
+const RuleError RuleEngine::parseTerm_()
+{
+	RuleError error = this->parseFactor_();
+	while (error == RuleError::RULE_OK && this->acceptWord_("and"))
+	{
+		error = this->parseFactor_();
+		if (error == RuleError::RULE_OK)
+		{
+			error = this->emit_(RULE_OP_AND);
+		}
+	}
+	return error;
+}
+
+/**
+ * @brief Parse a negation, a parenthesized expression, a comparison or a flag.
+ * @return RuleError
+ */
+const RuleError RuleEngine::parseFactor_()
+{
+	// The parser recurses for every not and parenthesis, so the nesting is limited to protect the stack
+	if (this->acceptWord_("not"))
+	{
+		if (++this->nesting_ > RULE_MAX_DEPTH)
+		{
+			return RuleError::RULE_ERR_TOO_COMPLEX;
+		}
+		const RuleError error = this->parseFactor_();
+		this->nesting_--;
+		return error == RuleError::RULE_OK ? this->emit_(RULE_OP_NOT) : error;
+	}
+
+	if (this->acceptChar_('('))
+	{
+		if (++this->nesting_ > RULE_MAX_DEPTH)
+		{
+			return RuleError::RULE_ERR_TOO_COMPLEX;
+		}
+		const RuleError error = this->parseExpression_();
+		this->nesting_--;
+		if (error != RuleError::RULE_OK)
+		{
+			return error;
+		}
+		return this->acceptChar_(')') ? RuleError::RULE_OK : RuleError::RULE_ERR_SYNTAX;
+	}
+
+	char word[RULE_MAX_WORD];
+	if (!this->readWord_(word))
+	{
+		return RuleError::RULE_ERR_SYNTAX;
+	}
+
+	int8_t field = -1;
+	for (uint8_t i = 0; i < SBMS_FIELD_COUNT && field < 0; i++)
+	{
+		if (strcmp(word, SmartBmsData::getFieldName(static_cast<SmartBmsField>(i))) == 0)
+		{
+			field = i;
+		}
+	}
+	if (field < 0)
+	{
+		return RuleError::RULE_ERR_UNKNOWN_FIELD;
+	}
+
+	uint8_t opcode = RULE_OP_FLAG;
+	uint8_t constant = 0;
+	if (this->readComparison_(opcode))
+	{
+		float value = 0.0f;
+		if (!this->readNumber_(value))
+		{
+			return RuleError::RULE_ERR_EXPECTED_NUMBER;
+		}
+
+		const RuleError error = this->addConstant_(value, constant);
+		if (error != RuleError::RULE_OK)
+		{
+			return error;
+		}
+	}
+	return this->emit_(opcode, field, constant);
+}
+
+/**
+ * @brief Append an instruction and track the depth of the stack.
+ * @param opcode opcode of the instruction
+ * @param field field to load
+ * @param constant index of the constant to compare with
+ * @return RuleError
+ */
+const RuleError RuleEngine::emit_(const uint8_t opcode, const uint8_t field, const uint8_t constant)
+{
+	if (this->codeSize_ >= RULE_MAX_CODE)
+	{
+		return RuleError::RULE_ERR_TOO_COMPLEX;
+	}
+
+	if (opcode <= RULE_OP_FLAG)
+	{
+		if (++this->depth_ > RULE_MAX_DEPTH)
+		{
+			return RuleError::RULE_ERR_TOO_COMPLEX;
+		}
+	}
+	else if (opcode != RULE_OP_NOT)
+	{
+		this->depth_--;
+	}
+
+	this->code_[this->codeSize_++] = {opcode, field, constant};
+	return RuleError::RULE_OK;
+}
+
+/**
+ * @brief Add a constant to the pool, equal constants are shared.
+ * @param value value of the constant
+ * @param index receives the index of the constant
+ * @return RuleError
+ */
+const RuleError RuleEngine::addConstant_(const float value, uint8_t &index)
+{
+	for (uint8_t i = 0; i < this->constantCount_; i++)
+	{
+		if (this->constants_[i] == value)
+		{
+			index = i;
+			return RuleError::RULE_OK;
+		}
+	}
+
+	if (this->constantCount_ >= RULE_MAX_CONSTANTS)
+	{
+		return RuleError::RULE_ERR_TOO_COMPLEX;
+	}
+	index = this->constantCount_;
+	this->constants_[this->constantCount_++] = value;
+	return RuleError::RULE_OK;
+}
+
+/**
+ * @brief Skip spaces and comments, but not the end of a line.
+ */
+void RuleEngine::skipSpace_()
+{
+	while (true)
+	{
+		const char c = this->text_[this->position_];
+		if (c == ' ' || c == '\t' || c == '\r')
+		{
+			this->position_++;
+		}
+		else if (c == '#')
+		{
+			while (this->text_[this->position_] != '\0' && this->text_[this->position_] != '\n')
+			{
+				this->position_++;
+			}
+		}
+		else
+		{
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Read a name or keyword.
+ * @param word buffer that receives the zero terminated word
+ * @return true when a word was read
+ */
+const bool RuleEngine::readWord_(char word[RULE_MAX_WORD])
+{
+	this->skipSpace_();
+	size_t length = 0;
+	while (isalnum(static_cast<unsigned char>(this->text_[this->position_ + length])) || this->text_[this->position_ + length] == '_')
+	{
+		if (length >= RULE_MAX_WORD - 1)
+		{
+			return false;
+		}
+		word[length] = this->text_[this->position_ + length];
+		length++;
+	}
+
+	word[length] = '\0';
+	this->position_ += length;
+	return length > 0;
+}
+
+/**
+ * @brief Consume a keyword if it follows.
+ * @param word keyword
+ * @return true when the keyword was consumed
+ */
+const bool RuleEngine::acceptWord_(const char *word)
+{
+	this->skipSpace_();
+	const size_t length = strlen(word);
+	const char next = this->text_[this->position_ + length];
+	if (strncmp(&this->text_[this->position_], word, length) != 0 || isalnum(static_cast<unsigned char>(next)) || next == '_')
+	{
+		return false;
+	}
+
+	this->position_ += length;
+	return true;
+}
+
+/**
+ * @brief Consume a character if it follows.
+ * @param c character
+ * @return true when the character was consumed
+ */
+const bool RuleEngine::acceptChar_(const char c)
+{
+	this->skipSpace_();
+	if (this->text_[this->position_] != c)
+	{
+		return false;
+	}
+
+	this->position_++;
+	return true;
+}
+
+/**
+ * @brief Read a decimal number.
+ * @param value receives the number
+ * @return true when a number was read
+ */
+const bool RuleEngine::readNumber_(float &value)
+{
+	this->skipSpace_();
+	const char *start = &this->text_[this->position_];
+	char *end = nullptr;
+	value = strtof(start, &end);
+	if (end == start)
+	{
+		return false;
+	}
+
+	this->position_ += end - start;
+	return true;
+}
+
+/**
+ * @brief Read a comparison operator.
+ * @param opcode receives the opcode of the comparison
+ * @return true when an operator was read
+ */
+const bool RuleEngine::readComparison_(uint8_t &opcode)
+{
+	this->skipSpace_();
+	const char first = this->text_[this->position_];
+	const bool equals = first != '\0' && this->text_[this->position_ + 1] == '=';
+	switch (first)
+	{
+	case '<':
+		opcode = equals ? RULE_OP_LE : RULE_OP_LT;
+		break;
+	case '>':
+		opcode = equals ? RULE_OP_GE : RULE_OP_GT;
+		break;
+	case '=':
+		if (!equals)
+		{
+			return false;
+		}
+		opcode = RULE_OP_EQ;
+		break;
+	case '!':
+		if (!equals)
+		{
+			return false;
+		}
+		opcode = RULE_OP_NE;
+		break;
+	default:
+		return false;
+	}
+
+	this->position_ += equals ? 2 : 1;
+	return true;
+}
+
+/**
+ * @brief Check if the current rule ends here.
+ * @return true at the end of a line, at ; and at the end of the text
+ */
+const bool RuleEngine::isEndOfRule_()
+{
+	this->skipSpace_();
+	const char c = this->text_[this->position_];
+	return c == '\0' || c == '\n' || c == ';';
+}
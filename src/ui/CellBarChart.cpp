@@ -0,0 +1,122 @@
+/**
+ * @file CellBarChart.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the CellBarChart class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "ui/CellBarChart.h"
+
+#include <string.h>
+
+/**
+ * @brief Create a new instance of CellBarChart without a size.
+ */
+CellBarChart::CellBarChart()
+{
+	this->begin(0, 0, 0, 0);
+}
+
+/**
+ * @brief Destroy the CellBarChart instance.
+ */
+CellBarChart::~CellBarChart()
+{
+}
+
+/**
+ * @brief Set the area of the chart including the labels.
+ * @param x left edge, the bars are byte aligned if it is a multiple of 8
+ * @param y top edge
+ * @param width width in pixels
+ * @param height height in pixels
+ */
+void CellBarChart::begin(const int16_t x, const int16_t y, const uint16_t width, const uint16_t height)
+{
+	this->x_ = x;
+	this->y_ = y;
+	this->width_ = width;
+	this->height_ = height;
+}
+
+/**
+ * @brief Get the width of the slot of a bar, a multiple of 8 if possible so whole bytes can be filled.
+ * @param chartWidth width of all bars
+ * @param cellCount number of cells
+ * @return width in pixels
+ */
+const uint16_t CellBarChart::getSlotWidth_(const uint16_t chartWidth, const uint8_t cellCount) const
+{
+	const uint16_t slot = chartWidth / cellCount;
+	return slot >= 8 ? slot & ~7 : (slot > 0 ? slot : 1);
+}
+
+/**
+ * @brief Convert a voltage to a row of the chart.
+ * @param voltage voltage in V
+ * @param scaleMin voltage at the bottom of the chart
+ * @param scaleMax voltage at the top of the chart
+ * @return row on the canvas
+ */
+const int16_t CellBarChart::toPixel_(const float voltage, const float scaleMin, const float scaleMax) const
+{
+	const int16_t chartHeight = this->height_ - CELL_CHART_NUMBER_HEIGHT;
+	const float position = (voltage - scaleMin) / (scaleMax - scaleMin) * (chartHeight - 1);
+	const int16_t row = position < 0.0f ? 0 : (position > chartHeight - 1 ? chartHeight - 1 : static_cast<int16_t>(position + 0.5f));
+	return this->y_ + chartHeight - 1 - row;
+}
+
+/**
+ * @brief Fill a rectangle of a 1 bit buffer, whole bytes are written at once and only the edges are masked.
+ * @param buffer buffer of the canvas, 8 pixels per byte with the leftmost pixel in the highest bit
+ * @param bufferWidth width of the canvas in pixels
+ * @param x left edge
+ * @param y top edge
+ * @param width width in pixels
+ * @param height height in pixels
+ * @param set true to set the bits, false to clear them
+ */
+void CellBarChart::fillBytes_(uint8_t *buffer, const uint16_t bufferWidth, const int16_t x, const int16_t y, const uint16_t width, const uint16_t height,
+							  const bool set)
+{
+	if (buffer == nullptr || x < 0 || y < 0 || width == 0 || x + width > bufferWidth)
+	{
+		return;
+	}
+
+	const uint16_t stride = (bufferWidth + 7) / 8;
+	const uint16_t firstByte = x / 8;
+	const uint16_t lastByte = (x + width - 1) / 8;
+	const uint8_t firstMask = 0xFF >> (x % 8);
+	const uint8_t lastMask = 0xFF << (7 - (x + width - 1) % 8);
+	for (uint16_t row = y; row < y + height; row++)
+	{
+		uint8_t *line = &buffer[row * stride];
+		if (firstByte == lastByte)
+		{
+			const uint8_t mask = firstMask & lastMask;
+			line[firstByte] = set ? line[firstByte] | mask : line[firstByte] & ~mask;
+			continue;
+		}
+
+		line[firstByte] = set ? line[firstByte] | firstMask : line[firstByte] & ~firstMask;
+		if (lastByte > firstByte + 1)
+		{
+			memset(&line[firstByte + 1], set ? 0xFF : 0x00, lastByte - firstByte - 1);
+		}
+		line[lastByte] = set ? line[lastByte] | lastMask : line[lastByte] & ~lastMask;
+	}
+}
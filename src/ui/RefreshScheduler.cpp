@@ -0,0 +1,301 @@
+/**
+ * @file RefreshScheduler.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the RefreshScheduler.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "ui/RefreshScheduler.h"
+
+#include <math.h>
+
+// Length of one bucket of the refreshes per hour
+#define REFRESH_BUCKET_MS (3600000UL / REFRESH_HOUR_BUCKETS)
+
+/**
+ * @brief Create a new instance of RefreshScheduler.
+ * @param config intervals, steps and ghosting budget
+ */
+RefreshScheduler::RefreshScheduler(const RefreshSchedulerConfig &config)
+{
+	this->config_ = config;
+	this->hasShown_ = false;
+	this->cleanRedraw_ = true;
+	this->previousCurrent_ = 0.0f;
+	this->hasPrevious_ = false;
+	this->swinging_ = false;
+	this->lastSwingMs_ = 0;
+	this->lastRefreshMs_ = 0;
+	this->lastFullMs_ = 0;
+	this->interval_ = config.minIntervalMs;
+	this->ghosting_ = 0;
+	this->reason_ = REFRESH_REASON_NONE;
+	this->fullCount_ = 0;
+	this->partialCount_ = 0;
+	for (uint8_t i = 0; i < REFRESH_HOUR_BUCKETS; i++)
+	{
+		this->hourBuckets_[i] = 0;
+	}
+	this->bucketIndex_ = 0;
+	this->bucketStartMs_ = 0;
+}
+
+/**
+ * @brief Destroy the RefreshScheduler instance.
+ */
+RefreshScheduler::~RefreshScheduler()
+{
+}
+
+/**
+ * @brief Decide if the display must be refreshed for a new frame.
+ * If a refresh is returned, the frame becomes the shown data, so the caller must perform it.
+ * @param smartBmsData latest data of the BMS
+ * @param nowMs current time in milliseconds
+ * @return kind of refresh, DISPLAY_REFRESH_NONE if the display can stay as it is
+ */
+const DisplayRefresh RefreshScheduler::update(const SmartBmsData &smartBmsData, const uint32_t nowMs)
+{
+	this->advanceBuckets_(nowMs);
+
+	// A swing holds the longer interval until the current settled for a whole swing interval
+	const float current = smartBmsData.getPackCurrent();
+	if (this->hasPrevious_ && fabsf(current - this->previousCurrent_) >= this->config_.swingCurrent)
+	{
+		this->swinging_ = true;
+		this->lastSwingMs_ = nowMs;
+	}
+	else if (this->swinging_ && nowMs - this->lastSwingMs_ >= this->config_.swingIntervalMs)
+	{
+		this->swinging_ = false;
+	}
+	this->previousCurrent_ = current;
+	this->hasPrevious_ = true;
+
+	// Find the most important reason for a refresh, only alarms may skip the minimum interval
+	const uint32_t elapsed = nowMs - this->lastRefreshMs_;
+	const uint32_t minInterval = this->swinging_ ? this->config_.swingIntervalMs : this->config_.minIntervalMs;
+	RefreshReason reason = REFRESH_REASON_NONE;
+	if (!this->hasShown_)
+	{
+		reason = REFRESH_REASON_REDRAW;
+	}
+	else if ((smartBmsData.getChangeMask(this->shown_) & REFRESH_ALARM_MASK) != 0)
+	{
+		reason = REFRESH_REASON_ALARM;
+	}
+	else if (elapsed >= minInterval && this->isChanged_(smartBmsData))
+	{
+		reason = REFRESH_REASON_CHANGE;
+	}
+	else if (elapsed >= minInterval && elapsed >= this->interval_)
+	{
+		reason = REFRESH_REASON_STABLE;
+	}
+	if (reason == REFRESH_REASON_NONE)
+	{
+		return DISPLAY_REFRESH_NONE;
+	}
+
+	// Back off while nothing changes, any change starts again with the minimum interval
+	if (reason == REFRESH_REASON_STABLE)
+	{
+		this->interval_ = this->interval_ * 2 < this->config_.maxIntervalMs ? this->interval_ * 2 : this->config_.maxIntervalMs;
+	}
+	else
+	{
+		this->interval_ = this->config_.minIntervalMs;
+	}
+	this->reason_ = reason;
+	this->shown_ = smartBmsData;
+	this->hasShown_ = true;
+	this->lastRefreshMs_ = nowMs;
+
+	// Clean the panel once the ghosting budget is used up, a clean redraw replaces another screen anyway
+	const bool full = this->config_.ghostingBudget == 0 || (reason == REFRESH_REASON_REDRAW && this->cleanRedraw_) || this->ghosting_ >= this->config_.ghostingBudget * 100 ||
+					  nowMs - this->lastFullMs_ >= this->config_.fullIntervalMs;
+	return full ? DISPLAY_REFRESH_FULL : DISPLAY_REFRESH_PARTIAL;
+}
+
+/**
+ * @brief Report a refresh of the panel, including refreshes that were not scheduled.
+ * @param refresh kind of refresh
+ * @param nowMs current time in milliseconds
+ * @param area refreshed area in percent of the screen, it is only used for partial refreshes
+ */
+void RefreshScheduler::onRefresh(const DisplayRefresh refresh, const uint32_t nowMs, const uint8_t area)
+{
+	this->advanceBuckets_(nowMs);
+	if (refresh == DISPLAY_REFRESH_FULL)
+	{
+		this->fullCount_++;
+		this->ghosting_ = 0;
+		this->lastFullMs_ = nowMs;
+	}
+	else if (refresh == DISPLAY_REFRESH_PARTIAL)
+	{
+		this->partialCount_++;
+		this->ghosting_ = this->ghosting_ + area < UINT16_MAX ? this->ghosting_ + area : UINT16_MAX;
+	}
+	else
+	{
+		return;
+	}
+
+	if (this->hourBuckets_[this->bucketIndex_] < UINT16_MAX)
+	{
+		this->hourBuckets_[this->bucketIndex_]++;
+	}
+}
+
+/**
+ * @brief Refresh the display with the next frame, for example after another screen was shown.
+ * @param clean true for a full refresh, false if the panel still shows an image of the values
+ */
+void RefreshScheduler::invalidate(const bool clean)
+{
+	this->hasShown_ = false;
+	this->cleanRedraw_ = clean;
+}
+
+/**
+ * @brief Get the reason of the latest scheduled refresh.
+ * @return reason of the latest refresh
+ */
+const RefreshReason RefreshScheduler::getReason() const
+{
+	return this->reason_;
+}
+
+/**
+ * @brief Get the current interval for stable values.
+ * @return interval in milliseconds
+ */
+const uint32_t RefreshScheduler::getInterval() const
+{
+	return this->interval_;
+}
+
+/**
+ * @brief Get how much of the ghosting budget is used.
+ * @return used budget in percent
+ */
+const uint8_t RefreshScheduler::getGhostingLevel() const
+{
+	if (this->config_.ghostingBudget == 0)
+	{
+		return 0;
+	}
+	const uint16_t level = this->ghosting_ / this->config_.ghostingBudget;
+	return level < 100 ? level : 100;
+}
+
+/**
+ * @brief Get the number of full refreshes.
+ * @return number of full refreshes
+ */
+const uint32_t RefreshScheduler::getFullRefreshCount() const
+{
+	return this->fullCount_;
+}
+
+/**
+ * @brief Get the number of partial refreshes.
+ * @return number of partial refreshes
+ */
+const uint32_t RefreshScheduler::getPartialRefreshCount() const
+{
+	return this->partialCount_;
+}
+
+/**
+ * @brief Get the number of refreshes within the last hour.
+ * The count is only updated by update() and onRefresh(), so it may include up to one bucket too much.
+ * @return number of full and partial refreshes
+ */
+const uint16_t RefreshScheduler::getRefreshesPerHour() const
+{
+	uint32_t count = 0;
+	for (uint8_t i = 0; i < REFRESH_HOUR_BUCKETS; i++)
+	{
+		count += this->hourBuckets_[i];
+	}
+	return count < UINT16_MAX ? count : UINT16_MAX;
+}
+
+/**
+ * @brief Get a short name of a refresh reason.
+ * @param reason reason of a refresh
+ * @return name of the reason
+ */
+const char *RefreshScheduler::getReasonName(const RefreshReason reason)
+{
+	switch (reason)
+	{
+	case REFRESH_REASON_NONE:
+		return "none";
+	case REFRESH_REASON_REDRAW:
+		return "redraw";
+	case REFRESH_REASON_ALARM:
+		return "alarm";
+	case REFRESH_REASON_CHANGE:
+		return "change";
+	case REFRESH_REASON_STABLE:
+		return "stable";
+	}
+	return "unknown";
+}
+
+/**
+ * @brief Check if a value changed by more than its step since it was shown.
+ * @param smartBmsData latest data of the BMS
+ * @return true if the change should be shown
+ */
+const bool RefreshScheduler::isChanged_(const SmartBmsData &smartBmsData) const
+{
+	const SmartBmsData &shown = this->shown_;
+	const uint8_t socChange = smartBmsData.getPackSoc() > shown.getPackSoc() ? smartBmsData.getPackSoc() - shown.getPackSoc() : shown.getPackSoc() - smartBmsData.getPackSoc();
+	return smartBmsData.getCellCount() != shown.getCellCount() ||
+		   socChange >= this->config_.socStep ||
+		   fabsf(smartBmsData.getPackVoltage() - shown.getPackVoltage()) >= this->config_.voltageStep ||
+		   fabsf(smartBmsData.getPackCurrent() - shown.getPackCurrent()) >= this->config_.currentStep ||
+		   fabsf(smartBmsData.getLowestCellVoltage() - shown.getLowestCellVoltage()) >= this->config_.cellVoltageStep ||
+		   fabsf(smartBmsData.getHighestCellVoltage() - shown.getHighestCellVoltage()) >= this->config_.cellVoltageStep ||
+		   fabsf(smartBmsData.getLowestCellTemperature() - shown.getLowestCellTemperature()) >= this->config_.temperatureStep ||
+		   fabsf(smartBmsData.getHighestCellTemperature() - shown.getHighestCellTemperature()) >= this->config_.temperatureStep;
+}
+
+/**
+ * @brief Move to the bucket of the current time and clear the buckets in between.
+ * @param nowMs current time in milliseconds
+ */
+void RefreshScheduler::advanceBuckets_(const uint32_t nowMs)
+{
+	uint8_t steps = 0;
+	while (nowMs - this->bucketStartMs_ >= REFRESH_BUCKET_MS && steps < REFRESH_HOUR_BUCKETS)
+	{
+		this->bucketStartMs_ += REFRESH_BUCKET_MS;
+		this->bucketIndex_ = (this->bucketIndex_ + 1) % REFRESH_HOUR_BUCKETS;
+		this->hourBuckets_[this->bucketIndex_] = 0;
+		steps++;
+	}
+
+	// After more than an hour without a call all buckets are empty
+	if (steps == REFRESH_HOUR_BUCKETS)
+	{
+		this->bucketStartMs_ = nowMs;
+	}
+}
@@ -0,0 +1,317 @@
+/**
+ * @file TrendWidget.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the TrendWidget class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "ui/TrendWidget.h"
+
+/**
+ * @brief Create a new instance of TrendWidget without a size.
+ */
+TrendWidget::TrendWidget()
+{
+	this->begin(0, 0, 0, 0, HISTORY_PACK_SOC, 1000);
+}
+
+/**
+ * @brief Destroy the TrendWidget instance.
+ */
+TrendWidget::~TrendWidget()
+{
+}
+
+/**
+ * @brief Set the position, the size and the content of the widget, this removes all values.
+ * @param x left edge on the display
+ * @param y top edge on the display
+ * @param width width in pixels, at most TREND_MAX_WIDTH
+ * @param height height in pixels
+ * @param channel channel that is shown
+ * @param spanMs time span of the whole widget in ms
+ * @param scaleMin value at the bottom edge
+ * @param scaleMax value at the top edge, the scale follows the values if it equals scaleMin
+ */
+void TrendWidget::begin(const int16_t x, const int16_t y, const uint16_t width, const uint16_t height, const HistoryChannel channel, const uint32_t spanMs,
+						const float scaleMin, const float scaleMax)
+{
+	this->x_ = x;
+	this->y_ = y;
+	this->width_ = width < TREND_MAX_WIDTH ? width : TREND_MAX_WIDTH;
+	this->height_ = height;
+	this->channel_ = channel;
+	this->columnMs_ = this->width_ > 0 && spanMs / this->width_ > 0 ? spanMs / this->width_ : 1;
+	this->fixedScale_ = scaleMax > scaleMin;
+	this->scaleMin_ = scaleMin;
+	this->scaleMax_ = scaleMax;
+	this->clear();
+}
+
+/**
+ * @brief Add a value.
+ * @param timeMs unix time in ms, older values than the newest column are ignored
+ * @param value value in the unit of the channel
+ */
+void TrendWidget::add(const int64_t timeMs, const float value)
+{
+	if (this->width_ == 0)
+	{
+		return;
+	}
+
+	const int64_t slot = timeMs / this->columnMs_;
+	if (this->count_ > 0 && slot < this->headSlot_)
+	{
+		return;
+	}
+
+	if (this->count_ == 0 || slot > this->headSlot_)
+	{
+		// Empty columns for the time without values
+		const int64_t steps = this->count_ == 0 ? 1 : (slot - this->headSlot_ < this->width_ ? slot - this->headSlot_ : this->width_);
+		for (int64_t i = 0; i < steps; i++)
+		{
+			this->head_ = (this->head_ + 1) % TREND_MAX_WIDTH;
+			this->columns_[this->head_].min = 1.0f;
+			this->columns_[this->head_].max = 0.0f;
+		}
+		const uint16_t previousCount = this->count_;
+		this->count_ = this->count_ + steps < this->width_ ? this->count_ + steps : this->width_;
+		this->headSlot_ = slot;
+
+		// Appending only changes the new columns, scrolling changes all of them
+		if (previousCount + steps <= this->width_)
+		{
+			this->markDirty_(previousCount, this->count_);
+		}
+		else
+		{
+			this->markDirty_(0, this->width_);
+		}
+	}
+
+	Column &column = this->columns_[this->head_];
+	const int16_t top = column.min <= column.max ? this->toPixel_(column.max) : -1;
+	const int16_t bottom = column.min <= column.max ? this->toPixel_(column.min) : -1;
+	if (column.min > column.max)
+	{
+		column.min = value;
+		column.max = value;
+	}
+	else
+	{
+		column.min = value < column.min ? value : column.min;
+		column.max = value > column.max ? value : column.max;
+	}
+
+	if (this->updateScale_())
+	{
+		this->markDirty_(0, this->width_);
+	}
+	else if (this->toPixel_(column.max) != top || this->toPixel_(column.min) != bottom)
+	{
+		this->markDirty_(this->count_ - 1, this->count_);
+	}
+}
+
+/**
+ * @brief Add the value of the channel of a sample.
+ * @param sample sample with the unix time in ms
+ */
+void TrendWidget::add(const HistorySample &sample)
+{
+	this->add(sample.getTime(), sample.getValue(this->channel_));
+}
+
+/**
+ * @brief Replace the values with the downsampled history, e.g. after a restart.
+ * @param historyQuery query over the history
+ * @param nowMs unix time in ms of the right edge
+ */
+void TrendWidget::load(HistoryQuery &historyQuery, const int64_t nowMs)
+{
+	this->clear();
+	if (this->width_ > 0 && historyQuery.begin(this->channel_, nowMs - static_cast<int64_t>(this->columnMs_) * this->width_, nowMs, this->width_))
+	{
+		historyQuery.run(writePoint_, this);
+	}
+	this->markDirty_(0, this->width_);
+}
+
+/**
+ * @brief Remove all values.
+ */
+void TrendWidget::clear()
+{
+	this->head_ = 0;
+	this->count_ = 0;
+	this->headSlot_ = 0;
+	if (!this->fixedScale_)
+	{
+		this->scaleMin_ = 0.0f;
+		this->scaleMax_ = 0.0f;
+	}
+	this->clearDirty();
+	this->markDirty_(0, this->width_);
+}
+
+/**
+ * @brief Check if columns changed since the last call of clearDirty.
+ * @return true if the widget needs to be drawn
+ */
+const bool TrendWidget::isDirty() const
+{
+	return this->dirtyFrom_ < this->dirtyTo_;
+}
+
+/**
+ * @brief Get the left edge of the changed columns.
+ * @return position on the display
+ */
+const int16_t TrendWidget::getDirtyX() const
+{
+	return this->x_ + this->dirtyFrom_;
+}
+
+/**
+ * @brief Get the width of the changed columns.
+ * @return width in pixels
+ */
+const uint16_t TrendWidget::getDirtyWidth() const
+{
+	return this->dirtyTo_ > this->dirtyFrom_ ? this->dirtyTo_ - this->dirtyFrom_ : 0;
+}
+
+/**
+ * @brief Mark all columns as drawn.
+ */
+void TrendWidget::clearDirty()
+{
+	this->dirtyFrom_ = this->width_;
+	this->dirtyTo_ = 0;
+}
+
+/**
+ * @brief Get the left edge of the widget.
+ * @return position on the display
+ */
+const int16_t TrendWidget::getX() const
+{
+	return this->x_;
+}
+
+/**
+ * @brief Get the top edge of the widget.
+ * @return position on the display
+ */
+const int16_t TrendWidget::getY() const
+{
+	return this->y_;
+}
+
+/**
+ * @brief Get the width of the widget.
+ * @return width in pixels
+ */
+const uint16_t TrendWidget::getWidth() const
+{
+	return this->width_;
+}
+
+/**
+ * @brief Get the height of the widget.
+ * @return height in pixels
+ */
+const uint16_t TrendWidget::getHeight() const
+{
+	return this->height_;
+}
+
+/**
+ * @brief Extend the range of changed columns.
+ * @param from first changed column
+ * @param to column after the last changed one
+ */
+void TrendWidget::markDirty_(const uint16_t from, const uint16_t to)
+{
+	this->dirtyFrom_ = from < this->dirtyFrom_ ? from : this->dirtyFrom_;
+	this->dirtyTo_ = to > this->dirtyTo_ ? to : this->dirtyTo_;
+}
+
+/**
+ * @brief Fit the scale to the visible values, it only changes if a value is outside or the range shrank by half.
+ * @return true if the scale changed
+ */
+const bool TrendWidget::updateScale_()
+{
+	if (this->fixedScale_)
+	{
+		return false;
+	}
+
+	float minimum = 0.0f;
+	float maximum = 0.0f;
+	for (uint16_t i = 0; i < this->count_; i++)
+	{
+		const Column &column = this->columns_[(this->head_ + TREND_MAX_WIDTH + 1 - this->count_ + i) % TREND_MAX_WIDTH];
+		if (column.min <= column.max)
+		{
+			minimum = column.min < minimum ? column.min : minimum;
+			maximum = column.max > maximum ? column.max : maximum;
+		}
+	}
+
+	const float range = this->scaleMax_ - this->scaleMin_;
+	if (minimum >= this->scaleMin_ && maximum <= this->scaleMax_ && (maximum - minimum) * 2.0f > range)
+	{
+		return false;
+	}
+
+	// Leave some headroom so the scale does not change with every value
+	const float headroom = (maximum - minimum) * 0.1f;
+	this->scaleMin_ = minimum < 0.0f ? minimum - headroom : 0.0f;
+	this->scaleMax_ = maximum > 0.0f ? maximum + headroom : 0.0f;
+	return true;
+}
+
+/**
+ * @brief Convert a value to a row of the display.
+ * @param value value in the unit of the channel
+ * @return row within the widget
+ */
+const int16_t TrendWidget::toPixel_(const float value) const
+{
+	const float range = this->scaleMax_ - this->scaleMin_;
+	if (range <= 0.0f || this->height_ == 0)
+	{
+		return this->y_ + this->height_ - 1;
+	}
+
+	const float position = (value - this->scaleMin_) / range * (this->height_ - 1);
+	const int16_t row = static_cast<int16_t>(position + 0.5f);
+	return this->y_ + this->height_ - 1 - (row < 0 ? 0 : (row >= this->height_ ? this->height_ - 1 : row));
+}
+
+/**
+ * @brief Receive a point of the history query.
+ * @param point point of the query
+ * @param context widget
+ */
+void TrendWidget::writePoint_(const HistoryPoint &point, void *context)
+{
+	static_cast<TrendWidget *>(context)->add(point.timeMs, point.value);
+}
@@ -0,0 +1,166 @@
+/**
+ * @file BitStream.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the BitWriter and BitReader classes.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "util/BitStream.h"
+
+/**
+ * @brief Create a new instance of BitWriter without a buffer.
+ */
+BitWriter::BitWriter()
+{
+	this->begin(nullptr, 0);
+}
+
+/**
+ * @brief Destroy the BitWriter instance.
+ */
+BitWriter::~BitWriter()
+{
+}
+
+/**
+ * @brief Start writing into a buffer.
+ * @param buffer zeroed buffer
+ * @param size size of the buffer in bytes
+ * @param bitCount number of bits that were already written
+ */
+void BitWriter::begin(uint8_t *buffer, const size_t size, const size_t bitCount)
+{
+	this->buffer_ = buffer;
+	this->capacity_ = size * 8;
+	this->bitCount_ = bitCount;
+}
+
+/**
+ * @brief Append the lower bits of a value.
+ * @param value value to write
+ * @param bits number of bits from 0 to 32
+ * @return true if the value was written, false if it does not fit
+ */
+const bool BitWriter::write(const uint32_t value, const uint8_t bits)
+{
+	if (bits > 32 || this->bitCount_ + bits > this->capacity_)
+	{
+		return false;
+	}
+
+	uint8_t remaining = bits;
+	while (remaining > 0)
+	{
+		const uint8_t free = 8 - (this->bitCount_ & 7);
+		const uint8_t count = remaining < free ? remaining : free;
+		const uint32_t chunk = (value >> (remaining - count)) & ((1UL << count) - 1);
+		this->buffer_[this->bitCount_ >> 3] |= chunk << (free - count);
+		this->bitCount_ += count;
+		remaining -= count;
+	}
+	return true;
+}
+
+/**
+ * @brief Get the number of written bits.
+ * @return number of bits
+ */
+const size_t BitWriter::getBitCount() const
+{
+	return this->bitCount_;
+}
+
+/**
+ * @brief Get the number of bits that still fit into the buffer.
+ * @return number of bits
+ */
+const size_t BitWriter::getFreeBits() const
+{
+	return this->capacity_ - this->bitCount_;
+}
+
+/**
+ * @brief Create a new instance of BitReader without a buffer.
+ */
+BitReader::BitReader()
+{
+	this->begin(nullptr, 0);
+}
+
+/**
+ * @brief Destroy the BitReader instance.
+ */
+BitReader::~BitReader()
+{
+}
+
+/**
+ * @brief Start reading from a buffer.
+ * @param buffer buffer written by a BitWriter
+ * @param bitCount number of valid bits
+ */
+void BitReader::begin(const uint8_t *buffer, const size_t bitCount)
+{
+	this->buffer_ = buffer;
+	this->bitCount_ = bitCount;
+	this->position_ = 0;
+}
+
+/**
+ * @brief Update the number of valid bits, e.g. after the writer appended more.
+ * @param bitCount number of valid bits
+ */
+void BitReader::setBitCount(const size_t bitCount)
+{
+	this->bitCount_ = bitCount;
+}
+
+/**
+ * @brief Read the next value.
+ * @param value reference that receives the value
+ * @param bits number of bits from 0 to 32
+ * @return true if the value was read, false at the end of the data
+ */
+const bool BitReader::read(uint32_t &value, const uint8_t bits)
+{
+	if (bits > 32 || this->position_ + bits > this->bitCount_)
+	{
+		return false;
+	}
+
+	uint32_t result = 0;
+	uint8_t remaining = bits;
+	while (remaining > 0)
+	{
+		const uint8_t available = 8 - (this->position_ & 7);
+		const uint8_t count = remaining < available ? remaining : available;
+		const uint32_t chunk = (this->buffer_[this->position_ >> 3] >> (available - count)) & ((1UL << count) - 1);
+		result = (result << count) | chunk;
+		this->position_ += count;
+		remaining -= count;
+	}
+	value = result;
+	return true;
+}
+
+/**
+ * @brief Get the number of bits that were read.
+ * @return position in bits
+ */
+const size_t BitReader::getPosition() const
+{
+	return this->position_;
+}
@@ -0,0 +1,91 @@
+/**
+ * @file Crc32.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the Crc32 class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "util/Crc32.h"
+
+/**
+ * Nibble wise lookup table of the reflected polynomial 0xEDB88320.
+ * It is a good trade off between speed and flash size.
+ */
+static const uint32_t CRC32_TABLE[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+/**
+ * @brief Create a new instance of Crc32.
+ */
+Crc32::Crc32()
+{
+	this->reset();
+}
+
+/**
+ * @brief Destroy the Crc32 instance.
+ */
+Crc32::~Crc32()
+{
+}
+
+/**
+ * @brief Add data to the checksum.
+ * @param data data to add
+ * @param length length of the data
+ */
+void Crc32::update(const uint8_t *data, const size_t length)
+{
+	uint32_t crc = this->crc_;
+	for (size_t i = 0; i < length; i++)
+	{
+		crc ^= data[i];
+		crc = (crc >> 4) ^ CRC32_TABLE[crc & 0x0F];
+		crc = (crc >> 4) ^ CRC32_TABLE[crc & 0x0F];
+	}
+	this->crc_ = crc;
+}
+
+/**
+ * @brief Start a new checksum.
+ */
+void Crc32::reset()
+{
+	this->crc_ = 0xFFFFFFFF;
+}
+
+/**
+ * @brief Get the checksum of all data added since the last reset.
+ * @return CRC-32 checksum
+ */
+const uint32_t Crc32::getValue() const
+{
+	return ~this->crc_;
+}
+
+/**
+ * @brief Calculate the checksum of a single buffer.
+ * @param data data to calculate the checksum for
+ * @param length length of the data
+ * @return CRC-32 checksum
+ */
+const uint32_t Crc32::calculate(const uint8_t *data, const size_t length)
+{
+	Crc32 crc;
+	crc.update(data, length);
+	return crc.getValue();
+}
@@ -0,0 +1,263 @@
+/**
+ * @file GzipEncoder.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the GzipEncoder class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "util/GzipEncoder.h"
+#include "util/Crc32.h"
+
+#include <string.h>
+
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+#define GZIP_MAX_DISTANCE 32768
+
+static const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/**
+ * @brief Create a new instance of GzipEncoder.
+ */
+GzipEncoder::GzipEncoder()
+{
+	this->output_ = nullptr;
+	this->capacity_ = 0;
+	this->length_ = 0;
+	this->bitBuffer_ = 0;
+	this->bitCount_ = 0;
+	this->overflow_ = false;
+}
+
+/**
+ * @brief Destroy the GzipEncoder instance.
+ */
+GzipEncoder::~GzipEncoder()
+{
+}
+
+/**
+ * @brief Compress a buffer into a gzip member.
+ * @param input data to compress
+ * @param length length of the data, at most GZIP_MAX_INPUT bytes
+ * @param output buffer that receives the gzip data
+ * @param capacity size of the output buffer
+ * @return length of the gzip data or 0 when the input is too large or the output buffer too small
+ */
+const size_t GzipEncoder::compress(const uint8_t *input, const size_t length, uint8_t *output, const size_t capacity)
+{
+	if (length > GZIP_MAX_INPUT)
+	{
+		return 0;
+	}
+
+	this->output_ = output;
+	this->capacity_ = capacity;
+	this->length_ = 0;
+	this->bitBuffer_ = 0;
+	this->bitCount_ = 0;
+	this->overflow_ = false;
+	memset(this->hashHead_, 0, sizeof(this->hashHead_));
+
+	// Header: magic, deflate, no flags, no time, no extra flags, unknown OS
+	static const uint8_t header[10] = {0x1F, 0x8B, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF};
+	for (uint8_t i = 0; i < sizeof(header); i++)
+	{
+		this->putByte_(header[i]);
+	}
+
+	// A single final block with the fixed Huffman codes
+	this->putBits_(1, 1);
+	this->putBits_(1, 2);
+
+	size_t position = 0;
+	while (position < length && !this->overflow_)
+	{
+		uint16_t matchLength = 0;
+		uint16_t matchDistance = 0;
+		if (position + GZIP_MIN_MATCH <= length)
+		{
+			// Look up the last position with the same 3 bytes and remember this one, positions are stored + 1
+			const uint16_t hash = this->hash_(&input[position]);
+			const size_t candidate = this->hashHead_[hash];
+			this->hashHead_[hash] = position + 1;
+			if (candidate > 0 && position - (candidate - 1) <= GZIP_MAX_DISTANCE)
+			{
+				const size_t start = candidate - 1;
+				const size_t maxLength = length - position < GZIP_MAX_MATCH ? length - position : GZIP_MAX_MATCH;
+				size_t matched = 0;
+				while (matched < maxLength && input[start + matched] == input[position + matched])
+				{
+					matched++;
+				}
+				if (matched >= GZIP_MIN_MATCH)
+				{
+					matchLength = matched;
+					matchDistance = position - start;
+				}
+			}
+		}
+
+		if (matchLength == 0)
+		{
+			this->putSymbol_(input[position]);
+			position++;
+			continue;
+		}
+
+		// Index the skipped positions as well, so later matches can refer to them
+		this->putMatch_(matchLength, matchDistance);
+		for (size_t i = position + 1; i < position + matchLength && i + GZIP_MIN_MATCH <= length; i++)
+		{
+			this->hashHead_[this->hash_(&input[i])] = i + 1;
+		}
+		position += matchLength;
+	}
+
+	// End of block, then the trailer with checksum and size of the input
+	this->putSymbol_(256);
+	this->flushBits_();
+	const uint32_t crc = Crc32::calculate(input, length);
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		this->putByte_(crc >> (i * 8));
+	}
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		this->putByte_(static_cast<uint32_t>(length) >> (i * 8));
+	}
+
+	return this->overflow_ ? 0 : this->length_;
+}
+
+/**
+ * @brief Append a byte to the output.
+ * @param value byte to append
+ */
+void GzipEncoder::putByte_(const uint8_t value)
+{
+	if (this->length_ >= this->capacity_)
+	{
+		this->overflow_ = true;
+		return;
+	}
+	this->output_[this->length_++] = value;
+}
+
+/**
+ * @brief Append bits to the output, least significant bit first as required by deflate.
+ * @param value bits to append
+ * @param count number of bits, at most 16
+ */
+void GzipEncoder::putBits_(const uint32_t value, const uint8_t count)
+{
+	this->bitBuffer_ |= value << this->bitCount_;
+	this->bitCount_ += count;
+	while (this->bitCount_ >= 8)
+	{
+		this->putByte_(this->bitBuffer_ & 0xFF);
+		this->bitBuffer_ >>= 8;
+		this->bitCount_ -= 8;
+	}
+}
+
+/**
+ * @brief Append a Huffman code. Codes are defined most significant bit first, so they are reversed.
+ * @param code Huffman code
+ * @param count length of the code in bits
+ */
+void GzipEncoder::putCode_(const uint16_t code, const uint8_t count)
+{
+	uint16_t reversed = 0;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		reversed |= ((code >> i) & 1) << (count - 1 - i);
+	}
+	this->putBits_(reversed, count);
+}
+
+/**
+ * @brief Append a literal/length symbol with its fixed Huffman code.
+ * @param symbol symbol from 0 to 287
+ */
+void GzipEncoder::putSymbol_(const uint16_t symbol)
+{
+	if (symbol < 144)
+	{
+		this->putCode_(0x30 + symbol, 8);
+	}
+	else if (symbol < 256)
+	{
+		this->putCode_(0x190 + symbol - 144, 9);
+	}
+	else if (symbol < 280)
+	{
+		this->putCode_(symbol - 256, 7);
+	}
+	else
+	{
+		this->putCode_(0xC0 + symbol - 280, 8);
+	}
+}
+
+/**
+ * @brief Append a back reference.
+ * @param length length of the match from 3 to 258
+ * @param distance distance of the match from 1 to 32768
+ */
+void GzipEncoder::putMatch_(const uint16_t length, const uint16_t distance)
+{
+	uint8_t lengthCode = 28;
+	while (LENGTH_BASE[lengthCode] > length)
+	{
+		lengthCode--;
+	}
+	this->putSymbol_(257 + lengthCode);
+	this->putBits_(length - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+
+	uint8_t distanceCode = 29;
+	while (DISTANCE_BASE[distanceCode] > distance)
+	{
+		distanceCode--;
+	}
+	this->putCode_(distanceCode, 5);
+	this->putBits_(distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+}
+
+/**
+ * @brief Pad the last partial byte with zero bits.
+ */
+void GzipEncoder::flushBits_()
+{
+	if (this->bitCount_ > 0)
+	{
+		this->putBits_(0, 8 - this->bitCount_);
+	}
+}
+
+/**
+ * @brief Hash the next 3 bytes.
+ * @param data pointer to at least 3 bytes
+ * @return hash value with GZIP_HASH_BITS bits
+ */
+const uint16_t GzipEncoder::hash_(const uint8_t *data) const
+{
+	const uint32_t value = (static_cast<uint32_t>(data[0]) << 16) | (static_cast<uint32_t>(data[1]) << 8) | data[2];
+	return static_cast<uint32_t>(value * 2654435761UL) >> (32 - GZIP_HASH_BITS);
+}
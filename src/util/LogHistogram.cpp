@@ -0,0 +1,149 @@
+/**
+ * @file LogHistogram.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the LogHistogram class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "util/LogHistogram.h"
+
+/**
+ * @brief Create a new and empty instance of LogHistogram.
+ */
+LogHistogram::LogHistogram()
+{
+	this->reset();
+}
+
+/**
+ * @brief Destroy the LogHistogram instance.
+ */
+LogHistogram::~LogHistogram()
+{
+}
+
+/**
+ * @brief Record a single value.
+ * @param value value to record, e.g. a latency in µs
+ */
+void LogHistogram::record(const uint32_t value)
+{
+	const uint8_t bucket = value == 0 ? 0 : 32 - __builtin_clz(value);
+	this->buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+	this->count_.fetch_add(1, std::memory_order_relaxed);
+
+	// The sum is split, 64 bit atomics are not lock free on the ESP32
+	const uint32_t sumLow = this->sumLow_.load(std::memory_order_relaxed);
+	if (sumLow + value < sumLow)
+	{
+		this->sumHigh_.fetch_add(1, std::memory_order_relaxed);
+	}
+	this->sumLow_.store(sumLow + value, std::memory_order_relaxed);
+
+	if (value > this->max_.load(std::memory_order_relaxed))
+	{
+		this->max_.store(value, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Remove all recorded values.
+ */
+void LogHistogram::reset()
+{
+	for (uint8_t i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+	{
+		this->buckets_[i].store(0, std::memory_order_relaxed);
+	}
+	this->count_.store(0, std::memory_order_relaxed);
+	this->sumLow_.store(0, std::memory_order_relaxed);
+	this->sumHigh_.store(0, std::memory_order_relaxed);
+	this->max_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the number of values in a single bucket.
+ * @param bucket index of the bucket
+ * @return number of values
+ */
+const uint32_t LogHistogram::getBucketCount(const uint8_t bucket) const
+{
+	return bucket < LOG_HISTOGRAM_BUCKETS ? this->buckets_[bucket].load(std::memory_order_relaxed) : 0;
+}
+
+/**
+ * @brief Get the number of recorded values.
+ * @return number of values
+ */
+const uint32_t LogHistogram::getCount() const
+{
+	return this->count_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the sum of all recorded values.
+ * @return sum of the values
+ */
+const uint64_t LogHistogram::getSum() const
+{
+	return (static_cast<uint64_t>(this->sumHigh_.load(std::memory_order_relaxed)) << 32) | this->sumLow_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the largest recorded value.
+ * @return largest value
+ */
+const uint32_t LogHistogram::getMax() const
+{
+	return this->max_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Get the upper bound of the bucket that contains the given percentile.
+ * @param percentile percentile between 0 and 100
+ * @return upper bound of the bucket, it is never larger than the maximum
+ */
+const uint32_t LogHistogram::getPercentile(const float percentile) const
+{
+	const uint32_t count = this->getCount();
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	const uint32_t rank = static_cast<uint32_t>(count * percentile / 100.0f + 0.5f);
+	uint32_t total = 0;
+	for (uint8_t i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+	{
+		total += this->getBucketCount(i);
+		if (total >= rank && total > 0)
+		{
+			const uint32_t bound = LogHistogram::getUpperBound(i);
+			return bound < this->getMax() ? bound : this->getMax();
+		}
+	}
+	return this->getMax();
+}
+
+/**
+ * @brief Get the largest value that falls into a bucket.
+ * @param bucket index of the bucket
+ * @return upper bound, inclusive
+ */
+const uint32_t LogHistogram::getUpperBound(const uint8_t bucket)
+{
+	return bucket >= 32 ? UINT32_MAX : (1UL << bucket) - 1;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file MemoryReport.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the MemoryReport class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifdef ARDUINO
+
+#include "util/MemoryReport.h"
+
+#include <stdio.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * @brief Create a new and empty instance of MemoryReport.
+ */
+MemoryReport::MemoryReport()
+{
+	this->taskCount_ = 0;
+	this->objectCount_ = 0;
+}
+
+/**
+ * @brief Destroy the MemoryReport instance.
+ */
+MemoryReport::~MemoryReport()
+{
+}
+
+/**
+ * @brief Add a task whose stack headroom is reported.
+ * @param name name of the task, the string must stay valid
+ */
+void MemoryReport::addTask(const char *name)
+{
+	if (this->taskCount_ < MEMORY_REPORT_MAX_TASKS)
+	{
+		this->taskNames_[this->taskCount_++] = name;
+	}
+}
+
+/**
+ * @brief Add a static object whose size is reported.
+ * @param name name of the object, the string must stay valid
+ * @param size size in bytes
+ */
+void MemoryReport::addObject(const char *name, const size_t size)
+{
+	if (this->objectCount_ < MEMORY_REPORT_MAX_OBJECTS)
+	{
+		this->objects_[this->objectCount_++] = {name, size};
+	}
+}
+
+/**
+ * @brief Format the report.
+ * @param buffer buffer that receives the zero terminated report
+ * @param size size of the buffer
+ * @return length of the report
+ */
+const size_t MemoryReport::format(char *buffer, const size_t size) const
+{
+	size_t length = 0;
+	auto append = [&](const char *format, auto... args)
+	{
+		if (length < size)
+		{
+			const int written = snprintf(&buffer[length], size - length, format, args...);
+			length = written > 0 ? (length + written < size ? length + written : size - 1) : length;
+		}
+	};
+
+	append("Heap (internal): free %u, minimum free %u, largest block %u, total %u\n",
+		   heap_caps_get_free_size(MALLOC_CAP_INTERNAL), heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+		   heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL), heap_caps_get_total_size(MALLOC_CAP_INTERNAL));
+	if (heap_caps_get_total_size(MALLOC_CAP_SPIRAM) > 0)
+	{
+		append("Heap (PSRAM): free %u, minimum free %u, largest block %u, total %u\n",
+			   heap_caps_get_free_size(MALLOC_CAP_SPIRAM), heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM),
+			   heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM), heap_caps_get_total_size(MALLOC_CAP_SPIRAM));
+	}
+	else
+	{
+		append("Heap (PSRAM): not available\n");
+	}
+
+	// ESP-IDF reports the high water mark in bytes
+	append("Stack headroom:\n");
+	for (uint8_t i = 0; i < this->taskCount_; i++)
+	{
+		TaskHandle_t task = xTaskGetHandle(this->taskNames_[i]);
+		if (task != nullptr)
+		{
+			append("  %-16s %6u\n", this->taskNames_[i], static_cast<unsigned int>(uxTaskGetStackHighWaterMark(task)));
+		}
+	}
+
+	size_t total = 0;
+	append("Static objects:\n");
+	for (uint8_t i = 0; i < this->objectCount_; i++)
+	{
+		append("  %-16s %6u\n", this->objects_[i].name, static_cast<unsigned int>(this->objects_[i].size));
+		total += this->objects_[i].size;
+	}
+	append("  %-16s %6u\n", "total", static_cast<unsigned int>(total));
+	return length;
+}
+
+#endif
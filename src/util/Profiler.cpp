@@ -0,0 +1,131 @@
+/**
+ * @file Profiler.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the Profiler class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "util/Profiler.h"
+
+#ifdef SBMS_PROFILING
+
+#include <stdio.h>
+
+LogHistogram Profiler::histograms_[PROFILE_STAGE_COUNT];
+
+/**
+ * @brief Record the duration of a stage.
+ * @param stage measured stage
+ * @param ticks duration in ticks
+ */
+void Profiler::record(const ProfileStage stage, const uint32_t ticks)
+{
+	if (stage < PROFILE_STAGE_COUNT)
+	{
+		Profiler::histograms_[stage].record(ticks);
+	}
+}
+
+/**
+ * @brief Clear all histograms.
+ */
+void Profiler::reset()
+{
+	for (uint8_t i = 0; i < PROFILE_STAGE_COUNT; i++)
+	{
+		Profiler::histograms_[i].reset();
+	}
+}
+
+/**
+ * @brief Get the histogram of a stage.
+ * @param stage stage
+ * @return histogram in ticks
+ */
+const LogHistogram &Profiler::getHistogram(const ProfileStage stage)
+{
+	return Profiler::histograms_[stage < PROFILE_STAGE_COUNT ? stage : 0];
+}
+
+/**
+ * @brief Get the name of a stage.
+ * @param stage stage
+ * @return name
+ */
+const char *Profiler::getStageName(const ProfileStage stage)
+{
+	switch (stage)
+	{
+	case PROFILE_STAGE_DECODE:
+		return "decode";
+	case PROFILE_STAGE_SERIAL_DUMP:
+		return "serial-dump";
+	case PROFILE_STAGE_PUBLISH:
+		return "publish";
+	case PROFILE_STAGE_RASTERIZE:
+		return "rasterize";
+	case PROFILE_STAGE_SPI_TRANSFER:
+		return "spi-transfer";
+	case PROFILE_STAGE_REFRESH:
+		return "refresh";
+	case PROFILE_STAGE_COUNT:
+		break;
+	}
+	return "unknown";
+}
+
+/**
+ * @brief Get the resolution of the ticks.
+ * @return ticks per µs
+ */
+const uint32_t Profiler::getTicksPerUs()
+{
+#if defined(__XTENSA__)
+	return 1;
+#else
+	return 1000;
+#endif
+}
+
+/**
+ * @brief Format a table of all stages. Percentiles are the upper bounds of the log2 buckets.
+ * @param buffer buffer that receives the zero terminated table
+ * @param size size of the buffer
+ * @return length of the table
+ */
+const size_t Profiler::format(char *buffer, const size_t size)
+{
+	const double ticksPerUs = Profiler::getTicksPerUs();
+	size_t length = 0;
+	int written = snprintf(buffer, size, "%-14s %8s %10s %10s %10s %10s %12s\n", "stage", "count", "p50 us", "p90 us", "p99 us", "max us", "total ms");
+	for (uint8_t i = 0; written > 0 && length + written < size; i++)
+	{
+		length += written;
+		if (i >= PROFILE_STAGE_COUNT)
+		{
+			break;
+		}
+
+		const LogHistogram &histogram = Profiler::histograms_[i];
+		written = snprintf(&buffer[length], size - length, "%-14s %8lu %10.1f %10.1f %10.1f %10.1f %12.1f\n",
+						   Profiler::getStageName(static_cast<ProfileStage>(i)), static_cast<unsigned long>(histogram.getCount()),
+						   histogram.getPercentile(50.0f) / ticksPerUs, histogram.getPercentile(90.0f) / ticksPerUs,
+						   histogram.getPercentile(99.0f) / ticksPerUs, histogram.getMax() / ticksPerUs, histogram.getSum() / ticksPerUs / 1000.0);
+	}
+	return length;
+}
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ * @file RollingWindow.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the RollingWindow class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "util/RollingWindow.h"
+
+/**
+ * @brief Create a new and empty instance of RollingWindow.
+ */
+RollingWindow::RollingWindow()
+{
+	this->setLength(ROLLING_WINDOW_BUCKETS * 1000);
+}
+
+/**
+ * @brief Destroy the RollingWindow instance.
+ */
+RollingWindow::~RollingWindow()
+{
+}
+
+/**
+ * @brief Set the length of the window and clear it.
+ * @param lengthMs length of the window in ms
+ */
+void RollingWindow::setLength(const uint32_t lengthMs)
+{
+	this->lengthMs_ = lengthMs;
+	this->bucketMs_ = lengthMs >= ROLLING_WINDOW_BUCKETS ? lengthMs / ROLLING_WINDOW_BUCKETS : 1;
+	this->reset();
+}
+
+/**
+ * @brief Add a sample.
+ * @param value value of the sample
+ * @param nowMs time of the sample in ms
+ */
+void RollingWindow::add(const float value, const uint32_t nowMs)
+{
+	const uint32_t index = nowMs / this->bucketMs_;
+	if (this->current_.count > 0 && this->current_.index != index)
+	{
+		this->close_();
+	}
+	this->expire_(index);
+
+	if (this->current_.count == 0)
+	{
+		this->current_ = {index, value, value, value, 1};
+		return;
+	}
+
+	this->current_.min = value < this->current_.min ? value : this->current_.min;
+	this->current_.max = value > this->current_.max ? value : this->current_.max;
+	this->current_.sum += value;
+	this->current_.count++;
+}
+
+/**
+ * @brief Remove all samples.
+ */
+void RollingWindow::reset()
+{
+	this->current_ = {0, 0.0f, 0.0f, 0.0f, 0};
+	this->head_ = 0;
+	this->count_ = 0;
+	this->minHead_ = 0;
+	this->minCount_ = 0;
+	this->maxHead_ = 0;
+	this->maxCount_ = 0;
+	this->sum_ = 0.0;
+	this->samples_ = 0;
+}
+
+/**
+ * @brief Get the length of the window.
+ * @return length in ms
+ */
+const uint32_t RollingWindow::getLength() const
+{
+	return this->lengthMs_;
+}
+
+/**
+ * @brief Get the number of samples in the window.
+ * @return number of samples
+ */
+const uint32_t RollingWindow::getCount() const
+{
+	return this->samples_ + this->current_.count;
+}
+
+/**
+ * @brief Get the smallest sample in the window.
+ * @return smallest sample or 0 if the window is empty
+ */
+const float RollingWindow::getMin() const
+{
+	if (this->minCount_ == 0)
+	{
+		return this->current_.count > 0 ? this->current_.min : 0.0f;
+	}
+	const float min = this->buckets_[this->minDeque_[this->minHead_]].min;
+	return this->current_.count > 0 && this->current_.min < min ? this->current_.min : min;
+}
+
+/**
+ * @brief Get the largest sample in the window.
+ * @return largest sample or 0 if the window is empty
+ */
+const float RollingWindow::getMax() const
+{
+	if (this->maxCount_ == 0)
+	{
+		return this->current_.count > 0 ? this->current_.max : 0.0f;
+	}
+	const float max = this->buckets_[this->maxDeque_[this->maxHead_]].max;
+	return this->current_.count > 0 && this->current_.max > max ? this->current_.max : max;
+}
+
+/**
+ * @brief Get the mean of the samples in the window.
+ * @return mean or 0 if the window is empty
+ */
+const float RollingWindow::getMean() const
+{
+	const uint32_t count = this->getCount();
+	return count > 0 ? (this->sum_ + this->current_.sum) / count : 0.0f;
+}
+
+/**
+ * @brief Move the current bucket into the ring and the deques.
+ */
+void RollingWindow::close_()
+{
+	const uint8_t slot = (this->head_ + this->count_) % ROLLING_WINDOW_BUCKETS;
+	this->buckets_[slot] = this->current_;
+	this->count_++;
+	this->sum_ += this->current_.sum;
+	this->samples_ += this->current_.count;
+
+	// Buckets that can never be the minimum or maximum again are dropped from the back
+	while (this->minCount_ > 0 && this->buckets_[this->minDeque_[(this->minHead_ + this->minCount_ - 1) % ROLLING_WINDOW_BUCKETS]].min >= this->current_.min)
+	{
+		this->minCount_--;
+	}
+	this->minDeque_[(this->minHead_ + this->minCount_++) % ROLLING_WINDOW_BUCKETS] = slot;
+
+	while (this->maxCount_ > 0 && this->buckets_[this->maxDeque_[(this->maxHead_ + this->maxCount_ - 1) % ROLLING_WINDOW_BUCKETS]].max <= this->current_.max)
+	{
+		this->maxCount_--;
+	}
+	this->maxDeque_[(this->maxHead_ + this->maxCount_++) % ROLLING_WINDOW_BUCKETS] = slot;
+
+	this->current_.count = 0;
+}
+
+/**
+ * @brief Remove the buckets that left the window.
+ * The distance is unsigned, so a wrap of the timer only clears the window.
+ * @param index index of the current bucket
+ */
+void RollingWindow::expire_(const uint32_t index)
+{
+	while (this->count_ > 0 && index - this->buckets_[this->head_].index >= ROLLING_WINDOW_BUCKETS)
+	{
+		// The oldest bucket can only be at the front of the deques
+		if (this->minCount_ > 0 && this->minDeque_[this->minHead_] == this->head_)
+		{
+			this->minHead_ = (this->minHead_ + 1) % ROLLING_WINDOW_BUCKETS;
+			this->minCount_--;
+		}
+		if (this->maxCount_ > 0 && this->maxDeque_[this->maxHead_] == this->head_)
+		{
+			this->maxHead_ = (this->maxHead_ + 1) % ROLLING_WINDOW_BUCKETS;
+			this->maxCount_--;
+		}
+		this->sum_ -= this->buckets_[this->head_].sum;
+		this->samples_ -= this->buckets_[this->head_].count;
+		this->head_ = (this->head_ + 1) % ROLLING_WINDOW_BUCKETS;
+		this->count_--;
+	}
+
+	// Avoid drift of the running sum once the window is empty
+	if (this->count_ == 0)
+	{
+		this->sum_ = 0.0;
+	}
+}
@@ -0,0 +1,175 @@
+/**
+ * @file Trace.cpp
+ * @author TheRealKasumi
+ * @brief Implementation of the Trace class.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "util/Trace.h"
+
+#ifdef SBMS_TRACING
+
+#include <stdio.h>
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#endif
+
+Trace::Record Trace::records_[TRACE_CORES][TRACE_EVENTS_PER_CORE];
+std::atomic<uint32_t> Trace::heads_[TRACE_CORES];
+std::atomic<bool> Trace::enabled_(true);
+
+/**
+ * @brief Record an event on the current core.
+ * @param event event
+ * @param phase begin, end or instant
+ * @param argument value shown with the event
+ */
+void Trace::record(const TraceEvent event, const Phase phase, const uint32_t argument)
+{
+	if (!Trace::enabled_.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+#ifdef ARDUINO
+	const uint8_t core = xPortGetCoreID();
+	const uint32_t timestampUs = static_cast<uint32_t>(esp_timer_get_time());
+#else
+	const uint8_t core = 0;
+	const uint32_t timestampUs = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+
+	const uint32_t index = Trace::heads_[core].fetch_add(1, std::memory_order_relaxed) % TRACE_EVENTS_PER_CORE;
+	Record &record = Trace::records_[core][index];
+	record.timestampUs = timestampUs;
+	record.event = event;
+	record.phase = phase;
+	record.core = core;
+	record.argument = argument;
+}
+
+/**
+ * @brief Pause or resume the recording.
+ * @param enabled true to record events
+ */
+void Trace::setEnabled(const bool enabled)
+{
+	Trace::enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Check if events are recorded.
+ * @return true when events are recorded
+ */
+const bool Trace::isEnabled()
+{
+	return Trace::enabled_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Remove all recorded events.
+ */
+void Trace::clear()
+{
+	for (uint8_t i = 0; i < TRACE_CORES; i++)
+	{
+		Trace::heads_[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Write all events as text lines, oldest first per core. Recording is paused meanwhile.
+ * Format: TRACE-NAME <event> <name> for every event name, then TRACE <core> <µs> <phase> <event> <argument>.
+ * @param writeLine function that writes a single zero terminated line without line feed
+ */
+void Trace::dump(void (*writeLine)(const char *line))
+{
+	const bool enabled = Trace::isEnabled();
+	Trace::setEnabled(false);
+
+	char line[64];
+	for (uint8_t i = 0; i < TRACE_EVENT_COUNT; i++)
+	{
+		snprintf(line, sizeof(line), "TRACE-NAME %u %s", i, Trace::getEventName(static_cast<TraceEvent>(i)));
+		writeLine(line);
+	}
+
+	for (uint8_t core = 0; core < TRACE_CORES; core++)
+	{
+		const uint32_t head = Trace::heads_[core].load(std::memory_order_relaxed);
+		const uint32_t count = head < TRACE_EVENTS_PER_CORE ? head : TRACE_EVENTS_PER_CORE;
+		for (uint32_t i = head - count; i != head; i++)
+		{
+			const Record &record = Trace::records_[core][i % TRACE_EVENTS_PER_CORE];
+			snprintf(line, sizeof(line), "TRACE %u %lu %c %u %lu", record.core, static_cast<unsigned long>(record.timestampUs),
+					 record.phase, record.event, static_cast<unsigned long>(record.argument));
+			writeLine(line);
+		}
+	}
+
+	Trace::setEnabled(enabled);
+}
+
+/**
+ * @brief Get the name of an event.
+ * @param event event
+ * @return name without spaces
+ */
+const char *Trace::getEventName(const TraceEvent event)
+{
+	switch (event)
+	{
+	case TRACE_UART_RECEIVE:
+		return "uart-receive";
+	case TRACE_DECODE:
+		return "decode";
+	case TRACE_OUTPUTS:
+		return "outputs";
+	case TRACE_QUEUE_SEND:
+		return "queue-send";
+	case TRACE_QUEUE_RECEIVE:
+		return "queue-receive";
+	case TRACE_PUBLISH:
+		return "publish";
+	case TRACE_RASTERIZE:
+		return "rasterize";
+	case TRACE_DISPLAY_UPDATE:
+		return "display-update";
+	case TRACE_LINK_STATE:
+		return "link-state";
+	case TRACE_INFLUX_UPLOAD:
+		return "influx-upload";
+	case TRACE_EVENT_COUNT:
+		break;
+	}
+	return "unknown";
+}
+
+/**
+ * @brief Get the size of the event buffers of all cores.
+ * @return size in bytes
+ */
+const size_t Trace::getBufferSize()
+{
+	return sizeof(Trace::records_);
+}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+ * @file flash_log_sim.cpp
+ * @author TheRealKasumi
+ * @brief Host tool that runs the flash log against a file with simulated power cuts.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * Build on the host from the repository root:
+ *   g++ -std=c++17 -O2 -Iinclude -o flash_log_sim tools/flash_log_sim/flash_log_sim.cpp src/history/FlashLog.cpp src/history/FileLogStorage.cpp src/util/Crc32.cpp
+ *
+ * Usage:
+ *   flash_log_sim <file> [rounds, default 500] [seed, default 1]
+ *
+ * Every round mounts the log, replays and checks all records and then appends records until the power is cut
+ * after a random number of written bytes. Records contain their number and a pattern derived from it.
+ * The replayed numbers must be consecutive and must include every record that was flushed before the power cut.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "history/FileLogStorage.h"
+#include "history/FlashLog.h"
+
+#define SIM_STORAGE_SIZE (128 * 1024)
+#define SIM_SEGMENT_SIZE (16 * 1024)
+#define SIM_MAX_RECORD_SIZE 1100
+
+/**
+ * @brief Fill a record with its number and a pattern.
+ * @param record buffer of the record
+ * @param number number of the record
+ * @return length of the record
+ */
+static size_t makeRecord(uint8_t *record, const uint32_t number)
+{
+	const size_t length = sizeof(number) + (number * 2654435761UL) % (SIM_MAX_RECORD_SIZE - sizeof(number));
+	memcpy(record, &number, sizeof(number));
+	for (size_t i = sizeof(number); i < length; i++)
+	{
+		record[i] = static_cast<uint8_t>(number * 31 + i);
+	}
+	return length;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <file> [rounds] [seed]\n", argv[0]);
+		return 1;
+	}
+	const uint32_t rounds = argc > 2 ? strtoul(argv[2], nullptr, 10) : 500;
+	srand(argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+
+	remove(argv[1]);
+	FileLogStorage storage(argv[1], SIM_STORAGE_SIZE);
+	FlashLog log;
+	uint32_t nextNumber = 0;
+	uint32_t durableNumber = 0;
+	bool anyDurable = false;
+	uint32_t tornRecords = 0;
+	uint32_t eraseCount = 0;
+	uint8_t record[SIM_MAX_RECORD_SIZE];
+	uint8_t expected[SIM_MAX_RECORD_SIZE];
+
+	for (uint32_t round = 0; round < rounds; round++)
+	{
+		if (!log.begin(&storage, SIM_SEGMENT_SIZE))
+		{
+			fprintf(stderr, "round %u: mount failed\n", round);
+			return 1;
+		}
+		tornRecords += log.getRecoveredTornRecords();
+
+		// Replay and check the records
+		LogCursor cursor;
+		size_t length = 0;
+		uint32_t count = 0;
+		uint32_t last = 0;
+		log.rewind(cursor);
+		while (log.next(cursor, record, sizeof(record), length))
+		{
+			uint32_t number = 0;
+			memcpy(&number, record, sizeof(number));
+			if (length != makeRecord(expected, number) || memcmp(record, expected, length) != 0)
+			{
+				fprintf(stderr, "round %u: record %u is corrupted\n", round, number);
+				return 1;
+			}
+			if (count > 0 && number != last + 1)
+			{
+				fprintf(stderr, "round %u: record %u follows record %u\n", round, number, last);
+				return 1;
+			}
+			last = number;
+			count++;
+		}
+		if (anyDurable && (count == 0 || last < durableNumber))
+		{
+			fprintf(stderr, "round %u: flushed record %u was lost\n", round, durableNumber);
+			return 1;
+		}
+		if (count > 0)
+		{
+			nextNumber = last + 1;
+		}
+
+		// Append until the power is cut
+		storage.setPowerCutAfter(rand() % (3 * SIM_SEGMENT_SIZE));
+		while (!storage.isPoweredOff())
+		{
+			const uint32_t number = nextNumber++;
+			if (!log.append(record, makeRecord(record, number)))
+			{
+				break;
+			}
+			if (rand() % 4 == 0 && log.flush())
+			{
+				durableNumber = number;
+				anyDurable = true;
+			}
+		}
+		eraseCount += log.getEraseCount();
+		log.end();
+	}
+
+	printf("%u rounds passed, %u torn records recovered, %u segments erased, last record %u\n", rounds, tornRecords, eraseCount, nextNumber);
+	return 0;
+}
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""
+Attribute the flash and RAM use of the firmware to its modules using the linker map.
+
+PlatformIO runs this after every build (extra_scripts in platformio.ini) and
+prints a table for the modules reader, fonts, icons, display, app and framework.
+It can also be run on an existing map file:
+
+    tools/memory_map.py .pio/build/esp32/firmware.map
+
+Fonts and icons are headers that end up in main.cpp, they are recognized by
+their symbol names. Arduino builds with -ffunction-sections and -fdata-sections,
+so every symbol has its own input section in the map.
+"""
+import os
+import re
+import sys
+
+# ESP32 address ranges
+REGIONS = (
+    ("flash_code", 0x400C2000, 0x40C00000),
+    ("flash_const", 0x3F400000, 0x3F800000),
+    ("iram", 0x40070000, 0x400C0000),
+    ("dram", 0x3FFAE000, 0x40000000),
+    ("rtc", 0x50000000, 0x50002000),
+)
+
+MODULES = ("reader", "fonts", "icons", "display", "app", "framework")
+
+# The icons are const arrays at namespace scope with internal linkage, so their
+# sections are named like .rodata._ZL11icon_charge
+ICON_SECTION = re.compile(r"(\.|_ZL\d+)icon_")
+SECTION_LINE = re.compile(r"^ (\.\S+|COMMON)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*))?$")
+ADDRESS_LINE = re.compile(r"^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*)$")
+
+
+def get_module(section, obj):
+    path = obj.replace("\\", "/")
+    if "SourceSans3_" in section:
+        return "fonts"
+    if ICON_SECTION.search(section):
+        return "icons"
+    if "GxEPD2" in path or "Adafruit_GFX" in path or "Adafruit_BusIO" in path or "/lib/SPI/" in path:
+        return "display"
+    if "/src/bms/" in path:
+        return "reader"
+    if "/src/" in path and "framework-" not in path:
+        return "app"
+    return "framework"
+
+
+def get_region(section, address):
+    for name, start, end in REGIONS:
+        if start <= address < end:
+            if name == "dram":
+                return "bss" if section.startswith((".bss", ".dram1.bss", "COMMON")) or ".bss." in section else "data"
+            return name
+    return None
+
+
+def parse(lines):
+    usage = {module: {} for module in MODULES}
+    in_map = False
+    pending = None
+
+    for line in lines:
+        line = line.rstrip("\n")
+        if not in_map:
+            in_map = line.startswith("Linker script and memory map")
+            continue
+
+        # Long section names are followed by the address on the next line
+        if pending is not None:
+            match = ADDRESS_LINE.match(line)
+            section, pending = pending, None
+            if match:
+                record(usage, section, *match.groups())
+                continue
+
+        match = SECTION_LINE.match(line)
+        if not match:
+            continue
+        section, address, size, obj = match.groups()
+        if address is None:
+            pending = section
+        else:
+            record(usage, section, address, size, obj)
+    return usage
+
+
+def record(usage, section, address, size, obj):
+    address, size = int(address, 16), int(size, 16)
+    region = get_region(section, address)
+    if size == 0 or region is None or obj.startswith("load address"):
+        return
+    counters = usage[get_module(section, obj)]
+    counters[region] = counters.get(region, 0) + size
+
+
+def print_table(usage, out=sys.stdout):
+    columns = ("flash_code", "flash_const", "iram", "data", "bss", "rtc")
+    out.write("%-10s %11s %11s %8s %8s %8s %6s %10s %10s\n"
+              % ("module", "flash code", "flash const", "iram", "data", "bss", "rtc", "flash", "ram"))
+    totals = {column: 0 for column in columns}
+    for module in MODULES:
+        counters = usage[module]
+        for column in columns:
+            totals[column] += counters.get(column, 0)
+        write_row(out, module, counters, columns)
+    write_row(out, "total", totals, columns)
+
+
+def write_row(out, name, counters, columns):
+    values = [counters.get(column, 0) for column in columns]
+    # IRAM code and initialized data are copied from the flash image at boot
+    flash = counters.get("flash_code", 0) + counters.get("flash_const", 0) + counters.get("iram", 0) + counters.get("data", 0)
+    ram = counters.get("iram", 0) + counters.get("data", 0) + counters.get("bss", 0)
+    out.write("%-10s %11d %11d %8d %8d %8d %6d %10d %10d\n" % tuple([name] + values + [flash, ram]))
+
+
+def report(map_path):
+    with open(map_path, "r", errors="replace") as map_file:
+        print_table(parse(map_file))
+
+
+try:
+    Import("env")  # noqa: F821, only defined when PlatformIO runs the script
+
+    map_path = os.path.join(env.subst("$BUILD_DIR"), env.subst("${PROGNAME}.map"))  # noqa: F821
+    env.Append(LINKFLAGS=["-Wl,-Map," + map_path])  # noqa: F821
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", lambda *args, **kwargs: report(map_path))  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        if len(sys.argv) != 2:
+            sys.stderr.write("usage: %s <firmware.map>\n" % sys.argv[0])
+            sys.exit(1)
+        report(sys.argv[1])
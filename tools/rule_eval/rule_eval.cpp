@@ -0,0 +1,195 @@
+/**
+ * @file rule_eval.cpp
+ * @author TheRealKasumi
+ * @brief Host tool that runs a rule set against a recorded capture of the BMS serial data.
+ * @copyright Copyright (c) 2024 TheRealKasumi
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*
+ * Build on the host from the repository root:
+ *   g++ -std=c++17 -O2 -Iinclude -o rule_eval tools/rule_eval/rule_eval.cpp src/rules/RuleEngine.cpp src/bms/SmartBmsDecoder.cpp src/bms/SmartBmsData.cpp
+ *
+ * Usage:
+ *   rule_eval <rules.txt> <capture.bin> [frame period in ms, default 1000] [output names, default relay1,relay2,relay3,relay4]
+ *   rule_eval --self-test
+ *
+ * The capture is the raw serial data of the BMS, e.g. recorded with cat /dev/ttyUSB0 > capture.bin.
+ * Frames are found with their checksum, so partial frames at the start are skipped.
+ * Every change of an output is printed with the time and the data that caused it.
+ * The self test compiles a few fixed rule sets, e.g. deeply nested ones that must be rejected, and returns 1 on a failure.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "bms/SmartBmsDecoder.h"
+#include "rules/RuleEngine.h"
+
+/**
+ * @brief Read a whole file.
+ * @param path path of the file
+ * @param content receives the content
+ * @return true when the file was read
+ */
+static bool readFile(const char *path, std::vector<uint8_t> &content)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	uint8_t chunk[4096];
+	size_t length = 0;
+	while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0)
+	{
+		content.insert(content.end(), chunk, chunk + length);
+	}
+	fclose(file);
+	return true;
+}
+
+/**
+ * @brief Compile a rule set and compare the result.
+ * @param name name of the case
+ * @param text rule set
+ * @param expected expected result
+ * @return true when the result matches
+ */
+static bool checkCompile(const char *name, const std::string &text, const RuleError expected)
+{
+	const char *outputNames[] = {"relay1"};
+	RuleEngine ruleEngine(outputNames, 1);
+	const RuleError error = ruleEngine.compile(text.c_str());
+	printf("%-24s %s (%s)\n", name, error == expected ? "ok" : "FAILED", RuleEngine::getErrorMessage(error));
+	return error == expected;
+}
+
+/**
+ * @brief Check that the nesting is limited, the parser would overflow the stack otherwise.
+ * @return 0 when all cases passed, 1 otherwise
+ */
+static int runSelfTest()
+{
+	std::string parentheses = "relay1 = on ";
+	std::string negations = "relay1 = on ";
+	for (uint16_t i = 0; i < 1000; i++)
+	{
+		parentheses += "(";
+		negations += "not ";
+	}
+	parentheses += "allowedToCharge";
+	negations += "allowedToCharge";
+
+	// Every not and every parenthesis is one level
+	std::string allowed = "relay1 = on ";
+	for (uint8_t i = 0; i < RULE_MAX_DEPTH; i++)
+	{
+		allowed += i % 2 == 0 ? "(" : "not ";
+	}
+	allowed += "allowedToCharge";
+	for (uint8_t i = 0; i < RULE_MAX_DEPTH; i += 2)
+	{
+		allowed += ")";
+	}
+
+	bool ok = checkCompile("simple", "relay1 = on packSoc < 20 off packSoc > 30", RuleError::RULE_OK);
+	ok = checkCompile("deep parentheses", parentheses, RuleError::RULE_ERR_TOO_COMPLEX) && ok;
+	ok = checkCompile("deep negations", negations, RuleError::RULE_ERR_TOO_COMPLEX) && ok;
+	ok = checkCompile("nesting at the limit", allowed, RuleError::RULE_OK) && ok;
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc == 2 && strcmp(argv[1], "--self-test") == 0)
+	{
+		return runSelfTest();
+	}
+	if (argc < 3)
+	{
+		fprintf(stderr, "usage: %s <rules.txt> <capture.bin> [period ms] [output names] | --self-test\n", argv[0]);
+		return 2;
+	}
+
+	const uint32_t periodMs = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1000;
+	char outputList[256] = "relay1,relay2,relay3,relay4";
+	if (argc > 4)
+	{
+		snprintf(outputList, sizeof(outputList), "%s", argv[4]);
+	}
+
+	const char *outputNames[RULE_MAX_OUTPUTS];
+	uint8_t outputCount = 0;
+	for (char *name = strtok(outputList, ","); name != nullptr && outputCount < RULE_MAX_OUTPUTS; name = strtok(nullptr, ","))
+	{
+		outputNames[outputCount++] = name;
+	}
+
+	std::vector<uint8_t> rules;
+	std::vector<uint8_t> capture;
+	if (!readFile(argv[1], rules) || !readFile(argv[2], capture))
+	{
+		fprintf(stderr, "error: failed to read the input files\n");
+		return 2;
+	}
+	rules.push_back('\0');
+
+	RuleEngine ruleEngine(outputNames, outputCount);
+	const RuleError error = ruleEngine.compile(reinterpret_cast<const char *>(rules.data()));
+	if (error != RuleError::RULE_OK)
+	{
+		fprintf(stderr, "%s:%u: %s\n", argv[1], ruleEngine.getErrorLine(), RuleEngine::getErrorMessage(error));
+		return 1;
+	}
+	printf("%u rules, %u instructions\n", ruleEngine.getRuleCount(), ruleEngine.getCodeSize());
+
+	// Slide over the capture until a valid frame is found
+	SmartBmsDecoder decoder;
+	uint32_t frames = 0;
+	uint32_t skipped = 0;
+	uint8_t outputMask = 0;
+	size_t offset = 0;
+	while (offset + SBMS_FRAME_SIZE <= capture.size())
+	{
+		SmartBmsData smartBmsData;
+		if (decoder.decode(&capture[offset], &smartBmsData) != SmartBmsError::SBMS_OK)
+		{
+			offset++;
+			skipped++;
+			continue;
+		}
+
+		const uint32_t nowMs = frames * periodMs;
+		const uint8_t newMask = ruleEngine.evaluate(smartBmsData, nowMs);
+		for (uint8_t i = 0; i < outputCount; i++)
+		{
+			if ((newMask ^ outputMask) & (1 << i))
+			{
+				printf("%10.1f s  %-12s %s  soc=%u%% voltage=%.2fV current=%.2fA\n", nowMs / 1000.0, outputNames[i], newMask & (1 << i) ? "ON " : "OFF",
+					   smartBmsData.getPackSoc(), smartBmsData.getPackVoltage(), smartBmsData.getPackCurrent());
+			}
+		}
+		outputMask = newMask;
+		offset += SBMS_FRAME_SIZE;
+		frames++;
+	}
+
+	printf("%u frames, %u bytes skipped\n", frames, skipped);
+	return 0;
+}
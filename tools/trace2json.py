@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+"""
+Convert the output of the 'trace' serial command into Chrome trace_event JSON.
+
+Usage:
+    pio device monitor | tee serial.log      (then send 'trace')
+    tools/trace2json.py serial.log > trace.json
+
+Open trace.json in https://ui.perfetto.dev or chrome://tracing.
+Every event gets its own track per core, so begin and end always nest,
+even when tasks on the same core preempt each other.
+"""
+import json
+import re
+import sys
+
+NAME_LINE = re.compile(r"TRACE-NAME (\d+) (\S+)")
+EVENT_LINE = re.compile(r"TRACE (\d+) (\d+) ([BEi]) (\d+) (\d+)")
+
+
+def convert(lines):
+    names = {}
+    events = []
+    last_timestamp = {}
+    wraps = {}
+    open_tracks = set()
+
+    for line in lines:
+        match = NAME_LINE.search(line)
+        if match:
+            names[int(match.group(1))] = match.group(2)
+            continue
+
+        match = EVENT_LINE.search(line)
+        if not match:
+            continue
+        core, timestamp, phase, event, argument = match.groups()
+        core, timestamp, event, argument = int(core), int(timestamp), int(event), int(argument)
+
+        # The timestamps are 32 bit µs, unwrap them per core
+        if core in last_timestamp and timestamp + (1 << 31) < last_timestamp[core]:
+            wraps[core] = wraps.get(core, 0) + 1
+        last_timestamp[core] = timestamp
+        timestamp += wraps.get(core, 0) << 32
+
+        track = core * 100 + event
+        if phase == "E" and track not in open_tracks:
+            # The begin was overwritten in the ring
+            continue
+        if phase == "B":
+            open_tracks.add(track)
+        elif phase == "E":
+            open_tracks.discard(track)
+
+        record = {"name": names.get(event, str(event)), "ph": phase, "ts": timestamp, "pid": 0, "tid": track, "args": {"value": argument}}
+        if phase == "i":
+            record["s"] = "t"
+        events.append(record)
+
+    if not events:
+        return {"traceEvents": []}
+
+    # Start at zero and name the tracks
+    start = min(event["ts"] for event in events)
+    for event in events:
+        event["ts"] -= start
+    for track in sorted({event["tid"] for event in events}):
+        name = names.get(track % 100, str(track % 100))
+        events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": track, "args": {"name": "core%d %s" % (track // 100, name)}})
+    events.append({"name": "process_name", "ph": "M", "pid": 0, "args": {"name": "SmartBMS"}})
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) > 2:
+        sys.exit("usage: trace2json.py [serial.log] > trace.json")
+    with open(sys.argv[1], errors="replace") if len(sys.argv) == 2 else sys.stdin as source:
+        json.dump(convert(source), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()